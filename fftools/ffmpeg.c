@@ -68,8 +68,10 @@
 #include <conio.h>
 #endif
 
+#include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
 #include "libavutil/dict.h"
+#include "libavutil/getenv_utf8.h"
 #include "libavutil/mem.h"
 #include "libavutil/time.h"
 
@@ -85,6 +87,7 @@
 #include "ffmpeg_sched.h"
 #include "ffmpeg_utils.h"
 #include "graph/graphprint.h"
+#include "opt_common.h"
 
 const char program_name[] = "ffmpeg";
 const int program_birth_year = 2000;
@@ -143,6 +146,8 @@ static volatile int received_nb_signals = 0;
 static atomic_int transcode_init_done = 0;
 static volatile int ffmpeg_exited = 0;
 static int64_t copy_ts_first_pts = AV_NOPTS_VALUE;
+static int64_t last_report_time = -1;
+static int first_report = 1;
 
 static void
 sigterm_handler(int sig)
@@ -324,6 +329,7 @@ static void ffmpeg_cleanup(int ret)
     for (int i = 0; i < nb_filtergraphs; i++)
         fg_free(&filtergraphs[i]);
     av_freep(&filtergraphs);
+    nb_filtergraphs = 0;
 
     for (int i = 0; i < nb_output_files; i++)
         of_free(&output_files[i]);
@@ -334,13 +340,16 @@ static void ffmpeg_cleanup(int ret)
     for (int i = 0; i < nb_decoders; i++)
         dec_free(&decoders[i]);
     av_freep(&decoders);
+    nb_decoders = 0;
 
     if (vstats_file) {
         if (fclose(vstats_file))
             av_log(NULL, AV_LOG_ERROR,
                    "Error closing vstats file, loss of information possible: %s\n",
                    av_err2str(AVERROR(errno)));
+        vstats_file = NULL;
     }
+    avio_closep(&progress_avio);
     av_freep(&vstats_filename);
     of_enc_stats_close();
 
@@ -350,14 +359,15 @@ static void ffmpeg_cleanup(int ret)
 
     av_freep(&print_graphs_file);
     av_freep(&print_graphs_format);
+    av_freep(&metrics_file);
 
     av_freep(&input_files);
     av_freep(&output_files);
+    nb_input_files  = 0;
+    nb_output_files = 0;
 
     uninit_opts();
 
-    avformat_network_deinit();
-
     if (received_sigterm) {
         av_log(NULL, AV_LOG_INFO, "Exiting normally, received signal %d.\n",
                (int) received_sigterm);
@@ -365,7 +375,6 @@ static void ffmpeg_cleanup(int ret)
         av_log(NULL, AV_LOG_INFO, "Conversion failed!\n");
     }
     term_exit();
-    ffmpeg_exited = 1;
 }
 
 OutputStream *ost_iter(OutputStream *prev)
@@ -576,8 +585,6 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     int vid;
     double bitrate;
     double speed;
-    static int64_t last_time = -1;
-    static int first_report = 1;
     uint64_t nb_frames_dup = 0, nb_frames_drop = 0;
     int mins, secs, ms, us;
     int64_t hours;
@@ -589,13 +596,13 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         return;
 
     if (!is_last_report) {
-        if (last_time == -1) {
-            last_time = cur_time;
+        if (last_report_time == -1) {
+            last_report_time = cur_time;
         }
-        if (((cur_time - last_time) < stats_period && !first_report) ||
+        if (((cur_time - last_report_time) < stats_period && !first_report) ||
             (first_report && atomic_load(&nb_output_dumped) < nb_output_files))
             return;
-        last_time = cur_time;
+        last_report_time = cur_time;
     }
 
     t = (cur_time-timer_start) / 1000000.0;
@@ -884,6 +891,55 @@ static int check_keyboard_interaction(int64_t cur_time)
 /*
  * The following code is the main loop of the file converter
  */
+/* a failure to write the metrics is only reported once per job */
+static int metrics_warned;
+
+/* Replace the metrics file with a complete snapshot, so that readers never
+ * see a partially written file. */
+static void write_metrics(Scheduler *sch)
+{
+    AVBPrint bp;
+    char *tmp;
+    FILE *f = NULL;
+    int ret = 0;
+
+    if (!metrics_file)
+        return;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    sch_metrics_print(sch, &bp);
+    of_metrics_print(&bp);
+
+    tmp = av_asprintf("%s.tmp", metrics_file);
+    if (!tmp || !av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    f = fopen(tmp, "w");
+    if (!f || fwrite(bp.str, 1, bp.len, f) != bp.len) {
+        ret = AVERROR(errno);
+        goto finish;
+    }
+    ret = fclose(f);
+    f   = NULL;
+    if (ret || rename(tmp, metrics_file)) {
+        ret = AVERROR(errno);
+        goto finish;
+    }
+
+finish:
+    if (f)
+        fclose(f);
+    if (ret < 0 && !metrics_warned) {
+        av_log(NULL, AV_LOG_WARNING, "Error writing metrics to '%s': %s\n",
+               metrics_file, av_err2str(ret));
+        metrics_warned = 1;
+    }
+    av_free(tmp);
+    av_bprint_finalize(&bp, NULL);
+}
+
 static int transcode(Scheduler *sch)
 {
     int ret = 0;
@@ -916,6 +972,7 @@ static int transcode(Scheduler *sch)
 
         /* dump report by using the output first video and audio streams */
         print_report(0, timer_start, cur_time, transcode_ts);
+        write_metrics(sch);
     }
 
     ret = sch_stop(sch, &transcode_ts);
@@ -930,6 +987,7 @@ static int transcode(Scheduler *sch)
 
     /* dump report by using the first video and audio streams */
     print_report(1, timer_start, av_gettime_relative(), transcode_ts);
+    write_metrics(sch);
 
     return ret;
 }
@@ -978,27 +1036,13 @@ static int64_t getmaxrss(void)
 #endif
 }
 
-int main(int argc, char **argv)
+static int run_job(int argc, char **argv)
 {
     Scheduler *sch = NULL;
 
     int ret;
     BenchmarkTimeStamps ti;
 
-    init_dynload();
-
-    setvbuf(stderr,NULL,_IONBF,0); /* win32 runtime needs this */
-
-    av_log_set_flags(AV_LOG_SKIP_REPEATED);
-    parse_loglevel(argc, argv, options);
-
-#if CONFIG_AVDEVICE
-    avdevice_register_all();
-#endif
-    avformat_network_init();
-
-    show_banner(argc, argv, options);
-
     sch = sch_alloc();
     if (!sch) {
         ret = AVERROR(ENOMEM);
@@ -1051,6 +1095,169 @@ finish:
 
     sch_free(&sch);
 
+    return ret;
+}
+
+/* Split one line of a batch file into arguments, honoring quoting and
+ * escaping the same way as av_get_token(). */
+static int split_job_line(const char *line, char ***args, int *nb_args)
+{
+    while (1) {
+        char *arg;
+        int ret;
+
+        line += strspn(line, " \t\r");
+        if (!*line)
+            return 0;
+
+        arg = av_get_token(&line, " \t\r");
+        if (!arg)
+            return AVERROR(ENOMEM);
+
+        ret = av_dynarray_add_nofree(args, nb_args, arg);
+        if (ret < 0) {
+            av_free(arg);
+            return ret;
+        }
+    }
+}
+
+/* Called after each job of a batch, so that the next one starts like a fresh
+ * run. */
+static void reset_job_state(int keep_report)
+{
+    reset_global_options();
+    reset_common_opts(keep_report);
+
+    atomic_store(&nb_output_dumped, 0);
+    atomic_store(&transcode_init_done, 0);
+    copy_ts_first_pts = AV_NOPTS_VALUE;
+    last_report_time  = -1;
+    first_report      = 1;
+    metrics_warned    = 0;
+}
+
+/* Exit status of a job returning ret when run on its own: main() returns
+ * the error codes unchanged, of which the system keeps the low byte. */
+static int job_exit_code(int ret)
+{
+    if (ret >= 0)
+        return ret;
+    return ret & 0xff ? ret & 0xff : 1;
+}
+
+/* Run every job listed in the file given to -batch, one after the other.
+ * The arguments surrounding -batch on the command line are prepended to
+ * the arguments of each job. */
+static int run_batch(int argc, char **argv, int batch_idx)
+{
+    const char *filename = argv[batch_idx + 1];
+    char *script, *line, *next, *env;
+    int nb_jobs = 0, nb_failed = 0, lineno = 0;
+    int log_level = av_log_get_level(), log_flags = av_log_get_flags();
+    int keep_report, ret = 0;
+
+    /* a report requested for the whole batch is shared by all the jobs */
+    env = getenv_utf8("FFREPORT");
+    keep_report = env || locate_option(argc, argv, options, "report");
+    freeenv_utf8(env);
+
+    script = read_file_to_string(filename);
+    if (!script) {
+        av_log(NULL, AV_LOG_FATAL, "Error reading batch file '%s'\n", filename);
+        return 1;
+    }
+
+    for (line = script; line && !received_nb_signals; line = next) {
+        char **job_argv = NULL;
+        int job_argc = 0, job_ret;
+        int64_t start, elapsed;
+
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+        lineno++;
+
+        line += strspn(line, " \t\r");
+        if (!*line || *line == '#')
+            continue;
+
+        for (int i = 0; i < argc; i++) {
+            if (i == batch_idx || i == batch_idx + 1)
+                continue;
+            job_ret = av_dynarray_add_nofree(&job_argv, &job_argc, argv[i]);
+            if (job_ret < 0)
+                goto fail;
+        }
+        job_ret = split_job_line(line, &job_argv, &job_argc);
+        if (job_ret < 0)
+            goto fail;
+        /* the argument vector is NULL-terminated, like the real one */
+        job_ret = av_dynarray_add_nofree(&job_argv, &job_argc, NULL);
+        if (job_ret < 0)
+            goto fail;
+        job_argc--;
+
+        nb_jobs++;
+        av_log(NULL, AV_LOG_INFO, "Job %d (line %d) started\n", nb_jobs, lineno);
+
+        start   = av_gettime_relative();
+        parse_loglevel(job_argc, job_argv, options);
+        job_ret = job_exit_code(run_job(job_argc, job_argv));
+        elapsed = av_gettime_relative() - start;
+
+        reset_job_state(keep_report);
+        av_log_set_level(log_level);
+        av_log_set_flags(log_flags);
+
+        av_log(NULL, AV_LOG_INFO, "Job %d (line %d) finished with exit code %d in %.3fs\n",
+               nb_jobs, lineno, job_ret, elapsed / 1000000.0);
+fail:
+        for (int i = argc - 2; i < job_argc; i++)
+            av_free(job_argv[i]);
+        av_free(job_argv);
+
+        if (job_ret) {
+            nb_failed++;
+            ret = job_exit_code(job_ret);
+        }
+    }
+
+    av_free(script);
+
+    av_log(NULL, nb_failed ? AV_LOG_ERROR : AV_LOG_INFO,
+           "Batch finished: %d job(s) run, %d failed\n", nb_jobs, nb_failed);
+
+    return received_nb_signals ? 255 : ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret, batch_idx;
+
+    init_dynload();
+
+    setvbuf(stderr,NULL,_IONBF,0); /* win32 runtime needs this */
+
+    av_log_set_flags(AV_LOG_SKIP_REPEATED);
+    parse_loglevel(argc, argv, options);
+
+#if CONFIG_AVDEVICE
+    avdevice_register_all();
+#endif
+    avformat_network_init();
+
+    show_banner(argc, argv, options);
+
+    batch_idx = locate_option(argc, argv, options, "batch");
+    if (batch_idx && batch_idx + 1 < argc)
+        ret = run_batch(argc, argv, batch_idx);
+    else
+        ret = run_job(argc, argv);
+
+    avformat_network_deinit();
+    ffmpeg_exited = 1;
+
     av_log(NULL, AV_LOG_VERBOSE, "\n");
     av_log(NULL, AV_LOG_VERBOSE, "Exiting with exit code %d\n", ret);
 
@@ -240,6 +240,8 @@ typedef struct OptionsContext {
     SpecifierOptList canvas_sizes;
     SpecifierOptList pass;
     SpecifierOptList passlogfiles;
+    SpecifierOptList enc_chunks;
+    SpecifierOptList enc_chunk_frames;
     SpecifierOptList max_muxing_queue_size;
     SpecifierOptList muxing_queue_data_threshold;
     SpecifierOptList guess_layout_max;
@@ -669,6 +671,9 @@ typedef struct OutputStream {
 #endif
     int bitexact;
     int bits_per_raw_sample;
+    // number of chunks encoded in parallel and their length in frames
+    int enc_chunks;
+    int enc_chunk_frames;
 
     AVRational frame_aspect_ratio;
 
@@ -775,6 +780,8 @@ extern int exit_on_error;
 extern int abort_on_flags;
 extern int print_stats;
 extern int64_t stats_period;
+extern int64_t latency_target;
+extern char *metrics_file;
 extern int stdin_interaction;
 extern AVIOContext *progress_avio;
 extern float max_error_rate;
@@ -853,6 +860,11 @@ void fg_send_command(FilterGraph *fg, double time, const char *target,
                      const char *command, const char *arg, int all_filters);
 
 int ffmpeg_parse_options(int argc, char **argv, Scheduler *sch);
+/**
+ * Restore all global options to their defaults, so that the next job in
+ * a -batch run starts from a clean state.
+ */
+void reset_global_options(void);
 
 void enc_stats_write(OutputStream *ost, EncStats *es,
                      const AVFrame *frame, const AVPacket *pkt,
@@ -937,6 +949,12 @@ void of_enc_stats_close(void);
 
 int64_t of_filesize(OutputFile *of);
 
+/**
+ * Print the statistics of all the output streams, in the Prometheus text
+ * exposition format.
+ */
+void of_metrics_print(AVBPrint *bp);
+
 int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch);
 void ifile_close(InputFile **f);
 
@@ -18,19 +18,24 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 #include "ffmpeg.h"
+#include "thread_pool.h"
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/avutil.h"
+#include "libavutil/cpu.h"
 #include "libavutil/dict.h"
 #include "libavutil/display.h"
 #include "libavutil/eval.h"
+#include "libavutil/fifo.h"
 #include "libavutil/frame.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/log.h"
 #include "libavutil/mem.h"
+#include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/rational.h"
 #include "libavutil/time.h"
@@ -38,6 +43,19 @@
 
 #include "libavcodec/avcodec.h"
 
+// a run of consecutive frames encoded independently of the others
+typedef struct EncoderChunk {
+    AVFrame       **frames;
+    int          nb_frames;
+
+    AVPacket      **pkts;
+    int          nb_pkts;
+    // timestamps of the packets in presentation order
+    int64_t        *pts;
+
+    int             ret;
+} EncoderChunk;
+
 typedef struct EncoderPriv {
     Encoder        e;
 
@@ -55,6 +73,17 @@ typedef struct EncoderPriv {
 
     Scheduler      *sch;
     unsigned        sch_idx;
+
+    // parallel chunk encoding, enabled by -enc_chunks
+    ThreadPool     *chunk_tp;
+    EncoderChunk   *chunks;
+    int          nb_chunks;
+    int             chunk_frames;
+    // index of the chunk currently receiving frames
+    int             cur_chunk;
+    // sorted pts of the output chunk packets, from which their dts are
+    // derived
+    AVFifo         *chunk_dts;
 } EncoderPriv;
 
 static EncoderPriv *ep_from_enc(Encoder *enc)
@@ -68,6 +97,83 @@ typedef struct EncoderThread {
     AVPacket  *pkt;
 } EncoderThread;
 
+static void chunks_reset(EncoderPriv *ep)
+{
+    for (int i = 0; i < ep->nb_chunks; i++) {
+        EncoderChunk *c = &ep->chunks[i];
+
+        for (int j = 0; j < c->nb_frames; j++)
+            av_frame_unref(c->frames[j]);
+        c->nb_frames = 0;
+
+        for (int j = 0; j < c->nb_pkts; j++)
+            av_packet_free(&c->pkts[j]);
+        av_freep(&c->pkts);
+        av_freep(&c->pts);
+        c->nb_pkts = 0;
+
+        c->ret = 0;
+    }
+    ep->cur_chunk = 0;
+}
+
+static void chunks_free(EncoderPriv *ep)
+{
+    if (!ep->chunks)
+        return;
+
+    chunks_reset(ep);
+    for (int i = 0; i < ep->nb_chunks; i++) {
+        EncoderChunk *c = &ep->chunks[i];
+
+        for (int j = 0; j < ep->chunk_frames; j++)
+            av_frame_free(&c->frames[j]);
+        av_freep(&c->frames);
+    }
+    av_freep(&ep->chunks);
+    ep->nb_chunks = 0;
+
+    av_fifo_freep2(&ep->chunk_dts);
+    tp_free(&ep->chunk_tp);
+}
+
+static int chunks_init(EncoderPriv *ep, const OutputStream *ost)
+{
+    ep->chunks = av_calloc(ost->enc_chunks, sizeof(*ep->chunks));
+    if (!ep->chunks)
+        return AVERROR(ENOMEM);
+    ep->nb_chunks    = ost->enc_chunks;
+    ep->chunk_frames = ost->enc_chunk_frames;
+
+    for (int i = 0; i < ep->nb_chunks; i++) {
+        EncoderChunk *c = &ep->chunks[i];
+
+        c->frames = av_calloc(ep->chunk_frames, sizeof(*c->frames));
+        if (!c->frames)
+            return AVERROR(ENOMEM);
+
+        for (int j = 0; j < ep->chunk_frames; j++) {
+            c->frames[j] = av_frame_alloc();
+            if (!c->frames[j])
+                return AVERROR(ENOMEM);
+        }
+    }
+
+    ep->chunk_dts = av_fifo_alloc2(ep->nb_chunks * ep->chunk_frames,
+                                   sizeof(int64_t), AV_FIFO_FLAG_AUTO_GROW);
+    if (!ep->chunk_dts)
+        return AVERROR(ENOMEM);
+
+    ep->chunk_tp = tp_alloc(ep->nb_chunks);
+    if (!ep->chunk_tp)
+        return AVERROR(ENOMEM);
+
+    av_log(&ep->e, AV_LOG_VERBOSE, "Encoding %d chunks of %d frames in parallel\n",
+           ep->nb_chunks, ep->chunk_frames);
+
+    return 0;
+}
+
 void enc_free(Encoder **penc)
 {
     Encoder *enc = *penc;
@@ -75,6 +181,8 @@ void enc_free(Encoder **penc)
     if (!enc)
         return;
 
+    chunks_free(ep_from_enc(enc));
+
     if (enc->enc_ctx)
         av_freep(&enc->enc_ctx->stats_in);
     avcodec_free_context(&enc->enc_ctx);
@@ -350,6 +458,12 @@ int enc_open(void *opaque, const AVFrame *frame)
 
     ep->opened = 1;
 
+    if (ost->enc_chunks > 1 && enc->type == AVMEDIA_TYPE_VIDEO) {
+        ret = chunks_init(ep, ost);
+        if (ret < 0)
+            return ret;
+    }
+
     if (enc_ctx->frame_size)
         frame_samples = enc_ctx->frame_size;
 
@@ -608,6 +722,307 @@ static int update_video_stats(OutputStream *ost, const AVPacket *pkt, int write_
     return 0;
 }
 
+static int packet_output(OutputStream *ost, AVPacket *pkt)
+{
+    Encoder            *e = ost->enc;
+    EncoderPriv       *ep = ep_from_enc(e);
+    AVCodecContext   *enc = e->enc_ctx;
+    const char *type_desc = av_get_media_type_string(enc->codec_type);
+    FrameData *fd;
+    int ret;
+
+    fd = packet_data(pkt);
+    if (!fd)
+        return AVERROR(ENOMEM);
+    fd->wallclock[LATENCY_PROBE_ENC_POST] = av_gettime_relative();
+
+    // attach stream parameters to first packet if requested
+    avcodec_parameters_free(&fd->par_enc);
+    if (ep->attach_par && !ep->packets_encoded) {
+        fd->par_enc = avcodec_parameters_alloc();
+        if (!fd->par_enc)
+            return AVERROR(ENOMEM);
+
+        ret = avcodec_parameters_from_context(fd->par_enc, enc);
+        if (ret < 0)
+            return ret;
+    }
+
+    pkt->flags |= AV_PKT_FLAG_TRUSTED;
+
+    if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+        ret = update_video_stats(ost, pkt, !!vstats_filename);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (ost->enc_stats_post.io)
+        enc_stats_write(ost, &ost->enc_stats_post, NULL, pkt,
+                        ep->packets_encoded);
+
+    if (debug_ts) {
+        av_log(e, AV_LOG_INFO, "encoder -> type:%s "
+               "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
+               "duration:%s duration_time:%s\n",
+               type_desc,
+               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
+               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
+               av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
+    }
+
+    ep->data_size += pkt->size;
+
+    ep->packets_encoded++;
+
+    ret = sch_enc_send(ep->sch, ep->sch_idx, pkt);
+    if (ret < 0) {
+        av_packet_unref(pkt);
+        return ret;
+    }
+
+    return 0;
+}
+
+/* Set up a new encoder for one chunk with the same parameters as the
+ * already opened main encoder. */
+static int chunk_encoder_setup(AVCodecContext *dst, const AVCodecContext *src,
+                               int nb_chunks)
+{
+    int ret;
+
+    ret = av_opt_copy(dst, src);
+    if (ret < 0)
+        return ret;
+    if (src->codec->priv_class) {
+        ret = av_opt_copy(dst->priv_data, src->priv_data);
+        if (ret < 0)
+            return ret;
+    }
+
+    dst->time_base              = src->time_base;
+    dst->framerate              = src->framerate;
+    dst->width                  = src->width;
+    dst->height                 = src->height;
+    dst->sample_aspect_ratio    = src->sample_aspect_ratio;
+    dst->pix_fmt                = src->pix_fmt;
+    dst->bits_per_raw_sample    = src->bits_per_raw_sample;
+    dst->color_range            = src->color_range;
+    dst->color_primaries        = src->color_primaries;
+    dst->color_trc              = src->color_trc;
+    dst->colorspace             = src->colorspace;
+    dst->chroma_sample_location = src->chroma_sample_location;
+    dst->alpha_mode             = src->alpha_mode;
+    dst->field_order            = src->field_order;
+
+    // the threads of the main encoder are shared between the chunks
+    dst->thread_count = FFMAX(1, (src->thread_count ? src->thread_count :
+                                  av_cpu_count()) / nb_chunks);
+
+    if (src->intra_matrix) {
+        dst->intra_matrix = av_memdup(src->intra_matrix, sizeof(*src->intra_matrix) * 64);
+        if (!dst->intra_matrix)
+            return AVERROR(ENOMEM);
+    }
+    if (src->inter_matrix) {
+        dst->inter_matrix = av_memdup(src->inter_matrix, sizeof(*src->inter_matrix) * 64);
+        if (!dst->inter_matrix)
+            return AVERROR(ENOMEM);
+    }
+    if (src->chroma_intra_matrix) {
+        dst->chroma_intra_matrix = av_memdup(src->chroma_intra_matrix,
+                                             sizeof(*src->chroma_intra_matrix) * 64);
+        if (!dst->chroma_intra_matrix)
+            return AVERROR(ENOMEM);
+    }
+
+    if (src->hw_device_ctx) {
+        dst->hw_device_ctx = av_buffer_ref(src->hw_device_ctx);
+        if (!dst->hw_device_ctx)
+            return AVERROR(ENOMEM);
+    }
+    if (src->hw_frames_ctx) {
+        dst->hw_frames_ctx = av_buffer_ref(src->hw_frames_ctx);
+        if (!dst->hw_frames_ctx)
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+static int cmp_pts(const void *a, const void *b)
+{
+    return FFDIFFSIGN(*(const int64_t *)a, *(const int64_t *)b);
+}
+
+/* Encode all the frames of one chunk with a fresh encoder, starting with
+ * a keyframe, so that the output does not depend on any other chunk. */
+static int chunk_encode(void *priv, int jobnr, int nb_jobs)
+{
+    EncoderPriv          *ep = priv;
+    const AVCodecContext *src = ep->e.enc_ctx;
+    EncoderChunk          *c = &ep->chunks[jobnr];
+    AVCodecContext      *enc = NULL;
+    AVPacket            *pkt = NULL;
+    int ret;
+
+    if (!c->nb_frames)
+        return 0;
+
+    enc = avcodec_alloc_context3(src->codec);
+    if (!enc) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    ret = chunk_encoder_setup(enc, src, ep->nb_chunks);
+    if (ret < 0)
+        goto finish;
+
+    ret = avcodec_open2(enc, src->codec, NULL);
+    if (ret < 0)
+        goto finish;
+
+    /* The output stream is described by the main encoder, which the chunk
+     * encoders must match. Its reorder delay is used to derive the dts of
+     * the concatenated chunks. */
+    if (enc->has_b_frames > src->has_b_frames ||
+        enc->extradata_size != src->extradata_size ||
+        (src->extradata_size &&
+         memcmp(enc->extradata, src->extradata, src->extradata_size))) {
+        av_log(&ep->e, AV_LOG_ERROR, "Chunk encoder parameters differ from "
+               "the main encoder\n");
+        ret = AVERROR(EINVAL);
+        goto finish;
+    }
+
+    for (int i = 0; i <= c->nb_frames; i++) {
+        AVFrame *frame = i < c->nb_frames ? c->frames[i] : NULL;
+
+        if (frame && !i)
+            frame->pict_type = AV_PICTURE_TYPE_I;
+
+        ret = avcodec_send_frame(enc, frame);
+        if (ret < 0)
+            goto finish;
+
+        while (1) {
+            if (!pkt) {
+                pkt = av_packet_alloc();
+                if (!pkt) {
+                    ret = AVERROR(ENOMEM);
+                    goto finish;
+                }
+            }
+
+            ret = avcodec_receive_packet(enc, pkt);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                break;
+            else if (ret < 0)
+                goto finish;
+
+            pkt->time_base = enc->time_base;
+
+            ret = av_dynarray_add_nofree(&c->pkts, &c->nb_pkts, pkt);
+            if (ret < 0)
+                goto finish;
+            pkt = NULL;
+        }
+
+        if (frame)
+            av_frame_unref(frame);
+    }
+
+    c->pts = av_malloc_array(c->nb_pkts, sizeof(*c->pts));
+    if (!c->pts) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+    for (int i = 0; i < c->nb_pkts; i++)
+        c->pts[i] = c->pkts[i]->pts;
+    qsort(c->pts, c->nb_pkts, sizeof(*c->pts), cmp_pts);
+
+    ret = 0;
+
+finish:
+    av_packet_free(&pkt);
+    avcodec_free_context(&enc);
+    return c->ret = ret;
+}
+
+/* Encode all the buffered chunks in parallel and output their packets
+ * in order.
+ *
+ * Each chunk encoder starts with dts lower than pts by its reorder delay,
+ * so the dts of the concatenated chunks would go backwards at every chunk
+ * boundary. Since chunks are closed GOPs, the packets of all chunks taken
+ * together are reordered by at most the delay of the main encoder, so the
+ * dts of packet N is set to the Nth lowest pts minus that delay, keeping
+ * the dts of the first chunk encoder until then. */
+static int chunks_encode(OutputStream *ost)
+{
+    Encoder      *e = ost->enc;
+    EncoderPriv *ep = ep_from_enc(e);
+    const char *type_desc = av_get_media_type_string(e->enc_ctx->codec_type);
+    int ret = 0;
+
+    update_benchmark(NULL);
+
+    tp_execute(ep->chunk_tp, chunk_encode, ep, NULL, ep->nb_chunks, 0);
+
+    update_benchmark("encode_%s_chunks %d.%d", type_desc,
+                     ost->file->index, ost->index);
+
+    for (int i = 0; i < ep->nb_chunks && ret >= 0; i++) {
+        EncoderChunk *c = &ep->chunks[i];
+
+        if (c->ret < 0) {
+            av_log(e, AV_LOG_ERROR, "%s encoding failed\n", type_desc);
+            ret = c->ret;
+            break;
+        }
+
+        ret = av_fifo_write(ep->chunk_dts, c->pts, c->nb_pkts);
+        if (ret < 0)
+            break;
+
+        for (int j = 0; j < c->nb_pkts; j++) {
+            if (ep->packets_encoded >= e->enc_ctx->has_b_frames)
+                av_fifo_read(ep->chunk_dts, &c->pkts[j]->dts, 1);
+
+            ret = packet_output(ost, c->pkts[j]);
+            if (ret < 0)
+                break;
+        }
+    }
+
+    chunks_reset(ep);
+
+    return ret;
+}
+
+/* Add a frame to the current chunk, encoding all the chunks once they are
+ * full, or whatever is buffered when flushing. */
+static int chunk_add_frame(OutputStream *ost, AVFrame *frame)
+{
+    EncoderPriv *ep = ep_from_enc(ost->enc);
+    EncoderChunk *c = &ep->chunks[ep->cur_chunk];
+    int ret;
+
+    if (!frame) {
+        ret = chunks_encode(ost);
+        return ret < 0 ? ret : AVERROR_EOF;
+    }
+
+    av_frame_move_ref(c->frames[c->nb_frames++], frame);
+    if (c->nb_frames < ep->chunk_frames)
+        return 0;
+
+    if (++ep->cur_chunk < ep->nb_chunks)
+        return 0;
+
+    return chunks_encode(ost);
+}
+
 static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
                         AVPacket *pkt)
 {
@@ -645,6 +1060,9 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
             enc->sample_aspect_ratio = frame->sample_aspect_ratio;
     }
 
+    if (ep->chunks)
+        return chunk_add_frame(ost, frame);
+
     update_benchmark(NULL);
 
     ret = avcodec_send_frame(enc, frame);
@@ -655,8 +1073,6 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
     }
 
     while (1) {
-        FrameData *fd;
-
         av_packet_unref(pkt);
 
         ret = avcodec_receive_packet(enc, pkt);
@@ -678,54 +1094,9 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
             return ret;
         }
 
-        fd = packet_data(pkt);
-        if (!fd)
-            return AVERROR(ENOMEM);
-        fd->wallclock[LATENCY_PROBE_ENC_POST] = av_gettime_relative();
-
-        // attach stream parameters to first packet if requested
-        avcodec_parameters_free(&fd->par_enc);
-        if (ep->attach_par && !ep->packets_encoded) {
-            fd->par_enc = avcodec_parameters_alloc();
-            if (!fd->par_enc)
-                return AVERROR(ENOMEM);
-
-            ret = avcodec_parameters_from_context(fd->par_enc, enc);
-            if (ret < 0)
-                return ret;
-        }
-
-        pkt->flags |= AV_PKT_FLAG_TRUSTED;
-
-        if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-            ret = update_video_stats(ost, pkt, !!vstats_filename);
-            if (ret < 0)
-                return ret;
-        }
-
-        if (ost->enc_stats_post.io)
-            enc_stats_write(ost, &ost->enc_stats_post, NULL, pkt,
-                            ep->packets_encoded);
-
-        if (debug_ts) {
-            av_log(e, AV_LOG_INFO, "encoder -> type:%s "
-                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
-                   "duration:%s duration_time:%s\n",
-                   type_desc,
-                   av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
-                   av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
-                   av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
-        }
-
-        ep->data_size += pkt->size;
-
-        ep->packets_encoded++;
-
-        ret = sch_enc_send(ep->sch, ep->sch_idx, pkt);
-        if (ret < 0) {
-            av_packet_unref(pkt);
+        ret = packet_output(ost, pkt);
+        if (ret < 0)
             return ret;
-        }
     }
 
     av_unreachable("encode_frame() loop should return");
@@ -22,6 +22,7 @@
 
 #include "ffmpeg.h"
 #include "graph/graphprint.h"
+#include "thread_pool.h"
 
 #include "libavfilter/avfilter.h"
 #include "libavfilter/buffersink.h"
@@ -80,6 +81,8 @@ static const FilterGraphPriv *cfgp_from_cfg(const FilterGraph *fg)
 // data that is local to the filter thread and not visible outside of it
 typedef struct FilterGraphThread {
     AVFilterGraph   *graph;
+    // set to 1 once the graph was successfully configured
+    int              configured;
 
     AVFrame         *frame;
 
@@ -2026,8 +2029,28 @@ static int configure_input_filter(FilterGraph *fg, AVFilterGraph *graph,
     }
 }
 
+static void report_filter_stats(FilterGraph *fg, AVFilterGraph *graph)
+{
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *f = graph->filters[i];
+        const AVFilterStats *st = avfilter_get_stats(f);
+
+        av_log(fg, AV_LOG_INFO,
+               "bench: filter %-24s activations %8"PRId64" frames in %7"PRId64
+               " out %7"PRId64" cpu %9"PRId64" real %9"PRId64
+               " max queued %4"PRId64" alloc %"PRId64" bytes\n",
+               f->name, st->nb_activations, st->frames_in, st->frames_out,
+               st->cpu_time, st->wall_time, st->max_queued_frames,
+               st->bytes_allocated);
+    }
+}
+
 static void cleanup_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
 {
+    if (do_benchmark_all && fgt->configured)
+        report_filter_stats(fg, fgt->graph);
+    fgt->configured = 0;
+
     for (int i = 0; i < fg->nb_outputs; i++)
         fg->outputs[i]->filter = NULL;
     for (int i = 0; i < fg->nb_inputs; i++)
@@ -2061,6 +2084,30 @@ static int graph_is_meta(AVFilterGraph *graph)
 
 static int sub2video_frame(InputFilter *ifilter, AVFrame *frame, int buffer);
 
+typedef struct FilterPoolJob {
+    AVFilterContext      *ctx;
+    avfilter_action_func *func;
+    void                 *arg;
+} FilterPoolJob;
+
+static int filter_pool_job(void *priv, int jobnr, int nb_jobs)
+{
+    FilterPoolJob *job = priv;
+    return job->func(job->ctx, job->arg, jobnr, nb_jobs);
+}
+
+// run slice-threaded filters on the worker pool shared by all filtergraphs,
+// favouring the filtergraphs that hold back the outputs
+static int filter_pool_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                               void *arg, int *ret, int nb_jobs)
+{
+    FilterGraphPriv *fgp = ctx->graph->opaque;
+    FilterPoolJob    job = { .ctx = ctx, .func = func, .arg = arg };
+
+    return tp_execute(sch_thread_pool(fgp->sch), filter_pool_job, &job, ret,
+                      nb_jobs, sch_filter_pool_priority(fgp->sch, fgp->sch_idx));
+}
+
 static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
 {
     FilterGraphPriv *fgp = fgp_from_fg(fg);
@@ -2069,12 +2116,18 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
     int ret = AVERROR_BUG, i, simple = filtergraph_is_simple(fg);
     int have_input_eof = 0;
     const char *graph_desc = fg->graph_desc;
+    ThreadPool *pool = sch_thread_pool(fgp->sch);
 
     cleanup_filtergraph(fg, fgt);
     fgt->graph = avfilter_graph_alloc();
     if (!fgt->graph)
         return AVERROR(ENOMEM);
 
+    if (pool) {
+        fgt->graph->opaque  = fgp;
+        fgt->graph->execute = filter_pool_execute;
+    }
+
     if (simple) {
         OutputFilterPriv *ofp = ofp_from_ofilter(fg->outputs[0]);
 
@@ -2108,12 +2161,19 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
         fgt->graph->nb_threads = filter_complex_nbthreads;
     }
 
+    // automatic thread count, use the whole shared pool
+    if (pool && fgt->graph->nb_threads <= 0)
+        fgt->graph->nb_threads = tp_nb_threads(pool);
+
     if (filter_buffered_frames) {
         ret = av_opt_set_int(fgt->graph, "max_buffered_frames", filter_buffered_frames, 0);
         if (ret < 0)
             return ret;
     }
 
+    if (do_benchmark_all || print_graphs || print_graphs_file)
+        fgt->graph->collect_stats = 1;
+
     hw_device = hw_device_for_filter();
 
     ret = graph_parse(fg, fgt->graph, graph_desc, &inputs, &outputs, hw_device);
@@ -2141,6 +2201,7 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
         avfilter_graph_set_auto_convert(fgt->graph, AVFILTER_AUTO_CONVERT_NONE);
     if ((ret = avfilter_graph_config(fgt->graph, NULL)) < 0)
         goto fail;
+    fgt->configured = 1;
 
     fgp->is_meta = graph_is_meta(fgt->graph);
 
@@ -3082,7 +3143,7 @@ static int send_frame(FilterGraph *fg, FilterGraphThread *fgt,
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
     FrameData       *fd;
     AVFrameSideData *sd;
-    int need_reinit = 0, ret;
+    int need_reinit = 0, size_only = 0, ret;
 
     /* determine if the parameters for this input changed */
     switch (ifilter->type) {
@@ -3098,8 +3159,13 @@ static int send_frame(FilterGraph *fg, FilterGraphThread *fgt,
             ifp->height != frame->height ||
             ifp->color_space != frame->colorspace ||
             ifp->color_range != frame->color_range ||
-            ifp->alpha_mode != frame->alpha_mode)
+            ifp->alpha_mode != frame->alpha_mode) {
             need_reinit |= VIDEO_CHANGED;
+            size_only = ifp->format      == frame->format      &&
+                        ifp->color_space == frame->colorspace  &&
+                        ifp->color_range == frame->color_range &&
+                        ifp->alpha_mode  == frame->alpha_mode;
+        }
         break;
     }
 
@@ -3145,6 +3211,18 @@ static int send_frame(FilterGraph *fg, FilterGraphThread *fgt,
         }
     }
 
+    /* a change of the frame size only can often be absorbed by the graph
+     * (e.g. by a scale filter with a fixed output size) without
+     * reconfiguring it */
+    if (need_reinit == VIDEO_CHANGED && size_only && fgt->graph &&
+        !ifp->hw_frames_ctx &&
+        av_buffersrc_update_video_size(ifilter->filter, ifp->width, ifp->height,
+                                       ifp->sample_aspect_ratio) >= 0) {
+        av_log(fg, AV_LOG_VERBOSE, "Video size changed to %dx%d, filter graph "
+               "updated without reconfiguring\n", ifp->width, ifp->height);
+        need_reinit = 0;
+    }
+
     /* (re)init the graph if possible, otherwise buffer the frame and return */
     if (need_reinit || !fgt->graph) {
         AVFrame *tmp = av_frame_alloc();
@@ -3411,6 +3489,9 @@ read_frames:
 
 finish:
 
+    if (do_benchmark_all && fgt.configured)
+        report_filter_stats(fg, fgt.graph);
+
     if (print_graphs || print_graphs_file)
         print_filtergraph(fg, fgt.graph);
 
@@ -26,6 +26,7 @@
 #include "sync_queue.h"
 
 #include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
 #include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/log.h"
@@ -206,6 +207,163 @@ static int mux_fixup_ts(Muxer *mux, MuxStream *ms, AVPacket *pkt)
     return 0;
 }
 
+static const char *const latency_stage_desc[] = {
+    [LATENCY_PROBE_DEMUX]       = "demux",
+    [LATENCY_PROBE_DEC_PRE]     = "decode",
+    [LATENCY_PROBE_DEC_POST]    = "decoded",
+    [LATENCY_PROBE_FILTER_PRE]  = "filter",
+    [LATENCY_PROBE_FILTER_POST] = "filtered",
+    [LATENCY_PROBE_ENC_PRE]     = "encode",
+    [LATENCY_PROBE_ENC_POST]    = "encoded",
+};
+
+// only called from the muxer thread, which is the only writer of the stats
+static void latency_add(atomic_int_least64_t *sum, atomic_int_least64_t *max,
+                        atomic_uint_least64_t *nb, int64_t val)
+{
+    atomic_fetch_add_explicit(sum, val, memory_order_relaxed);
+    atomic_fetch_add_explicit(nb,  1,   memory_order_relaxed);
+    if (val > atomic_load_explicit(max, memory_order_relaxed))
+        atomic_store_explicit(max, val, memory_order_relaxed);
+}
+
+static void mux_latency_update(OutputStream *ost, const AVPacket *pkt)
+{
+    MuxStream       *ms = ms_from_ost(ost);
+    const FrameData *fd;
+    int64_t now, total = INT64_MIN;
+
+    if (!pkt->opaque_ref)
+        return;
+
+    fd  = (const FrameData*)pkt->opaque_ref->data;
+    now = av_gettime_relative();
+
+    for (int i = 0; i < LATENCY_PROBE_NB; i++) {
+        int64_t val = fd->wallclock[i], next = now;
+
+        if (val == INT64_MIN)
+            continue;
+
+        if (total == INT64_MIN)
+            total = now - val;
+
+        // a stage lasts until the next probe that was passed
+        for (int j = i + 1; j < LATENCY_PROBE_NB; j++) {
+            if (fd->wallclock[j] != INT64_MIN) {
+                next = fd->wallclock[j];
+                break;
+            }
+        }
+
+        latency_add(&ms->latency_stage_sum[i], &ms->latency_stage_max[i],
+                    &ms->latency_stage_nb[i], next - val);
+    }
+
+    if (total == INT64_MIN)
+        return;
+
+    latency_add(&ms->latency_sum, &ms->latency_max, &ms->latency_nb_packets, total);
+
+    if (latency_target && total > latency_target &&
+        !atomic_fetch_add_explicit(&ms->latency_nb_late, 1, memory_order_relaxed))
+        av_log(ost, AV_LOG_WARNING, "Latency of %gms exceeds the target of %gms\n",
+               total / 1e3, latency_target / 1e3);
+}
+
+static void mux_latency_report(OutputFile *of, OutputStream *ost)
+{
+    MuxStream *ms = ms_from_ost(ost);
+    uint64_t nb_packets = atomic_load(&ms->latency_nb_packets);
+    AVBPrint bp;
+
+    if (!nb_packets)
+        return;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_AUTOMATIC);
+    for (int i = 0; i < LATENCY_PROBE_NB; i++) {
+        uint64_t nb = atomic_load(&ms->latency_stage_nb[i]);
+        if (!nb)
+            continue;
+        av_bprintf(&bp, " %s %.1f/%.1fms", latency_stage_desc[i],
+                   atomic_load(&ms->latency_stage_sum[i]) / 1e3 / nb,
+                   atomic_load(&ms->latency_stage_max[i]) / 1e3);
+    }
+
+    av_log(of, AV_LOG_INFO, "  Output stream #%d:%d latency (average/max): "
+           "total %.1f/%.1fms;%s; %"PRIu64" of %"PRIu64" packets over the target\n",
+           of->index, ost->index,
+           atomic_load(&ms->latency_sum) / 1e3 / nb_packets,
+           atomic_load(&ms->latency_max) / 1e3,
+           bp.str, (uint64_t)atomic_load(&ms->latency_nb_late), nb_packets);
+
+    av_bprint_finalize(&bp, NULL);
+}
+
+void of_metrics_print(AVBPrint *bp)
+{
+#define HEADER(name, type, help) \
+    av_bprintf(bp, "# HELP " name " " help "\n# TYPE " name " " type "\n")
+#define FOREACH_OST(ost) \
+    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost))
+#define LABELS "file=\"%d\",stream=\"%d\""
+#define LOAD(x) ((uint64_t)atomic_load_explicit(&(x), memory_order_relaxed))
+
+    HEADER("ffmpeg_output_frames_duplicated_total", "counter",
+           "Frames duplicated for constant frame rate output.");
+    FOREACH_OST(ost)
+        if (ost->filter)
+            av_bprintf(bp, "ffmpeg_output_frames_duplicated_total{"LABELS"} %"PRIu64"\n",
+                       ost->file->index, ost->index, LOAD(ost->filter->nb_frames_dup));
+    HEADER("ffmpeg_output_frames_dropped_total", "counter",
+           "Frames dropped for constant frame rate output.");
+    FOREACH_OST(ost)
+        if (ost->filter)
+            av_bprintf(bp, "ffmpeg_output_frames_dropped_total{"LABELS"} %"PRIu64"\n",
+                       ost->file->index, ost->index, LOAD(ost->filter->nb_frames_drop));
+    HEADER("ffmpeg_output_packets_written_total", "counter",
+           "Packets written by the muxer.");
+    FOREACH_OST(ost)
+        av_bprintf(bp, "ffmpeg_output_packets_written_total{"LABELS"} %"PRIu64"\n",
+                   ost->file->index, ost->index, LOAD(ost->packets_written));
+
+    HEADER("ffmpeg_output_latency_seconds", "summary",
+           "Time from demuxing to muxing of the output packets.");
+    FOREACH_OST(ost) {
+        MuxStream *ms = ms_from_ost(ost);
+        av_bprintf(bp, "ffmpeg_output_latency_seconds_sum{"LABELS"} %f\n",
+                   ost->file->index, ost->index, LOAD(ms->latency_sum) / 1e6);
+        av_bprintf(bp, "ffmpeg_output_latency_seconds_count{"LABELS"} %"PRIu64"\n",
+                   ost->file->index, ost->index, LOAD(ms->latency_nb_packets));
+    }
+    HEADER("ffmpeg_output_latency_max_seconds", "gauge",
+           "Highest time from demuxing to muxing of an output packet.");
+    FOREACH_OST(ost)
+        av_bprintf(bp, "ffmpeg_output_latency_max_seconds{"LABELS"} %f\n",
+                   ost->file->index, ost->index,
+                   LOAD(ms_from_ost(ost)->latency_max) / 1e6);
+    HEADER("ffmpeg_output_stage_latency_seconds", "summary",
+           "Time spent by the output packets in each processing stage.");
+    FOREACH_OST(ost) {
+        MuxStream *ms = ms_from_ost(ost);
+        for (int i = 0; i < LATENCY_PROBE_NB; i++) {
+            if (!LOAD(ms->latency_stage_nb[i]))
+                continue;
+            av_bprintf(bp, "ffmpeg_output_stage_latency_seconds_sum{"LABELS",stage=\"%s\"} %f\n",
+                       ost->file->index, ost->index, latency_stage_desc[i],
+                       LOAD(ms->latency_stage_sum[i]) / 1e6);
+            av_bprintf(bp, "ffmpeg_output_stage_latency_seconds_count{"LABELS",stage=\"%s\"} %"PRIu64"\n",
+                       ost->file->index, ost->index, latency_stage_desc[i],
+                       LOAD(ms->latency_stage_nb[i]));
+        }
+    }
+
+#undef LOAD
+#undef LABELS
+#undef FOREACH_OST
+#undef HEADER
+}
+
 static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
 {
     MuxStream *ms = ms_from_ost(ost);
@@ -233,6 +391,9 @@ static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
     if (ms->stats.io)
         enc_stats_write(ost, &ms->stats, NULL, pkt, frame_num);
 
+    if (latency_target || metrics_file)
+        mux_latency_update(ost, pkt);
+
     ret = av_interleaved_write_frame(s, pkt);
     if (ret < 0) {
         av_log(ost, AV_LOG_ERROR,
@@ -733,6 +894,9 @@ static void mux_final_stats(Muxer *mux)
                atomic_load(&ost->packets_written), s);
 
         av_log(of, AV_LOG_VERBOSE, "\n");
+
+        if (latency_target)
+            mux_latency_report(of, ost);
     }
 
     av_log(of, AV_LOG_VERBOSE, "  Total: %"PRIu64" packets (%"PRIu64" bytes) muxed\n",
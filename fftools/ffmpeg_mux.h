@@ -78,6 +78,18 @@ typedef struct MuxStream {
     // combined size of all the packets sent to the muxer
     uint64_t        data_size_mux;
 
+    /* end-to-end latency of the muxed packets when -latency_target or
+     * -metrics is set, in microseconds; per-stage values are indexed by the
+     * latency probe starting the stage. Only written by the muxer thread,
+     * atomic so that they can be read for -metrics at any time. */
+    atomic_int_least64_t  latency_stage_sum[LATENCY_PROBE_NB];
+    atomic_int_least64_t  latency_stage_max[LATENCY_PROBE_NB];
+    atomic_uint_least64_t latency_stage_nb[LATENCY_PROBE_NB];
+    atomic_int_least64_t  latency_sum;
+    atomic_int_least64_t  latency_max;
+    atomic_uint_least64_t latency_nb_packets;
+    atomic_uint_least64_t latency_nb_late;
+
     int             copy_initial_nonkeyframes;
     int             copy_prior_start;
     int             streamcopy_started;
@@ -707,6 +707,22 @@ static int new_stream_video(Muxer *mux, const OptionsContext *o,
                 video_enc->flags |= AV_CODEC_FLAG_PASS2;
         }
 
+        ost->enc_chunk_frames = 60;
+        opt_match_per_stream_int(ost, &o->enc_chunks, oc, st, &ost->enc_chunks);
+        opt_match_per_stream_int(ost, &o->enc_chunk_frames, oc, st, &ost->enc_chunk_frames);
+        if (ost->enc_chunks > 1) {
+            if (do_pass || video_enc->rc_override_count) {
+                av_log(ost, AV_LOG_FATAL, "Parallel chunk encoding is not supported "
+                       "with two-pass encoding or rate control overrides\n");
+                return AVERROR(EINVAL);
+            }
+            if (ost->enc_chunk_frames <= 0) {
+                av_log(ost, AV_LOG_FATAL, "Invalid chunk size: %d frames\n",
+                       ost->enc_chunk_frames);
+                return AVERROR(EINVAL);
+            }
+        }
+
         opt_match_per_stream_str(ost, &o->passlogfiles, oc, st, &ost->logfile_prefix);
         if (ost->logfile_prefix &&
             !(ost->logfile_prefix = av_strdup(ost->logfile_prefix)))
@@ -3384,6 +3400,11 @@ int of_open(const OptionsContext *o, const char *filename, Scheduler *sch)
 
     oc->interrupt_callback = int_cb;
 
+    // do not hold packets back for interleaving for longer than the latency
+    // target; an explicit -max_interleave_delta still takes precedence
+    if (latency_target)
+        oc->max_interleave_delta = latency_target;
+
     if (o->bitexact) {
         oc->flags    |= AVFMT_FLAG_BITEXACT;
         of->bitexact  = 1;
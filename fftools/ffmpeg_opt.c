@@ -42,6 +42,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/avutil.h"
+#include "libavutil/cpu.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
@@ -82,6 +83,8 @@ char *print_graphs_file = NULL;
 char *print_graphs_format = NULL;
 int auto_conversion_filters = 1;
 int64_t stats_period = 500000;
+int64_t latency_target = 0;
+char *metrics_file = NULL;
 
 
 static int file_overwrite     = 0;
@@ -90,6 +93,43 @@ int ignore_unknown_streams = 0;
 int copy_unknown_streams = 0;
 int recast_media = 0;
 
+void reset_global_options(void)
+{
+    hide_banner              = 0;
+    filter_hw_device         = NULL;
+    dts_delta_threshold      = 10;
+    dts_error_threshold      = 3600*30;
+#if FFMPEG_OPT_VSYNC
+    video_sync_method        = VSYNC_AUTO;
+#endif
+    frame_drop_threshold     = 0;
+    do_benchmark             = 0;
+    do_benchmark_all         = 0;
+    do_hex_dump              = 0;
+    do_pkt_dump              = 0;
+    copy_ts                  = 0;
+    start_at_zero            = 0;
+    copy_tb                  = -1;
+    debug_ts                 = 0;
+    exit_on_error            = 0;
+    abort_on_flags           = 0;
+    print_stats              = -1;
+    stdin_interaction        = 1;
+    max_error_rate           = 2.0/3;
+    filter_complex_nbthreads = 0;
+    filter_buffered_frames   = 0;
+    vstats_version           = 2;
+    print_graphs             = 0;
+    auto_conversion_filters  = 1;
+    stats_period             = 500000;
+    latency_target           = 0;
+    file_overwrite           = 0;
+    no_file_overwrite        = 0;
+    ignore_unknown_streams   = 0;
+    copy_unknown_streams     = 0;
+    recast_media             = 0;
+}
+
 // this struct is passed as the optctx argument
 // to func_arg() for global options
 typedef struct GlobalOptionsContext {
@@ -491,6 +531,49 @@ static int opt_filter_threads(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_sched_threads(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    double num;
+    int ret;
+
+    if (!strcmp(arg, "auto")) {
+        num = av_cpu_count();
+    } else {
+        ret = parse_number(opt, arg, OPT_TYPE_INT, 0, INT_MAX, &num);
+        if (ret < 0)
+            return ret;
+    }
+
+    sch_thread_pool_size(go->sch, num);
+    return 0;
+}
+
+static int opt_latency_target(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    int64_t target;
+    int ret = av_parse_time(&target, arg, 1);
+    if (ret < 0)
+        return ret;
+
+    if (target <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "latency_target %s must be positive.\n", arg);
+        return AVERROR(EINVAL);
+    }
+
+    latency_target = target;
+    sch_latency_target(go->sch, target);
+
+    return 0;
+}
+
+static int opt_batch(void *optctx, const char *opt, const char *arg)
+{
+    av_log(NULL, AV_LOG_ERROR, "-%s cannot be used inside a batch job.\n", opt);
+    return AVERROR(EINVAL);
+}
+
 static int opt_abort_on(void *optctx, const char *opt, const char *arg)
 {
     static const AVOption opts[] = {
@@ -1813,6 +1896,9 @@ const OptionDef options[] = {
     { "filter_threads",         OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_filter_threads },
         "number of non-complex filter threads" },
+    { "sched_threads",          OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_sched_threads },
+        "size of the thread pool shared by all filtergraphs (0 to disable, 'auto' for the number of CPUs)", "number" },
     { "filter_buffered_frames", OPT_TYPE_INT, OPT_EXPERT,
         { &filter_buffered_frames },
         "maximum number of buffered frames in a filter graph" },
@@ -1847,6 +1933,9 @@ const OptionDef options[] = {
     { "print_graphs_file", OPT_TYPE_STRING, 0,
         { &print_graphs_file },
         "write execution graph data to the specified file", "filename" },
+    { "metrics",             OPT_TYPE_STRING, OPT_EXPERT,
+        { &metrics_file },
+        "periodically write per-component statistics to the specified file", "filename" },
     { "print_graphs_format", OPT_TYPE_STRING, 0,
         { &print_graphs_format },
       "set the output printing format (available formats are: default, compact, csv, flat, ini, json, xml, mermaid, mermaidhtml)", "format" },
@@ -1859,6 +1948,12 @@ const OptionDef options[] = {
     { "stats_period",        OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_stats_period },
         "set the period at which ffmpeg updates stats and -progress output", "time" },
+    { "latency_target",      OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_latency_target },
+        "bound the buffering between input and output to the given time and report per-stage latency", "time" },
+    { "batch",               OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_batch },
+        "run the jobs listed in the specified file, one command line per line", "filename" },
     { "attach",              OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_PERFILE | OPT_EXPERT | OPT_OUTPUT,
         { .func_arg = opt_attach },
         "add an attachment to the output file", "filename" },
@@ -1959,6 +2054,12 @@ const OptionDef options[] = {
     { "passlogfile",                OPT_TYPE_STRING, OPT_VIDEO | OPT_EXPERT | OPT_PERSTREAM | OPT_OUTPUT,
         { .off = OFFSET(passlogfiles) },
         "select two pass log file name prefix", "prefix" },
+    { "enc_chunks",                 OPT_TYPE_INT,    OPT_VIDEO | OPT_PERSTREAM | OPT_OUTPUT | OPT_EXPERT,
+        { .off = OFFSET(enc_chunks) },
+        "encode this many chunks of the stream in parallel with independent encoders", "n" },
+    { "enc_chunk_frames",           OPT_TYPE_INT,    OPT_VIDEO | OPT_PERSTREAM | OPT_OUTPUT | OPT_EXPERT,
+        { .off = OFFSET(enc_chunk_frames) },
+        "set the number of frames in each chunk encoded in parallel", "n" },
     { "vstats",                     OPT_TYPE_FUNC,   OPT_VIDEO | OPT_EXPERT,
         { .func_arg = opt_vstats },
         "dump video coding statistics to file" },
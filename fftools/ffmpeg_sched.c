@@ -19,6 +19,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <inttypes.h>
 #include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -27,11 +28,13 @@
 #include "ffmpeg_sched.h"
 #include "ffmpeg_utils.h"
 #include "sync_queue.h"
+#include "thread_pool.h"
 #include "thread_queue.h"
 
 #include "libavcodec/packet.h"
 
 #include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/frame.h"
@@ -75,6 +78,8 @@ typedef struct SchDecOutput {
     SchedulerNode      *dst;
     uint8_t            *dst_finished;
     unsigned         nb_dst;
+
+    atomic_uint_least64_t nb_frames;
 } SchDecOutput;
 
 typedef struct SchDec {
@@ -145,12 +150,18 @@ typedef struct SchEnc {
 
     // temporary storage used by sch_enc_send()
     AVPacket           *send_pkt;
+
+    atomic_uint_least64_t nb_packets;
+    atomic_uint_least64_t nb_bytes;
 } SchEnc;
 
 typedef struct SchDemuxStream {
     SchedulerNode      *dst;
     uint8_t            *dst_finished;
     unsigned         nb_dst;
+
+    atomic_uint_least64_t nb_packets;
+    atomic_uint_least64_t nb_bytes;
 } SchDemuxStream;
 
 typedef struct SchDemux {
@@ -198,6 +209,9 @@ typedef struct SchMuxStream {
     // an EOF was generated while flushing the pre-mux queue
     int                 init_eof;
 
+    atomic_uint_least64_t nb_packets;
+    atomic_uint_least64_t nb_bytes;
+
     ////////////////////////////////////////////////////////////
     // The following are protected by Scheduler.schedule_lock //
 
@@ -240,6 +254,8 @@ typedef struct SchFilterIn {
 
 typedef struct SchFilterOut {
     SchedulerNode       dst;
+
+    atomic_uint_least64_t nb_frames;
 } SchFilterOut;
 
 typedef struct SchFilterGraph {
@@ -259,9 +275,16 @@ typedef struct SchFilterGraph {
     ThreadQueue        *queue;
     SchWaiter           waiter;
 
+    // how far the streams fed by this filtergraph lag behind the most
+    // advanced output stream, in milliseconds; used as the priority of its
+    // jobs in the shared thread pool
+    atomic_int          pool_priority;
+
     // protected by schedule_lock
     unsigned            best_input;
     int                 task_exited;
+    // internal state of pool_priority_update_locked()
+    int64_t             out_dts;
 } SchFilterGraph;
 
 enum SchedulerState {
@@ -303,6 +326,16 @@ struct Scheduler {
     char               *sdp_filename;
     int                 sdp_auto;
 
+    // worker pool shared by the filtergraphs, created on start
+    // when nb_pool_threads > 0
+    int                 nb_pool_threads;
+    ThreadPool         *pool;
+
+    // end-to-end latency target in microseconds, 0 when unset
+    int64_t             latency_target;
+    // how far an output stream may get ahead of the trailing one
+    int64_t             schedule_tolerance;
+
     enum SchedulerState state;
     atomic_int          terminate;
 
@@ -311,6 +344,12 @@ struct Scheduler {
     atomic_int_least64_t last_dts;
 };
 
+// statistics counters are only read for reporting, no ordering is needed
+static void stats_add(atomic_uint_least64_t *counter, uint64_t val)
+{
+    atomic_fetch_add_explicit(counter, val, memory_order_relaxed);
+}
+
 /**
  * Wait until this task is allowed to proceed.
  *
@@ -369,16 +408,18 @@ static void waiter_uninit(SchWaiter *w)
     pthread_cond_destroy(&w->cond);
 }
 
-static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_size,
-                       enum QueueType type)
+static int queue_alloc(const Scheduler *sch, ThreadQueue **ptq, unsigned nb_streams,
+                       unsigned queue_size, enum QueueType type)
 {
     ThreadQueue *tq;
 
     if (queue_size <= 0) {
         if (type == QUEUE_FRAMES)
-            queue_size = DEFAULT_FRAME_THREAD_QUEUE_SIZE;
+            queue_size = sch->latency_target ? LOW_LATENCY_FRAME_THREAD_QUEUE_SIZE :
+                                               DEFAULT_FRAME_THREAD_QUEUE_SIZE;
         else
-            queue_size = DEFAULT_PACKET_THREAD_QUEUE_SIZE;
+            queue_size = sch->latency_target ? LOW_LATENCY_PACKET_THREAD_QUEUE_SIZE :
+                                               DEFAULT_PACKET_THREAD_QUEUE_SIZE;
     }
 
     if (type == QUEUE_FRAMES) {
@@ -503,6 +544,8 @@ void sch_free(Scheduler **psch)
 
     sch_stop(sch, NULL);
 
+    tp_free(&sch->pool);
+
     for (unsigned i = 0; i < sch->nb_demux; i++) {
         SchDemux *d = &sch->demux[i];
 
@@ -624,6 +667,8 @@ Scheduler *sch_alloc(void)
     sch->class    = &scheduler_class;
     sch->sdp_auto = 1;
 
+    sch->schedule_tolerance = SCHEDULE_TOLERANCE;
+
     ret = pthread_mutex_init(&sch->schedule_lock, NULL);
     if (ret)
         goto fail;
@@ -653,6 +698,30 @@ int sch_sdp_filename(Scheduler *sch, const char *sdp_filename)
     return sch->sdp_filename ? 0 : AVERROR(ENOMEM);
 }
 
+void sch_latency_target(Scheduler *sch, int64_t target)
+{
+    sch->latency_target     = target;
+    sch->schedule_tolerance = target > 0 ? FFMIN(target, SCHEDULE_TOLERANCE) :
+                                           SCHEDULE_TOLERANCE;
+}
+
+void sch_thread_pool_size(Scheduler *sch, int nb_threads)
+{
+    sch->nb_pool_threads = nb_threads;
+}
+
+ThreadPool *sch_thread_pool(Scheduler *sch)
+{
+    return sch->pool;
+}
+
+int sch_filter_pool_priority(Scheduler *sch, unsigned fg_idx)
+{
+    av_assert0(fg_idx < sch->nb_filters);
+    return atomic_load_explicit(&sch->filters[fg_idx].pool_priority,
+                                memory_order_relaxed);
+}
+
 static const AVClass sch_mux_class = {
     .class_name                = "SchMux",
     .version                   = LIBAVUTIL_VERSION_INT,
@@ -799,7 +868,7 @@ int sch_add_dec(Scheduler *sch, SchThreadFunc func, void *ctx, int send_end_ts)
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS);
+    ret = queue_alloc(sch, &dec->queue, 1, 0, QUEUE_PACKETS);
     if (ret < 0)
         return ret;
 
@@ -843,7 +912,7 @@ int sch_add_enc(Scheduler *sch, SchThreadFunc func, void *ctx,
     if (!enc->send_pkt)
         return AVERROR(ENOMEM);
 
-    ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES);
+    ret = queue_alloc(sch, &enc->queue, 1, 0, QUEUE_FRAMES);
     if (ret < 0)
         return ret;
 
@@ -870,6 +939,7 @@ int sch_add_filtergraph(Scheduler *sch, unsigned nb_inputs, unsigned nb_outputs,
     fg = &sch->filters[idx];
 
     fg->class = &sch_fg_class;
+    atomic_init(&fg->pool_priority, 0);
 
     task_init(sch, &fg->task, SCH_NODE_TYPE_FILTER_IN, idx, func, ctx);
 
@@ -891,7 +961,7 @@ int sch_add_filtergraph(Scheduler *sch, unsigned nb_inputs, unsigned nb_outputs,
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES);
+    ret = queue_alloc(sch, &fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES);
     if (ret < 0)
         return ret;
 
@@ -1409,6 +1479,53 @@ static void choke_demux(const Scheduler *sch, int demux_id, int choked)
     }
 }
 
+static SchedulerNode src_filtergraph(const Scheduler *sch, SchedulerNode src);
+
+/* Give the filtergraphs feeding the output streams that lag the most the
+ * largest share of the shared thread pool. Only the filtergraph directly
+ * producing each output stream is accounted for. */
+static void pool_priority_update_locked(Scheduler *sch, int64_t max_dts)
+{
+    for (unsigned i = 0; i < sch->nb_filters; i++)
+        sch->filters[i].out_dts = INT64_MAX;
+
+    for (unsigned i = 0; i < sch->nb_mux; i++) {
+        SchMux *mux = &sch->mux[i];
+
+        for (unsigned j = 0; j < mux->nb_streams; j++) {
+            SchMuxStream *ms = &mux->streams[j];
+            SchedulerNode src;
+            SchFilterGraph *fg;
+
+            if (ms->source_finished)
+                continue;
+
+            src = src_filtergraph(sch, ms->src);
+            if (src.type != SCH_NODE_TYPE_FILTER_OUT)
+                continue;
+
+            fg = &sch->filters[src.idx];
+            if (ms->last_dts == AV_NOPTS_VALUE)
+                fg->out_dts = AV_NOPTS_VALUE;
+            else if (fg->out_dts != AV_NOPTS_VALUE)
+                fg->out_dts = FFMIN(fg->out_dts, ms->last_dts);
+        }
+    }
+
+    for (unsigned i = 0; i < sch->nb_filters; i++) {
+        SchFilterGraph *fg = &sch->filters[i];
+        int priority = 0;
+
+        if (max_dts != AV_NOPTS_VALUE && fg->out_dts != INT64_MAX) {
+            // nothing was output yet while other streams are progressing
+            priority = fg->out_dts == AV_NOPTS_VALUE ? INT_MAX :
+                       av_clip64((max_dts - fg->out_dts) / 1000, 0, INT_MAX);
+        }
+
+        atomic_store_explicit(&fg->pool_priority, priority, memory_order_relaxed);
+    }
+}
+
 static void schedule_update_locked(Scheduler *sch)
 {
     int64_t dts;
@@ -1423,6 +1540,9 @@ static void schedule_update_locked(Scheduler *sch)
 
     atomic_store(&sch->last_dts, progressing_dts(sch, 0));
 
+    if (sch->pool)
+        pool_priority_update_locked(sch, atomic_load(&sch->last_dts));
+
     // initialize our internal state
     for (unsigned type = 0; type < 2; type++)
         for (unsigned i = 0; i < (type ? sch->nb_filters : sch->nb_demux); i++) {
@@ -1444,7 +1564,7 @@ static void schedule_update_locked(Scheduler *sch)
                 continue;
             if (dts == AV_NOPTS_VALUE && ms->last_dts != AV_NOPTS_VALUE)
                 continue;
-            if (dts != AV_NOPTS_VALUE && ms->last_dts - dts >= SCHEDULE_TOLERANCE)
+            if (dts != AV_NOPTS_VALUE && ms->last_dts - dts >= sch->schedule_tolerance)
                 continue;
 
             // resolve the source to unchoke
@@ -1678,7 +1798,7 @@ static int start_prepare(Scheduler *sch)
             }
         }
 
-        ret = queue_alloc(&mux->queue, mux->nb_streams, mux->queue_size,
+        ret = queue_alloc(sch, &mux->queue, mux->nb_streams, mux->queue_size,
                           QUEUE_PACKETS);
         if (ret < 0)
             return ret;
@@ -1727,6 +1847,16 @@ int sch_start(Scheduler *sch)
     av_assert0(sch->state == SCH_STATE_UNINIT);
     sch->state = SCH_STATE_STARTED;
 
+    if (sch->nb_pool_threads > 0) {
+        sch->pool = tp_alloc(sch->nb_pool_threads);
+        if (!sch->pool) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        av_log(sch, AV_LOG_VERBOSE, "Using a pool of %d threads shared by "
+               "the filtergraphs\n", sch->nb_pool_threads);
+    }
+
     for (unsigned i = 0; i < sch->nb_mux; i++) {
         SchMux *mux = &sch->mux[i];
 
@@ -1782,6 +1912,111 @@ fail:
     return ret;
 }
 
+static void metrics_header(AVBPrint *bp, const char *name, const char *type,
+                           const char *help)
+{
+    av_bprintf(bp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void metrics_queue(AVBPrint *bp, const char *name, const char *label,
+                          unsigned idx, ThreadQueue *tq)
+{
+    if (tq)
+        av_bprintf(bp, "%s{%s=\"%u\"} %zu\n", name, label, idx, tq_fill(tq, NULL));
+}
+
+#define LOAD(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+void sch_metrics_print(Scheduler *sch, AVBPrint *bp)
+{
+    int64_t dts = atomic_load(&sch->last_dts);
+
+    metrics_header(bp, "ffmpeg_progress_seconds", "gauge",
+                   "Timestamp of the most advanced output stream.");
+    if (dts != AV_NOPTS_VALUE)
+        av_bprintf(bp, "ffmpeg_progress_seconds %f\n", dts / (double)AV_TIME_BASE);
+
+    metrics_header(bp, "ffmpeg_demux_packets_total", "counter",
+                   "Packets sent by the demuxers.");
+    for (unsigned i = 0; i < sch->nb_demux; i++)
+        for (unsigned j = 0; j < sch->demux[i].nb_streams; j++)
+            av_bprintf(bp, "ffmpeg_demux_packets_total{demux=\"%u\",stream=\"%u\"} %"PRIu64"\n",
+                       i, j, (uint64_t)LOAD(sch->demux[i].streams[j].nb_packets));
+    metrics_header(bp, "ffmpeg_demux_bytes_total", "counter",
+                   "Packet data sent by the demuxers.");
+    for (unsigned i = 0; i < sch->nb_demux; i++)
+        for (unsigned j = 0; j < sch->demux[i].nb_streams; j++)
+            av_bprintf(bp, "ffmpeg_demux_bytes_total{demux=\"%u\",stream=\"%u\"} %"PRIu64"\n",
+                       i, j, (uint64_t)LOAD(sch->demux[i].streams[j].nb_bytes));
+    metrics_header(bp, "ffmpeg_demux_choked", "gauge",
+                   "Whether the demuxer is waiting for the outputs to catch up.");
+    for (unsigned i = 0; i < sch->nb_demux; i++)
+        av_bprintf(bp, "ffmpeg_demux_choked{demux=\"%u\"} %d\n",
+                   i, atomic_load(&sch->demux[i].waiter.choked));
+
+    metrics_header(bp, "ffmpeg_decoder_frames_total", "counter",
+                   "Frames output by the decoders.");
+    for (unsigned i = 0; i < sch->nb_dec; i++)
+        for (unsigned j = 0; j < sch->dec[i].nb_outputs; j++)
+            av_bprintf(bp, "ffmpeg_decoder_frames_total{dec=\"%u\",output=\"%u\"} %"PRIu64"\n",
+                       i, j, (uint64_t)LOAD(sch->dec[i].outputs[j].nb_frames));
+    metrics_header(bp, "ffmpeg_decoder_queue_packets", "gauge",
+                   "Packets waiting to be decoded.");
+    for (unsigned i = 0; i < sch->nb_dec; i++)
+        metrics_queue(bp, "ffmpeg_decoder_queue_packets", "dec", i, sch->dec[i].queue);
+
+    metrics_header(bp, "ffmpeg_filtergraph_frames_total", "counter",
+                   "Frames output by the filtergraphs.");
+    for (unsigned i = 0; i < sch->nb_filters; i++)
+        for (unsigned j = 0; j < sch->filters[i].nb_outputs; j++)
+            av_bprintf(bp, "ffmpeg_filtergraph_frames_total{filtergraph=\"%u\",output=\"%u\"} %"PRIu64"\n",
+                       i, j, (uint64_t)LOAD(sch->filters[i].outputs[j].nb_frames));
+    metrics_header(bp, "ffmpeg_filtergraph_queue_frames", "gauge",
+                   "Frames waiting to be filtered.");
+    for (unsigned i = 0; i < sch->nb_filters; i++)
+        metrics_queue(bp, "ffmpeg_filtergraph_queue_frames", "filtergraph", i,
+                      sch->filters[i].queue);
+    metrics_header(bp, "ffmpeg_filtergraph_choked", "gauge",
+                   "Whether the filtergraph is waiting for the outputs to catch up.");
+    for (unsigned i = 0; i < sch->nb_filters; i++)
+        av_bprintf(bp, "ffmpeg_filtergraph_choked{filtergraph=\"%u\"} %d\n",
+                   i, atomic_load(&sch->filters[i].waiter.choked));
+
+    metrics_header(bp, "ffmpeg_encoder_packets_total", "counter",
+                   "Packets output by the encoders.");
+    for (unsigned i = 0; i < sch->nb_enc; i++)
+        av_bprintf(bp, "ffmpeg_encoder_packets_total{enc=\"%u\"} %"PRIu64"\n",
+                   i, (uint64_t)LOAD(sch->enc[i].nb_packets));
+    metrics_header(bp, "ffmpeg_encoder_bytes_total", "counter",
+                   "Packet data output by the encoders.");
+    for (unsigned i = 0; i < sch->nb_enc; i++)
+        av_bprintf(bp, "ffmpeg_encoder_bytes_total{enc=\"%u\"} %"PRIu64"\n",
+                   i, (uint64_t)LOAD(sch->enc[i].nb_bytes));
+    metrics_header(bp, "ffmpeg_encoder_queue_frames", "gauge",
+                   "Frames waiting to be encoded.");
+    for (unsigned i = 0; i < sch->nb_enc; i++)
+        metrics_queue(bp, "ffmpeg_encoder_queue_frames", "enc", i, sch->enc[i].queue);
+
+    metrics_header(bp, "ffmpeg_mux_packets_total", "counter",
+                   "Packets sent to the muxers.");
+    for (unsigned i = 0; i < sch->nb_mux; i++)
+        for (unsigned j = 0; j < sch->mux[i].nb_streams; j++)
+            av_bprintf(bp, "ffmpeg_mux_packets_total{mux=\"%u\",stream=\"%u\"} %"PRIu64"\n",
+                       i, j, (uint64_t)LOAD(sch->mux[i].streams[j].nb_packets));
+    metrics_header(bp, "ffmpeg_mux_bytes_total", "counter",
+                   "Packet data sent to the muxers.");
+    for (unsigned i = 0; i < sch->nb_mux; i++)
+        for (unsigned j = 0; j < sch->mux[i].nb_streams; j++)
+            av_bprintf(bp, "ffmpeg_mux_bytes_total{mux=\"%u\",stream=\"%u\"} %"PRIu64"\n",
+                       i, j, (uint64_t)LOAD(sch->mux[i].streams[j].nb_bytes));
+    metrics_header(bp, "ffmpeg_mux_queue_packets", "gauge",
+                   "Packets waiting to be muxed.");
+    for (unsigned i = 0; i < sch->nb_mux; i++)
+        metrics_queue(bp, "ffmpeg_mux_queue_packets", "mux", i, sch->mux[i].queue);
+}
+
+#undef LOAD
+
 int sch_wait(Scheduler *sch, uint64_t timeout_us, int64_t *transcode_ts)
 {
     int ret;
@@ -1992,6 +2227,11 @@ static int send_to_mux(Scheduler *sch, SchMux *mux, unsigned stream_idx,
                   av_rescale_q(pkt->dts + pkt->duration, pkt->time_base, AV_TIME_BASE_Q) :
                   AV_NOPTS_VALUE;
 
+    if (pkt) {
+        stats_add(&ms->nb_packets, 1);
+        stats_add(&ms->nb_bytes,   pkt->size);
+    }
+
     // queue the packet if the muxer cannot be started yet
     if (!atomic_load(&mux->mux_started)) {
         int queued = 0;
@@ -2173,6 +2413,9 @@ int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
 
     av_assert0(pkt->stream_index < d->nb_streams);
 
+    stats_add(&d->streams[pkt->stream_index].nb_packets, 1);
+    stats_add(&d->streams[pkt->stream_index].nb_bytes,   pkt->size);
+
     return demux_send_for_stream(sch, d, &d->streams[pkt->stream_index], pkt, flags);
 }
 
@@ -2378,6 +2621,9 @@ int sch_dec_send(Scheduler *sch, unsigned dec_idx,
     av_assert0(out_idx < dec->nb_outputs);
     o = &dec->outputs[out_idx];
 
+    if (frame->buf[0])
+        stats_add(&o->nb_frames, 1);
+
     for (unsigned i = 0; i < o->nb_dst; i++) {
         uint8_t *finished = &o->dst_finished[i];
         AVFrame *to_send  = frame;
@@ -2485,6 +2731,9 @@ int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
     av_assert0(enc_idx < sch->nb_enc);
     enc = &sch->enc[enc_idx];
 
+    stats_add(&enc->nb_packets, 1);
+    stats_add(&enc->nb_bytes,   pkt->size);
+
     for (unsigned i = 0; i < enc->nb_dst; i++) {
         uint8_t *finished = &enc->dst_finished[i];
         AVPacket *to_send = pkt;
@@ -2609,6 +2858,9 @@ int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *
     av_assert0(out_idx < fg->nb_outputs);
     dst = fg->outputs[out_idx].dst;
 
+    if (frame)
+        stats_add(&fg->outputs[out_idx].nb_frames, 1);
+
     if (dst.type == SCH_NODE_TYPE_ENC) {
         ret = send_to_enc(sch, &sch->enc[dst.idx], frame);
         if (ret == AVERROR_EOF)
@@ -261,6 +261,13 @@ int sch_add_mux(Scheduler *sch, SchThreadFunc func, int (*init)(void *),
  */
 #define DEFAULT_FRAME_THREAD_QUEUE_SIZE 2
 
+/**
+ * Default thread queue sizes used when a latency target is set with
+ * sch_latency_target().
+ */
+#define LOW_LATENCY_PACKET_THREAD_QUEUE_SIZE 2
+#define LOW_LATENCY_FRAME_THREAD_QUEUE_SIZE  1
+
 /**
  * Add a muxed stream for a previously added muxer.
  *
@@ -300,6 +307,50 @@ int sch_mux_stream_ready(Scheduler *sch, unsigned mux_idx, unsigned stream_idx);
  */
 int sch_sdp_filename(Scheduler *sch, const char *sdp_filename);
 
+/**
+ * Set the end-to-end latency the caller aims for, in microseconds. This
+ * shrinks the default sizes of the queues between the components and
+ * limits how far output streams may get ahead of each other to the target.
+ * 0 (the default) means no target.
+ *
+ * Must be called before adding any components.
+ */
+void sch_latency_target(Scheduler *sch, int64_t target);
+
+struct AVBPrint;
+
+/**
+ * Print the per-component statistics of the scheduler, in the Prometheus text
+ * exposition format. Only reads counters updated with atomics by the
+ * components, so this may be called at any time after sch_start() without
+ * interfering with the processing threads.
+ */
+void sch_metrics_print(Scheduler *sch, struct AVBPrint *bp);
+
+struct ThreadPool;
+
+/**
+ * Set the number of threads in the worker pool shared by all filtergraphs
+ * for their slice threading, instead of each filtergraph starting its own
+ * threads. 0 (the default) disables the shared pool.
+ *
+ * Must be called before sch_start().
+ */
+void sch_thread_pool_size(Scheduler *sch, int nb_threads);
+
+/**
+ * @return the shared worker pool, or NULL if it is disabled or the scheduler
+ *         has not been started yet
+ */
+struct ThreadPool *sch_thread_pool(Scheduler *sch);
+
+/**
+ * @return the priority with which jobs of the given filtergraph should be
+ *         submitted to the shared worker pool; filtergraphs whose outputs
+ *         lag behind the other output streams get higher priorities
+ */
+int sch_filter_pool_priority(Scheduler *sch, unsigned fg_idx);
+
 /**
  * Add an encoder to the scheduler.
  *
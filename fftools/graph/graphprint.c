@@ -396,6 +396,17 @@ static void print_filter(GraphPrintContext *gpc, const AVFilterContext *filter,
         print_int_opt("nb_outputs", filter->nb_outputs);
     }
 
+    if (filter->graph && filter->graph->collect_stats) {
+        const AVFilterStats *stats = avfilter_get_stats(filter);
+        print_int_opt("activations", stats->nb_activations);
+        print_int_opt("frames_in", stats->frames_in);
+        print_int_opt("frames_out", stats->frames_out);
+        print_int_opt("cpu_time_us", stats->cpu_time);
+        print_int_opt("wall_time_us", stats->wall_time);
+        print_int_opt("max_queued_frames", stats->max_queued_frames);
+        print_int_opt("bytes_allocated", stats->bytes_allocated);
+    }
+
     if (filter->hw_device_ctx) {
         AVHWDeviceContext *device_context = (AVHWDeviceContext *)filter->hw_device_ctx->data;
         print_hwdevicecontext(gpc, device_context);
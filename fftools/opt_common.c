@@ -1235,6 +1235,22 @@ int opt_report(void *optctx, const char *opt, const char *arg)
     return init_report(NULL, NULL);
 }
 
+void reset_common_opts(int keep_report)
+{
+    if (report_file && !keep_report) {
+        av_log_set_callback(av_log_default_callback);
+        fclose(report_file);
+        report_file       = NULL;
+        report_file_level = AV_LOG_DEBUG;
+    }
+    warned_cfg = 0;
+
+    av_log_set_level(AV_LOG_INFO);
+    av_force_cpu_flags(-1);
+    av_cpu_force_count(0);
+    av_max_alloc(INT_MAX);
+}
+
 int opt_max_alloc(void *optctx, const char *opt, const char *arg)
 {
     char *tail;
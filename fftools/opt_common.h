@@ -184,6 +184,13 @@ int opt_loglevel(void *optctx, const char *opt, const char *arg);
 int opt_report(void *optctx, const char *opt, const char *arg);
 int init_report(const char *env, FILE **file);
 
+/**
+ * Restore the defaults of the options handled here: the log level, the
+ * cpu flags and count and the maximum allocation size. The report file
+ * opened by -report or FFREPORT is closed unless keep_report is set.
+ */
+void reset_common_opts(int keep_report);
+
 int opt_max_alloc(void *optctx, const char *opt, const char *arg);
 
 /**
@@ -0,0 +1,232 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "thread_pool.h"
+
+typedef struct ThreadPoolBatch {
+    ThreadPoolJobFunc       func;
+    void                   *priv;
+    int                    *ret;
+    int                     nb_jobs;
+    int                     priority;
+
+    // index of the next job to start, number of completed jobs
+    int                     next_job;
+    int                     nb_done;
+
+    struct ThreadPoolBatch *next;
+} ThreadPoolBatch;
+
+struct ThreadPool {
+    pthread_t      *workers;
+    int          nb_workers;
+
+    pthread_mutex_t lock;
+    // signalled when a batch is submitted, or on exit
+    pthread_cond_t  work_cond;
+    // signalled when a batch is completed
+    pthread_cond_t  done_cond;
+
+    // batches with jobs that were not started yet, in submission order
+    ThreadPoolBatch *pending;
+    int              exit;
+};
+
+static void batch_remove(ThreadPool *tp, ThreadPoolBatch *b)
+{
+    ThreadPoolBatch **p = &tp->pending;
+
+    while (*p && *p != b)
+        p = &(*p)->next;
+    if (*p)
+        *p = b->next;
+    b->next = NULL;
+}
+
+/* must be called with the lock held, which is released while the job runs */
+static void batch_run_job(ThreadPool *tp, ThreadPoolBatch *b)
+{
+    int jobnr = b->next_job++, ret;
+
+    if (b->next_job == b->nb_jobs)
+        batch_remove(tp, b);
+
+    pthread_mutex_unlock(&tp->lock);
+    ret = b->func(b->priv, jobnr, b->nb_jobs);
+    pthread_mutex_lock(&tp->lock);
+
+    if (b->ret)
+        b->ret[jobnr] = ret;
+    if (++b->nb_done == b->nb_jobs)
+        pthread_cond_broadcast(&tp->done_cond);
+}
+
+// the pending batch with the highest priority, the oldest one on ties
+static ThreadPoolBatch *batch_next(ThreadPool *tp)
+{
+    ThreadPoolBatch *best = tp->pending;
+
+    for (ThreadPoolBatch *b = best; b; b = b->next)
+        if (b->priority > best->priority)
+            best = b;
+
+    return best;
+}
+
+static void *worker_thread(void *arg)
+{
+    ThreadPool *tp = arg;
+
+    pthread_mutex_lock(&tp->lock);
+    while (1) {
+        while (!tp->exit && !tp->pending)
+            pthread_cond_wait(&tp->work_cond, &tp->lock);
+        if (tp->exit)
+            break;
+
+        batch_run_job(tp, batch_next(tp));
+    }
+    pthread_mutex_unlock(&tp->lock);
+
+    return NULL;
+}
+
+void tp_free(ThreadPool **ptp)
+{
+    ThreadPool *tp = *ptp;
+
+    if (!tp)
+        return;
+
+    if (tp->workers) {
+        pthread_mutex_lock(&tp->lock);
+        tp->exit = 1;
+        pthread_cond_broadcast(&tp->work_cond);
+        pthread_mutex_unlock(&tp->lock);
+
+        for (int i = 0; i < tp->nb_workers; i++)
+            pthread_join(tp->workers[i], NULL);
+        av_freep(&tp->workers);
+    }
+
+    pthread_cond_destroy(&tp->done_cond);
+    pthread_cond_destroy(&tp->work_cond);
+    pthread_mutex_destroy(&tp->lock);
+
+    av_freep(ptp);
+}
+
+ThreadPool *tp_alloc(int nb_threads)
+{
+    ThreadPool *tp;
+    int ret;
+
+    tp = av_mallocz(sizeof(*tp));
+    if (!tp)
+        return NULL;
+
+    ret = pthread_mutex_init(&tp->lock, NULL);
+    if (ret) {
+        av_freep(&tp);
+        return NULL;
+    }
+
+    ret = pthread_cond_init(&tp->work_cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&tp->lock);
+        av_freep(&tp);
+        return NULL;
+    }
+
+    ret = pthread_cond_init(&tp->done_cond, NULL);
+    if (ret) {
+        pthread_cond_destroy(&tp->work_cond);
+        pthread_mutex_destroy(&tp->lock);
+        av_freep(&tp);
+        return NULL;
+    }
+
+    if (nb_threads > 1) {
+        tp->workers = av_calloc(nb_threads - 1, sizeof(*tp->workers));
+        if (!tp->workers)
+            goto fail;
+
+        for (; tp->nb_workers < nb_threads - 1; tp->nb_workers++) {
+            ret = pthread_create(&tp->workers[tp->nb_workers], NULL,
+                                 worker_thread, tp);
+            if (ret)
+                goto fail;
+        }
+    }
+
+    return tp;
+fail:
+    tp_free(&tp);
+    return NULL;
+}
+
+int tp_nb_threads(const ThreadPool *tp)
+{
+    return tp->nb_workers + 1;
+}
+
+int tp_execute(ThreadPool *tp, ThreadPoolJobFunc func, void *priv,
+               int *ret, int nb_jobs, int priority)
+{
+    ThreadPoolBatch b = {
+        .func     = func,
+        .priv     = priv,
+        .ret      = ret,
+        .nb_jobs  = nb_jobs,
+        .priority = priority,
+    };
+    ThreadPoolBatch **p;
+
+    if (nb_jobs <= 0)
+        return 0;
+
+    if (!tp->nb_workers || nb_jobs == 1) {
+        for (int i = 0; i < nb_jobs; i++) {
+            int r = func(priv, i, nb_jobs);
+            if (ret)
+                ret[i] = r;
+        }
+        return 0;
+    }
+
+    pthread_mutex_lock(&tp->lock);
+
+    for (p = &tp->pending; *p; p = &(*p)->next)
+        ;
+    *p = &b;
+    pthread_cond_broadcast(&tp->work_cond);
+
+    // take part in executing our own batch, then wait for the jobs picked
+    // by the workers to complete
+    while (b.next_job < b.nb_jobs)
+        batch_run_job(tp, &b);
+    while (b.nb_done < b.nb_jobs)
+        pthread_cond_wait(&tp->done_cond, &tp->lock);
+
+    pthread_mutex_unlock(&tp->lock);
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFTOOLS_THREAD_POOL_H
+#define FFTOOLS_THREAD_POOL_H
+
+/**
+ * A pool of worker threads shared between any number of components, each of
+ * which may concurrently submit batches of independent jobs to it.
+ *
+ * The submitting thread takes part in executing its own batch, while idle
+ * workers pick jobs from the pending batch with the highest priority, or
+ * the oldest one among batches of equal priority.
+ */
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * @param priv  the opaque pointer passed to tp_execute()
+ * @param jobnr the index of the job to execute, in [0, nb_jobs)
+ * @return the return code of the job, stored in the ret array passed to
+ *         tp_execute()
+ */
+typedef int (*ThreadPoolJobFunc)(void *priv, int jobnr, int nb_jobs);
+
+/**
+ * Allocate a thread pool.
+ *
+ * @param nb_threads total number of threads executing jobs, including the
+ *                   submitting thread; nb_threads - 1 workers are started
+ */
+ThreadPool *tp_alloc(int nb_threads);
+void        tp_free(ThreadPool **tp);
+
+/**
+ * @return the number of threads that may execute jobs of a single batch
+ *         concurrently
+ */
+int tp_nb_threads(const ThreadPool *tp);
+
+/**
+ * Execute nb_jobs jobs and wait for all of them to complete.
+ *
+ * @param ret      if non-NULL, an array of nb_jobs elements receiving the
+ *                 return codes of the jobs
+ * @param priority batches with a higher priority are served first by the
+ *                 workers
+ * @return 0
+ */
+int tp_execute(ThreadPool *tp, ThreadPoolJobFunc func, void *priv,
+               int *ret, int nb_jobs, int priority);
+
+#endif // FFTOOLS_THREAD_POOL_H
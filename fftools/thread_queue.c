@@ -16,15 +16,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "libavutil/avassert.h"
-#include "libavutil/container_fifo.h"
 #include "libavutil/error.h"
-#include "libavutil/fifo.h"
 #include "libavutil/frame.h"
-#include "libavutil/intreadwrite.h"
+#include "libavutil/macros.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
 
@@ -37,15 +36,47 @@ enum {
     FINISHED_RECV = (1 << 1),
 };
 
+/*
+ * The items are stored in a bounded lock-free ring buffer, which may be
+ * written to by any number of senders and is read by a single receiver.
+ * Each cell carries a sequence number telling whether it is ready to be
+ * written (seq == pos) or read (seq == pos + 1) at position pos.
+ *
+ * The mutex and condition variable are only used for blocking, when the
+ * queue is full or when there is nothing to receive, and for the rare state
+ * changes (choking and finishing streams). Senders and the receiver only
+ * touch them when the other side is actually waiting.
+ */
+typedef struct ThreadQueueCell {
+    atomic_uintptr_t    seq;
+    unsigned int        stream_idx;
+    // AVFrame or AVPacket, depending on the queue type
+    void               *item;
+} ThreadQueueCell;
+
 struct ThreadQueue {
-    int             choked;
-    int              *finished;
-    unsigned int    nb_streams;
+    atomic_int          choked;
+    atomic_int         *finished;
+    unsigned int     nb_streams;
 
     enum ThreadQueueType type;
 
-    AVContainerFifo *fifo;
-    AVFifo          *fifo_stream_index;
+    ThreadQueueCell    *cells;
+    // number of cells, a power of two
+    uintptr_t        nb_cells;
+    // maximum number of queued items
+    uintptr_t           capacity;
+
+    atomic_uintptr_t    write_pos;
+    // only written by the receiver
+    atomic_uintptr_t    read_pos;
+
+    // number of senders waiting for the queue to have free space
+    atomic_int          send_waiters;
+    // nonzero when the receiver is waiting for something to receive
+    atomic_int          recv_waiting;
+    // incremented on every choke or finish state change
+    atomic_uint         state_gen;
 
     pthread_mutex_t lock;
     pthread_cond_t  cond;
@@ -58,8 +89,18 @@ void tq_free(ThreadQueue **ptq)
     if (!tq)
         return;
 
-    av_container_fifo_free(&tq->fifo);
-    av_fifo_freep2(&tq->fifo_stream_index);
+    if (tq->cells) {
+        for (uintptr_t i = 0; i < tq->nb_cells; i++) {
+            if (tq->type == THREAD_QUEUE_FRAMES) {
+                AVFrame *frame = tq->cells[i].item;
+                av_frame_free(&frame);
+            } else {
+                AVPacket *pkt = tq->cells[i].item;
+                av_packet_free(&pkt);
+            }
+        }
+        av_freep(&tq->cells);
+    }
 
     av_freep(&tq->finished);
 
@@ -96,78 +137,161 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
     if (!tq->finished)
         goto fail;
     tq->nb_streams = nb_streams;
+    for (unsigned int i = 0; i < nb_streams; i++)
+        atomic_init(&tq->finished[i], 0);
 
     tq->type = type;
 
-    tq->fifo = (type == THREAD_QUEUE_FRAMES) ?
-               av_container_fifo_alloc_avframe(0) : av_container_fifo_alloc_avpacket(0);
-    if (!tq->fifo)
-        goto fail;
+    tq->capacity = FFMAX(queue_size, 1);
+    for (tq->nb_cells = 1; tq->nb_cells < tq->capacity; tq->nb_cells <<= 1)
+        ;
 
-    tq->fifo_stream_index = av_fifo_alloc2(queue_size, sizeof(unsigned), 0);
-    if (!tq->fifo_stream_index)
+    tq->cells = av_calloc(tq->nb_cells, sizeof(*tq->cells));
+    if (!tq->cells)
         goto fail;
 
+    for (uintptr_t i = 0; i < tq->nb_cells; i++) {
+        ThreadQueueCell *c = &tq->cells[i];
+
+        atomic_init(&c->seq, i);
+        c->item = (type == THREAD_QUEUE_FRAMES) ?
+                  (void*)av_frame_alloc() : (void*)av_packet_alloc();
+        if (!c->item)
+            goto fail;
+    }
+
+    atomic_init(&tq->choked,       0);
+    atomic_init(&tq->write_pos,    0);
+    atomic_init(&tq->read_pos,     0);
+    atomic_init(&tq->send_waiters, 0);
+    atomic_init(&tq->recv_waiting, 0);
+    atomic_init(&tq->state_gen,    0);
+
     return tq;
 fail:
     tq_free(&tq);
     return NULL;
 }
 
-int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
+static void move_item(const ThreadQueue *tq, void *dst, void *src)
 {
-    int *finished;
-    int ret;
-
-    av_assert0(stream_idx < tq->nb_streams);
-    finished = &tq->finished[stream_idx];
+    if (tq->type == THREAD_QUEUE_FRAMES)
+        av_frame_move_ref(dst, src);
+    else
+        av_packet_move_ref(dst, src);
+}
 
+static void wake_up(ThreadQueue *tq)
+{
     pthread_mutex_lock(&tq->lock);
+    pthread_cond_broadcast(&tq->cond);
+    pthread_mutex_unlock(&tq->lock);
+}
 
-    if (*finished & FINISHED_SEND) {
-        ret = AVERROR(EINVAL);
-        goto finish;
-    }
+static int queue_full(ThreadQueue *tq)
+{
+    return atomic_load(&tq->write_pos) - atomic_load(&tq->read_pos) >= tq->capacity;
+}
+
+static int queue_can_read(ThreadQueue *tq)
+{
+    uintptr_t pos = atomic_load(&tq->read_pos);
+    return atomic_load(&tq->cells[pos & (tq->nb_cells - 1)].seq) == pos + 1;
+}
+
+/* @return 1 if the item was queued, 0 if the queue is full */
+static int queue_push(ThreadQueue *tq, unsigned int stream_idx, void *data)
+{
+    uintptr_t pos = atomic_load(&tq->write_pos);
 
-    while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo_stream_index))
-        pthread_cond_wait(&tq->cond, &tq->lock);
+    while (1) {
+        ThreadQueueCell *c = &tq->cells[pos & (tq->nb_cells - 1)];
+        intptr_t diff = (intptr_t)(atomic_load(&c->seq) - pos);
 
-    if (*finished & FINISHED_RECV) {
-        ret = AVERROR_EOF;
-        *finished |= FINISHED_SEND;
-    } else {
-        ret = av_fifo_write(tq->fifo_stream_index, &stream_idx, 1);
-        if (ret < 0)
-            goto finish;
+        if (diff < 0 || pos - atomic_load(&tq->read_pos) >= tq->capacity)
+            return 0;
 
-        ret = av_container_fifo_write(tq->fifo, data, 0);
-        if (ret < 0)
-            goto finish;
+        if (diff > 0) {
+            // another sender took this position
+            pos = atomic_load(&tq->write_pos);
+            continue;
+        }
 
-        pthread_cond_broadcast(&tq->cond);
+        if (atomic_compare_exchange_weak(&tq->write_pos, &pos, pos + 1)) {
+            c->stream_idx = stream_idx;
+            move_item(tq, c->item, data);
+            atomic_store(&c->seq, pos + 1);
+            break;
+        }
     }
 
-finish:
-    pthread_mutex_unlock(&tq->lock);
+    if (atomic_load(&tq->recv_waiting))
+        wake_up(tq);
 
-    return ret;
+    return 1;
 }
 
-static int receive_locked(ThreadQueue *tq, int *stream_idx,
-                          void *data)
+/* @return 1 if an item was read, 0 if the queue is empty */
+static int queue_pop(ThreadQueue *tq, unsigned int *stream_idx, void *data)
 {
-    unsigned int nb_finished = 0;
+    uintptr_t pos = atomic_load_explicit(&tq->read_pos, memory_order_relaxed);
+    ThreadQueueCell *c = &tq->cells[pos & (tq->nb_cells - 1)];
 
-    if (tq->choked)
-        return AVERROR(EAGAIN);
+    if (atomic_load(&c->seq) != pos + 1)
+        return 0;
 
-    while (av_container_fifo_read(tq->fifo, data, 0) >= 0) {
-        unsigned idx;
-        int ret;
+    *stream_idx = c->stream_idx;
+    move_item(tq, data, c->item);
 
-        ret = av_fifo_read(tq->fifo_stream_index, &idx, 1);
-        av_assert0(ret >= 0);
-        if (tq->finished[idx] & FINISHED_RECV) {
+    atomic_store(&c->seq, pos + tq->nb_cells);
+    atomic_store(&tq->read_pos, pos + 1);
+
+    if (atomic_load(&tq->send_waiters))
+        wake_up(tq);
+
+    return 1;
+}
+
+int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
+{
+    atomic_int *finished;
+
+    av_assert0(stream_idx < tq->nb_streams);
+    finished = &tq->finished[stream_idx];
+
+    if (atomic_load(finished) & FINISHED_SEND)
+        return AVERROR(EINVAL);
+
+    while (1) {
+        if (atomic_load(finished) & FINISHED_RECV) {
+            atomic_fetch_or(finished, FINISHED_SEND);
+            return AVERROR_EOF;
+        }
+
+        if (queue_push(tq, stream_idx, data))
+            return 0;
+
+        pthread_mutex_lock(&tq->lock);
+        atomic_fetch_add(&tq->send_waiters, 1);
+        while (!(atomic_load(finished) & FINISHED_RECV) && queue_full(tq))
+            pthread_cond_wait(&tq->cond, &tq->lock);
+        atomic_fetch_sub(&tq->send_waiters, 1);
+        pthread_mutex_unlock(&tq->lock);
+    }
+}
+
+static int receive_nonblock(ThreadQueue *tq, int *stream_idx,
+                            void *data)
+{
+    unsigned int nb_finished;
+    unsigned int idx;
+
+    if (atomic_load(&tq->choked))
+        return AVERROR(EAGAIN);
+
+retry:
+    while (queue_pop(tq, &idx, data)) {
+        if (atomic_load(&tq->finished[idx]) & FINISHED_RECV) {
             (tq->type == THREAD_QUEUE_FRAMES) ?
             av_frame_unref(data) : av_packet_unref(data);
             continue;
@@ -177,14 +301,21 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
         return 0;
     }
 
+    nb_finished = 0;
     for (unsigned int i = 0; i < tq->nb_streams; i++) {
-        if (!tq->finished[i])
+        int finished = atomic_load(&tq->finished[i]);
+
+        if (!finished)
             continue;
 
         /* return EOF to the consumer at most once for each stream */
-        if (!(tq->finished[i] & FINISHED_RECV)) {
-            tq->finished[i] |= FINISHED_RECV;
-            *stream_idx   = i;
+        if (!(finished & FINISHED_RECV)) {
+            /* items sent before the stream was finished come first */
+            if (queue_can_read(tq))
+                goto retry;
+
+            atomic_fetch_or(&tq->finished[i], FINISHED_RECV);
+            *stream_idx = i;
             return AVERROR_EOF;
         }
 
@@ -200,27 +331,22 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
 
     *stream_idx = -1;
 
-    pthread_mutex_lock(&tq->lock);
-
     while (1) {
-        size_t can_read = av_container_fifo_can_read(tq->fifo);
+        unsigned gen = atomic_load(&tq->state_gen);
 
-        ret = receive_locked(tq, stream_idx, data);
+        ret = receive_nonblock(tq, stream_idx, data);
+        if (ret != AVERROR(EAGAIN))
+            break;
 
-        // signal other threads if the fifo state changed
-        if (can_read != av_container_fifo_can_read(tq->fifo))
-            pthread_cond_broadcast(&tq->cond);
-
-        if (ret == AVERROR(EAGAIN)) {
+        pthread_mutex_lock(&tq->lock);
+        atomic_store(&tq->recv_waiting, 1);
+        while (atomic_load(&tq->state_gen) == gen &&
+               (atomic_load(&tq->choked) || !queue_can_read(tq)))
             pthread_cond_wait(&tq->cond, &tq->lock);
-            continue;
-        }
-
-        break;
+        atomic_store(&tq->recv_waiting, 0);
+        pthread_mutex_unlock(&tq->lock);
     }
 
-    pthread_mutex_unlock(&tq->lock);
-
     return ret;
 }
 
@@ -233,8 +359,9 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
     /* mark the stream as send-finished;
      * next time the consumer thread tries to read this stream it will get
      * an EOF and recv-finished flag will be set */
-    tq->finished[stream_idx] |= FINISHED_SEND;
-    tq->choked = 0;
+    atomic_fetch_or(&tq->finished[stream_idx], FINISHED_SEND);
+    atomic_store(&tq->choked, 0);
+    atomic_fetch_add(&tq->state_gen, 1);
     pthread_cond_broadcast(&tq->cond);
 
     pthread_mutex_unlock(&tq->lock);
@@ -249,7 +376,8 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
     /* mark the stream as recv-finished;
      * next time the producer thread tries to send for this stream, it will
      * get an EOF and send-finished flag will be set */
-    tq->finished[stream_idx] |= FINISHED_RECV;
+    atomic_fetch_or(&tq->finished[stream_idx], FINISHED_RECV);
+    atomic_fetch_add(&tq->state_gen, 1);
     pthread_cond_broadcast(&tq->cond);
 
     pthread_mutex_unlock(&tq->lock);
@@ -259,10 +387,24 @@ void tq_choke(ThreadQueue *tq, int choked)
 {
     pthread_mutex_lock(&tq->lock);
 
-    int prev_choked = tq->choked;
-    tq->choked = choked;
-    if (choked != prev_choked)
+    int prev_choked = atomic_load(&tq->choked);
+    atomic_store(&tq->choked, choked);
+    if (choked != prev_choked) {
+        atomic_fetch_add(&tq->state_gen, 1);
         pthread_cond_broadcast(&tq->cond);
+    }
 
     pthread_mutex_unlock(&tq->lock);
 }
+
+size_t tq_fill(ThreadQueue *tq, size_t *capacity)
+{
+    uintptr_t rpos = atomic_load_explicit(&tq->read_pos,  memory_order_relaxed);
+    uintptr_t wpos = atomic_load_explicit(&tq->write_pos, memory_order_relaxed);
+
+    if (capacity)
+        *capacity = tq->capacity;
+
+    // write_pos counts slots claimed by senders that may still be filling them
+    return FFMIN(wpos - rpos, tq->capacity);
+}
@@ -87,4 +87,13 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data);
  */
 void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx);
 
+/**
+ * Get the current fill level of the queue. May be called from any thread
+ * without blocking senders or the receiver, so the value is only a snapshot.
+ *
+ * @param capacity if non-NULL, receives the maximum number of queued items
+ * @return the number of items currently queued
+ */
+size_t tq_fill(ThreadQueue *tq, size_t *capacity);
+
 #endif // FFTOOLS_THREAD_QUEUE_H
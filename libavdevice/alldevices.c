@@ -38,6 +38,8 @@ extern const FFOutputFormat ff_decklink_muxer;
 extern const FFInputFormat  ff_dshow_demuxer;
 extern const FFInputFormat  ff_fbdev_demuxer;
 extern const FFOutputFormat ff_fbdev_muxer;
+extern const FFInputFormat  ff_framebus_demuxer;
+extern const FFOutputFormat ff_framebus_muxer;
 extern const FFInputFormat  ff_gdigrab_demuxer;
 extern const FFInputFormat  ff_iec61883_demuxer;
 extern const FFInputFormat  ff_jack_demuxer;
@@ -0,0 +1,151 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/time.h"
+
+#include "framebus_common.h"
+
+int ff_framebus_shm_name(void *logctx, const char *url, char *name, size_t size)
+{
+    av_strstart(url, "framebus:", &url);
+    if (*url == '/')
+        url++;
+
+    if (!*url || strchr(url, '/')) {
+        av_log(logctx, AV_LOG_ERROR, "Invalid frame bus name '%s'.\n", url);
+        return AVERROR(EINVAL);
+    }
+
+    if (snprintf(name, size, "/ffmpeg-framebus-%s", url) >= size) {
+        av_log(logctx, AV_LOG_ERROR, "Frame bus name '%s' is too long.\n", url);
+        return AVERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+int ff_framebus_reclaim_readers(FrameBusHeader *hdr, FrameBusWatch *watch)
+{
+    int64_t now = av_gettime_relative();
+    int nb = 0;
+
+    for (int i = 0; i < FRAMEBUS_MAX_READERS; i++) {
+        FrameBusReader *reader = &hdr->readers[i];
+        unsigned id = atomic_load(&reader->id);
+        unsigned heartbeat;
+
+        if (!id || id == FRAMEBUS_READER_RECLAIMING) {
+            watch->changed[i] = 0;
+            continue;
+        }
+        heartbeat = atomic_load(&reader->heartbeat);
+
+        if (!watch->changed[i] || watch->id[i] != id ||
+            watch->heartbeat[i] != heartbeat) {
+            watch->id[i]        = id;
+            watch->heartbeat[i] = heartbeat;
+            watch->changed[i]   = now;
+            continue;
+        }
+        if (now - watch->changed[i] < hdr->timeout)
+            continue;
+
+        /* a single process reclaims the entry, before it can be reused */
+        if (!atomic_compare_exchange_strong(&reader->id, &id,
+                                            FRAMEBUS_READER_RECLAIMING))
+            continue;
+
+        for (unsigned j = 0; j < hdr->nb_slots; j++)
+            atomic_fetch_and(&ff_framebus_slot(hdr, j)->refs, ~(1U << i));
+        atomic_store(&reader->id, 0);
+        watch->changed[i] = 0;
+        nb++;
+    }
+
+    return nb;
+}
+
+static void *heartbeat_thread(void *arg)
+{
+    FrameBusHeartbeat *hb = arg;
+
+    pthread_mutex_lock(&hb->lock);
+    while (!hb->stop) {
+        int64_t t = av_gettime() + hb->interval;
+        struct timespec tv = { .tv_sec  =  t / 1000000,
+                               .tv_nsec = (t % 1000000) * 1000 };
+
+        if (!hb->id || atomic_load(hb->id) == hb->own_id)
+            atomic_fetch_add(hb->counter, 1);
+        pthread_cond_timedwait(&hb->cond, &hb->lock, &tv);
+    }
+    pthread_mutex_unlock(&hb->lock);
+
+    return NULL;
+}
+
+int ff_framebus_heartbeat_start(FrameBusHeartbeat *hb, atomic_uint *counter,
+                                atomic_uint *id, unsigned own_id,
+                                int64_t interval)
+{
+    int ret;
+
+    hb->counter  = counter;
+    hb->id       = id;
+    hb->own_id   = own_id;
+    hb->interval = interval;
+    hb->stop     = 0;
+
+    if ((ret = pthread_mutex_init(&hb->lock, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&hb->cond, NULL))) {
+        pthread_mutex_destroy(&hb->lock);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_create(&hb->thread, NULL, heartbeat_thread, hb))) {
+        pthread_cond_destroy(&hb->cond);
+        pthread_mutex_destroy(&hb->lock);
+        return AVERROR(ret);
+    }
+    hb->started = 1;
+
+    return 0;
+}
+
+void ff_framebus_heartbeat_stop(FrameBusHeartbeat *hb)
+{
+    if (!hb->started)
+        return;
+
+    pthread_mutex_lock(&hb->lock);
+    hb->stop = 1;
+    pthread_cond_signal(&hb->cond);
+    pthread_mutex_unlock(&hb->lock);
+
+    pthread_join(hb->thread, NULL);
+    pthread_cond_destroy(&hb->cond);
+    pthread_mutex_destroy(&hb->lock);
+    hb->started = 0;
+}
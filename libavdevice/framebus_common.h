@@ -0,0 +1,203 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVDEVICE_FRAMEBUS_COMMON_H
+#define AVDEVICE_FRAMEBUS_COMMON_H
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libavutil/macros.h"
+#include "libavutil/thread.h"
+
+/*
+ * Layout of the shared memory segment of a frame bus, created by the
+ * framebus output device and mapped by up to FRAMEBUS_MAX_READERS framebus
+ * input devices:
+ *
+ * - a FrameBusHeader,
+ * - nb_slots FrameBusSlot descriptors,
+ * - nb_slots frame data buffers of frame_size bytes each,
+ *
+ * each of them aligned on FRAMEBUS_ALIGN bytes. Frame data is stored packed,
+ * as produced by av_image_copy_to_buffer() with an alignment of 1.
+ *
+ * The publisher numbers the frames it stores from 0. A slot holding frame n
+ * has seq set to n + 1; seq is 0 while the slot is being written. Consumers
+ * reference the slot data directly in their packets, and set their bit in
+ * the refs mask of the slot while they do: the publisher never reuses a
+ * referenced slot.
+ *
+ * Each consumer registers in an entry of the reader table, whose index is
+ * its bit in the refs masks, with an id unique to the bus. While it is
+ * registered, a thread of the consumer increments the heartbeat of its entry
+ * several times per timeout, and the publisher does the same with the
+ * heartbeat of the header. Process ids are not used, as they are not
+ * meaningful across PID namespaces. The references of a consumer whose
+ * heartbeat stopped for longer than the timeout are released by the next
+ * process that needs a slot or a reader entry, see
+ * ff_framebus_reclaim_readers().
+ */
+
+#define FRAMEBUS_MAGIC   MKTAG('F', 'B', 'U', 'S')
+#define FRAMEBUS_VERSION 3
+#define FRAMEBUS_ALIGN   64
+#define FRAMEBUS_MAX_READERS 32
+/* bounds of the timeout, in microseconds */
+#define FRAMEBUS_MIN_TIMEOUT 100000
+#define FRAMEBUS_MAX_TIMEOUT 60000000
+/* number of heartbeats per timeout */
+#define FRAMEBUS_HEARTBEATS  4
+/* id of a reader entry being reclaimed */
+#define FRAMEBUS_READER_RECLAIMING UINT_MAX
+
+typedef struct FrameBusReader {
+    /* id of the reader, 0 if the entry is free,
+     * FRAMEBUS_READER_RECLAIMING while the entry of a dead reader is
+     * being reclaimed */
+    atomic_uint id;
+    /* incremented by the reader while it is alive */
+    atomic_uint heartbeat;
+} FrameBusReader;
+
+typedef struct FrameBusHeader {
+    uint32_t    magic;
+    uint32_t    version;
+
+    uint32_t    nb_slots;
+    uint32_t    frame_size;
+
+    int32_t     width;
+    int32_t     height;
+    int32_t     format;
+    int32_t     time_base_num,  time_base_den;
+    int32_t     frame_rate_num, frame_rate_den;
+    int32_t     sar_num,        sar_den;
+
+    /* time in microseconds after which a process whose heartbeat did not
+     * change is considered dead */
+    int64_t     timeout;
+
+    /* incremented by the publisher while it is alive */
+    atomic_uint heartbeat;
+    /* last id given to a reader */
+    atomic_uint reader_id;
+
+    /* number of frames published so far */
+    atomic_uint nb_frames;
+    /* set when the publisher is done */
+    atomic_int  eof;
+
+    FrameBusReader readers[FRAMEBUS_MAX_READERS];
+} FrameBusHeader;
+
+typedef struct FrameBusSlot {
+    /* number of the frame stored in the slot plus one, 0 if none */
+    atomic_uint seq;
+    /* mask of the readers referencing the slot data */
+    atomic_uint refs;
+
+    int64_t     pts;
+    int64_t     duration;
+} FrameBusSlot;
+
+static inline size_t ff_framebus_slots_offset(void)
+{
+    return FFALIGN(sizeof(FrameBusHeader), FRAMEBUS_ALIGN);
+}
+
+static inline size_t ff_framebus_data_offset(unsigned nb_slots)
+{
+    return ff_framebus_slots_offset() +
+           FFALIGN(nb_slots * sizeof(FrameBusSlot), FRAMEBUS_ALIGN);
+}
+
+static inline size_t ff_framebus_size(unsigned nb_slots, size_t frame_size)
+{
+    return ff_framebus_data_offset(nb_slots) +
+           nb_slots * FFALIGN(frame_size, FRAMEBUS_ALIGN);
+}
+
+static inline FrameBusSlot *ff_framebus_slot(FrameBusHeader *hdr, unsigned idx)
+{
+    return (FrameBusSlot*)((uint8_t*)hdr + ff_framebus_slots_offset()) + idx;
+}
+
+static inline uint8_t *ff_framebus_slot_data(FrameBusHeader *hdr, unsigned idx)
+{
+    return (uint8_t*)hdr + ff_framebus_data_offset(hdr->nb_slots) +
+           idx * FFALIGN((size_t)hdr->frame_size, FRAMEBUS_ALIGN);
+}
+
+/**
+ * Build the name of the shared memory object of the bus called url.
+ */
+int ff_framebus_shm_name(void *logctx, const char *url, char *name, size_t size);
+
+/**
+ * State of the heartbeats of the readers, as last seen by a process.
+ */
+typedef struct FrameBusWatch {
+    unsigned id[FRAMEBUS_MAX_READERS];
+    unsigned heartbeat[FRAMEBUS_MAX_READERS];
+    /* time the heartbeat was last seen changing, 0 if never */
+    int64_t  changed[FRAMEBUS_MAX_READERS];
+} FrameBusWatch;
+
+/**
+ * Release the slot references of the readers whose heartbeat did not change
+ * for longer than the timeout of the bus, and free their entries. The
+ * heartbeats are compared to the ones seen by the previous calls with the
+ * same watch, so a dead reader is only reclaimed by a call made more than
+ * the timeout after the first call that saw its current heartbeat.
+ *
+ * @return number of readers reclaimed
+ */
+int ff_framebus_reclaim_readers(FrameBusHeader *hdr, FrameBusWatch *watch);
+
+/**
+ * Thread incrementing a heartbeat counter in the bus.
+ */
+typedef struct FrameBusHeartbeat {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int stop;
+
+    atomic_uint *counter;
+    /* if not NULL, only increment the counter while *id is own_id */
+    atomic_uint *id;
+    unsigned     own_id;
+    int64_t      interval;
+} FrameBusHeartbeat;
+
+/**
+ * Start incrementing counter every interval microseconds, until
+ * ff_framebus_heartbeat_stop() is called. If id is not NULL, counter is
+ * only incremented while *id is own_id.
+ */
+int ff_framebus_heartbeat_start(FrameBusHeartbeat *hb, atomic_uint *counter,
+                                atomic_uint *id, unsigned own_id,
+                                int64_t interval);
+
+void ff_framebus_heartbeat_stop(FrameBusHeartbeat *hb);
+
+#endif /* AVDEVICE_FRAMEBUS_COMMON_H */
@@ -0,0 +1,374 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Frame bus input device: reads the raw video frames published to a shared
+ * memory ring by the framebus output device of another process. Packets
+ * reference the shared memory directly, without copying the frame data.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/time.h"
+#include "libavformat/demux.h"
+#include "libavformat/internal.h"
+#include "avdevice.h"
+#include "framebus_common.h"
+
+typedef struct FrameBusContext {
+    AVClass *class;
+    int poll_interval;           ///< polling interval in microseconds
+
+    FrameBusHeader *hdr;
+    AVBufferRef *map;            ///< owns the mapping, referenced by packets
+    int reader;                  ///< reader entry
+    unsigned id;                 ///< reader id
+    unsigned ref_mask;           ///< bit of the reader in the slot refs masks
+    unsigned next;               ///< number of the next frame to read
+    int64_t nb_lost;
+} FrameBusContext;
+
+typedef struct FrameBusMapping {
+    size_t size;
+    int    reader;               ///< reader entry, -1 if not registered
+    unsigned id;
+    FrameBusHeartbeat heartbeat;
+} FrameBusMapping;
+
+typedef struct FrameBusPacket {
+    AVBufferRef  *map;
+    FrameBusSlot *slot;
+    int           reader;
+    unsigned      id;
+} FrameBusPacket;
+
+static void unmap_bus(void *opaque, uint8_t *data)
+{
+    FrameBusMapping *m = opaque;
+    FrameBusHeader *hdr = (FrameBusHeader*)data;
+
+    /* no packet references a slot anymore */
+    ff_framebus_heartbeat_stop(&m->heartbeat);
+    if (m->reader >= 0)
+        atomic_compare_exchange_strong(&hdr->readers[m->reader].id, &m->id, 0);
+    munmap(data, m->size);
+    av_free(m);
+}
+
+static void release_slot(void *opaque, uint8_t *data)
+{
+    FrameBusPacket *p = opaque;
+    FrameBusHeader *hdr = (FrameBusHeader*)p->map->data;
+
+    /* the entry may have been reclaimed and reused if the reader was
+     * considered dead */
+    if (atomic_load(&hdr->readers[p->reader].id) == p->id)
+        atomic_fetch_and(&p->slot->refs, ~(1U << p->reader));
+    av_buffer_unref(&p->map);
+    av_free(p);
+}
+
+/* register as a reader of the bus, waiting for the entries of dead readers
+ * to be reclaimed if all of them are in use */
+static int add_reader(FrameBusHeader *hdr, unsigned *rid)
+{
+    int64_t timeout = av_clip64(hdr->timeout, FRAMEBUS_MIN_TIMEOUT, FRAMEBUS_MAX_TIMEOUT);
+    int64_t start = av_gettime_relative();
+    FrameBusWatch watch = { 0 };
+    unsigned id;
+
+    do {
+        id = atomic_fetch_add(&hdr->reader_id, 1) + 1;
+    } while (!id || id == FRAMEBUS_READER_RECLAIMING);
+
+    while (1) {
+        for (int i = 0; i < FRAMEBUS_MAX_READERS; i++) {
+            unsigned free_id = 0;
+
+            if (atomic_compare_exchange_strong(&hdr->readers[i].id, &free_id, id)) {
+                *rid = id;
+                return i;
+            }
+        }
+        if (ff_framebus_reclaim_readers(hdr, &watch))
+            continue;
+        /* leave the time to a dead reader to be detected */
+        if (av_gettime_relative() - start > 2 * timeout)
+            return AVERROR(EBUSY);
+        av_usleep(timeout / FRAMEBUS_HEARTBEATS);
+    }
+}
+
+static av_cold int framebus_read_header(AVFormatContext *s)
+{
+    FrameBusContext *bus = s->priv_data;
+    FrameBusHeader *hdr;
+    FrameBusMapping *m;
+    AVStream *st;
+    struct stat sb;
+    char name[256];
+    unsigned nb_frames;
+    int ret, fd;
+
+    ret = ff_framebus_shm_name(s, s->url, name, sizeof(name));
+    if (ret < 0)
+        return ret;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Could not open frame bus '%s': %s\n",
+               name, av_err2str(ret));
+        return ret;
+    }
+
+    if (fstat(fd, &sb) < 0) {
+        ret = AVERROR(errno);
+        close(fd);
+        return ret;
+    }
+
+    if (sb.st_size < sizeof(*hdr)) {
+        av_log(s, AV_LOG_ERROR, "Frame bus '%s' is not initialized.\n", name);
+        close(fd);
+        return AVERROR(EAGAIN);
+    }
+
+    hdr = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Error in mmap(): %s\n", av_err2str(ret));
+        return ret;
+    }
+
+    m = av_mallocz(sizeof(*m));
+    if (m) {
+        m->size   = sb.st_size;
+        m->reader = -1;
+        bus->map  = av_buffer_create((uint8_t*)hdr, sb.st_size, unmap_bus, m, 0);
+    }
+    if (!bus->map) {
+        av_free(m);
+        munmap(hdr, sb.st_size);
+        return AVERROR(ENOMEM);
+    }
+    bus->hdr = hdr;
+
+    if (hdr->magic != FRAMEBUS_MAGIC) {
+        av_log(s, AV_LOG_ERROR, "Frame bus '%s' is not initialized.\n", name);
+        return AVERROR(EAGAIN);
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    if (hdr->version != FRAMEBUS_VERSION || !hdr->nb_slots ||
+        ff_framebus_size(hdr->nb_slots, hdr->frame_size) > sb.st_size) {
+        av_log(s, AV_LOG_ERROR, "Unsupported or invalid frame bus.\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (hdr->time_base_num <= 0 || hdr->time_base_den <= 0)
+        return AVERROR_INVALIDDATA;
+
+    ret = add_reader(hdr, &bus->id);
+    if (ret < 0) {
+        av_log(s, AV_LOG_ERROR, "Too many readers on frame bus '%s'.\n", name);
+        return ret;
+    }
+    m->reader     = ret;
+    m->id         = bus->id;
+    bus->reader   = ret;
+    bus->ref_mask = 1U << ret;
+
+    ret = ff_framebus_heartbeat_start(&m->heartbeat, &hdr->readers[m->reader].heartbeat,
+                                      &hdr->readers[m->reader].id, m->id,
+                                      av_clip64(hdr->timeout, FRAMEBUS_MIN_TIMEOUT,
+                                                FRAMEBUS_MAX_TIMEOUT) / FRAMEBUS_HEARTBEATS);
+    if (ret < 0)
+        return ret;
+
+    if (!(st = avformat_new_stream(s, NULL)))
+        return AVERROR(ENOMEM);
+    avpriv_set_pts_info(st, 64, hdr->time_base_num, hdr->time_base_den);
+
+    st->codecpar->codec_type          = AVMEDIA_TYPE_VIDEO;
+    st->codecpar->codec_id            = AV_CODEC_ID_RAWVIDEO;
+    st->codecpar->width               = hdr->width;
+    st->codecpar->height              = hdr->height;
+    st->codecpar->format              = hdr->format;
+    st->codecpar->sample_aspect_ratio = (AVRational){ hdr->sar_num, hdr->sar_den };
+    st->avg_frame_rate                = (AVRational){ hdr->frame_rate_num, hdr->frame_rate_den };
+    st->r_frame_rate                  = st->avg_frame_rate;
+
+    /* join the stream live, starting with the latest frame */
+    nb_frames = atomic_load(&hdr->nb_frames);
+    bus->next = nb_frames ? nb_frames - 1 : 0;
+
+    av_log(s, AV_LOG_VERBOSE, "Reading %dx%d %s frames from '%s' (%u slots)\n",
+           hdr->width, hdr->height, av_get_pix_fmt_name(hdr->format),
+           name, hdr->nb_slots);
+
+    return 0;
+}
+
+/* take a reference to the slot holding frame n, if it is still available */
+static FrameBusSlot *get_slot(FrameBusHeader *hdr, unsigned ref_mask,
+                              unsigned n, unsigned *idx)
+{
+    for (unsigned i = 0; i < hdr->nb_slots; i++) {
+        FrameBusSlot *slot = ff_framebus_slot(hdr, i);
+
+        if (atomic_load(&slot->seq) != n + 1)
+            continue;
+
+        atomic_fetch_or(&slot->refs, ref_mask);
+        if (atomic_load(&slot->seq) == n + 1) {
+            *idx = i;
+            return slot;
+        }
+        atomic_fetch_and(&slot->refs, ~ref_mask);
+    }
+
+    return NULL;
+}
+
+static int framebus_read_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    FrameBusContext *bus = s->priv_data;
+    FrameBusHeader *hdr = bus->hdr;
+    FrameBusPacket *p;
+    FrameBusSlot *slot;
+    unsigned idx, nb_frames;
+
+    while (1) {
+        if (atomic_load(&hdr->readers[bus->reader].id) != bus->id) {
+            av_log(s, AV_LOG_ERROR, "The reader was considered dead and "
+                   "removed from the frame bus.\n");
+            return AVERROR(EIO);
+        }
+
+        nb_frames = atomic_load(&hdr->nb_frames);
+
+        if (nb_frames == bus->next) {
+            /* frames published before EOF was set must still be read */
+            if (atomic_load(&hdr->eof) &&
+                atomic_load(&hdr->nb_frames) == bus->next)
+                return AVERROR_EOF;
+            if (s->flags & AVFMT_FLAG_NONBLOCK)
+                return AVERROR(EAGAIN);
+            av_usleep(bus->poll_interval);
+            continue;
+        }
+
+        if (nb_frames - bus->next > hdr->nb_slots) {
+            bus->nb_lost += nb_frames - bus->next - hdr->nb_slots;
+            bus->next     = nb_frames - hdr->nb_slots;
+        }
+
+        slot = get_slot(hdr, bus->ref_mask, bus->next, &idx);
+        if (slot)
+            break;
+
+        /* overwritten before we could read it */
+        bus->nb_lost++;
+        bus->next++;
+    }
+
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        goto fail;
+    p->slot     = slot;
+    p->reader   = bus->reader;
+    p->id       = bus->id;
+    p->map      = av_buffer_ref(bus->map);
+    if (!p->map)
+        goto fail;
+
+    pkt->buf = av_buffer_create(ff_framebus_slot_data(hdr, idx), hdr->frame_size,
+                                release_slot, p, AV_BUFFER_FLAG_READONLY);
+    if (!pkt->buf)
+        goto fail;
+
+    pkt->data     = pkt->buf->data;
+    pkt->size     = hdr->frame_size;
+    pkt->pts      = slot->pts;
+    pkt->dts      = slot->pts;
+    pkt->duration = slot->duration;
+    pkt->flags   |= AV_PKT_FLAG_KEY;
+
+    bus->next++;
+
+    return 0;
+fail:
+    if (p)
+        av_buffer_unref(&p->map);
+    av_free(p);
+    atomic_fetch_and(&slot->refs, ~bus->ref_mask);
+    return AVERROR(ENOMEM);
+}
+
+static av_cold int framebus_read_close(AVFormatContext *s)
+{
+    FrameBusContext *bus = s->priv_data;
+
+    if (bus->nb_lost)
+        av_log(s, AV_LOG_WARNING, "%"PRId64" frames were overwritten before "
+               "they could be read\n", bus->nb_lost);
+
+    /* the mapping stays alive as long as packets reference it */
+    av_buffer_unref(&bus->map);
+    bus->hdr = NULL;
+
+    return 0;
+}
+
+#define OFFSET(x) offsetof(FrameBusContext, x)
+#define DEC AV_OPT_FLAG_DECODING_PARAM
+static const AVOption options[] = {
+    { "poll_interval", "polling interval for new frames in microseconds", OFFSET(poll_interval), AV_OPT_TYPE_INT, {.i64 = 1000}, 1, 1000000, DEC },
+    { NULL },
+};
+
+static const AVClass framebus_class = {
+    .class_name = "framebus indev",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+    .category   = AV_CLASS_CATEGORY_DEVICE_VIDEO_INPUT,
+};
+
+const FFInputFormat ff_framebus_demuxer = {
+    .p.name         = "framebus",
+    .p.long_name    = NULL_IF_CONFIG_SMALL("Shared memory frame bus"),
+    .p.flags        = AVFMT_NOFILE,
+    .p.priv_class   = &framebus_class,
+    .priv_data_size = sizeof(FrameBusContext),
+    .read_header    = framebus_read_header,
+    .read_packet    = framebus_read_packet,
+    .read_close     = framebus_read_close,
+    .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP,
+};
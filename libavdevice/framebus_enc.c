@@ -0,0 +1,362 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Frame bus output device: publishes raw video frames to a shared memory
+ * ring, from which several local processes can read them with the
+ * framebus input device, without decoding the source again.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/log.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/time.h"
+#include "libavformat/avformat.h"
+#include "libavformat/mux.h"
+#include "avdevice.h"
+#include "framebus_common.h"
+
+typedef struct FrameBusContext {
+    AVClass *class;
+    int nb_slots;                ///< number of frames in the ring
+    int64_t timeout;             ///< time after which a silent process is dead
+
+    char name[256];              ///< shared memory object name
+    FrameBusHeader *hdr;         ///< mapped segment
+    size_t map_size;
+    unsigned next_slot;          ///< first slot to try for the next frame
+    unsigned nb_frames;          ///< number of frames published
+    int64_t nb_dropped;
+
+    FrameBusWatch watch;         ///< heartbeats of the readers
+    FrameBusHeartbeat heartbeat; ///< heartbeat of the publisher
+} FrameBusContext;
+
+/**
+ * Check whether the existing bus called name is left over by a publisher
+ * that is not running anymore, by watching its heartbeat for the timeout
+ * of the bus.
+ *
+ * @return 0 if the publisher is dead, AVERROR(EEXIST) if it is running or
+ *         its state cannot be checked
+ */
+static int check_publisher(AVFormatContext *s, const char *name)
+{
+    FrameBusHeader *hdr;
+    struct stat sb;
+    int64_t timeout, start;
+    unsigned heartbeat;
+    int ret = AVERROR(EEXIST), fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return errno == ENOENT ? 0 : AVERROR(errno);
+    if (fstat(fd, &sb) < 0 || sb.st_size < sizeof(*hdr)) {
+        close(fd);
+        goto invalid;
+    }
+    hdr = mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED)
+        goto invalid;
+
+    if (hdr->magic != FRAMEBUS_MAGIC || hdr->version != FRAMEBUS_VERSION) {
+        munmap(hdr, sizeof(*hdr));
+        goto invalid;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    timeout   = av_clip64(hdr->timeout, FRAMEBUS_MIN_TIMEOUT, FRAMEBUS_MAX_TIMEOUT);
+    heartbeat = atomic_load(&hdr->heartbeat);
+    start     = av_gettime_relative();
+    while (!atomic_load(&hdr->eof) &&
+           atomic_load(&hdr->heartbeat) == heartbeat) {
+        if (av_gettime_relative() - start >= timeout) {
+            ret = 0;
+            break;
+        }
+        av_usleep(timeout / 16);
+    }
+    if (atomic_load(&hdr->eof))
+        ret = 0;
+    munmap(hdr, sizeof(*hdr));
+
+    if (ret < 0)
+        av_log(s, AV_LOG_ERROR, "Frame bus '%s' is in use by another "
+               "publisher.\n", name);
+    else
+        av_log(s, AV_LOG_WARNING, "Replacing frame bus '%s' left over by a "
+               "publisher that is not running anymore.\n", name);
+    return ret;
+invalid:
+    av_log(s, AV_LOG_ERROR, "Frame bus '%s' already exists and its publisher "
+           "cannot be checked; remove it if it is not in use.\n", name);
+    return AVERROR(EEXIST);
+}
+
+static av_cold int framebus_write_header(AVFormatContext *s)
+{
+    FrameBusContext *bus = s->priv_data;
+    AVStream *st;
+    AVCodecParameters *par;
+    FrameBusHeader *hdr;
+    int ret, fd, frame_size;
+
+    if (s->nb_streams != 1 || s->streams[0]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+        av_log(s, AV_LOG_ERROR, "Only a single video stream is supported.\n");
+        return AVERROR(EINVAL);
+    }
+    st  = s->streams[0];
+    par = st->codecpar;
+
+    if (par->codec_id != AV_CODEC_ID_RAWVIDEO &&
+        par->codec_id != AV_CODEC_ID_WRAPPED_AVFRAME) {
+        av_log(s, AV_LOG_ERROR, "Only rawvideo and wrapped_avframe are supported.\n");
+        return AVERROR(EINVAL);
+    }
+
+    frame_size = av_image_get_buffer_size(par->format, par->width, par->height, 1);
+    if (frame_size < 0)
+        return frame_size;
+
+    ret = ff_framebus_shm_name(s, s->url, bus->name, sizeof(bus->name));
+    if (ret < 0)
+        return ret;
+
+    fd = shm_open(bus->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        /* only replace a segment left over by a publisher that did not exit
+         * cleanly */
+        ret = check_publisher(s, bus->name);
+        if (ret < 0)
+            return ret;
+        shm_unlink(bus->name);
+        fd = shm_open(bus->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd < 0) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Could not create frame bus '%s': %s\n",
+               bus->name, av_err2str(ret));
+        return ret;
+    }
+
+    bus->map_size = ff_framebus_size(bus->nb_slots, frame_size);
+    if (ftruncate(fd, bus->map_size) < 0) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Could not size frame bus: %s\n", av_err2str(ret));
+        close(fd);
+        goto fail;
+    }
+
+    hdr = mmap(NULL, bus->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Error in mmap(): %s\n", av_err2str(ret));
+        goto fail;
+    }
+    bus->hdr = hdr;
+
+    hdr->version        = FRAMEBUS_VERSION;
+    hdr->nb_slots       = bus->nb_slots;
+    hdr->frame_size     = frame_size;
+    hdr->width          = par->width;
+    hdr->height         = par->height;
+    hdr->format         = par->format;
+    hdr->time_base_num  = st->time_base.num;
+    hdr->time_base_den  = st->time_base.den;
+    hdr->frame_rate_num = st->avg_frame_rate.num;
+    hdr->frame_rate_den = st->avg_frame_rate.den;
+    hdr->sar_num        = par->sample_aspect_ratio.num;
+    hdr->sar_den        = par->sample_aspect_ratio.den;
+    hdr->timeout        = bus->timeout;
+    atomic_init(&hdr->heartbeat, 0);
+    atomic_init(&hdr->reader_id, 0);
+    atomic_init(&hdr->nb_frames, 0);
+    atomic_init(&hdr->eof, 0);
+    for (int i = 0; i < FRAMEBUS_MAX_READERS; i++) {
+        atomic_init(&hdr->readers[i].id, 0);
+        atomic_init(&hdr->readers[i].heartbeat, 0);
+    }
+    for (int i = 0; i < bus->nb_slots; i++) {
+        FrameBusSlot *slot = ff_framebus_slot(hdr, i);
+        atomic_init(&slot->seq, 0);
+        atomic_init(&slot->refs, 0);
+    }
+
+    /* readers check the magic before anything else */
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = FRAMEBUS_MAGIC;
+
+    ret = ff_framebus_heartbeat_start(&bus->heartbeat, &hdr->heartbeat, NULL, 0,
+                                      bus->timeout / FRAMEBUS_HEARTBEATS);
+    if (ret < 0)
+        goto fail;
+
+    av_log(s, AV_LOG_VERBOSE, "Publishing %dx%d %s frames to '%s' (%d slots)\n",
+           par->width, par->height, av_get_pix_fmt_name(par->format),
+           bus->name, bus->nb_slots);
+
+    return 0;
+fail:
+    shm_unlink(bus->name);
+    return ret;
+}
+
+static FrameBusSlot *get_free_slot(FrameBusContext *bus, unsigned *idx)
+{
+    for (unsigned i = 0; i < bus->nb_slots; i++) {
+        unsigned n = (bus->next_slot + i) % bus->nb_slots;
+        FrameBusSlot *slot = ff_framebus_slot(bus->hdr, n);
+        unsigned seq;
+
+        if (atomic_load(&slot->refs))
+            continue;
+
+        /* invalidate the slot, then make sure no reader took a reference
+         * in the meantime; readers check seq after taking one */
+        seq = atomic_exchange(&slot->seq, 0);
+        if (atomic_load(&slot->refs)) {
+            atomic_store(&slot->seq, seq);
+            continue;
+        }
+
+        bus->next_slot = (n + 1) % bus->nb_slots;
+        *idx = n;
+        return slot;
+    }
+
+    return NULL;
+}
+
+static int framebus_write_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    FrameBusContext *bus = s->priv_data;
+    AVCodecParameters *par = s->streams[0]->codecpar;
+    FrameBusHeader *hdr = bus->hdr;
+    FrameBusSlot *slot;
+    uint8_t *dst;
+    unsigned idx;
+    int ret;
+
+    if (par->codec_id == AV_CODEC_ID_WRAPPED_AVFRAME) {
+        const AVFrame *frame = (const AVFrame*)pkt->data;
+
+        if (frame->width != hdr->width || frame->height != hdr->height ||
+            frame->format != hdr->format) {
+            av_log(s, AV_LOG_ERROR, "Frame parameters changed, this is not supported.\n");
+            return AVERROR(EINVAL);
+        }
+    } else if (pkt->size != hdr->frame_size) {
+        av_log(s, AV_LOG_ERROR, "Invalid packet size %d, expected %u.\n",
+               pkt->size, hdr->frame_size);
+        return AVERROR(EINVAL);
+    }
+
+    slot = get_free_slot(bus, &idx);
+    /* the slots may be held by readers that died */
+    if (!slot && ff_framebus_reclaim_readers(hdr, &bus->watch))
+        slot = get_free_slot(bus, &idx);
+    if (!slot) {
+        /* never stall the publisher on slow readers */
+        if (!bus->nb_dropped++)
+            av_log(s, AV_LOG_WARNING, "All frame bus slots are in use by readers, "
+                   "dropping frames.\n");
+        return 0;
+    }
+
+    dst = ff_framebus_slot_data(hdr, idx);
+    if (par->codec_id == AV_CODEC_ID_WRAPPED_AVFRAME) {
+        const AVFrame *frame = (const AVFrame*)pkt->data;
+
+        ret = av_image_copy_to_buffer(dst, hdr->frame_size,
+                                      (const uint8_t * const *)frame->data,
+                                      frame->linesize, frame->format,
+                                      frame->width, frame->height, 1);
+        if (ret < 0)
+            return ret;
+    } else
+        memcpy(dst, pkt->data, pkt->size);
+
+    slot->pts      = pkt->pts;
+    slot->duration = pkt->duration;
+
+    atomic_store(&slot->seq, bus->nb_frames + 1);
+    atomic_store(&hdr->nb_frames, ++bus->nb_frames);
+
+    return 0;
+}
+
+static void framebus_deinit(AVFormatContext *s)
+{
+    FrameBusContext *bus = s->priv_data;
+
+    if (!bus->hdr)
+        return;
+
+    ff_framebus_heartbeat_stop(&bus->heartbeat);
+
+    /* unlink first: a new publisher seeing eof may replace the bus at once;
+     * readers still attached keep their mapping */
+    shm_unlink(bus->name);
+    atomic_store(&bus->hdr->eof, 1);
+    munmap(bus->hdr, bus->map_size);
+    bus->hdr = NULL;
+
+    if (bus->nb_dropped)
+        av_log(s, AV_LOG_WARNING, "%"PRId64" frames dropped because all "
+               "slots were in use\n", bus->nb_dropped);
+}
+
+#define OFFSET(x) offsetof(FrameBusContext, x)
+#define ENC AV_OPT_FLAG_ENCODING_PARAM
+static const AVOption options[] = {
+    { "slots", "number of frames in the ring", OFFSET(nb_slots), AV_OPT_TYPE_INT, {.i64 = 8}, 2, 1024, ENC },
+    { "timeout", "time after which a reader or publisher that stopped running is considered dead", OFFSET(timeout), AV_OPT_TYPE_DURATION, {.i64 = 2000000}, FRAMEBUS_MIN_TIMEOUT, FRAMEBUS_MAX_TIMEOUT, ENC },
+    { NULL }
+};
+
+static const AVClass framebus_class = {
+    .class_name = "framebus outdev",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+    .category   = AV_CLASS_CATEGORY_DEVICE_VIDEO_OUTPUT,
+};
+
+const FFOutputFormat ff_framebus_muxer = {
+    .p.name         = "framebus",
+    .p.long_name    = NULL_IF_CONFIG_SMALL("Shared memory frame bus"),
+    .priv_data_size = sizeof(FrameBusContext),
+    .p.audio_codec  = AV_CODEC_ID_NONE,
+    .p.video_codec  = AV_CODEC_ID_WRAPPED_AVFRAME,
+    .write_header   = framebus_write_header,
+    .write_packet   = framebus_write_packet,
+    .deinit         = framebus_deinit,
+    .p.flags        = AVFMT_NOFILE | AVFMT_VARIABLE_FPS,
+    .p.priv_class   = &framebus_class,
+};
@@ -0,0 +1,241 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the liveness checks of a frame bus:
+ * - a publisher may only replace the bus of a publisher that died, and must
+ *   fail while the other one is running,
+ * - the slots referenced by a reader that died are reclaimed: a child
+ *   process reads frames and exits while its packets still reference all the
+ *   slots, then the publisher must still be able to publish once the timeout
+ *   expired.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "libavformat/avformat.h"
+#include "libavdevice/avdevice.h"
+#include "libavdevice/framebus_common.h"
+
+#define WIDTH  16
+#define HEIGHT 16
+#define SLOTS  2
+#define TIMEOUT 300000
+
+static char bus_name[64];
+
+static AVFormatContext *open_publisher(int *err)
+{
+    AVFormatContext *oc = NULL;
+    AVDictionary *opts = NULL;
+    AVStream *st;
+
+    *err = avformat_alloc_output_context2(&oc, NULL, "framebus", bus_name);
+    if (*err < 0)
+        return NULL;
+    st = avformat_new_stream(oc, NULL);
+    if (!st) {
+        *err = AVERROR(ENOMEM);
+        goto fail;
+    }
+    st->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    st->codecpar->codec_id   = AV_CODEC_ID_RAWVIDEO;
+    st->codecpar->format     = AV_PIX_FMT_GRAY8;
+    st->codecpar->width      = WIDTH;
+    st->codecpar->height     = HEIGHT;
+    st->time_base            = (AVRational){ 1, 25 };
+
+    av_dict_set_int(&opts, "slots", SLOTS, 0);
+    av_dict_set(&opts, "timeout", AV_STRINGIFY(TIMEOUT) "us", 0);
+    if ((*err = avformat_write_header(oc, &opts)) < 0) {
+        av_dict_free(&opts);
+        goto fail;
+    }
+    av_dict_free(&opts);
+    return oc;
+fail:
+    avformat_free_context(oc);
+    return NULL;
+}
+
+static int publish(AVFormatContext *oc, int n)
+{
+    static int64_t pts;
+    uint8_t data[WIDTH * HEIGHT];
+    AVPacket *pkt = av_packet_alloc();
+    int ret = 0;
+
+    if (!pkt)
+        return AVERROR(ENOMEM);
+    memset(data, 0x80, sizeof(data));
+    for (int i = 0; i < n && ret >= 0; i++) {
+        pkt->data         = data;
+        pkt->size         = sizeof(data);
+        pkt->pts          =
+        pkt->dts          = pts++;
+        pkt->stream_index = 0;
+        ret = av_write_frame(oc, pkt);
+    }
+    av_packet_free(&pkt);
+    return ret;
+}
+
+/* read frames while the publisher publishes them, and die holding them */
+static void reader(int to_parent, int from_parent)
+{
+    const AVInputFormat *fmt = av_find_input_format("framebus");
+    AVFormatContext *ic = NULL;
+    AVPacket *pkt[SLOTS];
+    char c = 0;
+
+    if (avformat_open_input(&ic, bus_name, fmt, NULL) < 0)
+        _exit(1);
+    for (int i = 0; i < SLOTS; i++) {
+        pkt[i] = av_packet_alloc();
+        if (!pkt[i] || av_read_frame(ic, pkt[i]) < 0)
+            _exit(1);
+        // let the publisher publish the next frame
+        if (write(to_parent, &c, 1) != 1 || read(from_parent, &c, 1) != 1)
+            _exit(1);
+    }
+    _exit(0);
+}
+
+/* number of frames published and number of slots referenced */
+static void print_bus(const char *what)
+{
+    char name[256];
+    FrameBusHeader *hdr;
+    struct stat sb;
+    int fd, refs = 0;
+
+    if (ff_framebus_shm_name(NULL, bus_name, name, sizeof(name)) < 0 ||
+        (fd = shm_open(name, O_RDONLY, 0)) < 0)
+        return;
+    if (fstat(fd, &sb) < 0 ||
+        (hdr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    close(fd);
+    for (int i = 0; i < hdr->nb_slots; i++)
+        refs += !!atomic_load(&ff_framebus_slot(hdr, i)->refs);
+    printf("%s: %u frames published, %d slots referenced\n",
+           what, atomic_load(&hdr->nb_frames), refs);
+    munmap(hdr, sb.st_size);
+}
+
+/* publish a frame and die without closing the bus */
+static void dead_publisher(void)
+{
+    AVFormatContext *oc;
+    int err;
+
+    oc = open_publisher(&err);
+    _exit(!oc || publish(oc, 1) < 0);
+}
+
+int main(void)
+{
+    AVFormatContext *oc, *oc2;
+    int to_parent[2], from_parent[2];
+    int status, err, ret = 1;
+    pid_t pid;
+    char c = 0;
+
+    avdevice_register_all();
+    av_log_set_level(AV_LOG_ERROR);
+    snprintf(bus_name, sizeof(bus_name), "fate-framebus-%d", (int)getpid());
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0)
+        return 1;
+    if (!pid)
+        dead_publisher();
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        printf("dead publisher failed\n");
+        return 1;
+    }
+    print_bus("publisher died");
+
+    oc = open_publisher(&err);
+    if (!oc) {
+        printf("replacing the bus of a dead publisher failed: %s\n", av_err2str(err));
+        return 1;
+    }
+    print_bus("bus replaced");
+
+    oc2 = open_publisher(&err);
+    printf("second publisher: %s\n", oc2 ? "opened" :
+           err == AVERROR(EEXIST) ? "EEXIST" : av_err2str(err));
+    if (oc2) {
+        av_write_trailer(oc2);
+        avformat_free_context(oc2);
+        goto end;
+    }
+
+    if (publish(oc, 1) < 0 || pipe(to_parent) < 0 || pipe(from_parent) < 0)
+        goto end;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0)
+        goto end;
+    if (!pid)
+        reader(to_parent[1], from_parent[0]);
+
+    for (int i = 0; i < SLOTS; i++) {
+        if (read(to_parent[0], &c, 1) != 1 ||
+            (i + 1 < SLOTS && publish(oc, 1) < 0) ||
+            write(from_parent[1], &c, 1) != 1)
+            break;
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        printf("reader failed\n");
+        goto end;
+    }
+    print_bus("reader died");
+
+    /* the reader is only considered dead once its heartbeat was seen not
+     * changing for the timeout */
+    if (publish(oc, 1) < 0)
+        goto end;
+    print_bus("published 1 more frame");
+    av_usleep(2 * TIMEOUT);
+    if (publish(oc, 4) < 0)
+        goto end;
+    print_bus("published 4 more frames");
+
+    ret = 0;
+end:
+    av_write_trailer(oc);
+    avformat_free_context(oc);
+    return ret;
+}
@@ -43,6 +43,14 @@ AVFrame *ff_null_get_audio_buffer(AVFilterLink *link, int nb_samples)
     return ff_get_audio_buffer(link->dst->outputs[0], nb_samples);
 }
 
+static AVBufferRef *alloc_audio_buffer(void *opaque, size_t size)
+{
+    AVBufferRef *buf = av_buffer_alloc(size);
+    if (buf)
+        ff_filter_stats_add_alloc(opaque, size);
+    return buf;
+}
+
 AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
 {
     AVFrame *frame = NULL;
@@ -51,8 +59,9 @@ AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
     int align = av_cpu_max_align();
 
     if (!li->frame_pool) {
-        li->frame_pool = ff_frame_pool_audio_init(av_buffer_allocz, channels,
-                                                  nb_samples, link->format, align);
+        li->frame_pool = ff_frame_pool_audio_init(alloc_audio_buffer, link->src,
+                                                  channels, nb_samples,
+                                                  link->format, align);
         if (!li->frame_pool)
             return NULL;
     } else {
@@ -71,8 +80,9 @@ AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
             pool_format != link->format || pool_align != align) {
 
             ff_frame_pool_uninit(&li->frame_pool);
-            li->frame_pool = ff_frame_pool_audio_init(av_buffer_allocz, channels,
-                                                      nb_samples, link->format, align);
+            li->frame_pool = ff_frame_pool_audio_init(alloc_audio_buffer, link->src,
+                                                      channels, nb_samples,
+                                                      link->format, align);
             if (!li->frame_pool)
                 return NULL;
         }
@@ -19,6 +19,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <time.h>
+
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
@@ -34,6 +36,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/rational.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/time.h"
 
 #include "audio.h"
 #include "avfilter.h"
@@ -1105,6 +1108,7 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
     li->frame_blocked_in = li->frame_wanted_out = 0;
     li->l.frame_count_in++;
     li->l.sample_count_in += frame->nb_samples;
+    fffilterctx(link->src)->stats.frames_out++;
     filter_unblock(link->dst);
     ret = ff_framequeue_add(&li->fifo, frame);
     if (ret < 0) {
@@ -1443,22 +1447,113 @@ static int filter_activate_default(AVFilterContext *filter)
      input, so we need to do it for them.
  */
 
+static int64_t thread_cpu_time(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    return -1;
+}
+
+static int64_t queued_frames_in(AVFilterContext *filter)
+{
+    int64_t queued = 0;
+
+    for (unsigned i = 0; i < filter->nb_inputs; i++)
+        queued += ff_framequeue_queued_frames(&ff_link_internal(filter->inputs[i])->fifo);
+    return queued;
+}
+
 int ff_filter_activate(AVFilterContext *filter)
 {
     FFFilterContext *ctxi = fffilterctx(filter);
     const FFFilter *const fi = fffilter(filter->filter);
+    int collect_stats = filter->graph->collect_stats;
+    int64_t wall_start = 0, cpu_start = 0;
     int ret;
 
     /* Generic timeline support is not yet implemented but should be easy */
     av_assert1(!(fi->p.flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC &&
                  fi->activate));
     ctxi->ready = 0;
+
+    ctxi->stats.nb_activations++;
+    ctxi->stats.max_queued_frames = FFMAX(ctxi->stats.max_queued_frames,
+                                          queued_frames_in(filter));
+    if (collect_stats) {
+        wall_start = av_gettime_relative();
+        cpu_start  = thread_cpu_time();
+    }
+
     ret = fi->activate ? fi->activate(filter) : filter_activate_default(filter);
+
+    if (collect_stats) {
+        ctxi->stats.wall_time += av_gettime_relative() - wall_start;
+        if (cpu_start >= 0 && ctxi->stats.cpu_time >= 0)
+            ctxi->stats.cpu_time += thread_cpu_time() - cpu_start;
+        else
+            ctxi->stats.cpu_time = -1;
+    }
+
     if (ret == FFERROR_NOT_READY)
         ret = 0;
     return ret;
 }
 
+static int update_video_size(AVFilterLink *link, int width, int height,
+                             AVRational sar, int apply)
+{
+    AVFilterContext *dst = link->dst;
+    const FFFilter *f = fffilter(dst->filter);
+    int ret;
+
+    if (link->type != AVMEDIA_TYPE_VIDEO || ff_filter_link(link)->hw_frames_ctx)
+        return AVERROR(ENOSYS);
+
+    if (apply) {
+        link->w                   = width;
+        link->h                   = height;
+        link->sample_aspect_ratio = sar;
+    }
+
+    if (f->update_video_input)
+        return f->update_video_input(link, width, height, sar, apply);
+
+    if (!(f->flags_internal & FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC) ||
+        dst->nb_inputs != 1)
+        return AVERROR(ENOSYS);
+
+    for (unsigned i = 0; i < dst->nb_outputs; i++) {
+        ret = update_video_size(dst->outputs[i], width, height, sar, apply);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int ff_filter_link_update_video_size(AVFilterLink *link, int width, int height,
+                                     AVRational sample_aspect_ratio)
+{
+    int ret = update_video_size(link, width, height, sample_aspect_ratio, 0);
+    if (ret < 0)
+        return ret;
+    return update_video_size(link, width, height, sample_aspect_ratio, 1);
+}
+
+void ff_filter_stats_add_alloc(AVFilterContext *ctx, size_t size)
+{
+    fffilterctx(ctx)->stats.bytes_allocated += size;
+}
+
+const AVFilterStats *avfilter_get_stats(const AVFilterContext *ctx)
+{
+    return &((const FFFilterContext*)ctx)->stats;
+}
+
 int ff_inlink_acknowledge_status(AVFilterLink *link, int *rstatus, int64_t *rpts)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
@@ -1510,6 +1605,7 @@ static void consume_update(FilterLinkInternal *li, const AVFrame *frame)
         link->dst->is_disabled = !evaluate_timeline_at_frame(link, frame);
     li->l.frame_count_out++;
     li->l.sample_count_out += frame->nb_samples;
+    fffilterctx(link->dst)->stats.frames_in++;
 }
 
 int ff_inlink_consume_frame(AVFilterLink *link, AVFrame **rframe)
@@ -557,6 +557,60 @@ int avfilter_insert_filter(AVFilterLink *link, AVFilterContext *filt,
  */
 const AVClass *avfilter_get_class(void);
 
+/**
+ * Processing statistics of a filter instance, see avfilter_get_stats().
+ *
+ * sizeof(AVFilterStats) is not a part of the public ABI, new fields may be
+ * added to the end with a minor version bump.
+ */
+typedef struct AVFilterStats {
+    /**
+     * Number of times the filter was activated by the graph scheduler.
+     */
+    int64_t nb_activations;
+    /**
+     * Number of frames consumed on all the filter inputs.
+     */
+    int64_t frames_in;
+    /**
+     * Number of frames sent on all the filter outputs.
+     */
+    int64_t frames_out;
+    /**
+     * Time spent in the filter activation, in microseconds. Only collected
+     * when AVFilterGraph.collect_stats is set.
+     */
+    int64_t wall_time;
+    /**
+     * CPU time of the activating thread spent in the filter, in microseconds.
+     * Only collected when AVFilterGraph.collect_stats is set, -1 if not
+     * supported on this platform.
+     */
+    int64_t cpu_time;
+    /**
+     * Largest number of frames queued on the filter inputs seen when the
+     * filter was activated.
+     */
+    int64_t max_queued_frames;
+    /**
+     * Total size of the buffers newly allocated by libavfilter for the frame
+     * pools of the filter outputs, in bytes. Frames using buffers reused from
+     * the pools are not counted.
+     */
+    int64_t bytes_allocated;
+} AVFilterStats;
+
+/**
+ * Get the processing statistics of a filter.
+ *
+ * The statistics are updated by the thread running the filter graph, so this
+ * function must not be called concurrently with it.
+ *
+ * @return pointer to the statistics of the filter, valid until the filter is
+ *         freed
+ */
+const AVFilterStats *avfilter_get_stats(const AVFilterContext *ctx);
+
 /**
  * A function pointer passed to the @ref AVFilterGraph.execute callback to be
  * executed multiple times, possibly in parallel.
@@ -644,6 +698,12 @@ typedef struct AVFilterGraph {
      * avfilter_graph_config().
      */
     unsigned max_buffered_frames;
+
+    /**
+     * Collect the processing time of each filter, see avfilter_get_stats().
+     * The other statistics are always collected. May be set at any time.
+     */
+    int collect_stats;
 } AVFilterGraph;
 
 /**
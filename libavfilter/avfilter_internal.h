@@ -116,6 +116,11 @@ typedef struct FFFilterContext {
     double *var_values;
 
     struct AVFilterCommand *command_queue;
+
+    /**
+     * Processing statistics, see avfilter_get_stats().
+     */
+    AVFilterStats stats;
 } FFFilterContext;
 
 static inline FFFilterContext *fffilterctx(AVFilterContext *ctx)
@@ -123,6 +128,27 @@ static inline FFFilterContext *fffilterctx(AVFilterContext *ctx)
     return (FFFilterContext*)ctx;
 }
 
+/**
+ * Change the dimensions and sample aspect ratio of a configured video link
+ * and propagate the change downstream without reconfiguring the graph.
+ *
+ * The change goes through filters flagged FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC
+ * and stops at filters implementing FFFilter.update_video_input, which
+ * absorb it. Nothing is modified unless all the filters reached support the
+ * change.
+ *
+ * @return 0 on success, AVERROR(ENOSYS) if the graph must be reconfigured,
+ *         another negative error code on failure
+ */
+int ff_filter_link_update_video_size(AVFilterLink *link, int width, int height,
+                                     AVRational sample_aspect_ratio);
+
+/**
+ * Account a buffer newly allocated for the frame pool of an output of ctx
+ * in its statistics.
+ */
+void ff_filter_stats_add_alloc(AVFilterContext *ctx, size_t size);
+
 typedef struct AVFilterCommand {
     double time;                ///< time expressed in seconds
     char *command;              ///< command
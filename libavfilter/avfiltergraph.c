@@ -58,6 +58,8 @@ static const AVOption filtergraph_options[] = {
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, F|A },
     {"max_buffered_frames"  , "maximum number of buffered frames allowed", OFFSET(max_buffered_frames),
         AV_OPT_TYPE_UINT,   {.i64 = 0}, 0, UINT_MAX, F|V|A },
+    {"collect_stats"        , "collect per-filter processing time"  , OFFSET(collect_stats)         ,
+        AV_OPT_TYPE_BOOL,   {.i64 = 0}, 0, 1, F|V|A },
     { NULL },
 };
 
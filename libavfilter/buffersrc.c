@@ -181,6 +181,29 @@ int av_buffersrc_parameters_set(AVFilterContext *ctx, AVBufferSrcParameters *par
     return 0;
 }
 
+int av_buffersrc_update_video_size(AVFilterContext *ctx, int width, int height,
+                                   AVRational sample_aspect_ratio)
+{
+    BufferSourceContext *s = ctx->priv;
+    int ret;
+
+    if (ctx->outputs[0]->type != AVMEDIA_TYPE_VIDEO ||
+        ff_link_internal(ctx->outputs[0])->init_state != AVLINK_INIT ||
+        width <= 0 || height <= 0)
+        return AVERROR(EINVAL);
+
+    ret = ff_filter_link_update_video_size(ctx->outputs[0], width, height,
+                                           sample_aspect_ratio);
+    if (ret < 0)
+        return ret;
+
+    s->w = s->prev_w = width;
+    s->h = s->prev_h = height;
+    s->pixel_aspect  = sample_aspect_ratio;
+
+    return 0;
+}
+
 int attribute_align_arg av_buffersrc_write_frame(AVFilterContext *ctx, const AVFrame *frame)
 {
     return av_buffersrc_add_frame_flags(ctx, (AVFrame *)frame,
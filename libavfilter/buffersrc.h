@@ -151,6 +151,27 @@ AVBufferSrcParameters *av_buffersrc_parameters_alloc(void);
  */
 int av_buffersrc_parameters_set(AVFilterContext *ctx, AVBufferSrcParameters *param);
 
+/**
+ * Change the dimensions and sample aspect ratio of the frames sent to a
+ * configured video buffer source, without reconfiguring the filtergraph.
+ *
+ * This only succeeds if every filter the change reaches can handle it
+ * in place: filters that only pass frames through, and filters such as
+ * scale whose output properties do not depend on the input dimensions.
+ * On failure, nothing is changed and the caller is expected to reconfigure
+ * the graph as for any other change of the input parameters.
+ *
+ * @param ctx    an instance of the buffersrc filter, in a configured graph
+ * @param width  new frame width
+ * @param height new frame height
+ * @param sample_aspect_ratio new sample aspect ratio
+ * @return 0 on success, AVERROR(ENOSYS) if the change cannot be applied
+ *         without reconfiguring the graph, another negative AVERROR code
+ *         on failure
+ */
+int av_buffersrc_update_video_size(AVFilterContext *ctx, int width, int height,
+                                   AVRational sample_aspect_ratio);
+
 /**
  * Add a frame to the buffer source.
  *
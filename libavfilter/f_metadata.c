@@ -408,6 +408,7 @@ const FFFilter ff_vf_metadata = {
     .p.priv_class  = &metadata_class,
     .p.flags       = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC |
                      AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
     .priv_size   = sizeof(MetadataContext),
     .init        = init,
     .uninit      = uninit,
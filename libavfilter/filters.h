@@ -207,6 +207,15 @@ static inline FilterLink* ff_filter_link(AVFilterLink *link)
  */
 #define FF_FILTER_FLAG_HWFRAME_AWARE (1 << 0)
 
+/**
+ * The filter does not depend on the dimensions or sample aspect ratio of its
+ * single video input, and forwards frames with those properties unchanged to
+ * all its outputs. A change of these properties can then be propagated
+ * through it without reconfiguring the graph, see
+ * ff_filter_link_update_video_size().
+ */
+#define FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC (1 << 1)
+
 /**
  * Find the index of a link.
  *
@@ -446,6 +455,21 @@ typedef struct FFFilter {
      */
     int (*process_command)(AVFilterContext *, const char *cmd, const char *arg, char *res, int res_len, int flags);
 
+    /**
+     * Adapt the filter to new dimensions and sample aspect ratio of one of
+     * its configured video inputs, without changing any property of its
+     * outputs, see ff_filter_link_update_video_size().
+     *
+     * @param inlink the input whose properties change; when apply is set,
+     *               they have already been updated
+     * @param apply  if 0, only check whether the change can be handled
+     * @return 0 on success, AVERROR(ENOSYS) if the change would affect the
+     *         outputs or cannot be handled otherwise, another negative error
+     *         code on failure
+     */
+    int (*update_video_input)(AVFilterLink *inlink, int width, int height,
+                              AVRational sample_aspect_ratio, int apply);
+
     /**
      * Filter activation function.
      *
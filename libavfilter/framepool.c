@@ -49,7 +49,8 @@ struct FFFramePool {
 
 };
 
-FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(size_t size),
+FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(void *opaque, size_t size),
+                                      void *opaque,
                                       int width,
                                       int height,
                                       enum AVPixelFormat format,
@@ -100,7 +101,7 @@ FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(size_t size),
     for (i = 0; i < 4 && sizes[i]; i++) {
         if (sizes[i] > SIZE_MAX - align)
             goto fail;
-        pool->pools[i] = av_buffer_pool_init(sizes[i] + align, alloc);
+        pool->pools[i] = av_buffer_pool_init2(sizes[i] + align, opaque, alloc, NULL);
         if (!pool->pools[i])
             goto fail;
     }
@@ -112,7 +113,8 @@ fail:
     return NULL;
 }
 
-FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(size_t size),
+FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(void *opaque, size_t size),
+                                      void *opaque,
                                       int channels,
                                       int nb_samples,
                                       enum AVSampleFormat format,
@@ -141,7 +143,8 @@ FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(size_t size),
 
     if (pool->linesize[0] > SIZE_MAX - align)
         goto fail;
-    pool->pools[0] = av_buffer_pool_init(pool->linesize[0] + align, NULL);
+    pool->pools[0] = av_buffer_pool_init2(pool->linesize[0] + align, opaque,
+                                         alloc, NULL);
     if (!pool->pools[0])
         goto fail;
 
@@ -38,13 +38,15 @@ typedef struct FFFramePool FFFramePool;
  * @param alloc a function that will be used to allocate new frame buffers when
  * the pool is empty. May be NULL, then the default allocator will be used
  * (av_buffer_alloc()).
+ * @param opaque arbitrary user data passed to alloc
  * @param width width of each frame in this pool
  * @param height height of each frame in this pool
  * @param format format of each frame in this pool
  * @param align buffers alignment of each frame in this pool
  * @return newly created video frame pool on success, NULL on error.
  */
-FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(size_t size),
+FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(void *opaque, size_t size),
+                                      void *opaque,
                                       int width,
                                       int height,
                                       enum AVPixelFormat format,
@@ -56,13 +58,15 @@ FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(size_t size),
  * @param alloc a function that will be used to allocate new frame buffers when
  * the pool is empty. May be NULL, then the default allocator will be used
  * (av_buffer_alloc()).
+ * @param opaque arbitrary user data passed to alloc
  * @param channels channels of each frame in this pool
  * @param nb_samples number of samples of each frame in this pool
  * @param format format of each frame in this pool
  * @param align buffers alignment of each frame in this pool
  * @return newly created audio frame pool on success, NULL on error.
  */
-FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(size_t size),
+FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(void *opaque, size_t size),
+                                      void *opaque,
                                       int channels,
                                       int samples,
                                       enum AVSampleFormat format,
@@ -338,6 +338,7 @@ const FFFilter ff_vf_setpts = {
     .p.name          = "setpts",
     .p.description   = NULL_IF_CONFIG_SMALL("Set PTS for the output video frame."),
     .p.flags         = AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal  = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
 
     .p.priv_class    = &setpts_class,
 
@@ -177,6 +177,7 @@ const FFFilter ff_vf_settb = {
     .p.description = NULL_IF_CONFIG_SMALL("Set timebase for the video output link."),
     .p.priv_class  = &settb_class,
     .p.flags       = AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
     .priv_size   = sizeof(SetTBContext),
     FILTER_INPUTS(ff_video_default_filterpad),
     FILTER_OUTPUTS(avfilter_vf_settb_outputs),
@@ -129,6 +129,7 @@ const FFFilter ff_vf_split = {
     .p.description = NULL_IF_CONFIG_SMALL("Pass on the input to N video outputs."),
     .p.priv_class  = &split_class,
     .p.flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
     .priv_size   = sizeof(SplitContext),
     .init        = split_init,
     .activate    = activate,
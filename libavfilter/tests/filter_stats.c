@@ -0,0 +1,161 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of avfilter_get_stats(): frames are sent through a graph with a
+ * filter allocating its output frames and one passing them through, and the
+ * frame counts and allocated sizes reported for each filter are checked.
+ * The buffers of the output frame pool must only be counted when they are
+ * allocated, not when they are reused.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixfmt.h"
+
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+
+#define WIDTH  32
+#define HEIGHT 32
+
+static int nb_sent;
+
+static AVFilterGraph *create_graph(AVFilterContext **src, AVFilterContext **flip,
+                                   AVFilterContext **null, AVFilterContext **sink)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    char args[256];
+    int ret = AVERROR(ENOMEM);
+
+    if (!graph)
+        return NULL;
+    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=1/25:pixel_aspect=1/1",
+             WIDTH, HEIGHT, AV_PIX_FMT_GRAY8);
+    if ((ret = avfilter_graph_create_filter(src, avfilter_get_by_name("buffer"),
+                                            "src", args, NULL, graph)) < 0 ||
+        (ret = avfilter_graph_create_filter(flip, avfilter_get_by_name("hflip"),
+                                            "hflip", NULL, NULL, graph)) < 0 ||
+        (ret = avfilter_graph_create_filter(null, avfilter_get_by_name("null"),
+                                            "null", NULL, NULL, graph)) < 0 ||
+        (ret = avfilter_graph_create_filter(sink, avfilter_get_by_name("buffersink"),
+                                            "sink", NULL, NULL, graph)) < 0 ||
+        (ret = avfilter_link(*src, 0, *flip, 0)) < 0 ||
+        (ret = avfilter_link(*flip, 0, *null, 0)) < 0 ||
+        (ret = avfilter_link(*null, 0, *sink, 0)) < 0)
+        goto end;
+    ret = avfilter_graph_config(graph, NULL);
+
+end:
+    if (ret < 0)
+        avfilter_graph_free(&graph);
+    return graph;
+}
+
+static int send_frame(AVFilterContext *src)
+{
+    AVFrame *frame = av_frame_alloc();
+    int ret;
+
+    if (!frame)
+        return AVERROR(ENOMEM);
+    frame->format = AV_PIX_FMT_GRAY8;
+    frame->width  = WIDTH;
+    frame->height = HEIGHT;
+    frame->sample_aspect_ratio = (AVRational){ 1, 1 };
+    frame->pts    = nb_sent++;
+    ret = av_frame_get_buffer(frame, 0);
+    if (ret >= 0)
+        ret = av_buffersrc_add_frame(src, frame);
+    av_frame_free(&frame);
+    return ret;
+}
+
+static void print_stats(AVFilterContext *f)
+{
+    const AVFilterStats *st = avfilter_get_stats(f);
+
+    printf("%s: activated %s, %"PRId64" frames in, %"PRId64" frames out, %s\n",
+           f->name, st->nb_activations > 0 ? "yes" : "no",
+           st->frames_in, st->frames_out,
+           st->bytes_allocated ? "allocated" : "nothing allocated");
+}
+
+int main(void)
+{
+    AVFilterContext *src, *flip, *null, *sink;
+    AVFilterGraph *graph;
+    AVFrame *frames[2];
+    int64_t size;
+    int ret = 0;
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    graph = create_graph(&src, &flip, &null, &sink);
+    frames[0] = av_frame_alloc();
+    frames[1] = av_frame_alloc();
+    if (!graph || !frames[0] || !frames[1]) {
+        printf("creating the graph failed\n");
+        return 1;
+    }
+
+    // one frame at a time, reusing the buffer of the first one
+    for (int i = 0; i < 10 && ret >= 0; i++) {
+        if ((ret = send_frame(src)) >= 0 &&
+            (ret = av_buffersink_get_frame(sink, frames[0])) >= 0)
+            av_frame_unref(frames[0]);
+        if (!i) {
+            size = avfilter_get_stats(flip)->bytes_allocated;
+            printf("first frame: %s\n", size >= WIDTH * HEIGHT ?
+                   "buffer allocated" : "allocated size too small");
+        }
+    }
+    printf("10 frames one at a time: %s\n",
+           avfilter_get_stats(flip)->bytes_allocated == size ?
+           "buffer reused" : "allocated size changed");
+
+    // two frames kept at the same time need a second buffer
+    for (int i = 0; i < 2 && ret >= 0; i++)
+        ret = send_frame(src);
+    for (int i = 0; i < 2 && ret >= 0; i++)
+        ret = av_buffersink_get_frame(sink, frames[i]);
+    printf("2 frames kept: %s\n",
+           avfilter_get_stats(flip)->bytes_allocated == 2 * size ?
+           "second buffer allocated" : "wrong allocated size");
+    av_frame_free(&frames[0]);
+    av_frame_free(&frames[1]);
+
+    if (ret >= 0)
+        ret = av_buffersrc_close(src, nb_sent, 0);
+    if (ret < 0)
+        printf("filtering failed: %s\n", av_err2str(ret));
+
+    print_stats(src);
+    print_stats(flip);
+    print_stats(null);
+    print_stats(sink);
+
+    avfilter_graph_free(&graph);
+    return ret < 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of av_buffersrc_update_video_size(): the size of the frames sent to
+ * a configured graph changes mid-stream, and the frames coming out of it
+ * must be scaled from the new size, without the side data that was only
+ * valid for the old one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixfmt.h"
+#include "libavutil/spherical.h"
+
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+
+static int nb_sent;
+
+static AVFilterGraph *create_graph(const char *filters, AVFilterContext **src,
+                                   AVFilterContext **sink)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
+    AVFilterContext *scale;
+    AVFrameSideData **sd = NULL;
+    int nb_sd = 0, ret = AVERROR(ENOMEM);
+
+    if (!graph || !par)
+        goto end;
+    *src  = avfilter_graph_alloc_filter(graph, avfilter_get_by_name("buffer"), "src");
+    *sink = avfilter_graph_alloc_filter(graph, avfilter_get_by_name("buffersink"), "sink");
+    if (!*src || !*sink)
+        goto end;
+
+    // side data that is only valid for one frame size
+    if (!av_frame_side_data_new(&sd, &nb_sd, AV_FRAME_DATA_SPHERICAL,
+                                sizeof(AVSphericalMapping), 0))
+        goto end;
+    par->format              = AV_PIX_FMT_GRAY8;
+    par->width               = 32;
+    par->height              = 32;
+    par->sample_aspect_ratio = (AVRational){ 1, 1 };
+    par->time_base           = (AVRational){ 1, 25 };
+    par->side_data           = sd;
+    par->nb_side_data        = nb_sd;
+    if ((ret = av_buffersrc_parameters_set(*src, par)) < 0 ||
+        (ret = avfilter_init_str(*src, NULL)) < 0 ||
+        (ret = avfilter_init_str(*sink, NULL)) < 0 ||
+        (ret = avfilter_graph_create_filter(&scale, avfilter_get_by_name("scale"),
+                                            "scale", filters, NULL, graph)) < 0 ||
+        (ret = avfilter_link(*src, 0, scale, 0)) < 0 ||
+        (ret = avfilter_link(scale, 0, *sink, 0)) < 0)
+        goto end;
+    ret = avfilter_graph_config(graph, NULL);
+
+end:
+    av_frame_side_data_free(&sd, &nb_sd);
+    av_free(par);
+    if (ret < 0)
+        avfilter_graph_free(&graph);
+    return graph;
+}
+
+static int send_frame(AVFilterContext *src, int width, int height, int value)
+{
+    AVFrame *frame = av_frame_alloc();
+    int ret;
+
+    if (!frame)
+        return AVERROR(ENOMEM);
+    frame->format = AV_PIX_FMT_GRAY8;
+    frame->width  = width;
+    frame->height = height;
+    frame->sample_aspect_ratio = (AVRational){ 1, 1 };
+    frame->pts    = nb_sent++;
+    ret = av_frame_get_buffer(frame, 0);
+    for (int y = 0; ret >= 0 && y < height; y++)
+        memset(frame->data[0] + y * frame->linesize[0], value, width);
+    if (ret >= 0)
+        ret = av_buffersrc_add_frame(src, frame);
+    av_frame_free(&frame);
+    return ret;
+}
+
+static void print_output(AVFilterContext *sink)
+{
+    AVFrame *frame = av_frame_alloc();
+    int nb_sd;
+
+    while (frame && av_buffersink_get_frame(sink, frame) >= 0) {
+        const uint8_t *data = frame->data[0];
+        int uniform = 1;
+
+        for (int y = 0; y < frame->height; y++)
+            for (int x = 0; x < frame->width; x++)
+                uniform &= data[y * frame->linesize[0] + x] == data[0];
+        printf("frame %"PRId64": %dx%d, value %d%s\n", frame->pts,
+               frame->width, frame->height, data[0], uniform ? "" : ", not uniform");
+        av_frame_unref(frame);
+    }
+    av_frame_free(&frame);
+
+    av_buffersink_get_side_data(sink, &nb_sd);
+    printf("output side data: %d\n", nb_sd);
+}
+
+int main(void)
+{
+    AVFilterContext *src, *sink;
+    AVFilterGraph *graph;
+    int ret;
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    graph = create_graph("w=32:h=32:flags=bilinear+bitexact", &src, &sink);
+    if (!graph) {
+        printf("creating the graph failed\n");
+        return 1;
+    }
+    send_frame(src, 32, 32, 100);
+    send_frame(src, 32, 32, 110);
+    print_output(sink);
+
+    ret = av_buffersrc_update_video_size(src, 24, 24, (AVRational){ 1, 1 });
+    printf("update to 24x24: %s\n", av_err2str(ret));
+    send_frame(src, 24, 24, 120);
+    send_frame(src, 24, 24, 130);
+    print_output(sink);
+
+    ret = av_buffersrc_update_video_size(src, 16, 16, (AVRational){ 1, 1 });
+    printf("update to 16x16: %s\n", av_err2str(ret));
+    send_frame(src, 16, 16, 140);
+    print_output(sink);
+    avfilter_graph_free(&graph);
+
+    // the output size depends on the input one
+    graph = create_graph("w=iw/2:h=ih/2", &src, &sink);
+    if (!graph) {
+        printf("creating the graph failed\n");
+        return 1;
+    }
+    ret = av_buffersrc_update_video_size(src, 24, 24, (AVRational){ 1, 1 });
+    printf("update to 24x24 with a size depending on the input: %s\n",
+           ret == AVERROR(ENOSYS) ? "ENOSYS" : av_err2str(ret));
+    avfilter_graph_free(&graph);
+
+    return 0;
+}
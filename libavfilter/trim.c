@@ -353,6 +353,7 @@ const FFFilter ff_vf_trim = {
     .p.description = NULL_IF_CONFIG_SMALL("Pick one continuous section from the input, drop the rest."),
     .p.priv_class  = &trim_class,
     .p.flags       = AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
     .init        = init,
     .activate    = activate,
     .priv_size   = sizeof(TrimContext),
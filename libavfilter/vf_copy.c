@@ -73,6 +73,7 @@ const FFFilter ff_vf_copy = {
     .p.name        = "copy",
     .p.description = NULL_IF_CONFIG_SMALL("Copy the input video unchanged to the output."),
     .p.flags       = AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
     FILTER_INPUTS(avfilter_vf_copy_inputs),
     FILTER_OUTPUTS(ff_video_default_filterpad),
     FILTER_QUERY_FUNC2(query_formats),
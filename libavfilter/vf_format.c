@@ -206,6 +206,7 @@ const FFFilter ff_vf_format = {
     .p.priv_class  = &format_class,
 
     .p.flags       = AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
 
     .init          = init,
     .uninit        = uninit,
@@ -226,6 +227,7 @@ const FFFilter ff_vf_noformat = {
     .p.priv_class  = &format_class,
 
     .p.flags       = AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
 
     .init          = init,
     .uninit        = uninit,
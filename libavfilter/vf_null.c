@@ -30,6 +30,7 @@ const FFFilter ff_vf_null = {
     .p.name        = "null",
     .p.description = NULL_IF_CONFIG_SMALL("Pass the source unchanged to the output."),
     .p.flags       = AVFILTER_FLAG_METADATA_ONLY,
+    .flags_internal = FF_FILTER_FLAG_FRAME_SIZE_AGNOSTIC,
     FILTER_INPUTS(ff_video_default_filterpad),
     FILTER_OUTPUTS(ff_video_default_filterpad),
 };
@@ -174,6 +174,7 @@ typedef struct ScaleContext {
 
     int eval_mode;              ///< expression evaluation mode
 
+    int input_changed;          ///< input properties changed by update_video_input()
 } ScaleContext;
 
 const FFFilter ff_vf_scale2ref;
@@ -712,6 +713,52 @@ fail:
     return ret;
 }
 
+static int update_video_input(AVFilterLink *inlink, int width, int height,
+                              AVRational sar, int apply)
+{
+    AVFilterContext *ctx = inlink->dst;
+    ScaleContext *scale = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    unsigned vars_w[VARS_NB] = { 0 }, vars_h[VARS_NB] = { 0 };
+    AVRational out_sar;
+
+    /* reconfigure for the new input on the next frame */
+    if (apply) {
+        scale->input_changed = 1;
+        return 0;
+    }
+
+    /* The output dimensions must not depend on the input ones */
+    if (IS_SCALE2REF(ctx) || scale->uses_ref ||
+        scale->force_original_aspect_ratio ||
+        scale->w <= 0 || scale->h <= 0)
+        return AVERROR(ENOSYS);
+
+    av_expr_count_vars(scale->w_pexpr, vars_w, VARS_NB);
+    av_expr_count_vars(scale->h_pexpr, vars_h, VARS_NB);
+    if (vars_w[VAR_IN_W] || vars_h[VAR_IN_W] ||
+        vars_w[VAR_IW]   || vars_h[VAR_IW]   ||
+        vars_w[VAR_IN_H] || vars_h[VAR_IN_H] ||
+        vars_w[VAR_IH]   || vars_h[VAR_IH]   ||
+        vars_w[VAR_A]    || vars_h[VAR_A]    ||
+        vars_w[VAR_SAR]  || vars_h[VAR_SAR]  ||
+        vars_w[VAR_DAR]  || vars_h[VAR_DAR])
+        return AVERROR(ENOSYS);
+
+    if (scale->reset_sar)
+        return 0;
+
+    /* Neither may the output sample aspect ratio */
+    if (sar.num)
+        out_sar = av_mul_q((AVRational){ outlink->h * width, outlink->w * height }, sar);
+    else
+        out_sar = sar;
+    if (av_cmp_q(out_sar, outlink->sample_aspect_ratio))
+        return AVERROR(ENOSYS);
+
+    return 0;
+}
+
 static int config_props_ref(AVFilterLink *outlink)
 {
     AVFilterLink *inlink = outlink->src->inputs[1];
@@ -754,7 +801,8 @@ static int scale_frame(AVFilterLink *link, AVFrame **frame_in,
 
     *frame_in = NULL;
 
-    frame_changed = in->width  != link->w ||
+    frame_changed = scale->input_changed ||
+                    in->width  != link->w ||
                     in->height != link->h ||
                     in->format != link->format ||
                     in->sample_aspect_ratio.den != link->sample_aspect_ratio.den ||
@@ -810,6 +858,7 @@ static int scale_frame(AVFilterLink *link, AVFrame **frame_in,
 
         if ((ret = config_props(outlink)) < 0)
             goto err;
+        scale->input_changed = 0;
     }
 
 scale:
@@ -1201,6 +1250,7 @@ const FFFilter ff_vf_scale = {
     FILTER_QUERY_FUNC2(query_formats),
     .activate        = activate,
     .process_command = process_command,
+    .update_video_input = update_video_input,
 };
 
 static const AVClass *scale2ref_child_class_iterate(void **iter)
@@ -46,6 +46,15 @@ AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h)
     return ff_get_video_buffer(link->dst->outputs[0], w, h);
 }
 
+static AVBufferRef *alloc_video_buffer(void *opaque, size_t size)
+{
+    AVBufferRef *buf = CONFIG_MEMORY_POISONING ? av_buffer_alloc(size)
+                                               : av_buffer_allocz(size);
+    if (buf)
+        ff_filter_stats_add_alloc(opaque, size);
+    return buf;
+}
+
 AVFrame *ff_default_get_video_buffer2(AVFilterLink *link, int w, int h, int align)
 {
     FilterLinkInternal *const li = ff_link_internal(link);
@@ -71,9 +80,7 @@ AVFrame *ff_default_get_video_buffer2(AVFilterLink *link, int w, int h, int alig
     }
 
     if (!li->frame_pool) {
-        li->frame_pool = ff_frame_pool_video_init(CONFIG_MEMORY_POISONING
-                                                     ? NULL
-                                                     : av_buffer_allocz,
+        li->frame_pool = ff_frame_pool_video_init(alloc_video_buffer, link->src,
                                                   w, h, link->format, align);
         if (!li->frame_pool)
             return NULL;
@@ -89,9 +96,7 @@ AVFrame *ff_default_get_video_buffer2(AVFilterLink *link, int w, int h, int alig
             pool_format != link->format || pool_align != align) {
 
             ff_frame_pool_uninit(&li->frame_pool);
-            li->frame_pool = ff_frame_pool_video_init(CONFIG_MEMORY_POISONING
-                                                         ? NULL
-                                                         : av_buffer_allocz,
+            li->frame_pool = ff_frame_pool_video_init(alloc_video_buffer, link->src,
                                                       w, h, link->format, align);
             if (!li->frame_pool)
                 return NULL;
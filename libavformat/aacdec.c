@@ -211,7 +211,7 @@ const FFInputFormat ff_aac_demuxer = {
     .p.flags      = AVFMT_GENERIC_INDEX,
     .p.extensions = "aac",
     .p.mime_type  = "audio/aac,audio/aacp,audio/x-aac",
-    .flags_internal = FF_INFMT_FLAG_ID3V2_AUTO,
+    .flags_internal = FF_INFMT_FLAG_ID3V2_AUTO | FF_INFMT_FLAG_COMPACT_INDEX,
     .read_probe   = adts_aac_probe,
     .read_header  = adts_aac_read_header,
     .read_packet  = adts_aac_read_packet,
@@ -116,6 +116,7 @@ const FFInputFormat ff_ac3_demuxer = {
     .read_packet    = ff_raw_read_partial_packet,
     .raw_codec_id   = AV_CODEC_ID_AC3,
     .priv_data_size = sizeof(FFRawDemuxerContext),
+    .flags_internal = FF_INFMT_FLAG_COMPACT_INDEX,
 };
 #endif
 
@@ -136,5 +137,6 @@ const FFInputFormat ff_eac3_demuxer = {
     .read_packet    = ff_raw_read_partial_packet,
     .raw_codec_id   = AV_CODEC_ID_EAC3,
     .priv_data_size = sizeof(FFRawDemuxerContext),
+    .flags_internal = FF_INFMT_FLAG_COMPACT_INDEX,
 };
 #endif
@@ -34,6 +34,7 @@
 #include "libavutil/log.h"
 #include "libavutil/opt.h"
 #include "libavutil/thread.h"
+#include "libavutil/time.h"
 #include "url.h"
 #include <stdint.h>
 
@@ -44,10 +45,16 @@
 #define BUFFER_CAPACITY         (4 * 1024 * 1024)
 #define READ_BACK_CAPACITY      (4 * 1024 * 1024)
 #define SHORT_SEEK_THRESHOLD    (256 * 1024)
+/* period over which the consumption rate is measured */
+#define RATE_WINDOW             1000000
+/* number of consecutive rate windows the target must stay below the size of
+ * the fifo before it is reallocated smaller */
+#define SHRINK_WINDOWS          4
 
 typedef struct RingBuffer
 {
     AVFifo       *fifo;
+    int           capacity;
     int           read_back_capacity;
 
     int           read_pos;
@@ -78,6 +85,37 @@ typedef struct AsyncContext {
 
     int             abort_request;
     AVIOInterruptCB interrupt_callback;
+
+    /* buffer capacity requested by the reading side */
+    int             target_capacity;
+    /* the reader is waiting for the first data after opening or seeking */
+    int             filling;
+    int64_t         rate_start;
+    int64_t         rate_bytes;
+    int             window_underrun;
+    /* the buffer was full, a larger one would have prevented an underrun */
+    int             buffer_full;
+    /* rate windows since the target went below the size of the fifo */
+    int             shrink_windows;
+    /* reallocate the fifo to the target once the buffered data fits */
+    int             shrink;
+    /* time spent and bytes read in the inner protocol */
+    int64_t         io_time;
+    int64_t         io_bytes;
+
+    /* options */
+    int             min_buffer_size;
+    int             max_buffer_size;
+    int64_t         buffer_duration;
+    int             read_back_size;
+    int             short_seek_size;
+
+    /* exported buffer health */
+    int64_t         buffer_level;
+    int64_t         buffer_capacity;
+    int64_t         bitrate;
+    int64_t         throughput;
+    int64_t         underruns;
 } AsyncContext;
 
 static int ring_init(RingBuffer *ring, unsigned int capacity, int read_back_capacity)
@@ -87,10 +125,53 @@ static int ring_init(RingBuffer *ring, unsigned int capacity, int read_back_capa
     if (!ring->fifo)
         return AVERROR(ENOMEM);
 
+    ring->capacity           = capacity;
     ring->read_back_capacity = read_back_capacity;
     return 0;
 }
 
+static size_t ring_allocated(RingBuffer *ring)
+{
+    return av_fifo_can_read(ring->fifo) + av_fifo_can_write(ring->fifo);
+}
+
+static int fifo_write_cb(void *opaque, void *buf, size_t *nb_elems)
+{
+    return av_fifo_write(opaque, buf, *nb_elems);
+}
+
+/* The fifo grows to the capacity right away. A smaller capacity leaves part
+ * of it unused, unless shrink is set: it is then reallocated once the
+ * buffered data fits. Returns 1 if the fifo was reallocated smaller. */
+static int ring_resize(RingBuffer *ring, int capacity, int shrink)
+{
+    size_t size   = ring_allocated(ring);
+    size_t needed = (size_t)capacity + ring->read_back_capacity;
+    size_t nb     = av_fifo_can_read(ring->fifo);
+    int ret = 0;
+
+    if (needed > size) {
+        ret = av_fifo_grow2(ring->fifo, needed - size);
+        if (ret < 0)
+            return ret;
+    } else if (shrink && needed < size && nb <= needed) {
+        AVFifo *fifo = av_fifo_alloc2(needed, 1, 0);
+        if (!fifo)
+            return AVERROR(ENOMEM);
+        ret = av_fifo_read_to_cb(ring->fifo, fifo_write_cb, fifo, &nb);
+        if (ret < 0) {
+            av_fifo_freep2(&fifo);
+            return ret;
+        }
+        av_fifo_freep2(&ring->fifo);
+        ring->fifo = fifo;
+        ret = 1;
+    }
+
+    ring->capacity = capacity;
+    return ret;
+}
+
 static void ring_destroy(RingBuffer *ring)
 {
     av_fifo_freep2(&ring->fifo);
@@ -109,7 +190,8 @@ static int ring_size(RingBuffer *ring)
 
 static int ring_space(RingBuffer *ring)
 {
-    return av_fifo_can_write(ring->fifo);
+    int space = ring->capacity + ring->read_back_capacity - (int)av_fifo_can_read(ring->fifo);
+    return FFMIN(space, (int)av_fifo_can_write(ring->fifo));
 }
 
 static int ring_read(RingBuffer *ring, void *dest, int buf_size)
@@ -181,13 +263,41 @@ static int async_check_interrupt(void *arg)
     return c->abort_request;
 }
 
+/* Apply the target set by the reading side. Called with the mutex held. */
+static void resize_buffer(void *logctx, AsyncContext *c)
+{
+    RingBuffer *ring = &c->ring;
+    int capacity = ring->capacity;
+    int ret;
+
+    if (c->target_capacity == ring->capacity && !c->shrink)
+        return;
+
+    ret = ring_resize(ring, c->target_capacity, c->shrink);
+    if (ret < 0) {
+        av_log(logctx, AV_LOG_WARNING, "Failed to resize buffer to %d bytes\n",
+               c->target_capacity);
+        c->target_capacity = ring->capacity;
+        return;
+    }
+    if (ret > 0) {
+        av_log(logctx, AV_LOG_DEBUG, "Buffer reallocated to %zu bytes\n",
+               ring_allocated(ring));
+        c->shrink         = 0;
+        c->shrink_windows = 0;
+    }
+    if (ring->capacity != capacity)
+        av_log(logctx, AV_LOG_DEBUG, "Buffer capacity set to %d bytes\n",
+               ring->capacity);
+}
+
 static void *async_buffer_task(void *arg)
 {
     URLContext   *h    = arg;
     AsyncContext *c    = h->priv_data;
     RingBuffer   *ring = &c->ring;
     int           ret  = 0;
-    int64_t       seek_ret;
+    int64_t       seek_ret, io_start;
 
     ff_thread_setname("async");
 
@@ -208,6 +318,8 @@ static void *async_buffer_task(void *arg)
             if (seek_ret >= 0) {
                 c->io_eof_reached = 0;
                 c->io_error       = 0;
+                c->filling        = 1;
+                c->buffer_full    = 0;
                 ring_reset(ring);
             }
 
@@ -221,7 +333,11 @@ static void *async_buffer_task(void *arg)
             continue;
         }
 
+        resize_buffer(h, c);
+
         fifo_space = ring_space(ring);
+        if (!c->io_eof_reached && fifo_space <= 0)
+            c->buffer_full = 1;
         if (c->io_eof_reached || fifo_space <= 0) {
             pthread_cond_signal(&c->cond_wakeup_main);
             pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
@@ -231,9 +347,13 @@ static void *async_buffer_task(void *arg)
         pthread_mutex_unlock(&c->mutex);
 
         to_copy = FFMIN(4096, fifo_space);
+        io_start = av_gettime_relative();
         ret = ring_write(ring, h, to_copy);
 
         pthread_mutex_lock(&c->mutex);
+        c->io_time += av_gettime_relative() - io_start;
+        if (ret > 0)
+            c->io_bytes += ret;
         if (ret <= 0) {
             c->io_eof_reached = 1;
             if (c->inner_io_error < 0)
@@ -255,7 +375,14 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "async:", &arg);
 
-    ret = ring_init(&c->ring, BUFFER_CAPACITY, READ_BACK_CAPACITY);
+    if (c->min_buffer_size > c->max_buffer_size) {
+        av_log(h, AV_LOG_ERROR, "min_buffer_size is larger than max_buffer_size\n");
+        return AVERROR(EINVAL);
+    }
+    c->target_capacity = av_clip(BUFFER_CAPACITY, c->min_buffer_size, c->max_buffer_size);
+    c->filling         = 1;
+
+    ret = ring_init(&c->ring, c->target_capacity, c->read_back_size);
     if (ret < 0)
         goto fifo_fail;
 
@@ -328,6 +455,10 @@ static int async_close(URLContext *h)
     if (ret != 0)
         av_log(h, AV_LOG_ERROR, "pthread_join(): %s\n", av_err2str(ret));
 
+    av_log(h, AV_LOG_VERBOSE, "Statistics, underruns:%"PRId64" buffer capacity:%d "
+           "bitrate:%"PRId64" throughput:%"PRId64"\n",
+           c->underruns, c->ring.capacity, c->bitrate, c->throughput);
+
     pthread_cond_destroy(&c->cond_wakeup_background);
     pthread_cond_destroy(&c->cond_wakeup_main);
     pthread_mutex_destroy(&c->mutex);
@@ -337,6 +468,54 @@ static int async_close(URLContext *h)
     return 0;
 }
 
+/* Size the buffer to hold buffer_duration of data at the rate it is read,
+ * and grow it when the reader has to wait for data after it was full, as
+ * the data is then consumed in bursts. The fifo is reallocated smaller when
+ * the target stayed below 3/4 of its size for SHRINK_WINDOWS rate windows.
+ * Called with the mutex held. */
+static void update_buffer_target(AsyncContext *c, int64_t now, int consumed,
+                                 int underrun)
+{
+    int64_t target = c->target_capacity;
+
+    if (!c->rate_start)
+        c->rate_start = now;
+    c->rate_bytes += consumed;
+    c->window_underrun |= underrun;
+
+    if (now - c->rate_start >= RATE_WINDOW) {
+        int64_t rate = av_rescale(c->rate_bytes, 8 * 1000000, now - c->rate_start);
+
+        c->bitrate    = c->bitrate ? (3 * c->bitrate + rate) / 4 : rate;
+        if (c->buffer_duration)
+            target = av_rescale(c->bitrate, c->buffer_duration, 8 * 1000000);
+        // do not shrink the buffer right after running out of data
+        if (c->window_underrun)
+            target = FFMAX(target, c->target_capacity);
+        c->rate_start      = now;
+        c->rate_bytes      = 0;
+        c->window_underrun = 0;
+
+        // ignore small differences, not worth a reallocation
+        if (4 * (av_clip64(target, c->min_buffer_size, c->max_buffer_size) +
+                 c->ring.read_back_capacity) < 3 * ring_allocated(&c->ring))
+            c->shrink_windows++;
+        else
+            c->shrink_windows = 0;
+        c->shrink = c->shrink_windows >= SHRINK_WINDOWS;
+    }
+    if (underrun && c->buffer_full) {
+        target = FFMAX(target, 2 * (int64_t)c->ring.capacity);
+        c->buffer_full = 0;
+    }
+
+    c->target_capacity = av_clip64(target, c->min_buffer_size, c->max_buffer_size);
+    if (c->io_time > 0)
+        c->throughput = av_rescale(c->io_bytes, 8 * 1000000, c->io_time);
+    c->buffer_level    = ring_size(&c->ring);
+    c->buffer_capacity = c->ring.capacity;
+}
+
 static int async_read_internal(URLContext *h, void *dest, int size)
 {
     AsyncContext *c       = h->priv_data;
@@ -344,6 +523,7 @@ static int async_read_internal(URLContext *h, void *dest, int size)
     int     read_complete = !dest;
     int           to_read = size;
     int           ret     = 0;
+    int           underrun = 0;
 
     pthread_mutex_lock(&c->mutex);
 
@@ -356,6 +536,7 @@ static int async_read_internal(URLContext *h, void *dest, int size)
         fifo_size = ring_size(ring);
         to_copy   = FFMIN(to_read, fifo_size);
         if (to_copy > 0) {
+            c->filling = 0;
             ring_read(ring, dest, to_copy);
             if (dest)
                 dest = (uint8_t *)dest + to_copy;
@@ -373,11 +554,15 @@ static int async_read_internal(URLContext *h, void *dest, int size)
                     ret = AVERROR_EOF;
             }
             break;
+        } else if (!c->filling && !underrun) {
+            underrun = 1;
+            c->underruns++;
         }
         pthread_cond_signal(&c->cond_wakeup_background);
         pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
     }
 
+    update_buffer_target(c, av_gettime_relative(), size - to_read, underrun);
     pthread_cond_signal(&c->cond_wakeup_background);
     pthread_mutex_unlock(&c->mutex);
 
@@ -419,7 +604,7 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
         /* current position */
         return c->logical_pos;
     } else if ((new_logical_pos >= (c->logical_pos - fifo_size_of_read_back)) &&
-               (new_logical_pos < (c->logical_pos + fifo_size + SHORT_SEEK_THRESHOLD))) {
+               (new_logical_pos < (c->logical_pos + fifo_size + c->short_seek_size))) {
         int pos_delta = (int)(new_logical_pos - c->logical_pos);
         /* fast seek */
         av_log(h, AV_LOG_TRACE, "async_seek: fask_seek %"PRId64" from %d dist:%d/%d\n",
@@ -476,6 +661,16 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
 #define D AV_OPT_FLAG_DECODING_PARAM
 
 static const AVOption options[] = {
+    { "min_buffer_size", "minimum size of the read-ahead buffer", OFFSET(min_buffer_size), AV_OPT_TYPE_INT, { .i64 = 256 * 1024 }, 4096, INT_MAX / 4, D },
+    { "max_buffer_size", "maximum size of the read-ahead buffer", OFFSET(max_buffer_size), AV_OPT_TYPE_INT, { .i64 = 64 * 1024 * 1024 }, 4096, INT_MAX / 4, D },
+    { "buffer_duration", "duration of data to read ahead at the observed bitrate, 0 to only grow on underruns", OFFSET(buffer_duration), AV_OPT_TYPE_DURATION, { .i64 = 10000000 }, 0, INT64_MAX, D },
+    { "read_back_size", "amount of data kept for seeking backwards", OFFSET(read_back_size), AV_OPT_TYPE_INT, { .i64 = READ_BACK_CAPACITY }, 0, INT_MAX / 4, D },
+    { "short_seek_size", "distance beyond the buffered data up to which forward seeks read through", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = SHORT_SEEK_THRESHOLD }, 0, INT_MAX, D },
+    { "buffer_level", "amount of data buffered ahead", OFFSET(buffer_level), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "buffer_capacity", "current size of the read-ahead buffer", OFFSET(buffer_capacity), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "bitrate", "rate at which data is read, in bits per second", OFFSET(bitrate), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "throughput", "rate of the underlying protocol, in bits per second", OFFSET(throughput), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "underruns", "number of reads which had to wait for data", OFFSET(underruns), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     {NULL},
 };
 
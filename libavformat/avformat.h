@@ -1434,6 +1434,19 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_SORT_DTS    0x10000 ///< try to interleave outputted packets by dts (using this flag can slow demuxing down)
 #define AVFMT_FLAG_FAST_SEEK   0x80000 ///< Enable fast, but inaccurate seeks for some formats
 #define AVFMT_FLAG_AUTO_BSF   0x200000 ///< Add bitstream filters as requested by the muxer
+/**
+ * Do not open decoders in avformat_find_stream_info(). The codec parameters
+ * are only taken from the container and the parsers, so the ones that require
+ * decoding (e.g. the pixel or sample format) may be left unset. This is
+ * enough for remuxing and avoids the cost of initializing the decoders.
+ */
+#define AVFMT_FLAG_NODECODE   0x400000
+/**
+ * Store the index entries in a compact form, for the demuxers that support
+ * it. This reduces the memory used by large indexes, at the expense of
+ * decoding the entries when they are accessed.
+ */
+#define AVFMT_FLAG_COMPACT_INDEX 0x800000
 
     /**
      * Maximum number of bytes read from input in order to determine stream
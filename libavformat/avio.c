@@ -25,6 +25,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/time.h"
 #include "libavutil/avassert.h"
+#include "libavcodec/defs.h"
 #include "avio_internal.h"
 #include "os_support.h"
 #include "internal.h"
@@ -115,6 +116,36 @@ URLContext *ffio_geturlcontext(AVIOContext *s)
         return NULL;
 }
 
+int ffio_read_mapped(AVIOContext *s, int size, AVBufferRef **buf)
+{
+    URLContext *h = ffio_geturlcontext(s);
+    AVBufferRef *map;
+    int64_t pos, ret;
+
+    if (!h || !h->prot->url_get_mapping || s->write_flag ||
+        s->update_checksum || size < s->buffer_size ||
+        size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return AVERROR(ENOSYS);
+
+    pos = avio_tell(s);
+    if (pos < 0)
+        return AVERROR(ENOSYS);
+
+    ret = h->prot->url_get_mapping(h, pos, size, &map);
+    if (ret < 0)
+        return ret == AVERROR(ENOMEM) ? ret : AVERROR(ENOSYS);
+
+    ret = avio_skip(s, size);
+    if (ret < 0) {
+        av_buffer_unref(&map);
+        return ret;
+    }
+
+    *buf = map;
+
+    return size;
+}
+
 static int url_alloc_for_protocol(URLContext **puc, const URLProtocol *up,
                                   const char *filename, int flags,
                                   const AVIOInterruptCB *int_cb)
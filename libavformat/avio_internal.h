@@ -21,6 +21,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 
 extern const AVClass ff_avio_class;
@@ -222,6 +223,22 @@ int ffio_open_dyn_packet_buf(AVIOContext **s, int max_packet_size);
  */
 struct URLContext *ffio_geturlcontext(AVIOContext *s);
 
+/**
+ * Reference the next size bytes of s without copying them and skip them,
+ * if s reads directly from a protocol that maps the resource in memory
+ * (e.g. the file protocol with the mmap option).
+ *
+ * The returned buffer is read-only and followed by
+ * AV_INPUT_BUFFER_PADDING_SIZE zeroed bytes, like the buffers allocated for
+ * packets. Reads smaller than the I/O buffer are refused, since copying them
+ * is cheaper than mapping them.
+ *
+ * @param buf set to the new reference on success
+ * @return size on success, AVERROR(ENOSYS) if the data cannot be mapped, in
+ *         which case nothing is consumed, or another negative error code
+ */
+int ffio_read_mapped(AVIOContext *s, int size, AVBufferRef **buf);
+
 /**
  * Create and initialize a AVIOContext for accessing the
  * resource referenced by the URLContext h.
@@ -23,21 +23,30 @@
 
 /**
  * @TODO
- *      support keeping files
  *      support filling with a background thread
  */
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/file_open.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/sha.h"
 #include "libavutil/tree.h"
 #include "avio.h"
+#include "internal.h"
 #include <fcntl.h>
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#endif
 #if HAVE_IO_H
 #include <io.h>
 #endif
+#if HAVE_FLOCK
+#include <sys/file.h>
+#endif
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -46,6 +55,32 @@
 #include "os_support.h"
 #include "url.h"
 
+/*
+ * With the cache_dir option, each resource is kept in a single file,
+ * <cache_dir>/<key>.cache, holding a header, a bitmap of the blocks of
+ * PERSISTENT_BLOCK_SIZE bytes present in the entry, then from data_offset
+ * the data at its offset in the resource. The key is a hash of the URL, size,
+ * entity tag and modification time of the resource, so that a modified
+ * resource gets a new entry.
+ *
+ * Entries are created with their header under a temporary name, then
+ * renamed into place, so an entry is complete as soon as it can be opened.
+ * Blocks are written before their bit is set in the map, and the same block
+ * always has the same content, so several processes can fill the same entry
+ * concurrently: a bit lost to a concurrent update only causes the block to be
+ * downloaded again. Since the map and the data share a file, a process never
+ * pairs the map of an entry with the data of another.
+ *
+ * Opened entries are locked shared, and eviction only deletes the entries it
+ * can lock exclusively. Without flock(), an entry deleted while in use stays
+ * valid for the processes having it open, but is no longer shared.
+ */
+#define PERSISTENT_BLOCK_SIZE   (64 * 1024)
+#define PERSISTENT_MAGIC        MKBETAG('F', 'F', 'C', 'E')
+#define PERSISTENT_HEADER_SIZE  16
+#define PERSISTENT_KEY_SIZE     32
+#define PERSISTENT_DATA_ALIGN   4096
+
 typedef struct CacheEntry {
     int64_t logical_pos;
     int64_t physical_pos;
@@ -65,6 +100,17 @@ typedef struct CacheContext {
     URLContext *inner;
     int64_t cache_hit, cache_miss;
     int read_ahead_limit;
+
+    char *cache_dir;
+    int64_t cache_max_size;
+    char key[2 * PERSISTENT_KEY_SIZE + 1];
+    /* bitmap of the cached blocks, NULL if the cache is not persistent */
+    uint8_t *map;
+    int64_t map_size;
+    int64_t data_offset;
+    int64_t nb_blocks;
+    int64_t size;
+    uint8_t *block;
 } CacheContext;
 
 static int cmp(const void *key, const void *node)
@@ -72,6 +118,426 @@ static int cmp(const void *key, const void *node)
     return FFDIFFSIGN(*(const int64_t *)key, ((const CacheEntry *) node)->logical_pos);
 }
 
+static char *persistent_path(CacheContext *c)
+{
+    return av_asprintf("%s/%s.cache", c->cache_dir, c->key);
+}
+
+static int persistent_key(URLContext *h, const char *url)
+{
+    CacheContext *c = h->priv_data;
+    static const char *const validators[] = { "etag", "last_modified" };
+    uint8_t digest[PERSISTENT_KEY_SIZE];
+    char size[32];
+    struct AVSHA *sha = av_sha_alloc();
+
+    if (!sha)
+        return AVERROR(ENOMEM);
+
+    snprintf(size, sizeof(size), "%"PRId64, c->size);
+
+    av_sha_init(sha, 8 * PERSISTENT_KEY_SIZE);
+    av_sha_update(sha, url, strlen(url) + 1);
+    av_sha_update(sha, size, strlen(size) + 1);
+    for (int i = 0; i < FF_ARRAY_ELEMS(validators); i++) {
+        uint8_t *val = NULL;
+
+        // only some protocols export them
+        av_opt_get(c->inner, validators[i], AV_OPT_SEARCH_CHILDREN, &val);
+        if (val)
+            av_sha_update(sha, val, strlen(val) + 1);
+        else
+            av_sha_update(sha, "", 1);
+        av_free(val);
+    }
+    av_sha_final(sha, digest);
+    ff_data_to_hex(c->key, digest, sizeof(digest), 1);
+
+    av_free(sha);
+    return 0;
+}
+
+/**
+ * Lock an entry, shared while using it, or exclusively without blocking to
+ * delete it.
+ */
+static int persistent_lock(int fd, int exclusive)
+{
+#if HAVE_FLOCK
+    if (flock(fd, exclusive ? LOCK_EX | LOCK_NB : LOCK_SH) < 0)
+        return AVERROR(errno);
+#endif
+    return 0;
+}
+
+static int persistent_write_header(CacheContext *c)
+{
+    uint8_t header[PERSISTENT_HEADER_SIZE];
+
+    AV_WB32(header,      PERSISTENT_MAGIC);
+    AV_WB32(header +  4, PERSISTENT_BLOCK_SIZE);
+    AV_WB64(header +  8, c->size);
+
+    // also marks the entry as recently used for the eviction
+    if (lseek(c->fd, 0, SEEK_SET) < 0 ||
+        write(c->fd, header, sizeof(header)) != sizeof(header))
+        return AVERROR(errno);
+    return 0;
+}
+
+/**
+ * Open the existing entry of the resource and read its map.
+ *
+ * @return 0 on success, AVERROR(ENOENT) if there is no valid entry
+ */
+static int persistent_open_entry(URLContext *h, const char *path)
+{
+    CacheContext *c = h->priv_data;
+    uint8_t header[PERSISTENT_HEADER_SIZE];
+    int access = O_RDWR;
+    struct stat st;
+    int ret;
+
+#ifdef O_BINARY
+    access |= O_BINARY;
+#endif
+    c->fd = avpriv_open(path, access);
+    if (c->fd < 0)
+        return errno == ENOENT ? AVERROR(ENOENT) : AVERROR(errno);
+
+    if ((ret = persistent_lock(c->fd, 0)) < 0)
+        return ret;
+
+    // deleted by an eviction while being opened
+    if (fstat(c->fd, &st) < 0)
+        return AVERROR(errno);
+    if (!st.st_nlink)
+        goto invalid;
+
+    if (read(c->fd, header, sizeof(header)) != sizeof(header) ||
+        AV_RB32(header)     != PERSISTENT_MAGIC      ||
+        AV_RB32(header + 4) != PERSISTENT_BLOCK_SIZE ||
+        AV_RB64(header + 8) != c->size) {
+        av_log(h, AV_LOG_WARNING, "Invalid cache entry %s, replacing it\n", c->key);
+        goto invalid;
+    }
+    // the end of the map may not have been written yet
+    if (read(c->fd, c->map, c->map_size) < 0)
+        return AVERROR(errno);
+
+    return 0;
+invalid:
+    close(c->fd);
+    c->fd = -1;
+    return AVERROR(ENOENT);
+}
+
+/**
+ * Create an empty entry for the resource under a temporary name and rename
+ * it into place, replacing any invalid entry.
+ */
+static int persistent_create_entry(URLContext *h, const char *path)
+{
+    CacheContext *c = h->priv_data;
+    int access = O_RDWR | O_CREAT | O_EXCL;
+    char *tmp = NULL;
+    int ret;
+
+#ifdef O_BINARY
+    access |= O_BINARY;
+#endif
+    for (int i = 0; i < 16; i++) {
+        av_freep(&tmp);
+        tmp = av_asprintf("%s/%s.%08"PRIx32".tmp", c->cache_dir, c->key,
+                          av_get_random_seed());
+        if (!tmp)
+            return AVERROR(ENOMEM);
+        c->fd = avpriv_open(tmp, access, 0666);
+        if (c->fd >= 0 || errno != EEXIST)
+            break;
+    }
+    if (c->fd < 0) {
+        ret = AVERROR(errno);
+        av_free(tmp);
+        return ret;
+    }
+
+    if ((ret = persistent_lock(c->fd, 0)) < 0 ||
+        (ret = persistent_write_header(c)) < 0)
+        goto fail;
+
+    if (rename(tmp, path) < 0) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+    av_free(tmp);
+
+    return 0;
+fail:
+    unlink(tmp);
+    av_free(tmp);
+    return ret;
+}
+
+static int persistent_open(URLContext *h, const char *url)
+{
+    CacheContext *c = h->priv_data;
+    char *path;
+    int ret;
+
+    c->size = ffurl_size(c->inner);
+    if (c->size <= 0) {
+        av_log(h, AV_LOG_WARNING, "Unknown size, not using the persistent cache\n");
+        return 0;
+    }
+    c->nb_blocks   = (c->size + PERSISTENT_BLOCK_SIZE - 1) / PERSISTENT_BLOCK_SIZE;
+    c->map_size    = (c->nb_blocks + 7) >> 3;
+    c->data_offset = FFALIGN(PERSISTENT_HEADER_SIZE + c->map_size, PERSISTENT_DATA_ALIGN);
+    if (c->map_size > INT_MAX)
+        return AVERROR(ERANGE);
+
+    if ((ret = persistent_key(h, url)) < 0)
+        return ret;
+
+    c->map   = av_mallocz(c->map_size);
+    c->block = av_malloc(PERSISTENT_BLOCK_SIZE);
+    path     = persistent_path(c);
+    if (!c->map || !c->block || !path) {
+        av_free(path);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = persistent_open_entry(h, path);
+    if (ret >= 0)
+        ret = persistent_write_header(c);
+    else if (ret == AVERROR(ENOENT))
+        ret = persistent_create_entry(h, path);
+    av_free(path);
+    if (ret < 0) {
+        av_log(h, AV_LOG_ERROR, "Failed to access cache entry %s: %s\n",
+               c->key, av_err2str(ret));
+        return ret;
+    }
+
+    c->cache_pos   = -1;
+    c->end         = c->size;
+    c->is_true_eof = 1;
+
+    av_log(h, AV_LOG_VERBOSE, "Using cache entry %s\n", c->key);
+
+    return 0;
+}
+
+static int persistent_has_block(URLContext *h, int64_t block)
+{
+    CacheContext *c = h->priv_data;
+    uint8_t byte;
+
+    if (c->map[block >> 3] & (1 << (block & 7)))
+        return 1;
+
+    // another process may have stored it
+    c->cache_pos = -1;
+    if (lseek(c->fd, PERSISTENT_HEADER_SIZE + (block >> 3), SEEK_SET) >= 0 &&
+        read(c->fd, &byte, 1) == 1)
+        c->map[block >> 3] |= byte;
+
+    return !!(c->map[block >> 3] & (1 << (block & 7)));
+}
+
+static int persistent_add_block(URLContext *h, int64_t block, int size)
+{
+    CacheContext *c = h->priv_data;
+    int64_t map_pos = PERSISTENT_HEADER_SIZE + (block >> 3);
+    uint8_t byte;
+
+    c->cache_pos = -1;
+    if (lseek(c->fd, c->data_offset + block * PERSISTENT_BLOCK_SIZE, SEEK_SET) < 0 ||
+        write(c->fd, c->block, size) != size)
+        return AVERROR(errno);
+
+    if (lseek(c->fd, map_pos, SEEK_SET) >= 0 &&
+        read(c->fd, &byte, 1) == 1)
+        c->map[block >> 3] |= byte;
+    c->map[block >> 3] |= 1 << (block & 7);
+
+    if (lseek(c->fd, map_pos, SEEK_SET) < 0 ||
+        write(c->fd, &c->map[block >> 3], 1) != 1)
+        return AVERROR(errno);
+
+    return 0;
+}
+
+static int persistent_read(URLContext *h, unsigned char *buf, int size)
+{
+    CacheContext *c = h->priv_data;
+    int64_t block = c->logical_pos / PERSISTENT_BLOCK_SIZE;
+    int64_t block_pos = block * PERSISTENT_BLOCK_SIZE;
+    int block_size, in_block_pos, r;
+
+    if (c->logical_pos >= c->size)
+        return AVERROR_EOF;
+    block_size   = FFMIN(PERSISTENT_BLOCK_SIZE, c->size - block_pos);
+    in_block_pos = c->logical_pos - block_pos;
+    size         = FFMIN(size, block_size - in_block_pos);
+
+    if (persistent_has_block(h, block)) {
+        int64_t pos = c->data_offset + c->logical_pos;
+
+        if (c->cache_pos != pos)
+            pos = lseek(c->fd, pos, SEEK_SET);
+        r = pos >= 0 ? read(c->fd, buf, size) : -1;
+        if (r > 0) {
+            c->cache_pos    = pos + r;
+            c->logical_pos += r;
+            c->cache_hit ++;
+            return r;
+        }
+        c->cache_pos = -1;
+    }
+
+    // Fetch the whole block so that it can be stored
+
+    if (block_pos != c->inner_pos) {
+        int64_t pos = ffurl_seek(c->inner, block_pos, SEEK_SET);
+        if (pos < 0) {
+            av_log(h, AV_LOG_ERROR, "Failed to perform internal seek\n");
+            return pos;
+        }
+        c->inner_pos = pos;
+    }
+
+    r = ffurl_read_complete(c->inner, c->block, block_size);
+    if (r > 0)
+        c->inner_pos += r;
+    if (r != block_size) {
+        av_log(h, AV_LOG_ERROR, "Failed to read %d bytes at %"PRId64"\n",
+               block_size, block_pos);
+        return r < 0 ? r : AVERROR(EIO);
+    }
+
+    c->cache_miss ++;
+
+    r = persistent_add_block(h, block, block_size);
+    if (r < 0)
+        av_log(h, AV_LOG_WARNING, "Failed to store block in cache entry %s: %s\n",
+               c->key, av_err2str(r));
+
+    memcpy(buf, c->block + in_block_pos, size);
+    c->logical_pos += size;
+
+    return size;
+}
+
+#if HAVE_DIRENT_H
+typedef struct PersistentEntry {
+    char   *name;
+    time_t  mtime;
+    int64_t size;
+} PersistentEntry;
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const PersistentEntry *ea = a, *eb = b;
+    return FFDIFFSIGN(ea->mtime, eb->mtime);
+}
+
+/* Size of the data of a cache entry from its block map. */
+static int64_t entry_size(const char *path)
+{
+    uint8_t buf[4096];
+    int64_t size = 0, total, block_size, map_size;
+    int fd = avpriv_open(path, O_RDONLY);
+    int ret;
+
+    if (fd < 0)
+        return 0;
+    if (read(fd, buf, PERSISTENT_HEADER_SIZE) != PERSISTENT_HEADER_SIZE ||
+        AV_RB32(buf) != PERSISTENT_MAGIC || !AV_RB32(buf + 4)) {
+        close(fd);
+        return 0;
+    }
+    block_size = AV_RB32(buf + 4);
+    total      = AV_RB64(buf + 8);
+    map_size   = ((total + block_size - 1) / block_size + 7) >> 3;
+    while (map_size > 0 &&
+           (ret = read(fd, buf, FFMIN(sizeof(buf), map_size))) > 0) {
+        for (int i = 0; i < ret; i++)
+            size += av_popcount(buf[i]) * block_size;
+        map_size -= ret;
+    }
+    close(fd);
+
+    return FFMIN(size, total);
+}
+
+/* Delete the least recently used entries until the cache fits in
+ * cache_max_size. */
+static void persistent_evict(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    PersistentEntry *entries = NULL;
+    int nb_entries = 0;
+    int64_t total = 0;
+    struct dirent *dir;
+    DIR *d = opendir(c->cache_dir);
+
+    if (!d)
+        return;
+
+    while ((dir = readdir(d))) {
+        PersistentEntry *e;
+        struct stat st;
+        char *path;
+
+        if (strlen(dir->d_name) != 2 * PERSISTENT_KEY_SIZE + 6 ||
+            strcmp(dir->d_name + 2 * PERSISTENT_KEY_SIZE, ".cache"))
+            continue;
+        if (av_dynarray2_add((void **)&entries, &nb_entries, sizeof(*entries), NULL) == NULL)
+            break;
+        e = &entries[nb_entries - 1];
+        e->name = av_strndup(dir->d_name, 2 * PERSISTENT_KEY_SIZE);
+        path    = av_asprintf("%s/%s", c->cache_dir, dir->d_name);
+        if (!e->name || !path || stat(path, &st) < 0) {
+            av_free(e->name);
+            av_free(path);
+            nb_entries--;
+            continue;
+        }
+        e->mtime = st.st_mtime;
+        e->size  = entry_size(path);
+        total   += e->size;
+        av_free(path);
+    }
+    closedir(d);
+
+    qsort(entries, nb_entries, sizeof(*entries), entry_cmp);
+    for (int i = 0; i < nb_entries && total > c->cache_max_size; i++) {
+        char *path;
+        int fd;
+
+        if (!strcmp(entries[i].name, c->key))
+            continue;
+        path = av_asprintf("%s/%s.cache", c->cache_dir, entries[i].name);
+        if (!path)
+            break;
+        // skip the entries in use by other processes
+        fd = avpriv_open(path, O_RDONLY);
+        if (fd >= 0 && persistent_lock(fd, 1) >= 0 && unlink(path) >= 0) {
+            av_log(h, AV_LOG_VERBOSE, "Evicting cache entry %s\n", entries[i].name);
+            total -= entries[i].size;
+        }
+        if (fd >= 0)
+            close(fd);
+        av_free(path);
+    }
+
+    for (int i = 0; i < nb_entries; i++)
+        av_free(entries[i].name);
+    av_free(entries);
+}
+#endif
+
 static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     CacheContext *c = h->priv_data;
@@ -80,10 +546,26 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "cache:", &arg);
 
+    c->fd = -1;
+
+    ret = ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
+                               options, h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0)
+        return ret;
+
+    if (c->cache_dir) {
+        ret = persistent_open(h, arg);
+        if (ret < 0)
+            goto fail;
+        if (c->map)
+            return 0;
+    }
+
     c->fd = avpriv_tempfile("ffcache", &buffername, 0, h);
     if (c->fd < 0){
         av_log(h, AV_LOG_ERROR, "Failed to create tempfile\n");
-        return c->fd;
+        ret = c->fd;
+        goto fail;
     }
 
     ret = unlink(buffername);
@@ -93,8 +575,14 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
     else
         c->filename = buffername;
 
-    return ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
-                                options, h->protocol_whitelist, h->protocol_blacklist, h);
+    return 0;
+fail:
+    if (c->fd >= 0)
+        close(c->fd);
+    av_freep(&c->map);
+    av_freep(&c->block);
+    ffurl_closep(&c->inner);
+    return ret;
 }
 
 static int add_entry(URLContext *h, const unsigned char *buf, int size)
@@ -166,6 +654,9 @@ static int cache_read(URLContext *h, unsigned char *buf, int size)
     CacheEntry *entry, *next[2] = {NULL, NULL};
     int64_t r;
 
+    if (c->map)
+        return persistent_read(h, buf, size);
+
     entry = av_tree_find(c->root, &c->logical_pos, cmp, (void**)next);
 
     if (!entry)
@@ -231,6 +722,8 @@ static int64_t cache_seek(URLContext *h, int64_t pos, int whence)
     int64_t ret;
 
     if (whence == AVSEEK_SIZE) {
+        if (c->map)
+            return c->size;
         pos= ffurl_seek(c->inner, pos, whence);
         if(pos <= 0){
             pos= ffurl_seek(c->inner, -1, SEEK_END);
@@ -305,6 +798,14 @@ static int cache_close(URLContext *h)
            c->cache_hit, c->cache_miss);
 
     close(c->fd);
+    if (c->map) {
+        av_freep(&c->map);
+        av_freep(&c->block);
+#if HAVE_DIRENT_H
+        if (c->cache_max_size)
+            persistent_evict(h);
+#endif
+    }
     if (c->filename) {
         ret = unlink(c->filename);
         if (ret < 0)
@@ -323,6 +824,8 @@ static int cache_close(URLContext *h)
 
 static const AVOption options[] = {
     { "read_ahead_limit", "Amount in bytes that may be read ahead when seeking isn't supported, -1 for unlimited", OFFSET(read_ahead_limit), AV_OPT_TYPE_INT, { .i64 = 65536 }, -1, INT_MAX, D },
+    { "cache_dir", "Directory keeping the cached data across opens", OFFSET(cache_dir), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
+    { "cache_max_size", "Size in bytes above which the least recently used entries of cache_dir are deleted, 0 for unlimited", OFFSET(cache_max_size), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
     {NULL},
 };
 
@@ -0,0 +1,465 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#include "compact_index.h"
+#include "demux.h"
+
+/* bits of the header byte of an entry, the low bits are the entry flags */
+#define SAME_DURATION  0x04
+#define CONTIGUOUS     0x08
+#define SAME_SIZE      0x10
+#define SAME_DISTANCE  0x20
+
+/* header byte and 4 variable length integers */
+#define MAX_ENTRY_SIZE (1 + 4 * 10)
+
+typedef struct EntryState {
+    AVIndexEntry prev;
+    int64_t duration;
+} EntryState;
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static int put_varint(uint8_t *p, uint64_t v)
+{
+    int n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+
+    return n;
+}
+
+static uint64_t get_varint(const uint8_t **pp)
+{
+    const uint8_t *p = *pp;
+    uint64_t v = 0;
+    int shift = 0;
+
+    do {
+        v |= (uint64_t)(*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    *pp = p;
+
+    return v;
+}
+
+static int encode_entry(uint8_t *buf, EntryState *s, const AVIndexEntry *e)
+{
+    const AVIndexEntry *prev = &s->prev;
+    int64_t duration = (uint64_t)e->timestamp - prev->timestamp;
+    int64_t next_pos = (uint64_t)prev->pos + prev->size;
+    uint8_t *p = buf + 1;
+    int header = e->flags & (AVINDEX_KEYFRAME | AVINDEX_DISCARD_FRAME);
+
+    if (duration == s->duration)
+        header |= SAME_DURATION;
+    else
+        p += put_varint(p, zigzag(duration));
+    if (e->pos == next_pos)
+        header |= CONTIGUOUS;
+    else
+        p += put_varint(p, zigzag((uint64_t)e->pos - next_pos));
+    if (e->size == prev->size)
+        header |= SAME_SIZE;
+    else
+        p += put_varint(p, e->size);
+    if (e->min_distance == prev->min_distance)
+        header |= SAME_DISTANCE;
+    else
+        p += put_varint(p, zigzag(e->min_distance));
+    buf[0] = header;
+
+    s->prev     = *e;
+    s->duration = duration;
+
+    return p - buf;
+}
+
+static void decode_block(const FFCompactIndexBlock *b, AVIndexEntry *entries)
+{
+    const uint8_t *p = b->data;
+    AVIndexEntry prev = { 0 };
+    int64_t duration = 0;
+
+    for (int i = 0; i < b->nb_entries; i++) {
+        AVIndexEntry *e = &entries[i];
+        int header = *p++;
+
+        if (!(header & SAME_DURATION))
+            duration = unzigzag(get_varint(&p));
+        e->timestamp = (uint64_t)prev.timestamp + duration;
+        e->pos = (uint64_t)prev.pos + prev.size;
+        if (!(header & CONTIGUOUS))
+            e->pos += unzigzag(get_varint(&p));
+        e->size = header & SAME_SIZE ? prev.size : get_varint(&p);
+        e->min_distance = header & SAME_DISTANCE ? prev.min_distance
+                                                 : unzigzag(get_varint(&p));
+        e->flags = header & (AVINDEX_KEYFRAME | AVINDEX_DISCARD_FRAME);
+        prev = *e;
+    }
+}
+
+/**
+ * Replace the entries of a block.
+ */
+static int encode_block(FFCompactIndex *ci, FFCompactIndexBlock *b,
+                        const AVIndexEntry *entries, int nb_entries)
+{
+    uint8_t buf[FF_COMPACT_INDEX_BLOCK_SIZE * MAX_ENTRY_SIZE];
+    EntryState s = { { 0 } };
+    unsigned int size = 0;
+    uint8_t *data;
+
+    for (int i = 0; i < nb_entries; i++)
+        size += encode_entry(buf + size, &s, &entries[i]);
+
+    data = av_malloc(size);
+    if (!data)
+        return AVERROR(ENOMEM);
+    memcpy(data, buf, size);
+
+    av_free(b->data);
+    b->data           = data;
+    b->size           =
+    b->allocated_size = size;
+    b->nb_entries     = nb_entries;
+    b->timestamp      = entries[0].timestamp;
+
+    if (b == &ci->blocks[ci->nb_blocks - 1]) {
+        ci->last          = s.prev;
+        ci->last_duration = s.duration;
+    }
+
+    return 0;
+}
+
+static void free_blocks(FFCompactIndex *ci)
+{
+    for (int i = 0; i < ci->nb_blocks; i++)
+        av_freep(&ci->blocks[i].data);
+    av_freep(&ci->blocks);
+    ci->nb_blocks             = 0;
+    ci->blocks_allocated_size = 0;
+    ci->nb_entries            = 0;
+    ci->data_size             = 0;
+    ci->cache_block           = -1;
+}
+
+static int append_entry(FFCompactIndex *ci, const AVIndexEntry *e)
+{
+    FFCompactIndexBlock *b = ci->nb_blocks ? &ci->blocks[ci->nb_blocks - 1] : NULL;
+    EntryState s = { ci->last, ci->last_duration };
+    uint8_t buf[MAX_ENTRY_SIZE];
+    unsigned int allocated_size;
+    uint8_t *data;
+    int size;
+
+    if (!b || b->nb_entries == FF_COMPACT_INDEX_BLOCK_SIZE) {
+        if (b && b->size < b->allocated_size) {
+            /* the block is complete, drop the unused space */
+            data = av_realloc(b->data, b->size);
+            if (data) {
+                ci->data_size    -= b->allocated_size - b->size;
+                b->data           = data;
+                b->allocated_size = b->size;
+            }
+        }
+        b = av_fast_realloc(ci->blocks, &ci->blocks_allocated_size,
+                            (ci->nb_blocks + 1) * sizeof(*ci->blocks));
+        if (!b)
+            return AVERROR(ENOMEM);
+        ci->blocks = b;
+        b = &ci->blocks[ci->nb_blocks];
+        memset(b, 0, sizeof(*b));
+        b->timestamp = e->timestamp;
+        b->first     = ci->nb_entries;
+        memset(&s, 0, sizeof(s));
+    }
+
+    size = encode_entry(buf, &s, e);
+    allocated_size = b->allocated_size;
+    data = av_fast_realloc(b->data, &b->allocated_size, b->size + size);
+    if (!data)
+        return AVERROR(ENOMEM);
+    ci->data_size += b->allocated_size - allocated_size;
+    b->data = data;
+    memcpy(b->data + b->size, buf, size);
+    b->size += size;
+    b->nb_entries++;
+
+    if (b == &ci->blocks[ci->nb_blocks])
+        ci->nb_blocks++;
+    if (ci->cache_block == ci->nb_blocks - 1)
+        ci->cache_block = -1;
+    ci->last          = s.prev;
+    ci->last_duration = s.duration;
+
+    return ci->nb_entries++;
+}
+
+/**
+ * @return the last block whose first entry is not after timestamp, or -1
+ */
+static int find_block(const FFCompactIndex *ci, int64_t timestamp)
+{
+    int a = -1, b = ci->nb_blocks;
+
+    while (b - a > 1) {
+        int m = (a + b) >> 1;
+        if (ci->blocks[m].timestamp <= timestamp)
+            a = m;
+        else
+            b = m;
+    }
+
+    return a;
+}
+
+FFCompactIndex *ff_compact_index_alloc(void)
+{
+    FFCompactIndex *ci = av_mallocz(sizeof(*ci));
+
+    if (ci)
+        ci->cache_block = -1;
+
+    return ci;
+}
+
+void ff_compact_index_free(FFCompactIndex **pci)
+{
+    if (!*pci)
+        return;
+    free_blocks(*pci);
+    av_freep(pci);
+}
+
+int ff_compact_index_add(FFCompactIndex *ci, int64_t pos, int64_t timestamp,
+                         int size, int distance, int flags)
+{
+    AVIndexEntry entries[FF_COMPACT_INDEX_BLOCK_SIZE + 1];
+    FFCompactIndexBlock *b;
+    AVIndexEntry *ie;
+    int k, nb_entries, inserted, index, ret;
+
+    if (!ci->nb_blocks || ci->last.timestamp < timestamp) {
+        AVIndexEntry e = {
+            .pos          = pos,
+            .timestamp    = timestamp,
+            .flags        = flags,
+            .size         = size,
+            .min_distance = distance,
+        };
+        return append_entry(ci, &e);
+    }
+
+    /* insert the entry into the block it belongs to, splitting it if full */
+    k = FFMAX(find_block(ci, timestamp), 0);
+    if (ci->blocks[k].nb_entries == FF_COMPACT_INDEX_BLOCK_SIZE) {
+        b = av_fast_realloc(ci->blocks, &ci->blocks_allocated_size,
+                            (ci->nb_blocks + 1) * sizeof(*ci->blocks));
+        if (!b)
+            return AVERROR(ENOMEM);
+        ci->blocks = b;
+    }
+    b = &ci->blocks[k];
+    nb_entries = b->nb_entries;
+    decode_block(b, entries);
+    ci->cache_block = -1;
+
+    index = ff_index_search_timestamp(entries, nb_entries, timestamp,
+                                      AVSEEK_FLAG_ANY);
+    if (index < 0) {
+        index = nb_entries++;
+        ie    = &entries[index];
+    } else {
+        ie = &entries[index];
+        if (ie->timestamp != timestamp) {
+            if (ie->timestamp <= timestamp)
+                return -1;
+            memmove(entries + index + 1, entries + index,
+                    sizeof(*entries) * (nb_entries - index));
+            nb_entries++;
+        } else if (ie->pos == pos && distance < ie->min_distance)
+            // do not reduce the distance
+            distance = ie->min_distance;
+    }
+
+    ie->pos          = pos;
+    ie->timestamp    = timestamp;
+    ie->min_distance = distance;
+    ie->size         = size;
+    ie->flags        = flags;
+    inserted = nb_entries > b->nb_entries;
+
+    if (nb_entries > FF_COMPACT_INDEX_BLOCK_SIZE) {
+        FFCompactIndexBlock *next;
+        int half = nb_entries >> 1;
+
+        memmove(b + 2, b + 1, sizeof(*b) * (ci->nb_blocks - k - 1));
+        next = b + 1;
+        memset(next, 0, sizeof(*next));
+        next->first = b->first + half;
+        ci->nb_blocks++;
+        ci->data_size -= b->allocated_size;
+        if ((ret = encode_block(ci, next, entries + half, nb_entries - half)) < 0 ||
+            (ret = encode_block(ci, b, entries, half)) < 0) {
+            /* the entries of the block are lost */
+            free_blocks(ci);
+            return ret;
+        }
+        ci->data_size += b->allocated_size + next->allocated_size;
+        k++;
+    } else {
+        ci->data_size -= b->allocated_size;
+        if ((ret = encode_block(ci, b, entries, nb_entries)) < 0) {
+            free_blocks(ci);
+            return ret;
+        }
+        ci->data_size += b->allocated_size;
+    }
+
+    if (inserted) {
+        for (int i = k + 1; i < ci->nb_blocks; i++)
+            ci->blocks[i].first++;
+        ci->nb_entries++;
+    }
+
+    return b->first + index;
+}
+
+const AVIndexEntry *ff_compact_index_get(FFCompactIndex *ci, int idx)
+{
+    const FFCompactIndexBlock *b;
+    int k, a = -1, c = ci->nb_blocks;
+
+    if (idx < 0 || idx >= ci->nb_entries)
+        return NULL;
+
+    while (c - a > 1) {
+        int m = (a + c) >> 1;
+        if (ci->blocks[m].first <= idx)
+            a = m;
+        else
+            c = m;
+    }
+    k = a;
+    b = &ci->blocks[k];
+
+    if (ci->cache_block != k) {
+        decode_block(b, ci->cache);
+        ci->cache_block = k;
+    }
+
+    return &ci->cache[idx - b->first];
+}
+
+static const AVIndexEntry *entry(FFCompactIndex *ci, int idx)
+{
+    return ff_compact_index_get(ci, idx);
+}
+
+int ff_compact_index_search(FFCompactIndex *ci, int64_t wanted_timestamp,
+                            int flags)
+{
+    int nb_entries = ci->nb_entries;
+    int a, b, m, k;
+    int64_t timestamp;
+
+    /* the entries around the timestamp are in the block found or are the
+     * first entry of the next block */
+    k = find_block(ci, wanted_timestamp);
+    a = k >= 0 ? ci->blocks[k].first - 1 : -1;
+    b = k + 1 < ci->nb_blocks ? ci->blocks[k + 1].first : nb_entries;
+
+    while (b - a > 1) {
+        m = (a + b) >> 1;
+
+        // Search for the next non-discarded packet.
+        while ((entry(ci, m)->flags & AVINDEX_DISCARD_FRAME) && m < b && m < nb_entries - 1) {
+            m++;
+            if (m == b && entry(ci, m)->timestamp >= wanted_timestamp) {
+                m = b - 1;
+                break;
+            }
+        }
+
+        timestamp = entry(ci, m)->timestamp;
+        if (timestamp >= wanted_timestamp)
+            b = m;
+        if (timestamp <= wanted_timestamp)
+            a = m;
+    }
+    m = (flags & AVSEEK_FLAG_BACKWARD) ? a : b;
+
+    if (!(flags & AVSEEK_FLAG_ANY))
+        while (m >= 0 && m < nb_entries &&
+               !(entry(ci, m)->flags & AVINDEX_KEYFRAME))
+            m += (flags & AVSEEK_FLAG_BACKWARD) ? -1 : 1;
+
+    if (m == nb_entries)
+        return -1;
+    return m;
+}
+
+int ff_compact_index_reduce(FFCompactIndex *ci)
+{
+    FFCompactIndex reduced = { .cache_block = -1 };
+    int ret;
+
+    for (int i = 0; i < ci->nb_entries; i += 2) {
+        AVIndexEntry e = *ff_compact_index_get(ci, i);
+        if ((ret = append_entry(&reduced, &e)) < 0) {
+            free_blocks(&reduced);
+            return ret;
+        }
+    }
+
+    free_blocks(ci);
+    ci->blocks                = reduced.blocks;
+    ci->nb_blocks             = reduced.nb_blocks;
+    ci->blocks_allocated_size = reduced.blocks_allocated_size;
+    ci->nb_entries            = reduced.nb_entries;
+    ci->data_size             = reduced.data_size;
+    ci->last                  = reduced.last;
+    ci->last_duration         = reduced.last_duration;
+
+    return 0;
+}
+
+size_t ff_compact_index_size(const FFCompactIndex *ci)
+{
+    return ci->blocks_allocated_size + ci->data_size;
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_COMPACT_INDEX_H
+#define AVFORMAT_COMPACT_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "avformat.h"
+
+/**
+ * @file
+ * Compact storage for the index entries of a stream.
+ *
+ * The entries are stored in blocks of up to FF_COMPACT_INDEX_BLOCK_SIZE
+ * entries. Each entry is coded relative to the previous one of its block,
+ * with a header byte telling which fields can be predicted (same duration,
+ * contiguous position, same size and distance) followed by variable length
+ * integers for the other fields. Entries of regular streams, e.g. constant
+ * size audio frames, take a single byte instead of sizeof(AVIndexEntry).
+ *
+ * Looking up an entry decodes its block, which is cached until another
+ * block is accessed or the index is modified.
+ */
+
+#define FF_COMPACT_INDEX_BLOCK_SIZE 64
+
+typedef struct FFCompactIndexBlock {
+    int64_t timestamp;      ///< timestamp of the first entry
+    int first;              ///< index of the first entry
+    int nb_entries;
+    uint8_t *data;
+    unsigned int size;
+    unsigned int allocated_size;
+} FFCompactIndexBlock;
+
+typedef struct FFCompactIndex {
+    FFCompactIndexBlock *blocks;
+    int nb_blocks;
+    unsigned int blocks_allocated_size;
+    int nb_entries;
+    size_t data_size;       ///< allocated size of the data of all the blocks
+
+    /* last entry of the last block, to append to it without decoding it */
+    AVIndexEntry last;
+    int64_t last_duration;
+
+    /* entries of the block last accessed */
+    AVIndexEntry cache[FF_COMPACT_INDEX_BLOCK_SIZE];
+    int cache_block;
+} FFCompactIndex;
+
+FFCompactIndex *ff_compact_index_alloc(void);
+
+void ff_compact_index_free(FFCompactIndex **pci);
+
+/**
+ * Same as ff_add_index_entry(), the arguments must have been checked by
+ * the caller.
+ *
+ * @return index of the entry or a negative error code
+ */
+int ff_compact_index_add(FFCompactIndex *ci, int64_t pos, int64_t timestamp,
+                         int size, int distance, int flags);
+
+/**
+ * Get an entry of the index.
+ *
+ * @return the entry, valid until an entry of another block is accessed or
+ *         the index is modified, or NULL if idx is out of range
+ */
+const AVIndexEntry *ff_compact_index_get(FFCompactIndex *ci, int idx);
+
+/**
+ * Same as ff_index_search_timestamp().
+ */
+int ff_compact_index_search(FFCompactIndex *ci, int64_t wanted_timestamp,
+                            int flags);
+
+/**
+ * Discard every second entry, like ff_reduce_index().
+ */
+int ff_compact_index_reduce(FFCompactIndex *ci);
+
+/**
+ * @return the memory used by the entries, in bytes
+ */
+size_t ff_compact_index_size(const FFCompactIndex *ci);
+
+#endif /* AVFORMAT_COMPACT_INDEX_H */
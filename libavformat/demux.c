@@ -2151,6 +2151,13 @@ static int try_decode_frame(AVFormatContext *s, AVStream *st,
     if (!frame)
         return AVERROR(ENOMEM);
 
+    if (s->flags & AVFMT_FLAG_NODECODE && !avcodec_is_open(avctx)) {
+        // behave as if there was no decoder, so that nothing waits for it
+        sti->info->found_decoder = -st->codecpar->codec_id;
+        ret = -1;
+        goto fail;
+    }
+
     if (!avcodec_is_open(avctx) &&
         sti->info->found_decoder <= 0 &&
         (st->codecpar->codec_id != -sti->info->found_decoder || !st->codecpar->codec_id)) {
@@ -2685,10 +2692,14 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         if (ic->codec_whitelist)
             av_dict_set(options ? &options[i] : &thread_opt, "codec_whitelist", ic->codec_whitelist, 0);
 
+        if (ic->flags & AVFMT_FLAG_NODECODE)
+            sti->info->found_decoder = -st->codecpar->codec_id;
+
         // Try to just open decoders, in case this is enough to get parameters.
         // Also ensure that subtitle_header is properly set.
-        if (!has_codec_parameters(st, NULL) && sti->request_probe <= 0 ||
-            st->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE) {
+        if (!(ic->flags & AVFMT_FLAG_NODECODE) &&
+            (!has_codec_parameters(st, NULL) && sti->request_probe <= 0 ||
+             st->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE)) {
             if (codec && !avctx->codec)
                 if (avcodec_open2(avctx, codec, options ? &options[i] : &thread_opt) < 0)
                     av_log(ic, AV_LOG_WARNING,
@@ -2947,7 +2958,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         for (unsigned stream_index = 0; stream_index < ic->nb_streams; stream_index++) {
             AVStream *const st = ic->streams[stream_index];
             AVCodecContext *const avctx = ffstream(st)->avctx;
-            if (!has_codec_parameters(st, NULL)) {
+            if (!has_codec_parameters(st, NULL) && !(ic->flags & AVFMT_FLAG_NODECODE)) {
                 const AVCodec *codec = find_probe_decoder(ic, st, st->codecpar->codec_id);
                 if (codec && !avctx->codec) {
                     AVDictionary *opts = NULL;
@@ -44,6 +44,13 @@ struct AVDeviceInfoList;
  */
 #define FF_INFMT_FLAG_ID3V2_AUTO                               (1 << 2)
 
+/**
+ * The demuxer only accesses the index entries of its streams with
+ * avformat_index_get_entry() and av_index_search_timestamp(), so that
+ * they can be stored in a compact index with AVFMT_FLAG_COMPACT_INDEX.
+ */
+#define FF_INFMT_FLAG_COMPACT_INDEX                            (1 << 3)
+
 /**
  * Input format stream state
  * The stream states to be used for FFInputFormat::read_set_state
@@ -19,13 +19,19 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE // O_DIRECT
+#endif
+
 #include "config_components.h"
 
 #include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
 #include "libavutil/file_open.h"
 #include "libavutil/internal.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavcodec/defs.h"
 #include "avio.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -38,9 +44,16 @@
 #include <unistd.h>
 #endif
 #include <sys/stat.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <stdlib.h>
+#include <string.h>
 #include "os_support.h"
 #include "url.h"
+#if CONFIG_FILE_ASYNC
+#include "file_async.h"
+#endif
 
 /* Some systems may not have S_ISFIFO */
 #ifndef S_ISFIFO
@@ -97,6 +110,15 @@ typedef struct FileContext {
     int pkt_size;
     int follow;
     int seekable;
+    int queue_depth;
+    int io_block_size;
+    int direct;
+    int mmap;
+#if CONFIG_FILE_ASYNC
+    FileAsync *async;
+    // logical position of the next read or write with async
+    int64_t pos;
+#endif
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -108,6 +130,10 @@ static const AVOption file_options[] = {
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
     { "pkt_size", "Maximum packet size", offsetof(FileContext, pkt_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "queue_depth", "number of asynchronous read-ahead or write-behind requests, 0 to disable", offsetof(FileContext, queue_depth), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "io_block_size", "size of each asynchronous request", offsetof(FileContext, io_block_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, 64 << 20, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "direct", "bypass the page cache when reading asynchronously", offsetof(FileContext, direct), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "mmap", "map the file in memory to let demuxers reference packet data without copying it", offsetof(FileContext, mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -143,6 +169,14 @@ static int file_read(URLContext *h, unsigned char *buf, int size)
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+#if CONFIG_FILE_ASYNC
+    if (c->async) {
+        ret = ff_file_async_read(c->async, c->pos, buf, size);
+        if (ret > 0)
+            c->pos += ret;
+        return ret;
+    }
+#endif
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -156,6 +190,14 @@ static int file_write(URLContext *h, const unsigned char *buf, int size)
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+#if CONFIG_FILE_ASYNC
+    if (c->async) {
+        ret = ff_file_async_write(c->async, c->pos, buf, size);
+        if (ret > 0)
+            c->pos += ret;
+        return ret;
+    }
+#endif
     ret = write(c->fd, buf, size);
     return (ret == -1) ? AVERROR(errno) : ret;
 }
@@ -166,6 +208,55 @@ static int file_get_handle(URLContext *h)
     return c->fd;
 }
 
+#if HAVE_MMAP
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    // the mapping starts at the page holding the data
+    munmap((void *)((uintptr_t)data & ~(page - 1)), (uintptr_t)opaque);
+}
+#endif
+
+static int file_get_mapping(URLContext *h, int64_t pos, int size,
+                            AVBufferRef **buf)
+{
+#if HAVE_MMAP
+    FileContext *c = h->priv_data;
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t start = pos - pos % page;
+    size_t len = pos - start + size + AV_INPUT_BUFFER_PADDING_SIZE;
+    struct stat st;
+    uint8_t *data;
+
+    if (!c->mmap || pos < 0 || page <= 0)
+        return AVERROR(ENOSYS);
+    // accessing the pages mapped past the end of the file raises SIGBUS,
+    // the bytes past the end in the last page read as zeroes
+    if (fstat(c->fd, &st) < 0 ||
+        pos + size + AV_INPUT_BUFFER_PADDING_SIZE > FFALIGN(st.st_size, page))
+        return AVERROR(ENOSYS);
+
+    // a private mapping, so that only the pages holding the padding are
+    // copied when zeroing it
+    data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, c->fd, start);
+    if (data == MAP_FAILED)
+        return AVERROR(errno);
+    memset(data + len - AV_INPUT_BUFFER_PADDING_SIZE, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    mprotect(data, len, PROT_READ);
+
+    *buf = av_buffer_create(data + (pos - start), size, file_unmap,
+                            (void *)(uintptr_t)len, AV_BUFFER_FLAG_READONLY);
+    if (!*buf) {
+        munmap(data, len);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 static int file_check(URLContext *h, int mask)
 {
     int ret = 0;
@@ -223,16 +314,58 @@ static int fd_dup(URLContext *h, int oldfd)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
-    return (ret == -1) ? AVERROR(errno) : 0;
+    int ret, err = 0;
+#if CONFIG_FILE_ASYNC
+    err = ff_file_async_free(&c->async);
+#endif
+    ret = close(c->fd);
+    return (ret == -1) ? AVERROR(errno) : err;
 }
 
+#if CONFIG_FILE_ASYNC
+static int64_t file_async_seek(URLContext *h, int64_t pos, int whence)
+{
+    FileContext *c = h->priv_data;
+    struct stat st;
+    int ret;
+
+    // muxers seek to patch or reread what they wrote, possibly through
+    // another handle on the same file, so it has to be on disk first
+    ret = ff_file_async_flush(c->async);
+    if (ret < 0)
+        return ret;
+
+    if (whence == SEEK_SET || whence == SEEK_CUR) {
+        pos += whence == SEEK_CUR ? c->pos : 0;
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        c->pos = pos;
+        return pos;
+    }
+
+    if (fstat(c->fd, &st) < 0)
+        return AVERROR(errno);
+
+    if (whence == AVSEEK_SIZE)
+        return st.st_size;
+    if (whence != SEEK_END || st.st_size + pos < 0)
+        return AVERROR(EINVAL);
+    c->pos = st.st_size + pos;
+    return c->pos;
+}
+#endif
+
 /* XXX: use llseek */
 static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 {
     FileContext *c = h->priv_data;
     int64_t ret;
 
+#if CONFIG_FILE_ASYNC
+    if (c->async)
+        return file_async_seek(h, pos, whence);
+#endif
+
     if (whence == AVSEEK_SIZE) {
         struct stat st;
         ret = fstat(c->fd, &st);
@@ -305,6 +438,19 @@ static int file_open(URLContext *h, const char *filename, int flags)
 #ifdef O_BINARY
     access |= O_BINARY;
 #endif
+    if (c->direct) {
+#if defined(O_DIRECT) && CONFIG_FILE_ASYNC
+        // O_DIRECT requires aligned buffers, which only the async reads use
+        if (!c->queue_depth || flags & AVIO_FLAG_WRITE) {
+            av_log(h, AV_LOG_ERROR, "Direct I/O requires reading with queue_depth > 0\n");
+            return AVERROR(EINVAL);
+        }
+        access |= O_DIRECT;
+#else
+        av_log(h, AV_LOG_ERROR, "Direct I/O is not supported on this system\n");
+        return AVERROR(ENOSYS);
+#endif
+    }
     fd = avpriv_open(filename, access, 0666);
     if (fd == -1)
         return AVERROR(errno);
@@ -312,6 +458,53 @@ static int file_open(URLContext *h, const char *filename, int flags)
 
     h->is_streamed = !fstat(fd, &st) && S_ISFIFO(st.st_mode);
 
+    if (c->mmap) {
+#if HAVE_MMAP
+        if (!S_ISREG(st.st_mode) || c->follow || flags & AVIO_FLAG_WRITE) {
+            av_log(h, AV_LOG_WARNING, "Memory mapping is only supported on "
+                   "regular files opened for reading\n");
+            c->mmap = 0;
+        }
+#else
+        av_log(h, AV_LOG_WARNING, "Memory mapping is not supported on this system\n");
+        c->mmap = 0;
+#endif
+    }
+
+    if (c->queue_depth) {
+#if CONFIG_FILE_ASYNC
+        if (!S_ISREG(st.st_mode) || c->follow ||
+            (flags & AVIO_FLAG_WRITE && flags & AVIO_FLAG_READ)) {
+            av_log(h, AV_LOG_WARNING, "Asynchronous I/O is only supported on "
+                   "regular files opened for either reading or writing\n");
+#ifdef O_DIRECT
+            // the synchronous reads are not aligned for direct I/O
+            if (c->direct) {
+                int fl = fcntl(fd, F_GETFL);
+                if (fl == -1 || fcntl(fd, F_SETFL, fl & ~O_DIRECT) == -1) {
+                    int ret = AVERROR(errno);
+                    close(fd);
+                    return ret;
+                }
+                c->direct = 0;
+            }
+#endif
+        } else {
+            int ret = ff_file_async_init(&c->async, h, fd, flags & AVIO_FLAG_WRITE,
+                                         c->queue_depth,
+                                         FFALIGN(c->io_block_size, 4096),
+                                         c->direct ? 4096 : 1);
+            if (ret < 0) {
+                close(fd);
+                return ret;
+            }
+            c->pos = 0;
+        }
+#else
+        av_log(h, AV_LOG_WARNING, "Asynchronous I/O is not supported on this system\n");
+#endif
+    }
+
     if (c->pkt_size) {
         h->max_packet_size = c->pkt_size;
     } else {
@@ -423,6 +616,7 @@ const URLProtocol ff_file_protocol = {
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
+    .url_get_mapping     = file_get_mapping,
     .url_check           = file_check,
     .url_delete          = file_delete,
     .url_move            = file_move,
@@ -0,0 +1,443 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "file_async.h"
+
+enum BlockState {
+    BLOCK_EMPTY,
+    // queued for a worker
+    BLOCK_PENDING,
+    // read completed
+    BLOCK_READY,
+    // being filled by the writer
+    BLOCK_FILLING,
+};
+
+typedef struct FileBlock {
+    uint8_t        *alloc;
+    uint8_t        *buf;
+
+    int64_t         pos;
+    // number of valid bytes, read from or to be written to the file
+    int             size;
+    int             err;
+
+    enum BlockState state;
+    // a worker is doing I/O on the block
+    int             busy;
+    // the block was queued again at a new position while busy, the result
+    // of the I/O in progress must be dropped
+    int             restart;
+} FileBlock;
+
+struct FileAsync {
+    void           *logctx;
+    int             fd;
+    int             write;
+    int             block_size;
+
+    FileBlock      *blocks;
+    int          nb_blocks;
+
+    pthread_t      *workers;
+    int          nb_workers;
+
+    pthread_mutex_t lock;
+    // signalled when a block is queued or on abort
+    pthread_cond_t  work_cond;
+    // signalled when the I/O on a block completes
+    pthread_cond_t  done_cond;
+    int             abort;
+
+    // reading: position of the next block to queue
+    int64_t         next_pos;
+
+    // writing: block being filled and first write error
+    FileBlock      *cur;
+    int             write_err;
+};
+
+static int read_full(int fd, uint8_t *buf, int size, int64_t pos)
+{
+    int done = 0;
+
+    while (done < size) {
+        ssize_t ret = pread(fd, buf + done, size - done, pos + done);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return done ? done : AVERROR(errno);
+        }
+        if (!ret)
+            break;
+        done += ret;
+    }
+
+    return done;
+}
+
+static int write_full(int fd, const uint8_t *buf, int size, int64_t pos)
+{
+    int done = 0;
+
+    while (done < size) {
+        ssize_t ret = pwrite(fd, buf + done, size - done, pos + done);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return AVERROR(errno);
+        }
+        done += ret;
+    }
+
+    return done;
+}
+
+static void *worker(void *arg)
+{
+    FileAsync *fa = arg;
+
+    pthread_mutex_lock(&fa->lock);
+    while (!fa->abort) {
+        FileBlock *b = NULL;
+        int64_t pos;
+        int ret;
+
+        // serve the block the reader will need first
+        for (int i = 0; i < fa->nb_blocks; i++) {
+            FileBlock *cand = &fa->blocks[i];
+            if (cand->state == BLOCK_PENDING && !cand->busy &&
+                (!b || cand->pos < b->pos))
+                b = cand;
+        }
+        if (!b) {
+            pthread_cond_wait(&fa->work_cond, &fa->lock);
+            continue;
+        }
+
+        b->busy = 1;
+        pos     = b->pos;
+        pthread_mutex_unlock(&fa->lock);
+
+        ret = fa->write ? write_full(fa->fd, b->buf, b->size, pos) :
+                          read_full (fa->fd, b->buf, fa->block_size, pos);
+
+        pthread_mutex_lock(&fa->lock);
+        b->busy = 0;
+        if (b->restart) {
+            b->restart = 0;
+            continue;
+        }
+
+        if (fa->write) {
+            if (ret < 0 && !fa->write_err)
+                fa->write_err = ret;
+            b->state = BLOCK_EMPTY;
+        } else {
+            b->size  = FFMAX(ret, 0);
+            b->err   = FFMIN(ret, 0);
+            b->state = BLOCK_READY;
+        }
+        pthread_cond_broadcast(&fa->done_cond);
+    }
+    pthread_mutex_unlock(&fa->lock);
+
+    return NULL;
+}
+
+int ff_file_async_init(FileAsync **pfa, void *logctx, int fd, int write,
+                       int queue_depth, int block_size, int align)
+{
+    FileAsync *fa;
+    int ret;
+
+    *pfa = NULL;
+
+    fa = av_mallocz(sizeof(*fa));
+    if (!fa)
+        return AVERROR(ENOMEM);
+
+    fa->logctx     = logctx;
+    fa->fd         = fd;
+    fa->write      = write;
+    fa->block_size = block_size;
+
+    ret = pthread_mutex_init(&fa->lock, NULL);
+    if (ret) {
+        av_free(fa);
+        return AVERROR(ret);
+    }
+    ret = pthread_cond_init(&fa->work_cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&fa->lock);
+        av_free(fa);
+        return AVERROR(ret);
+    }
+    ret = pthread_cond_init(&fa->done_cond, NULL);
+    if (ret) {
+        pthread_cond_destroy(&fa->work_cond);
+        pthread_mutex_destroy(&fa->lock);
+        av_free(fa);
+        return AVERROR(ret);
+    }
+
+    // one more block than requests in flight, for the reader or writer
+    fa->blocks = av_calloc(queue_depth + 1, sizeof(*fa->blocks));
+    if (!fa->blocks) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    fa->nb_blocks = queue_depth + 1;
+
+    for (int i = 0; i < fa->nb_blocks; i++) {
+        FileBlock *b = &fa->blocks[i];
+
+        b->alloc = av_malloc(block_size + align);
+        if (!b->alloc) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        b->buf = (uint8_t *)FFALIGN((uintptr_t)b->alloc, align);
+    }
+
+    fa->workers = av_calloc(queue_depth, sizeof(*fa->workers));
+    if (!fa->workers) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < queue_depth; i++) {
+        ret = pthread_create(&fa->workers[i], NULL, worker, fa);
+        if (ret) {
+            ret = AVERROR(ret);
+            av_log(logctx, AV_LOG_ERROR, "pthread_create failed: %s\n", av_err2str(ret));
+            goto fail;
+        }
+        fa->nb_workers++;
+    }
+
+    av_log(logctx, AV_LOG_VERBOSE, "Asynchronous %s with %d requests of %d bytes\n",
+           write ? "writes" : "reads", queue_depth, block_size);
+
+    *pfa = fa;
+
+    return 0;
+fail:
+    ff_file_async_free(&fa);
+    return ret;
+}
+
+// (re)start the read-ahead with the block containing pos
+static void queue_reads(FileAsync *fa, int64_t pos)
+{
+    int64_t base = pos - pos % fa->block_size;
+
+    for (int i = 0; i < fa->nb_blocks; i++) {
+        FileBlock *b = &fa->blocks[i];
+
+        b->pos     = base + (int64_t)i * fa->block_size;
+        b->state   = BLOCK_PENDING;
+        b->restart = b->busy;
+    }
+    fa->next_pos = base + (int64_t)fa->nb_blocks * fa->block_size;
+
+    pthread_cond_broadcast(&fa->work_cond);
+}
+
+int ff_file_async_read(FileAsync *fa, int64_t pos, uint8_t *buf, int size)
+{
+    FileBlock *b;
+    int64_t offset;
+    int ret;
+
+    pthread_mutex_lock(&fa->lock);
+
+    while (1) {
+        b = NULL;
+        for (int i = 0; i < fa->nb_blocks; i++) {
+            FileBlock *cand = &fa->blocks[i];
+            if (cand->state != BLOCK_EMPTY && pos >= cand->pos &&
+                pos - cand->pos < fa->block_size) {
+                b = cand;
+                break;
+            }
+        }
+        if (b)
+            break;
+        queue_reads(fa, pos);
+    }
+
+    while (b->state != BLOCK_READY || b->busy)
+        pthread_cond_wait(&fa->done_cond, &fa->lock);
+
+    offset = pos - b->pos;
+    if (b->err < 0) {
+        ret = b->err;
+        // retry on the next read
+        b->state = BLOCK_EMPTY;
+    } else if (offset >= b->size) {
+        ret = AVERROR_EOF;
+    } else {
+        ret = FFMIN(size, b->size - offset);
+        memcpy(buf, b->buf + offset, ret);
+
+        // fully consumed, reuse the block to read further ahead
+        if (offset + ret == fa->block_size) {
+            b->pos        = fa->next_pos;
+            b->state      = BLOCK_PENDING;
+            fa->next_pos += fa->block_size;
+            pthread_cond_signal(&fa->work_cond);
+        }
+    }
+
+    pthread_mutex_unlock(&fa->lock);
+
+    return ret;
+}
+
+static void submit_write(FileAsync *fa)
+{
+    FileBlock *b = fa->cur;
+
+    fa->cur = NULL;
+    if (!b->size) {
+        b->state = BLOCK_EMPTY;
+        return;
+    }
+
+    b->state = BLOCK_PENDING;
+    pthread_cond_signal(&fa->work_cond);
+}
+
+static int flush_locked(FileAsync *fa)
+{
+    // the read-ahead blocks are never written back
+    if (!fa->write)
+        return 0;
+
+    if (fa->cur)
+        submit_write(fa);
+
+    for (int i = 0; i < fa->nb_blocks; i++) {
+        while (fa->blocks[i].state != BLOCK_EMPTY)
+            pthread_cond_wait(&fa->done_cond, &fa->lock);
+    }
+
+    return fa->write_err;
+}
+
+int ff_file_async_write(FileAsync *fa, int64_t pos, const uint8_t *buf, int size)
+{
+    FileBlock *b;
+    int ret;
+
+    pthread_mutex_lock(&fa->lock);
+
+    // keep overlapping writes in order
+    if (fa->cur && pos != fa->cur->pos + fa->cur->size)
+        flush_locked(fa);
+
+    if (fa->write_err) {
+        ret = fa->write_err;
+        goto finish;
+    }
+
+    if (!fa->cur) {
+        while (1) {
+            for (int i = 0; i < fa->nb_blocks && !fa->cur; i++)
+                if (fa->blocks[i].state == BLOCK_EMPTY)
+                    fa->cur = &fa->blocks[i];
+            if (fa->cur)
+                break;
+            pthread_cond_wait(&fa->done_cond, &fa->lock);
+        }
+        fa->cur->state = BLOCK_FILLING;
+        fa->cur->pos   = pos;
+        fa->cur->size  = 0;
+    }
+
+    b   = fa->cur;
+    ret = FFMIN(size, fa->block_size - b->size);
+    memcpy(b->buf + b->size, buf, ret);
+    b->size += ret;
+
+    if (b->size == fa->block_size)
+        submit_write(fa);
+
+finish:
+    pthread_mutex_unlock(&fa->lock);
+
+    return ret;
+}
+
+int ff_file_async_flush(FileAsync *fa)
+{
+    int ret;
+
+    pthread_mutex_lock(&fa->lock);
+    ret = flush_locked(fa);
+    pthread_mutex_unlock(&fa->lock);
+
+    return ret;
+}
+
+int ff_file_async_free(FileAsync **pfa)
+{
+    FileAsync *fa = *pfa;
+    int ret = 0;
+
+    if (!fa)
+        return 0;
+
+    pthread_mutex_lock(&fa->lock);
+    if (fa->nb_workers)
+        ret = flush_locked(fa);
+    fa->abort = 1;
+    pthread_cond_broadcast(&fa->work_cond);
+    pthread_mutex_unlock(&fa->lock);
+
+    for (int i = 0; i < fa->nb_workers; i++)
+        pthread_join(fa->workers[i], NULL);
+    av_freep(&fa->workers);
+
+    for (int i = 0; i < fa->nb_blocks; i++)
+        av_freep(&fa->blocks[i].alloc);
+    av_freep(&fa->blocks);
+
+    pthread_cond_destroy(&fa->done_cond);
+    pthread_cond_destroy(&fa->work_cond);
+    pthread_mutex_destroy(&fa->lock);
+
+    av_freep(pfa);
+
+    return ret;
+}
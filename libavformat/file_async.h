@@ -0,0 +1,74 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_FILE_ASYNC_H
+#define AVFORMAT_FILE_ASYNC_H
+
+#include <stdint.h>
+
+/**
+ * @file
+ * Asynchronous I/O on a regular file descriptor: a set of worker threads
+ * keeps up to queue_depth positioned reads of block_size bytes in flight
+ * ahead of the reader, or writes the blocks filled by the writer behind its
+ * back. All the offsets are explicit, the file offset of the descriptor is
+ * neither used nor changed.
+ */
+
+typedef struct FileAsync FileAsync;
+
+/**
+ * @param write       if nonzero, the blocks are written instead of read
+ * @param block_size  size of each I/O request, a multiple of 4096
+ * @param align       alignment of the block buffers, e.g. for O_DIRECT
+ */
+int ff_file_async_init(FileAsync **pfa, void *logctx, int fd, int write,
+                       int queue_depth, int block_size, int align);
+
+/**
+ * Read up to size bytes at pos, waiting for the block containing it.
+ * Reading outside of the blocks already queued restarts the read-ahead at
+ * the new position.
+ *
+ * @return number of bytes read, AVERROR_EOF or another negative error code
+ */
+int ff_file_async_read(FileAsync *fa, int64_t pos, uint8_t *buf, int size);
+
+/**
+ * Queue up to size bytes for writing at pos. Writes at a position that does
+ * not follow the previous one wait for all the queued blocks first.
+ *
+ * @return number of bytes queued or a negative error code of a failed write
+ */
+int ff_file_async_write(FileAsync *fa, int64_t pos, const uint8_t *buf, int size);
+
+/**
+ * Wait for all the queued writes to complete, does nothing when reading.
+ *
+ * @return 0 or the error code of the first failed write
+ */
+int ff_file_async_flush(FileAsync *fa);
+
+/**
+ * Flush the queued writes, stop the workers and free everything.
+ *
+ * @return 0 or the error code of the first failed write
+ */
+int ff_file_async_free(FileAsync **pfa);
+
+#endif /* AVFORMAT_FILE_ASYNC_H */
@@ -46,6 +46,7 @@
 #include "id3v2.h"
 #include "url.h"
 
+#include "hls_prefetch.h"
 #include "hls_sample_encryption.h"
 
 #define INITIAL_BUFFER_SIZE 32768
@@ -107,6 +108,8 @@ struct playlist {
     int input_read_done;
     AVIOContext *input_next;
     int input_next_requested;
+    HLSPrefetchSegment *prefetch_seg;
+    int prefetch_failed;
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -231,6 +234,10 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch_segments;
+    int64_t prefetch_max_size;
+    int64_t prefetch_split_size;
+    HLSPrefetch *prefetch;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
@@ -1130,6 +1137,15 @@ static struct segment *next_segment(struct playlist *pls)
     return pls->segments[n];
 }
 
+static void close_prefetch_segment(HLSContext *c, struct playlist *pls)
+{
+#if CONFIG_HLS_PREFETCH
+    if (c->prefetch)
+        ff_hls_prefetch_release(c->prefetch, &pls->prefetch_seg);
+    pls->prefetch_failed = 0;
+#endif
+}
+
 static int read_from_url(struct playlist *pls, struct segment *seg,
                          uint8_t *buf, int buf_size)
 {
@@ -1139,6 +1155,12 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
+#if CONFIG_HLS_PREFETCH
+    if (pls->prefetch_seg) {
+        HLSContext *c = pls->parent->priv_data;
+        ret = ff_hls_prefetch_read(c->prefetch, pls->prefetch_seg, buf, buf_size);
+    } else
+#endif
     ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
@@ -1571,7 +1593,7 @@ static int reload_playlist(struct playlist *v, HLSContext *c)
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->prefetch_seg) || (c->http_persistent && v->input_read_done)) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1638,6 +1660,42 @@ reload:
     return ret;
 }
 
+#if CONFIG_HLS_PREFETCH
+/* Queue the segments following the current one and read the current one
+ * from the prefetched data if possible. */
+static int open_prefetch(HLSContext *c, struct playlist *pls, struct segment *seg)
+{
+    int64_t end = FFMIN(pls->cur_seq_no + c->prefetch_segments,
+                        pls->start_seq_no + pls->n_segments);
+    int ret;
+
+    ff_hls_prefetch_drop(c->prefetch, pls->index, pls->cur_seq_no, end);
+    for (int64_t n = pls->cur_seq_no; n < end; n++) {
+        struct segment *queued = pls->segments[n - pls->start_seq_no];
+
+        if (queued->key_type != KEY_NONE || !av_strstart(queued->url, "http", NULL))
+            continue;
+        ret = ff_hls_prefetch_add(c->prefetch, pls->index, n, queued->url,
+                                  queued->url_offset, queued->size, c->avio_opts);
+        if (ret < 0)
+            return ret;
+    }
+
+    pls->prefetch_seg = ff_hls_prefetch_get(c->prefetch, pls->index,
+                                            pls->cur_seq_no, seg->url);
+    if (!pls->prefetch_seg)
+        return 0;
+
+    av_log(pls->parent, AV_LOG_VERBOSE, "HLS prefetched url '%s', offset %"PRId64", playlist %d\n",
+           seg->url, seg->url_offset, pls->index);
+    ff_format_io_close(pls->parent, &pls->input);
+    pls->input_read_done = 0;
+    pls->cur_seg_offset  = 0;
+
+    return 1;
+}
+#endif
+
 static int read_data_continuous(void *opaque, uint8_t *buf, int buf_size)
 {
     struct playlist *v = opaque;
@@ -1662,7 +1720,7 @@ restart:
 
     seg = current_segment(v);
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->prefetch_seg) || (c->http_persistent && v->input_read_done)) {
         /* load/update Media Initialization Section, if any */
         ret = update_init_section(v, seg);
         if (ret)
@@ -1673,6 +1731,11 @@ restart:
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
             ret = 0;
+#if CONFIG_HLS_PREFETCH
+        } else if (c->prefetch && !v->prefetch_failed &&
+                   (ret = open_prefetch(c, v, seg))) {
+            ret = FFMIN(ret, 0);
+#endif
         } else {
             ret = open_input(c, v, seg, &v->input);
         }
@@ -1697,7 +1760,7 @@ restart:
         just_opened = 1;
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1707,7 +1770,7 @@ restart:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !c->prefetch &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1740,6 +1803,19 @@ restart:
 
         return ret;
     }
+#if CONFIG_HLS_PREFETCH
+    if (v->prefetch_seg) {
+        close_prefetch_segment(c, v);
+        /* open the segment directly if it could not be prefetched at all */
+        if (ret != AVERROR_EOF && ret != AVERROR_EXIT && !v->cur_seg_offset) {
+            av_log(v->parent, AV_LOG_WARNING, "Failed to prefetch segment %"PRId64" of playlist %d\n",
+                   v->cur_seq_no, v->index);
+            v->prefetch_failed = 1;
+            goto restart;
+        }
+    }
+    v->prefetch_failed = 0;
+#endif
     if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
@@ -2118,6 +2194,9 @@ static int hls_close(AVFormatContext *s)
 {
     HLSContext *c = s->priv_data;
 
+#if CONFIG_HLS_PREFETCH
+    ff_hls_prefetch_free(&c->prefetch);
+#endif
     free_playlist_list(c);
     free_variant_list(c);
     free_rendition_list(c);
@@ -2152,6 +2231,25 @@ static int hls_read_header(AVFormatContext *s)
        the range header */
     av_dict_set_int(&c->avio_opts, "seekable", c->http_seekable, 0);
 
+    if (c->prefetch_segments) {
+#if CONFIG_HLS_PREFETCH
+        /* the workers open the segments with the protocols directly */
+        if (!ff_format_io_open_is_default(s)) {
+            av_log(s, AV_LOG_WARNING, "Segment prefetching is not supported "
+                   "with a custom io_open callback\n");
+        } else {
+            ret = ff_hls_prefetch_alloc(&c->prefetch, s, c->prefetch_segments,
+                                        c->prefetch_max_size, c->prefetch_split_size,
+                                        c->http_persistent, &s->interrupt_callback,
+                                        s->protocol_whitelist, s->protocol_blacklist);
+            if (ret < 0)
+                return ret;
+        }
+#else
+        av_log(s, AV_LOG_WARNING, "Segment prefetching is not supported in this build\n");
+#endif
+    }
+
     if ((ret = parse_playlist(c, s->url, NULL, s->pb)) < 0)
         return ret;
 
@@ -2291,6 +2389,7 @@ static int hls_read_header(AVFormatContext *s)
             /* Reset reading */
             ff_format_io_close(pls->parent, &pls->input);
             pls->input = NULL;
+            close_prefetch_segment(c, pls);
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
@@ -2461,6 +2560,11 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             av_log(s, AV_LOG_INFO, "Now receiving playlist %d, segment %"PRId64"\n", i, pls->cur_seq_no);
         } else if (first && !cur_needed && pls->needed) {
             ff_format_io_close(pls->parent, &pls->input);
+            close_prefetch_segment(c, pls);
+#if CONFIG_HLS_PREFETCH
+            if (c->prefetch)
+                ff_hls_prefetch_drop(c->prefetch, pls->index, 0, 0);
+#endif
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
@@ -2722,6 +2826,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         struct playlist *pls = c->playlists[i];
         AVIOContext *const pb = &pls->pb.pub;
         ff_format_io_close(pls->parent, &pls->input);
+        close_prefetch_segment(c, pls);
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
@@ -2835,6 +2940,12 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of segments of each playlist downloaded in advance, and of download threads shared by all playlists",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_max_size", "Amount of prefetched data above which only the next segment is downloaded",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 0, INT64_MAX, FLAGS},
+    {"prefetch_split_size", "Download larger prefetched segments as several byte ranges of this size, 0 = disable",
+        OFFSET(prefetch_split_size), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS},
     {NULL}
 };
 
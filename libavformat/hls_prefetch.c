@@ -0,0 +1,640 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config_components.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "avio_internal.h"
+#include "hls_prefetch.h"
+#include "http.h"
+#include "url.h"
+
+/* size of the reads done by the workers */
+#define CHUNK_SIZE (64 * 1024)
+
+enum PartState {
+    PART_PENDING,
+    PART_RUNNING,
+    PART_DONE,
+};
+
+typedef struct PrefetchPart {
+    int64_t  offset;
+    /* -1 until the end of the resource */
+    int64_t  size;
+    uint8_t *buf;
+    unsigned buf_size;
+    size_t   filled;
+    enum PartState state;
+    int      err;
+} PrefetchPart;
+
+struct HLSPrefetchSegment {
+    int      playlist;
+    int64_t  seq_no;
+    char    *url;
+    AVDictionary *opts;
+
+    /* byte ranges downloaded separately, read in order */
+    PrefetchPart *parts;
+    int      nb_parts;
+    /* the size is unknown, the segment is split once the first response
+     * gives it */
+    int      split_pending;
+    /* number of workers downloading parts of the segment */
+    int      nb_running;
+    /* no longer queued, freed once no worker uses it */
+    atomic_int dropped;
+
+    int      read_part;
+    size_t   read_pos;
+
+    HLSPrefetchSegment *next;
+};
+
+typedef struct PrefetchWorker {
+    HLSPrefetch *p;
+    pthread_t    thread;
+    int          thread_started;
+    /* kept open between requests if persistent */
+    AVIOContext *pb;
+    HLSPrefetchSegment *seg;
+    AVIOInterruptCB int_cb;
+    uint8_t      buf[CHUNK_SIZE];
+} PrefetchWorker;
+
+struct HLSPrefetch {
+    void    *logctx;
+    AVIOInterruptCB *int_cb;
+    char    *whitelist;
+    char    *blacklist;
+    int64_t  max_size;
+    int64_t  split_size;
+    int      persistent;
+
+    PrefetchWorker *workers;
+    int      nb_workers;
+
+    pthread_mutex_t lock;
+    /* signalled when segments are queued or dropped and data is downloaded
+     * or consumed */
+    pthread_cond_t  cond;
+    atomic_int abort;
+
+    /* queued segments, in the order they were added */
+    HLSPrefetchSegment *segments;
+    /* size of the downloaded data not consumed yet */
+    int64_t  buffered;
+};
+
+static void segment_free(HLSPrefetchSegment *seg)
+{
+    for (int i = 0; i < seg->nb_parts; i++)
+        av_free(seg->parts[i].buf);
+    av_free(seg->parts);
+    av_dict_free(&seg->opts);
+    av_free(seg->url);
+    av_free(seg);
+}
+
+static void drop_locked(HLSPrefetch *p, HLSPrefetchSegment *seg)
+{
+    for (HLSPrefetchSegment **s = &p->segments; *s; s = &(*s)->next) {
+        if (*s == seg) {
+            *s = seg->next;
+            break;
+        }
+    }
+
+    for (int i = 0; i < seg->nb_parts; i++)
+        p->buffered -= seg->parts[i].filled;
+    atomic_store(&seg->dropped, 1);
+    pthread_cond_broadcast(&p->cond);
+
+    // the workers free it when they are done
+    if (!seg->nb_running)
+        segment_free(seg);
+}
+
+/* Position of the segment among the queued segments of its playlist. */
+static int segment_rank(HLSPrefetch *p, HLSPrefetchSegment *seg)
+{
+    int rank = 0;
+
+    for (HLSPrefetchSegment *s = p->segments; s != seg; s = s->next)
+        rank += s->playlist == seg->playlist;
+    return rank;
+}
+
+/* Data beyond max_size is only downloaded for the first segment of each
+ * playlist, which the demuxer is waiting for. */
+static int may_download(HLSPrefetch *p, HLSPrefetchSegment *seg)
+{
+    return p->buffered < p->max_size || !segment_rank(p, seg);
+}
+
+static int add_parts(HLSPrefetchSegment *seg, int64_t offset, int64_t end,
+                     int64_t split_size)
+{
+    int nb = (end - offset + split_size - 1) / split_size;
+    PrefetchPart *parts;
+
+    if (nb > INT_MAX / sizeof(*parts) - seg->nb_parts)
+        return AVERROR(ERANGE);
+    parts = av_realloc_array(seg->parts, seg->nb_parts + nb, sizeof(*parts));
+    if (!parts)
+        return AVERROR(ENOMEM);
+    seg->parts = parts;
+
+    for (; offset < end; offset += split_size) {
+        PrefetchPart *part = &seg->parts[seg->nb_parts++];
+        memset(part, 0, sizeof(*part));
+        part->offset = offset;
+        part->size   = FFMIN(split_size, end - offset);
+    }
+
+    return 0;
+}
+
+static int worker_interrupt(void *opaque)
+{
+    PrefetchWorker *w = opaque;
+
+    return atomic_load(&w->p->abort) ||
+           (w->seg && atomic_load(&w->seg->dropped)) ||
+           ff_check_interrupt(w->p->int_cb);
+}
+
+static int open_part(PrefetchWorker *w, HLSPrefetchSegment *seg,
+                     int64_t offset, int64_t size)
+{
+    HLSPrefetch *p = w->p;
+    AVDictionary *opts = NULL;
+    int ret = AVERROR(ENOSYS);
+
+    if ((ret = av_dict_copy(&opts, seg->opts, 0)) < 0 ||
+        (ret = av_dict_set_int(&opts, "offset", offset, 0)) < 0 ||
+        // reset the range of a reused connection
+        (ret = av_dict_set_int(&opts, "end_offset", size >= 0 ? offset + size : 0, 0)) < 0 ||
+        (p->persistent && (ret = av_dict_set(&opts, "multiple_requests", "1", 0)) < 0))
+        goto end;
+
+#if CONFIG_HTTP_PROTOCOL
+    if (w->pb) {
+        URLContext *uc = ffio_geturlcontext(w->pb);
+
+        w->pb->eof_reached = 0;
+        ret = uc ? ff_http_do_new_request2(uc, seg->url, &opts) : AVERROR(ENOSYS);
+        if (ret < 0)
+            avio_closep(&w->pb);
+    }
+#endif
+    if (!w->pb)
+        ret = ffio_open_whitelist(&w->pb, seg->url, AVIO_FLAG_READ, &w->int_cb,
+                                  &opts, p->whitelist, p->blacklist);
+end:
+    av_dict_free(&opts);
+    return ret;
+}
+
+static int append_locked(HLSPrefetch *p, PrefetchPart *part,
+                         const uint8_t *buf, int size)
+{
+    size_t needed = part->filled + size;
+    uint8_t *tmp;
+
+    if (needed > INT_MAX)
+        return AVERROR(ERANGE);
+    // allocated at once if the size is known
+    if (part->size >= 0)
+        needed = FFMAX(needed, part->size);
+
+    tmp = av_fast_realloc(part->buf, &part->buf_size, needed);
+    if (!tmp)
+        return AVERROR(ENOMEM);
+    part->buf = tmp;
+
+    memcpy(part->buf + part->filled, buf, size);
+    part->filled += size;
+    p->buffered  += size;
+    pthread_cond_broadcast(&p->cond);
+
+    return 0;
+}
+
+/* Called with the lock held, which is released while downloading. */
+static int download_part(PrefetchWorker *w, HLSPrefetchSegment *seg, int idx)
+{
+    HLSPrefetch *p = w->p;
+    int64_t offset = seg->parts[idx].offset;
+    int64_t size   = seg->parts[idx].size;
+    int64_t done   = 0;
+    int keep = p->persistent, ret;
+
+    pthread_mutex_unlock(&p->lock);
+    ret = open_part(w, seg, offset, size);
+    pthread_mutex_lock(&p->lock);
+    if (ret < 0)
+        return ret;
+
+    if (seg->split_pending) {
+        int64_t total = avio_size(w->pb);
+
+        seg->split_pending = 0;
+        // the server must also accept byte range requests
+        if ((w->pb->seekable & AVIO_SEEKABLE_NORMAL) &&
+            total > 0 && total - offset > p->split_size) {
+            // this request only serves the first range
+            seg->parts[idx].size = size = p->split_size;
+            if ((ret = add_parts(seg, offset + size, total, p->split_size)) < 0)
+                return ret;
+            keep = 0;
+            pthread_cond_broadcast(&p->cond);
+        }
+    }
+
+    while (size < 0 || done < size) {
+        while (!atomic_load(&p->abort) && !atomic_load(&seg->dropped) &&
+               !may_download(p, seg))
+            pthread_cond_wait(&p->cond, &p->lock);
+        if (atomic_load(&p->abort) || atomic_load(&seg->dropped)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+
+        pthread_mutex_unlock(&p->lock);
+        ret = avio_read(w->pb, w->buf, size < 0 ? CHUNK_SIZE :
+                                        FFMIN(CHUNK_SIZE, size - done));
+        pthread_mutex_lock(&p->lock);
+
+        if (ret == AVERROR_EOF && size < 0) {
+            ret = 0;
+            break;
+        }
+        if (ret == AVERROR_EOF || !ret)
+            ret = AVERROR(EIO);
+        if (ret < 0)
+            break;
+        if (atomic_load(&seg->dropped)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+
+        done += ret;
+        if ((ret = append_locked(p, &seg->parts[idx], w->buf, ret)) < 0)
+            break;
+    }
+
+    if (ret < 0 || !keep) {
+        pthread_mutex_unlock(&p->lock);
+        avio_closep(&w->pb);
+        pthread_mutex_lock(&p->lock);
+    }
+
+    return ret;
+}
+
+/* The pending part the demuxer will need first. */
+static HLSPrefetchSegment *pick_part(HLSPrefetch *p, int *idx)
+{
+    HLSPrefetchSegment *best = NULL;
+    int best_rank = INT_MAX;
+
+    for (HLSPrefetchSegment *seg = p->segments; seg; seg = seg->next) {
+        int rank = segment_rank(p, seg);
+
+        if (rank >= best_rank || (rank && p->buffered >= p->max_size))
+            continue;
+        for (int i = 0; i < seg->nb_parts; i++) {
+            // the other parts are only known once the first one started
+            if (seg->split_pending && i)
+                break;
+            if (seg->parts[i].state == PART_PENDING) {
+                best      = seg;
+                best_rank = rank;
+                *idx      = i;
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+static void *worker(void *arg)
+{
+    PrefetchWorker *w = arg;
+    HLSPrefetch *p = w->p;
+
+    pthread_mutex_lock(&p->lock);
+    while (!atomic_load(&p->abort)) {
+        HLSPrefetchSegment *seg;
+        int idx, ret;
+
+        seg = pick_part(p, &idx);
+        if (!seg) {
+            pthread_cond_wait(&p->cond, &p->lock);
+            continue;
+        }
+
+        seg->parts[idx].state = PART_RUNNING;
+        seg->nb_running++;
+        w->seg = seg;
+
+        ret = download_part(w, seg, idx);
+        if (ret < 0 && ret != AVERROR_EXIT)
+            av_log(p->logctx, AV_LOG_WARNING, "Failed to prefetch '%s': %s\n",
+                   seg->url, av_err2str(ret));
+
+        seg->parts[idx].state = PART_DONE;
+        seg->parts[idx].err   = FFMIN(ret, 0);
+        seg->nb_running--;
+        w->seg = NULL;
+        if (atomic_load(&seg->dropped) && !seg->nb_running)
+            segment_free(seg);
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+int ff_hls_prefetch_alloc(HLSPrefetch **pp, void *logctx, int nb_workers,
+                          int64_t max_size, int64_t split_size, int persistent,
+                          AVIOInterruptCB *int_cb,
+                          const char *whitelist, const char *blacklist)
+{
+    HLSPrefetch *p;
+    int ret;
+
+    *pp = NULL;
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return AVERROR(ENOMEM);
+
+    p->logctx     = logctx;
+    p->int_cb     = int_cb;
+    p->max_size   = max_size;
+    p->split_size = split_size;
+    p->persistent = persistent;
+    atomic_init(&p->abort, 0);
+    if ((whitelist && !(p->whitelist = av_strdup(whitelist))) ||
+        (blacklist && !(p->blacklist = av_strdup(blacklist)))) {
+        av_free(p->whitelist);
+        av_free(p);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = pthread_mutex_init(&p->lock, NULL);
+    if (ret) {
+        av_free(p->whitelist);
+        av_free(p->blacklist);
+        av_free(p);
+        return AVERROR(ret);
+    }
+    ret = pthread_cond_init(&p->cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&p->lock);
+        av_free(p->whitelist);
+        av_free(p->blacklist);
+        av_free(p);
+        return AVERROR(ret);
+    }
+
+    p->workers = av_calloc(nb_workers, sizeof(*p->workers));
+    if (!p->workers) {
+        ff_hls_prefetch_free(&p);
+        return AVERROR(ENOMEM);
+    }
+    for (int i = 0; i < nb_workers; i++) {
+        PrefetchWorker *w = &p->workers[i];
+
+        w->p      = p;
+        w->int_cb = (AVIOInterruptCB){ worker_interrupt, w };
+        ret = pthread_create(&w->thread, NULL, worker, w);
+        if (ret) {
+            av_log(logctx, AV_LOG_ERROR, "pthread_create failed: %s\n", av_err2str(AVERROR(ret)));
+            ff_hls_prefetch_free(&p);
+            return AVERROR(ret);
+        }
+        w->thread_started = 1;
+        p->nb_workers++;
+    }
+
+    *pp = p;
+
+    return 0;
+}
+
+void ff_hls_prefetch_free(HLSPrefetch **pp)
+{
+    HLSPrefetch *p = *pp;
+
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->abort, 1);
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int i = 0; i < p->nb_workers; i++) {
+        PrefetchWorker *w = &p->workers[i];
+        if (w->thread_started)
+            pthread_join(w->thread, NULL);
+        avio_closep(&w->pb);
+    }
+    av_freep(&p->workers);
+
+    while (p->segments) {
+        HLSPrefetchSegment *seg = p->segments;
+        p->segments = seg->next;
+        segment_free(seg);
+    }
+
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+    av_free(p->whitelist);
+    av_free(p->blacklist);
+    av_freep(pp);
+}
+
+int ff_hls_prefetch_add(HLSPrefetch *p, int playlist, int64_t seq_no,
+                        const char *url, int64_t offset, int64_t size,
+                        const AVDictionary *opts)
+{
+    HLSPrefetchSegment *seg, **tail;
+    int ret;
+
+    pthread_mutex_lock(&p->lock);
+    for (seg = p->segments; seg; seg = seg->next) {
+        if (seg->playlist == playlist && seg->seq_no == seq_no) {
+            if (!strcmp(seg->url, url) && seg->parts[0].offset == offset) {
+                pthread_mutex_unlock(&p->lock);
+                return 0;
+            }
+            // the playlist was updated
+            drop_locked(p, seg);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    seg = av_mallocz(sizeof(*seg));
+    if (!seg)
+        return AVERROR(ENOMEM);
+    seg->playlist = playlist;
+    seg->seq_no   = seq_no;
+    atomic_init(&seg->dropped, 0);
+    seg->url = av_strdup(url);
+    if (!seg->url || (ret = av_dict_copy(&seg->opts, opts, 0)) < 0) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    if (size >= 0 && p->split_size > 0)
+        ret = add_parts(seg, offset, offset + FFMAX(size, 1), p->split_size);
+    else
+        ret = add_parts(seg, offset, offset + 1, 1);
+    if (ret < 0)
+        goto fail;
+    seg->parts[seg->nb_parts - 1].size = size >= 0 ?
+        offset + size - seg->parts[seg->nb_parts - 1].offset : -1;
+    seg->split_pending = size < 0 && p->split_size > 0;
+
+    pthread_mutex_lock(&p->lock);
+    for (tail = &p->segments; *tail; tail = &(*tail)->next)
+        ;
+    *tail = seg;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+
+    av_log(p->logctx, AV_LOG_DEBUG, "Prefetching segment %"PRId64" of playlist %d "
+           "in %d part(s)\n", seq_no, playlist, seg->nb_parts);
+
+    return 0;
+fail:
+    segment_free(seg);
+    return ret;
+}
+
+void ff_hls_prefetch_drop(HLSPrefetch *p, int playlist,
+                          int64_t min_seq_no, int64_t max_seq_no)
+{
+    HLSPrefetchSegment *seg, *next;
+
+    pthread_mutex_lock(&p->lock);
+    for (seg = p->segments; seg; seg = next) {
+        next = seg->next;
+        if (seg->playlist == playlist &&
+            (seg->seq_no < min_seq_no || seg->seq_no >= max_seq_no))
+            drop_locked(p, seg);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+HLSPrefetchSegment *ff_hls_prefetch_get(HLSPrefetch *p, int playlist,
+                                        int64_t seq_no, const char *url)
+{
+    HLSPrefetchSegment *seg;
+
+    pthread_mutex_lock(&p->lock);
+    for (seg = p->segments; seg; seg = seg->next)
+        if (seg->playlist == playlist && seg->seq_no == seq_no &&
+            !strcmp(seg->url, url))
+            break;
+    pthread_mutex_unlock(&p->lock);
+
+    return seg;
+}
+
+int ff_hls_prefetch_read(HLSPrefetch *p, HLSPrefetchSegment *seg,
+                         uint8_t *buf, int size)
+{
+    int ret;
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        PrefetchPart *part;
+
+        if (seg->read_part >= seg->nb_parts) {
+            ret = AVERROR_EOF;
+            break;
+        }
+        part = &seg->parts[seg->read_part];
+
+        if (part->filled > seg->read_pos) {
+            ret = FFMIN(size, part->filled - seg->read_pos);
+            memcpy(buf, part->buf + seg->read_pos, ret);
+            seg->read_pos += ret;
+            break;
+        }
+        if (part->state == PART_DONE) {
+            if (part->err < 0) {
+                ret = part->err;
+                break;
+            }
+            // consumed, make room for the next segments
+            p->buffered -= part->filled;
+            av_freep(&part->buf);
+            part->buf_size = 0;
+            part->filled   = 0;
+            seg->read_part++;
+            seg->read_pos  = 0;
+            pthread_cond_broadcast(&p->cond);
+            continue;
+        }
+
+        if (ff_check_interrupt(p->int_cb)) {
+            ret = AVERROR_EXIT;
+            break;
+        } else {
+            int64_t t = av_gettime() + 100000;
+            struct timespec tv = { .tv_sec  =  t / 1000000,
+                                   .tv_nsec = (t % 1000000) * 1000 };
+            pthread_cond_timedwait(&p->cond, &p->lock, &tv);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return ret;
+}
+
+void ff_hls_prefetch_release(HLSPrefetch *p, HLSPrefetchSegment **pseg)
+{
+    if (!*pseg)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    drop_locked(p, *pseg);
+    pthread_mutex_unlock(&p->lock);
+    *pseg = NULL;
+}
@@ -0,0 +1,100 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_HLS_PREFETCH_H
+#define AVFORMAT_HLS_PREFETCH_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+
+#include "avio.h"
+
+/**
+ * @file
+ * Segment prefetching for the HLS demuxer: a set of worker threads
+ * downloads the queued segments concurrently into memory, splitting large
+ * segments into byte range requests, while the demuxer reads the segments
+ * in order as their data arrives.
+ */
+
+typedef struct HLSPrefetch HLSPrefetch;
+typedef struct HLSPrefetchSegment HLSPrefetchSegment;
+
+/**
+ * @param nb_workers  number of concurrent downloads
+ * @param max_size    amount of downloaded data above which only the first
+ *                    queued segment of each playlist keeps being downloaded
+ * @param split_size  size above which segments are downloaded as several
+ *                    byte ranges of this size, 0 to disable
+ * @param persistent  reuse the HTTP connection of each worker
+ * @param int_cb      interrupt callback of the demuxer, also checked by the
+ *                    workers
+ */
+int ff_hls_prefetch_alloc(HLSPrefetch **pp, void *logctx, int nb_workers,
+                          int64_t max_size, int64_t split_size, int persistent,
+                          AVIOInterruptCB *int_cb,
+                          const char *whitelist, const char *blacklist);
+
+/**
+ * Stop the workers and free everything.
+ */
+void ff_hls_prefetch_free(HLSPrefetch **pp);
+
+/**
+ * Queue a segment for download, unless it is already queued.
+ *
+ * @param playlist index of the playlist, segments are identified by
+ *                 playlist and seq_no
+ * @param size     size of the byte range to download, or -1 for the rest of
+ *                 the resource
+ * @param opts     options for opening url, copied
+ */
+int ff_hls_prefetch_add(HLSPrefetch *p, int playlist, int64_t seq_no,
+                        const char *url, int64_t offset, int64_t size,
+                        const AVDictionary *opts);
+
+/**
+ * Drop the queued segments of a playlist outside [min_seq_no, max_seq_no).
+ */
+void ff_hls_prefetch_drop(HLSPrefetch *p, int playlist,
+                          int64_t min_seq_no, int64_t max_seq_no);
+
+/**
+ * Find a queued segment to read it.
+ *
+ * @return the segment or NULL if it is not queued with this url
+ */
+HLSPrefetchSegment *ff_hls_prefetch_get(HLSPrefetch *p, int playlist,
+                                        int64_t seq_no, const char *url);
+
+/**
+ * Read the next bytes of a segment, waiting for them to be downloaded.
+ *
+ * @return number of bytes read, AVERROR_EOF at the end of the segment or
+ *         the error of the download
+ */
+int ff_hls_prefetch_read(HLSPrefetch *p, HLSPrefetchSegment *seg,
+                         uint8_t *buf, int size);
+
+/**
+ * Drop a segment returned by ff_hls_prefetch_get() and set *pseg to NULL.
+ */
+void ff_hls_prefetch_release(HLSPrefetch *p, HLSPrefetchSegment **pseg);
+
+#endif /* AVFORMAT_HLS_PREFETCH_H */
@@ -0,0 +1,419 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+
+#include "hpack.h"
+
+/* RFC 7541 section 4.1 */
+#define ENTRY_OVERHEAD 32
+
+/* RFC 7541 appendix A */
+static const HPACKEntry static_table[] = {
+    { ":authority",                  ""              },
+    { ":method",                     "GET"           },
+    { ":method",                     "POST"          },
+    { ":path",                       "/"             },
+    { ":path",                       "/index.html"   },
+    { ":scheme",                     "http"          },
+    { ":scheme",                     "https"         },
+    { ":status",                     "200"           },
+    { ":status",                     "204"           },
+    { ":status",                     "206"           },
+    { ":status",                     "304"           },
+    { ":status",                     "400"           },
+    { ":status",                     "404"           },
+    { ":status",                     "500"           },
+    { "accept-charset",              ""              },
+    { "accept-encoding",             "gzip, deflate" },
+    { "accept-language",             ""              },
+    { "accept-ranges",               ""              },
+    { "accept",                      ""              },
+    { "access-control-allow-origin", ""              },
+    { "age",                         ""              },
+    { "allow",                       ""              },
+    { "authorization",               ""              },
+    { "cache-control",               ""              },
+    { "content-disposition",         ""              },
+    { "content-encoding",            ""              },
+    { "content-language",            ""              },
+    { "content-length",              ""              },
+    { "content-location",            ""              },
+    { "content-range",               ""              },
+    { "content-type",                ""              },
+    { "cookie",                      ""              },
+    { "date",                        ""              },
+    { "etag",                        ""              },
+    { "expect",                      ""              },
+    { "expires",                     ""              },
+    { "from",                        ""              },
+    { "host",                        ""              },
+    { "if-match",                    ""              },
+    { "if-modified-since",           ""              },
+    { "if-none-match",               ""              },
+    { "if-range",                    ""              },
+    { "if-unmodified-since",         ""              },
+    { "last-modified",               ""              },
+    { "link",                        ""              },
+    { "location",                    ""              },
+    { "max-forwards",                ""              },
+    { "proxy-authenticate",          ""              },
+    { "proxy-authorization",         ""              },
+    { "range",                       ""              },
+    { "referer",                     ""              },
+    { "refresh",                     ""              },
+    { "retry-after",                 ""              },
+    { "server",                      ""              },
+    { "set-cookie",                  ""              },
+    { "strict-transport-security",   ""              },
+    { "transfer-encoding",           ""              },
+    { "user-agent",                  ""              },
+    { "vary",                        ""              },
+    { "via",                         ""              },
+    { "www-authenticate",            ""              },
+};
+
+/* The Huffman code of RFC 7541 appendix B is canonical, it is fully
+ * described by the number of codes of each length and the symbols sorted by
+ * code length then value. Symbol 256 is EOS. */
+#define HUFFMAN_MAX_BITS 30
+
+static const uint8_t huffman_counts[HUFFMAN_MAX_BITS + 1] = {
+     0,  0,  0,  0,  0, 10, 26, 32,  6,  0,  5,  3,  2,  6,  2,  3,
+     0,  0,  0,  3,  8, 13, 26, 29, 12,  4, 15, 19, 29,  0,  4,
+};
+
+static const uint16_t huffman_symbols[257] = {
+     48,  49,  50,  97,  99, 101, 105, 111, 115, 116,  32,  37,  45,  46,  47,
+     51,  52,  53,  54,  55,  56,  57,  61,  65,  95,  98, 100, 102, 103, 104,
+    108, 109, 110, 112, 114, 117,  58,  66,  67,  68,  69,  70,  71,  72,  73,
+     74,  75,  76,  77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  89,
+    106, 107, 113, 118, 119, 120, 121, 122,  38,  42,  44,  59,  88,  90,  33,
+     34,  40,  41,  63,  39,  43, 124,  35,  62,   0,  36,  64,  91,  93, 126,
+     94, 125,  60,  96, 123,  92, 195, 208, 128, 130, 131, 162, 184, 194, 224,
+    226, 153, 161, 167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+    132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170, 173, 178, 181,
+    185, 186, 187, 189, 190, 196, 198, 228, 232, 233,   1, 135, 137, 138, 139,
+    140, 141, 143, 147, 149, 150, 151, 152, 155, 157, 158, 165, 166, 168, 174,
+    175, 180, 182, 183, 188, 191, 197, 231, 239,   9, 142, 144, 145, 148, 159,
+    171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193, 200, 201, 202,
+    205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211, 212, 214,
+    221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,   2,
+      3,   4,   5,   6,   7,   8,  11,  12,  14,  15,  16,  17,  18,  19,  20,
+     21,  23,  24,  25,  26,  27,  28,  29,  30,  31, 127, 220, 249,  10,  13,
+     22, 256,
+};
+
+void ff_hpack_decoder_init(HPACKDecoder *d, size_t max_size)
+{
+    memset(d, 0, sizeof(*d));
+    d->max_size       = max_size;
+    d->max_size_limit = max_size;
+}
+
+static void entry_free(HPACKEntry *e)
+{
+    av_freep(&e->name);
+    av_freep(&e->value);
+}
+
+static size_t entry_size(const HPACKEntry *e)
+{
+    return strlen(e->name) + strlen(e->value) + ENTRY_OVERHEAD;
+}
+
+void ff_hpack_decoder_uninit(HPACKDecoder *d)
+{
+    for (int i = 0; i < d->nb_entries; i++)
+        entry_free(&d->entries[i]);
+    av_freep(&d->entries);
+    d->nb_entries   = 0;
+    d->entries_size = 0;
+    d->size         = 0;
+}
+
+static void evict(HPACKDecoder *d, size_t max_size)
+{
+    while (d->nb_entries && d->size > max_size) {
+        HPACKEntry *e = &d->entries[--d->nb_entries];
+        d->size -= entry_size(e);
+        entry_free(e);
+    }
+}
+
+/* Takes ownership of name and value. */
+static int add_entry(HPACKDecoder *d, char *name, char *value)
+{
+    HPACKEntry e = { name, value };
+    size_t size  = entry_size(&e);
+    HPACKEntry *entries;
+
+    // an entry larger than the table empties it and is not inserted
+    if (size > d->max_size) {
+        evict(d, 0);
+        entry_free(&e);
+        return 0;
+    }
+    evict(d, d->max_size - size);
+
+    entries = av_fast_realloc(d->entries, &d->entries_size,
+                              (d->nb_entries + 1) * sizeof(*entries));
+    if (!entries) {
+        entry_free(&e);
+        return AVERROR(ENOMEM);
+    }
+    d->entries = entries;
+
+    memmove(&entries[1], &entries[0], d->nb_entries * sizeof(*entries));
+    entries[0] = e;
+    d->nb_entries++;
+    d->size += size;
+
+    return 0;
+}
+
+static const HPACKEntry *get_entry(const HPACKDecoder *d, uint32_t index)
+{
+    if (!index)
+        return NULL;
+    if (index <= FF_ARRAY_ELEMS(static_table))
+        return &static_table[index - 1];
+    index -= FF_ARRAY_ELEMS(static_table) + 1;
+    return index < d->nb_entries ? &d->entries[index] : NULL;
+}
+
+/* RFC 7541 section 5.1 */
+/* Integers are limited to HPACK_MAX_INT, which is enough for any index,
+ * length or table size accepted by the decoder and cannot overflow. */
+#define HPACK_MAX_INT ((1 << 28) - 1)
+
+static int decode_int(const uint8_t **pp, const uint8_t *end, int prefix,
+                      uint32_t *val)
+{
+    const uint8_t *p = *pp;
+    uint32_t max = (1 << prefix) - 1, v;
+    int shift = 0, b;
+
+    if (p >= end)
+        return AVERROR_INVALIDDATA;
+    v = *p++ & max;
+    if (v == max) {
+        do {
+            // at most 4 continuation bytes, so that the shifted value fits
+            if (p >= end || shift > 21)
+                return AVERROR_INVALIDDATA;
+            b  = *p++;
+            v += (uint32_t)(b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        if (v > HPACK_MAX_INT)
+            return AVERROR_INVALIDDATA;
+    }
+
+    *pp  = p;
+    *val = v;
+
+    return 0;
+}
+
+static int huffman_decode(uint8_t *dst, const uint8_t *src, int size)
+{
+    int code = 0, first = 0, index = 0, len = 0, n = 0;
+    // bits of the incomplete symbol, for checking the padding
+    uint32_t bits = 0;
+
+    for (int i = 0; i < size; i++) {
+        for (int j = 7; j >= 0; j--) {
+            int bit = src[i] >> j & 1, count;
+
+            code |= bit;
+            bits  = bits << 1 | bit;
+            count = huffman_counts[++len];
+            if (code - first < count) {
+                int sym = huffman_symbols[index + code - first];
+                if (sym == 256)
+                    return AVERROR_INVALIDDATA;
+                dst[n++] = sym;
+                code = first = index = len = 0;
+                bits = 0;
+                continue;
+            }
+            if (len == HUFFMAN_MAX_BITS)
+                return AVERROR_INVALIDDATA;
+            index += count;
+            first  = (first + count) << 1;
+            code <<= 1;
+        }
+    }
+
+    // padding: the most significant bits of EOS, strictly less than a byte
+    if (len > 7 || bits != (1U << len) - 1)
+        return AVERROR_INVALIDDATA;
+
+    return n;
+}
+
+/* RFC 7541 section 5.2 */
+static int decode_string(const uint8_t **pp, const uint8_t *end, char **str)
+{
+    const uint8_t *p = *pp;
+    uint32_t len;
+    int huffman, ret;
+    char *s;
+
+    if (p >= end)
+        return AVERROR_INVALIDDATA;
+    huffman = *p & 0x80;
+    if ((ret = decode_int(&p, end, 7, &len)) < 0)
+        return ret;
+    if (len > end - p)
+        return AVERROR_INVALIDDATA;
+
+    // the shortest codes are 5 bits long
+    s = av_malloc(huffman ? len * 8 / 5 + 1 : len + 1);
+    if (!s)
+        return AVERROR(ENOMEM);
+    if (huffman) {
+        ret = huffman_decode((uint8_t *)s, p, len);
+        if (ret < 0) {
+            av_free(s);
+            return ret;
+        }
+    } else {
+        memcpy(s, p, len);
+        ret = len;
+    }
+    s[ret] = '\0';
+
+    *pp  = p + len;
+    *str = s;
+
+    return 0;
+}
+
+int ff_hpack_decode(HPACKDecoder *d, const uint8_t *buf, int size,
+                    int (*cb)(void *opaque, const char *name, const char *value),
+                    void *opaque)
+{
+    const uint8_t *p = buf, *end = buf + size;
+    // dynamic table size updates are only allowed before the first field
+    int fields = 0;
+    int ret = 0;
+
+    while (p < end) {
+        const HPACKEntry *e;
+        char *name = NULL, *value = NULL;
+        uint32_t index;
+        int prefix, indexing = 0;
+
+        if (*p & 0x80) {
+            // indexed header field
+            fields = 1;
+            if ((ret = decode_int(&p, end, 7, &index)) < 0)
+                return ret;
+            if (!(e = get_entry(d, index)))
+                return AVERROR_INVALIDDATA;
+            if ((ret = cb(opaque, e->name, e->value)) < 0)
+                return ret;
+            continue;
+        }
+
+        if ((*p & 0xe0) == 0x20) {
+            // dynamic table size update
+            if (fields)
+                return AVERROR_INVALIDDATA;
+            if ((ret = decode_int(&p, end, 5, &index)) < 0)
+                return ret;
+            if (index > d->max_size_limit)
+                return AVERROR_INVALIDDATA;
+            d->max_size = index;
+            evict(d, d->max_size);
+            continue;
+        }
+
+        // literal header field with incremental indexing, without indexing
+        // or never indexed
+        fields = 1;
+        if (*p & 0x40) {
+            indexing = 1;
+            prefix   = 6;
+        } else
+            prefix   = 4;
+
+        if ((ret = decode_int(&p, end, prefix, &index)) < 0)
+            return ret;
+        if (index) {
+            if (!(e = get_entry(d, index)))
+                return AVERROR_INVALIDDATA;
+            if (!(name = av_strdup(e->name)))
+                return AVERROR(ENOMEM);
+        } else if ((ret = decode_string(&p, end, &name)) < 0)
+            return ret;
+        if ((ret = decode_string(&p, end, &value)) < 0) {
+            av_free(name);
+            return ret;
+        }
+
+        ret = cb(opaque, name, value);
+        if (ret >= 0 && indexing)
+            // takes ownership of name and value
+            ret = add_entry(d, name, value);
+        else {
+            av_free(name);
+            av_free(value);
+        }
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static void encode_string(AVBPrint *bp, const char *str)
+{
+    size_t len = strlen(str);
+    uint8_t buf[10];
+    int n = 0;
+
+    // 7-bit prefix integer, without Huffman coding
+    if (len < 0x7f)
+        buf[n++] = len;
+    else {
+        buf[n++] = 0x7f;
+        len -= 0x7f;
+        while (len >= 0x80) {
+            buf[n++] = (len & 0x7f) | 0x80;
+            len >>= 7;
+        }
+        buf[n++] = len;
+    }
+
+    av_bprint_append_data(bp, (const char *)buf, n);
+    av_bprint_append_data(bp, str, strlen(str));
+}
+
+void ff_hpack_encode_literal(AVBPrint *bp, const char *name, const char *value)
+{
+    av_bprint_chars(bp, 0x00, 1);
+    encode_string(bp, name);
+    encode_string(bp, value);
+}
@@ -0,0 +1,75 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_HPACK_H
+#define AVFORMAT_HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libavutil/bprint.h"
+
+/**
+ * @file
+ * HPACK header compression for HTTP/2, RFC 7541.
+ */
+
+typedef struct HPACKEntry {
+    const char *name;
+    const char *value;
+} HPACKEntry;
+
+typedef struct HPACKDecoder {
+    /* dynamic table, most recently inserted entry first */
+    HPACKEntry *entries;
+    int      nb_entries;
+    unsigned int entries_size;
+    /* size of the table as defined in RFC 7541 section 4.1 */
+    size_t   size;
+    size_t   max_size;
+    /* limit advertised to the encoder with SETTINGS_HEADER_TABLE_SIZE */
+    size_t   max_size_limit;
+} HPACKDecoder;
+
+/**
+ * Initialize a decoder whose dynamic table is limited to max_size bytes.
+ */
+void ff_hpack_decoder_init(HPACKDecoder *d, size_t max_size);
+
+void ff_hpack_decoder_uninit(HPACKDecoder *d);
+
+/**
+ * Decode a complete header block, updating the dynamic table.
+ *
+ * @param cb called for each header field in order, with NUL terminated
+ *           name and value; a negative return value aborts decoding
+ * @return 0 or a negative error code; the decoder cannot be used anymore
+ *         after AVERROR_INVALIDDATA since its state is out of sync with the
+ *         encoder
+ */
+int ff_hpack_decode(HPACKDecoder *d, const uint8_t *buf, int size,
+                    int (*cb)(void *opaque, const char *name, const char *value),
+                    void *opaque);
+
+/**
+ * Append a header field to bp as a literal without indexing, which leaves
+ * the dynamic table of the peer unchanged.
+ */
+void ff_hpack_encode_literal(AVBPrint *bp, const char *name, const char *value);
+
+#endif /* AVFORMAT_HPACK_H */
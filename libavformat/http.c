@@ -42,6 +42,7 @@
 
 #include "avformat.h"
 #include "http.h"
+#include "httppool.h"
 #include "httpauth.h"
 #include "internal.h"
 #include "network.h"
@@ -86,6 +87,8 @@ typedef struct HTTPContext {
     char *http_proxy;
     char *headers;
     char *mime_type;
+    char *etag;
+    char *last_modified;
     char *http_version;
     char *user_agent;
     char *referer;
@@ -158,6 +161,12 @@ typedef struct HTTPContext {
     int64_t sum_latency; /* divide by nb_requests */
     int64_t max_latency;
     int max_redirects;
+    int connection_pool;
+    int pool_idle_timeout;
+    int pool_max_idle;
+    int http2;
+    /* whether hd was taken from the pool of idle connections */
+    int reused_connection;
 } HTTPContext;
 
 #define OFFSET(x) offsetof(HTTPContext, x)
@@ -178,6 +187,8 @@ static const AVOption http_options[] = {
     { "initial_request_size", "size (in bytes) of initial requests made during probing / header parsing", OFFSET(initial_request_size), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
     { "post_data", "set custom HTTP post data", OFFSET(post_data), AV_OPT_TYPE_BINARY, .flags = D | E },
     { "mime_type", "export the MIME type", OFFSET(mime_type), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "etag", "export the entity tag of the resource", OFFSET(etag), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "last_modified", "export the modification date of the resource", OFFSET(last_modified), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "http_version", "export the http response version", OFFSET(http_version), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "cookies", "set cookies to be sent in applicable future requests, use newline delimited Set-Cookie HTTP field value syntax", OFFSET(cookies), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
     { "icy", "request ICY metadata", OFFSET(icy), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, D },
@@ -206,6 +217,10 @@ static const AVOption http_options[] = {
     { "reply_code", "The http status code to return to a client", OFFSET(reply_code), AV_OPT_TYPE_INT, { .i64 = 200}, INT_MIN, 599, E},
     { "short_seek_size", "Threshold to favor readahead over seek.", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
     { "max_redirects", "Maximum number of redirects", OFFSET(max_redirects), AV_OPT_TYPE_INT, { .i64 = MAX_REDIRECTS }, 0, INT_MAX, D },
+    { "connection_pool", "share persistent connections with the other HTTP contexts of the process", OFFSET(connection_pool), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D },
+    { "pool_idle_timeout", "time in seconds after which an idle pooled connection is closed", OFFSET(pool_idle_timeout), AV_OPT_TYPE_INT, { .i64 = 30 }, 0, UINT_MAX/1000/1000, D },
+    { "pool_max_idle", "maximum number of idle pooled connections per server", OFFSET(pool_max_idle), AV_OPT_TYPE_INT, { .i64 = 4 }, 1, INT_MAX, D },
+    { "http2", "send the requests as HTTP/2 streams of a shared connection", OFFSET(http2), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D },
     { NULL }
 };
 
@@ -237,6 +252,8 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
     int port, use_proxy, err = 0;
     HTTPContext *s = h->priv_data;
 
+    s->reused_connection = 0;
+
     av_url_split(proto, sizeof(proto), auth, sizeof(auth),
                  hostname, sizeof(hostname), &port,
                  path1, sizeof(path1), s->location);
@@ -309,9 +326,24 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
                      hostname, sizeof(hostname), &port, NULL, 0, proxy_path);
     }
 
-    ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
-
-    if (!s->hd) {
+    if (s->http2 && !use_proxy) {
+        /* the http2 protocol carries the requests over the connection */
+        av_strlcpy(buf, "http2:", sizeof(buf));
+        ff_url_join(buf + 6, sizeof(buf) - 6, lower_proto, NULL, hostname, port, NULL);
+    } else
+        ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
+
+    if (!s->hd && s->connection_pool) {
+        err = ff_http_pool_open(&s->hd, buf, AVIO_FLAG_READ_WRITE,
+                                &h->interrupt_callback, options,
+                                h->protocol_whitelist, h->protocol_blacklist, h,
+                                &s->reused_connection);
+        if (s->reused_connection) {
+            av_log(h, AV_LOG_DEBUG, "Reusing pooled connection to %s\n", buf);
+            s->line_count = 0;
+        } else
+            s->nb_connections++;
+    } else if (!s->hd) {
         s->nb_connections++;
         err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
                                    &h->interrupt_callback, options,
@@ -433,6 +465,14 @@ redo:
 
     off = s->off;
     ret = http_open_cnx_internal(h, options);
+    if (ret < 0 && s->reused_connection && !s->line_count) {
+        /* The server may have closed the idle connection just before it was
+         * reused, retry on a new one unless a response was received. */
+        av_log(h, AV_LOG_DEBUG, "Pooled connection failed: %s\n", av_err2str(ret));
+        s->off = off;
+        ff_http_pool_closep(&s->hd);
+        goto redo;
+    }
     if (ret < 0) {
         if (!http_should_reconnect(s, ret) ||
             reconnect_delay > s->reconnect_delay_max ||
@@ -461,7 +501,7 @@ redo:
         /* restore the offset (http_connect resets it) */
         s->off = off;
 
-        ffurl_closep(&s->hd);
+        ff_http_pool_closep(&s->hd);
         goto redo;
     }
 
@@ -469,7 +509,7 @@ redo:
     if (s->http_code == 401) {
         if ((cur_auth_type == HTTP_AUTH_NONE || s->auth_state.stale) &&
             s->auth_state.auth_type != HTTP_AUTH_NONE && auth_attempts < 4) {
-            ffurl_closep(&s->hd);
+            ff_http_pool_closep(&s->hd);
             goto redo;
         } else
             goto fail;
@@ -477,7 +517,7 @@ redo:
     if (s->http_code == 407) {
         if ((cur_proxy_auth_type == HTTP_AUTH_NONE || s->proxy_auth_state.stale) &&
             s->proxy_auth_state.auth_type != HTTP_AUTH_NONE && auth_attempts < 4) {
-            ffurl_closep(&s->hd);
+            ff_http_pool_closep(&s->hd);
             goto redo;
         } else
             goto fail;
@@ -486,7 +526,7 @@ redo:
          s->http_code == 303 || s->http_code == 307 || s->http_code == 308) &&
         s->new_location) {
         /* url moved, get next */
-        ffurl_closep(&s->hd);
+        ff_http_pool_closep(&s->hd);
         if (redirects++ >= s->max_redirects)
             return AVERROR(EIO);
 
@@ -514,7 +554,7 @@ redo:
 fail:
     s->off = off;
     if (s->hd)
-        ffurl_closep(&s->hd);
+        ff_http_pool_closep(&s->hd);
     if (ret < 0)
         return ret;
     return ff_http_averror(s->http_code, AVERROR(EIO));
@@ -808,6 +848,27 @@ static int http_open(URLContext *h, const char *uri, int flags,
     if (s->listen) {
         return http_listen(h, uri, flags, options);
     }
+    if (s->http2 && !CONFIG_HTTP2_PROTOCOL) {
+        av_log(h, AV_LOG_WARNING, "HTTP/2 support not compiled in, using HTTP/1.1\n");
+        s->http2 = 0;
+    }
+    if (s->http2) {
+        /* HTTP/2 connections are shared by design, the pool is not needed */
+        if (flags & AVIO_FLAG_WRITE)
+            s->http2 = 0;
+        else {
+            s->connection_pool   = 0;
+            s->multiple_requests = 1;
+        }
+    }
+    if (s->connection_pool) {
+        /* only the connections used for downloads are shared, and they have
+         * to be kept alive after each response */
+        if (flags & AVIO_FLAG_WRITE)
+            s->connection_pool = 0;
+        else
+            s->multiple_requests = 1;
+    }
     ret = http_open_cnx(h, options);
 bail_out:
     if (ret < 0) {
@@ -1299,6 +1360,12 @@ static int process_line(URLContext *h, char *line, int line_count, int *parsed_h
         } else if (!av_strcasecmp(tag, "Content-Type")) {
             av_free(s->mime_type);
             s->mime_type = av_get_token((const char **)&p, ";");
+        } else if (!av_strcasecmp(tag, "ETag")) {
+            av_free(s->etag);
+            s->etag = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "Last-Modified")) {
+            av_free(s->last_modified);
+            s->last_modified = av_strdup(p);
         } else if (!av_strcasecmp(tag, "Set-Cookie")) {
             if (parse_cookie(s, p, &s->cookie_dict))
                 av_log(h, AV_LOG_WARNING, "Unable to parse '%s'\n", p);
@@ -1737,7 +1804,7 @@ static int http_buf_read(URLContext *h, uint8_t *buf, int size)
             }
             else if (!s->chunksize) {
                 av_log(h, AV_LOG_DEBUG, "Last chunk received, closing conn\n");
-                ffurl_closep(&s->hd);
+                ff_http_pool_closep(&s->hd);
                 return 0;
             }
             else if (s->chunksize == UINT64_MAX) {
@@ -1853,7 +1920,7 @@ retry:
             /* send new request for more data on existing connection */
             AVDictionary *options = NULL;
             if (s->willclose)
-                ffurl_closep(&s->hd);
+                ff_http_pool_closep(&s->hd);
             s->initial_requests = 0; /* continue streaming uninterrupted from now on */
             read_ret = http_open_cnx(h, &options);
             av_dict_free(&options);
@@ -1885,7 +1952,7 @@ retry:
         conn_attempts++;
         seek_ret = http_seek_internal(h, target, SEEK_SET, 1);
         if (seek_ret >= 0 && seek_ret != target) {
-            ffurl_closep(&s->hd);
+            ff_http_pool_closep(&s->hd);
             av_log(h, AV_LOG_ERROR, "Failed to reconnect at %"PRIu64".\n", target);
             return read_ret;
         }
@@ -2048,6 +2115,20 @@ static int http_shutdown(URLContext *h, int flags)
     return ret;
 }
 
+/* Give the connection back to the pool if the response has been read
+ * entirely and the server keeps the connection open, close it otherwise. */
+static void http_release_hd(HTTPContext *s)
+{
+    uint64_t end = s->range_end ? s->range_end : s->filesize;
+
+    if (s->connection_pool && !s->willclose && s->buf_ptr == s->buf_end &&
+        (s->chunksize != UINT64_MAX ? s->chunkend : s->off >= end))
+        ff_http_pool_release(&s->hd, s->pool_idle_timeout * 1000000LL,
+                             s->pool_max_idle);
+    else
+        ff_http_pool_closep(&s->hd);
+}
+
 static int http_close(URLContext *h)
 {
     int ret = 0;
@@ -2063,7 +2144,7 @@ static int http_close(URLContext *h)
         ret = http_shutdown(h, h->flags);
 
     if (s->hd)
-        ffurl_closep(&s->hd);
+        http_release_hd(s);
     av_dict_free(&s->chained_options);
     av_dict_free(&s->cookie_dict);
     av_dict_free(&s->redirect_cache);
@@ -2146,7 +2227,7 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
             ret = ffurl_read(s->hd, discard, FFMIN(remaining, sizeof(discard)));
             if (ret < 0 || ret == AVERROR_EOF || (ret == 0 && remaining)) {
                 /* connection broken or stuck, need to reopen */
-                ffurl_closep(&s->hd);
+                ff_http_pool_closep(&s->hd);
                 break;
             }
             remaining -= ret;
@@ -2168,7 +2249,7 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
         return ret;
     }
     av_dict_free(&options);
-    ffurl_close(old_hd);
+    ff_http_pool_closep(&old_hd);
     return off;
 }
 
@@ -2217,7 +2298,7 @@ const URLProtocol ff_http_protocol = {
     .priv_data_size      = sizeof(HTTPContext),
     .priv_data_class     = &http_context_class,
     .flags               = URL_PROTOCOL_FLAG_NETWORK,
-    .default_whitelist   = "http,https,tls,rtp,tcp,udp,crypto,httpproxy,data"
+    .default_whitelist   = "http,https,http2,tls,rtp,tcp,udp,crypto,httpproxy,data"
 };
 #endif /* CONFIG_HTTP_PROTOCOL */
 
@@ -2237,7 +2318,7 @@ const URLProtocol ff_https_protocol = {
     .priv_data_size      = sizeof(HTTPContext),
     .priv_data_class     = &https_context_class,
     .flags               = URL_PROTOCOL_FLAG_NETWORK,
-    .default_whitelist   = "http,https,tls,rtp,tcp,udp,crypto,httpproxy"
+    .default_whitelist   = "http,https,http2,tls,rtp,tcp,udp,crypto,httpproxy"
 };
 #endif /* CONFIG_HTTPS_PROTOCOL */
 
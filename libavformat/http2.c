@@ -0,0 +1,1482 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/error.h"
+#include "libavutil/fifo.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "hpack.h"
+#include "http2.h"
+#include "network.h"
+#include "url.h"
+
+#define FRAME_HEADER_SIZE 9
+/* largest frame accepted from the server, the default SETTINGS_MAX_FRAME_SIZE */
+#define MAX_FRAME_SIZE    16384
+#define DEFAULT_WINDOW    65535
+#define MAX_WINDOW        0x7fffffff
+/* receive windows of each stream and of the connection */
+#define STREAM_WINDOW     (1 << 20)
+#define CONNECTION_WINDOW (16 << 20)
+#define HEADER_TABLE_SIZE 4096
+/* largest header block, and header list as counted by
+ * SETTINGS_MAX_HEADER_LIST_SIZE, accepted from the server */
+#define MAX_HEADER_SIZE   (64 * 1024)
+#define MAX_STREAM_ID     0x7fffffff
+/* time after which a connection without streams is closed */
+#define IDLE_TIMEOUT      (30 * 1000000LL)
+
+#define CLIENT_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+enum FrameType {
+    FRAME_DATA,
+    FRAME_HEADERS,
+    FRAME_PRIORITY,
+    FRAME_RST_STREAM,
+    FRAME_SETTINGS,
+    FRAME_PUSH_PROMISE,
+    FRAME_PING,
+    FRAME_GOAWAY,
+    FRAME_WINDOW_UPDATE,
+    FRAME_CONTINUATION,
+};
+
+#define FLAG_END_STREAM  0x01
+#define FLAG_ACK         0x01
+#define FLAG_END_HEADERS 0x04
+#define FLAG_PADDED      0x08
+#define FLAG_PRIORITY    0x20
+
+enum Setting {
+    SETTINGS_HEADER_TABLE_SIZE      = 1,
+    SETTINGS_ENABLE_PUSH            = 2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 3,
+    SETTINGS_INITIAL_WINDOW_SIZE    = 4,
+    SETTINGS_MAX_FRAME_SIZE         = 5,
+    SETTINGS_MAX_HEADER_LIST_SIZE   = 6,
+};
+
+enum ErrorCode {
+    NO_ERROR           = 0,
+    PROTOCOL_ERROR     = 1,
+    FLOW_CONTROL_ERROR = 3,
+    FRAME_SIZE_ERROR   = 6,
+    REFUSED_STREAM     = 7,
+    CANCEL             = 8,
+    COMPRESSION_ERROR  = 9,
+    ENHANCE_YOUR_CALM  = 11,
+};
+
+typedef struct HTTP2Stream {
+    uint32_t id;
+    int      status;
+    /* the final response header was received */
+    int      headers_done;
+    /* the server sent the whole response or reset the stream */
+    int      closed;
+    int      err;
+    /* the request was not processed by the server and can be sent again */
+    int      refused;
+    int      has_length;
+    /* the response has no content-length, its body is passed on with the
+     * chunked transfer coding */
+    int      chunked;
+    /* header lines of the response being received */
+    AVBPrint header;
+    /* size of the header list being received, as defined for
+     * SETTINGS_MAX_HEADER_LIST_SIZE */
+    size_t   header_size;
+    /* response converted to HTTP/1.1, waiting to be read */
+    AVFifo  *fifo;
+    /* DATA payload received and not acknowledged with WINDOW_UPDATE yet */
+    int      unacked;
+    int64_t  send_window;
+    struct HTTP2Stream *next;
+} HTTP2Stream;
+
+typedef struct HTTP2Session {
+    char       *key;
+    URLContext *hd;
+    int         fd;
+    /* number of contexts using the session */
+    int         refcount;
+    /* time after which the session is closed if unused, 0 while in use */
+    int64_t     expiry;
+    struct HTTP2Session *next;
+
+    /* protects everything below, and serializes the writes */
+    AVMutex     lock;
+    /* serializes the calls to hd, which is used without lock by the reader */
+    AVMutex     io_lock;
+    /* signalled when frames were processed */
+    AVCond      cond;
+    /* interrupt callback of the context opening the connection */
+    AVIOInterruptCB open_cb;
+
+    /* a thread is reading from the connection */
+    int         reading;
+    /* the connection failed, it cannot be used anymore */
+    int         err;
+    /* no more streams can be started on the connection */
+    int         goaway;
+    uint32_t    next_stream_id;
+    int         nb_active;
+    HTTP2Stream *streams;
+
+    uint32_t    peer_max_frame_size;
+    uint32_t    peer_max_streams;
+    int64_t     peer_initial_window;
+    int64_t     send_window;
+    /* DATA payload received on the connection and not acknowledged yet */
+    int         unacked;
+
+    HPACKDecoder hpack;
+    /* header block being received, split into CONTINUATION frames */
+    uint32_t    block_stream_id;
+    int         block_end_stream;
+    AVBPrint    block;
+
+    uint8_t     rx[2 * (FRAME_HEADER_SIZE + MAX_FRAME_SIZE)];
+    int         rx_len;
+    uint8_t     tx[FRAME_HEADER_SIZE + MAX_FRAME_SIZE];
+} HTTP2Session;
+
+typedef struct HTTP2Context {
+    const AVClass *class;
+    char         *lower_url;
+    AVDictionary *lower_opts;
+    const char   *scheme;
+    HTTP2Session *session;
+    /* used instead of a session if the server did not select h2 */
+    URLContext   *direct;
+
+    HTTP2Stream  *stream;
+    /* header of the current request, as written by the HTTP protocol */
+    AVBPrint      request;
+    int           request_sent;
+    /* length of the request body still to be sent */
+    int64_t       body_left;
+    /* the request had a body, it cannot be sent again */
+    int           has_body;
+    /* some of the response was read */
+    int           delivered;
+    int           retried;
+} HTTP2Context;
+
+static AVMutex sessions_mutex = AV_MUTEX_INITIALIZER;
+static HTTP2Session *sessions;
+
+static int wait_fd(HTTP2Session *s, URLContext *h, int write)
+{
+    return ff_network_wait_fd_timeout(s->fd, write, h->rw_timeout,
+                                      &h->interrupt_callback);
+}
+
+/* Called with the lock held, which keeps the frames of different threads
+ * from being interleaved. Without h, gives up instead of waiting. */
+static int session_write(HTTP2Session *s, URLContext *h,
+                         const uint8_t *buf, int size)
+{
+    int ret = 0;
+
+    ff_mutex_lock(&s->io_lock);
+    while (size > 0) {
+        ret = ffurl_write(s->hd, buf, size);
+        if (ret == AVERROR(EAGAIN)) {
+            // let the reader in while waiting
+            ff_mutex_unlock(&s->io_lock);
+            ret = h ? wait_fd(s, h, 1) : AVERROR(EAGAIN);
+            ff_mutex_lock(&s->io_lock);
+            if (ret < 0)
+                break;
+            continue;
+        }
+        if (ret < 0)
+            break;
+        buf  += ret;
+        size -= ret;
+    }
+    ff_mutex_unlock(&s->io_lock);
+
+    return FFMIN(ret, 0);
+}
+
+static void stream_close(HTTP2Session *s, HTTP2Stream *st, int err)
+{
+    if (st->closed)
+        return;
+    st->closed = 1;
+    st->err    = err;
+    s->nb_active--;
+}
+
+static void session_fail(HTTP2Session *s, URLContext *h, int err)
+{
+    if (s->err)
+        return;
+    av_log(h, AV_LOG_ERROR, "HTTP/2 connection failed: %s\n", av_err2str(err));
+    s->err    = err;
+    s->goaway = 1;
+    for (HTTP2Stream *st = s->streams; st; st = st->next)
+        stream_close(s, st, err);
+    ff_cond_broadcast(&s->cond);
+}
+
+static int send_frame(HTTP2Session *s, URLContext *h, int type, int flags,
+                      uint32_t stream_id, const uint8_t *payload, int size)
+{
+    int ret;
+
+    if (s->err)
+        return s->err;
+
+    AV_WB24(s->tx, size);
+    s->tx[3] = type;
+    s->tx[4] = flags;
+    AV_WB32(s->tx + 5, stream_id);
+    // a single write, the frames are small
+    memcpy(s->tx + FRAME_HEADER_SIZE, payload, size);
+
+    ret = session_write(s, h, s->tx, FRAME_HEADER_SIZE + size);
+    if (ret < 0 && h)
+        // the frame may have been partially sent
+        session_fail(s, h, ret);
+
+    return ret;
+}
+
+static int send_window_update(HTTP2Session *s, URLContext *h,
+                              uint32_t stream_id, uint32_t increment)
+{
+    uint8_t payload[4];
+
+    AV_WB32(payload, increment);
+    return send_frame(s, h, FRAME_WINDOW_UPDATE, 0, stream_id, payload, 4);
+}
+
+static int send_rst_stream(HTTP2Session *s, URLContext *h,
+                           uint32_t stream_id, uint32_t code)
+{
+    uint8_t payload[4];
+
+    AV_WB32(payload, code);
+    return send_frame(s, h, FRAME_RST_STREAM, 0, stream_id, payload, 4);
+}
+
+static int send_goaway(HTTP2Session *s, URLContext *h, uint32_t code)
+{
+    uint8_t payload[8];
+
+    // no stream is ever initiated by the server
+    AV_WB32(payload,     0);
+    AV_WB32(payload + 4, code);
+    return send_frame(s, h, FRAME_GOAWAY, 0, 0, payload, 8);
+}
+
+static int connection_error(HTTP2Session *s, URLContext *h, uint32_t code,
+                            const char *what)
+{
+    av_log(h, AV_LOG_ERROR, "HTTP/2 protocol error: %s\n", what);
+    send_goaway(s, h, code);
+    session_fail(s, h, AVERROR_INVALIDDATA);
+    return AVERROR_INVALIDDATA;
+}
+
+static HTTP2Stream *find_stream(HTTP2Session *s, uint32_t id)
+{
+    for (HTTP2Stream *st = s->streams; st; st = st->next)
+        if (st->id == id)
+            return st;
+    return NULL;
+}
+
+static int stream_output(HTTP2Stream *st, const void *buf, size_t size)
+{
+    return size ? av_fifo_write(st->fifo, buf, size) : 0;
+}
+
+static int stream_end(HTTP2Session *s, HTTP2Stream *st)
+{
+    int ret = 0;
+
+    if (st->chunked)
+        ret = stream_output(st, "0\r\n\r\n", 5);
+    stream_close(s, st, 0);
+
+    return ret;
+}
+
+static int header_field(void *opaque, const char *name, const char *value)
+{
+    HTTP2Stream *st = opaque;
+
+    // headers of an unknown stream or trailers, still decoded to keep the
+    // dynamic table in sync
+    if (!st || st->headers_done)
+        return 0;
+
+    // the block is still decoded to the end, the stream is reset afterwards
+    st->header_size += strlen(name) + strlen(value) + 32;
+    if (st->header_size > MAX_HEADER_SIZE)
+        return 0;
+
+    if (!strcmp(name, ":status"))
+        st->status = strtol(value, NULL, 10);
+    else if (name[0] != ':' && !strpbrk(value, "\r\n")) {
+        if (!av_strcasecmp(name, "content-length"))
+            st->has_length = 1;
+        av_bprintf(&st->header, "%s: %s\r\n", name, value);
+    }
+
+    return 0;
+}
+
+static int process_header_block(HTTP2Session *s, URLContext *h)
+{
+    HTTP2Stream *st = find_stream(s, s->block_stream_id);
+    AVBPrint line;
+    int ret;
+
+    if (st && st->closed)
+        st = NULL;
+
+    if (!av_bprint_is_complete(&s->block))
+        return AVERROR(ENOMEM);
+    ret = ff_hpack_decode(&s->hpack, (const uint8_t *)s->block.str,
+                          s->block.len, header_field, st);
+    s->block_stream_id = 0;
+    if (ret == AVERROR_INVALIDDATA)
+        return connection_error(s, h, COMPRESSION_ERROR, "invalid header block");
+    if (ret < 0)
+        return ret;
+    if (!st)
+        return 0;
+
+    if (!st->headers_done) {
+        if (!av_bprint_is_complete(&st->header))
+            return AVERROR(ENOMEM);
+        if (st->header_size > MAX_HEADER_SIZE) {
+            av_log(h, AV_LOG_ERROR, "Response header too large\n");
+            send_rst_stream(s, h, st->id, CANCEL);
+            stream_close(s, st, AVERROR_INVALIDDATA);
+            return 0;
+        }
+        if (st->status >= 100 && st->status < 200 && !s->block_end_stream) {
+            // informational response, the final one follows
+            st->status      = 0;
+            st->header_size = 0;
+            av_bprint_clear(&st->header);
+            return 0;
+        }
+        if (st->status < 200 || st->status > 999) {
+            av_log(h, AV_LOG_ERROR, "Invalid response status %d\n", st->status);
+            send_rst_stream(s, h, st->id, PROTOCOL_ERROR);
+            stream_close(s, st, AVERROR_INVALIDDATA);
+            return 0;
+        }
+
+        av_bprint_init(&line, 0, AV_BPRINT_SIZE_AUTOMATIC);
+        av_bprintf(&line, "HTTP/2.0 %d\r\n", st->status);
+        if (!st->has_length) {
+            if (s->block_end_stream)
+                av_bprintf(&line, "content-length: 0\r\n");
+            else
+                st->chunked = 1;
+        }
+        // the end of the HTTP/1.1 header
+        if (st->chunked)
+            av_bprintf(&st->header, "transfer-encoding: chunked\r\n");
+        av_bprintf(&st->header, "\r\n");
+
+        if (!av_bprint_is_complete(&st->header))
+            ret = AVERROR(ENOMEM);
+        if (ret >= 0)
+            ret = stream_output(st, line.str, line.len);
+        if (ret >= 0)
+            ret = stream_output(st, st->header.str, st->header.len);
+        av_bprint_finalize(&line, NULL);
+        av_bprint_finalize(&st->header, NULL);
+        if (ret < 0)
+            return ret;
+        st->headers_done = 1;
+    }
+
+    if (s->block_end_stream)
+        return stream_end(s, st);
+
+    return 0;
+}
+
+static int process_data(HTTP2Session *s, URLContext *h, int flags, uint32_t id,
+                        const uint8_t *payload, int size)
+{
+    HTTP2Stream *st;
+    // the padding counts for flow control
+    int flow_size = size, ret;
+
+    if (!id)
+        return connection_error(s, h, PROTOCOL_ERROR, "DATA on stream 0");
+    if (flags & FLAG_PADDED) {
+        if (!size || payload[0] >= size)
+            return connection_error(s, h, PROTOCOL_ERROR, "invalid padding");
+        size   -= payload[0] + 1;
+        payload++;
+    }
+
+    s->unacked += flow_size;
+    if (s->unacked >= CONNECTION_WINDOW / 2) {
+        if ((ret = send_window_update(s, h, 0, s->unacked)) < 0)
+            return ret;
+        s->unacked = 0;
+    }
+
+    st = find_stream(s, id);
+    // a stream we reset, its window does not matter anymore
+    if (!st || st->closed)
+        return 0;
+    if (!st->headers_done)
+        return connection_error(s, h, PROTOCOL_ERROR, "DATA before HEADERS");
+
+    st->unacked += flow_size;
+    if (st->unacked > STREAM_WINDOW)
+        return connection_error(s, h, FLOW_CONTROL_ERROR, "stream window exceeded");
+
+    if (st->chunked && size) {
+        char chunk[16];
+        int len = snprintf(chunk, sizeof(chunk), "%x\r\n", size);
+        if ((ret = stream_output(st, chunk, len)) < 0 ||
+            (ret = stream_output(st, payload, size)) < 0 ||
+            (ret = stream_output(st, "\r\n", 2)) < 0)
+            return ret;
+    } else if ((ret = stream_output(st, payload, size)) < 0)
+        return ret;
+
+    if (flags & FLAG_END_STREAM)
+        return stream_end(s, st);
+
+    return 0;
+}
+
+static int process_settings(HTTP2Session *s, URLContext *h, int flags,
+                            const uint8_t *payload, int size)
+{
+    if (flags & FLAG_ACK)
+        return 0;
+    if (size % 6)
+        return connection_error(s, h, FRAME_SIZE_ERROR, "invalid SETTINGS");
+
+    for (int i = 0; i < size; i += 6) {
+        uint32_t value = AV_RB32(payload + i + 2);
+
+        switch (AV_RB16(payload + i)) {
+        case SETTINGS_MAX_CONCURRENT_STREAMS:
+            s->peer_max_streams = value;
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+            if (value > MAX_WINDOW)
+                return connection_error(s, h, FLOW_CONTROL_ERROR, "invalid window size");
+            // applies to the streams already open
+            for (HTTP2Stream *st = s->streams; st; st = st->next) {
+                st->send_window += value - s->peer_initial_window;
+                if (st->send_window > MAX_WINDOW)
+                    return connection_error(s, h, FLOW_CONTROL_ERROR, "stream window overflow");
+            }
+            s->peer_initial_window = value;
+            break;
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < 16384 || value > 0xffffff)
+                return connection_error(s, h, PROTOCOL_ERROR, "invalid frame size");
+            s->peer_max_frame_size = value;
+            break;
+        }
+    }
+
+    return send_frame(s, h, FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+}
+
+static int process_goaway(HTTP2Session *s, URLContext *h,
+                          const uint8_t *payload, int size)
+{
+    uint32_t last_id, code;
+
+    if (size < 8)
+        return connection_error(s, h, FRAME_SIZE_ERROR, "invalid GOAWAY");
+    last_id = AV_RB32(payload) & MAX_STREAM_ID;
+    code    = AV_RB32(payload + 4);
+
+    av_log(h, code ? AV_LOG_WARNING : AV_LOG_VERBOSE,
+           "HTTP/2 connection shut down by the server, error code %"PRIu32"\n", code);
+    s->goaway = 1;
+    // the streams the server did not process can be retried elsewhere
+    for (HTTP2Stream *st = s->streams; st; st = st->next) {
+        if (st->id > last_id && !st->closed) {
+            st->refused = 1;
+            stream_close(s, st, AVERROR(ECONNRESET));
+        }
+    }
+
+    return 0;
+}
+
+static int process_window_update(HTTP2Session *s, URLContext *h, uint32_t id,
+                                 uint32_t increment)
+{
+    HTTP2Stream *st;
+
+    if (!id) {
+        if (!increment)
+            return connection_error(s, h, PROTOCOL_ERROR, "invalid WINDOW_UPDATE");
+        if (s->send_window + increment > MAX_WINDOW)
+            return connection_error(s, h, FLOW_CONTROL_ERROR, "connection window overflow");
+        s->send_window += increment;
+        return 0;
+    }
+
+    st = find_stream(s, id);
+    if (!st || st->closed)
+        return 0;
+    if (!increment || st->send_window + increment > MAX_WINDOW) {
+        av_log(h, AV_LOG_ERROR, "Invalid WINDOW_UPDATE on stream %"PRIu32"\n", id);
+        send_rst_stream(s, h, id, increment ? FLOW_CONTROL_ERROR : PROTOCOL_ERROR);
+        stream_close(s, st, AVERROR_INVALIDDATA);
+        return 0;
+    }
+    st->send_window += increment;
+
+    return 0;
+}
+
+static int process_frame(HTTP2Session *s, URLContext *h, int type, int flags,
+                         uint32_t id, const uint8_t *payload, int size)
+{
+    HTTP2Stream *st;
+
+    if (s->block_stream_id && type != FRAME_CONTINUATION)
+        return connection_error(s, h, PROTOCOL_ERROR, "missing CONTINUATION");
+
+    switch (type) {
+    case FRAME_DATA:
+        return process_data(s, h, flags, id, payload, size);
+    case FRAME_HEADERS:
+        if (!id)
+            return connection_error(s, h, PROTOCOL_ERROR, "HEADERS on stream 0");
+        if (flags & FLAG_PADDED) {
+            if (!size || payload[0] >= size)
+                return connection_error(s, h, PROTOCOL_ERROR, "invalid padding");
+            size   -= payload[0] + 1;
+            payload++;
+        }
+        if (flags & FLAG_PRIORITY) {
+            if (size < 5)
+                return connection_error(s, h, FRAME_SIZE_ERROR, "invalid HEADERS");
+            size    -= 5;
+            payload += 5;
+        }
+        s->block_stream_id  = id;
+        s->block_end_stream = flags & FLAG_END_STREAM;
+        av_bprint_clear(&s->block);
+        av_bprint_append_data(&s->block, payload, size);
+        return flags & FLAG_END_HEADERS ? process_header_block(s, h) : 0;
+    case FRAME_CONTINUATION:
+        if (!s->block_stream_id || id != s->block_stream_id)
+            return connection_error(s, h, PROTOCOL_ERROR, "unexpected CONTINUATION");
+        // the block must be decoded to keep the dynamic table in sync, it
+        // cannot be skipped
+        if (s->block.len + size > MAX_HEADER_SIZE)
+            return connection_error(s, h, ENHANCE_YOUR_CALM, "header block too large");
+        av_bprint_append_data(&s->block, payload, size);
+        return flags & FLAG_END_HEADERS ? process_header_block(s, h) : 0;
+    case FRAME_RST_STREAM:
+        if (size != 4)
+            return connection_error(s, h, FRAME_SIZE_ERROR, "invalid RST_STREAM");
+        st = find_stream(s, id);
+        if (st && !st->closed) {
+            uint32_t code = AV_RB32(payload);
+            av_log(h, AV_LOG_VERBOSE, "HTTP/2 stream %"PRIu32" reset by the server, "
+                   "error code %"PRIu32"\n", id, code);
+            st->refused = code == REFUSED_STREAM;
+            stream_close(s, st, AVERROR(ECONNRESET));
+        }
+        return 0;
+    case FRAME_SETTINGS:
+        if (id)
+            return connection_error(s, h, PROTOCOL_ERROR, "SETTINGS on a stream");
+        return process_settings(s, h, flags, payload, size);
+    case FRAME_PING:
+        if (size != 8)
+            return connection_error(s, h, FRAME_SIZE_ERROR, "invalid PING");
+        return flags & FLAG_ACK ? 0 :
+               send_frame(s, h, FRAME_PING, FLAG_ACK, 0, payload, 8);
+    case FRAME_GOAWAY:
+        return process_goaway(s, h, payload, size);
+    case FRAME_WINDOW_UPDATE:
+        if (size != 4)
+            return connection_error(s, h, FRAME_SIZE_ERROR, "invalid WINDOW_UPDATE");
+        return process_window_update(s, h, id, AV_RB32(payload) & MAX_WINDOW);
+    case FRAME_PUSH_PROMISE:
+        // disabled with SETTINGS_ENABLE_PUSH
+        return connection_error(s, h, PROTOCOL_ERROR, "unexpected PUSH_PROMISE");
+    default:
+        // PRIORITY and unknown frame types are ignored
+        return 0;
+    }
+}
+
+static int process_frames(HTTP2Session *s, URLContext *h)
+{
+    const uint8_t *p = s->rx;
+    int left = s->rx_len, ret = 0;
+
+    while (left >= FRAME_HEADER_SIZE) {
+        int size = AV_RB24(p);
+
+        if (size > MAX_FRAME_SIZE) {
+            ret = connection_error(s, h, FRAME_SIZE_ERROR, "frame too large");
+            break;
+        }
+        if (left < FRAME_HEADER_SIZE + size)
+            break;
+
+        ret = process_frame(s, h, p[3], p[4], AV_RB32(p + 5) & MAX_STREAM_ID,
+                            p + FRAME_HEADER_SIZE, size);
+        if (ret < 0)
+            break;
+
+        p    += FRAME_HEADER_SIZE + size;
+        left -= FRAME_HEADER_SIZE + size;
+    }
+
+    memmove(s->rx, p, left);
+    s->rx_len = left;
+
+    return ret;
+}
+
+/* Called by a single thread at a time, without the lock. */
+static int session_fill(HTTP2Session *s, URLContext *h, int nonblock)
+{
+    while (1) {
+        int ret;
+
+        ff_mutex_lock(&s->io_lock);
+        ret = ffurl_read(s->hd, s->rx + s->rx_len, sizeof(s->rx) - s->rx_len);
+        ff_mutex_unlock(&s->io_lock);
+
+        if (ret > 0) {
+            s->rx_len += ret;
+            return 0;
+        }
+        if (!ret || ret == AVERROR_EOF)
+            return AVERROR_EOF;
+        if (ret != AVERROR(EAGAIN) || nonblock)
+            return ret;
+        if ((ret = wait_fd(s, h, 0)) < 0)
+            return ret;
+    }
+}
+
+/* Read and process the frames received, or wait for the thread doing so.
+ * Called with the lock held. */
+static int session_pump(HTTP2Session *s, URLContext *h)
+{
+    int ret;
+
+    if (s->err)
+        return s->err;
+
+    if (s->reading) {
+        int64_t t = av_gettime() + 100000;
+        struct timespec tv = { .tv_sec  =  t / 1000000,
+                               .tv_nsec = (t % 1000000) * 1000 };
+        ff_cond_timedwait(&s->cond, &s->lock, &tv);
+        return ff_check_interrupt(&h->interrupt_callback) ? AVERROR_EXIT : 0;
+    }
+
+    s->reading = 1;
+    ff_mutex_unlock(&s->lock);
+    ret = session_fill(s, h, 0);
+    ff_mutex_lock(&s->lock);
+    s->reading = 0;
+
+    if (ret >= 0)
+        ret = process_frames(s, h);
+    // the other threads are not affected by an interrupt or timeout
+    else if (ret != AVERROR_EXIT && ret != AVERROR(ETIMEDOUT))
+        session_fail(s, h, ret);
+    ff_cond_broadcast(&s->cond);
+
+    return ret;
+}
+
+static void session_free(HTTP2Session *s)
+{
+    if (s->hd) {
+        if (!s->err)
+            send_goaway(s, NULL, NO_ERROR);
+        ffurl_closep(&s->hd);
+    }
+    while (s->streams) {
+        HTTP2Stream *st = s->streams;
+        s->streams = st->next;
+        av_fifo_freep2(&st->fifo);
+        av_bprint_finalize(&st->header, NULL);
+        av_free(st);
+    }
+    ff_hpack_decoder_uninit(&s->hpack);
+    av_bprint_finalize(&s->block, NULL);
+    ff_cond_destroy(&s->cond);
+    ff_mutex_destroy(&s->io_lock);
+    ff_mutex_destroy(&s->lock);
+    av_free(s->key);
+    av_free(s);
+}
+
+static void session_free_list(HTTP2Session *s)
+{
+    while (s) {
+        HTTP2Session *next = s->next;
+        session_free(s);
+        s = next;
+    }
+}
+
+static int forward_interrupt(void *opaque)
+{
+    HTTP2Session *s = opaque;
+    return ff_check_interrupt(&s->open_cb);
+}
+
+static int session_start(HTTP2Session *s, URLContext *h)
+{
+    uint8_t settings[18], update[4];
+    int ret;
+
+    AV_WB16(settings,      SETTINGS_ENABLE_PUSH);
+    AV_WB32(settings +  2, 0);
+    AV_WB16(settings +  6, SETTINGS_INITIAL_WINDOW_SIZE);
+    AV_WB32(settings +  8, STREAM_WINDOW);
+    AV_WB16(settings + 12, SETTINGS_MAX_HEADER_LIST_SIZE);
+    AV_WB32(settings + 14, MAX_HEADER_SIZE);
+    AV_WB32(update, CONNECTION_WINDOW - DEFAULT_WINDOW);
+
+    ff_mutex_lock(&s->lock);
+    ret = session_write(s, h, CLIENT_PREFACE, strlen(CLIENT_PREFACE));
+    if (ret >= 0)
+        ret = send_frame(s, h, FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+    if (ret >= 0)
+        ret = send_frame(s, h, FRAME_WINDOW_UPDATE, 0, 0, update, sizeof(update));
+    ff_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+/* Open a new connection, or set *direct to it if the server does not
+ * support HTTP/2. */
+static int session_open(HTTP2Session **ps, URLContext **direct, URLContext *h,
+                        const char *lower_url, AVDictionary **options, char *key)
+{
+    HTTP2Session *s;
+    AVIOInterruptCB cb;
+    int tls = av_strstart(lower_url, "tls:", NULL);
+    int ret;
+
+    *ps = NULL;
+
+    s = av_mallocz(sizeof(*s));
+    if (!s) {
+        av_free(key);
+        return AVERROR(ENOMEM);
+    }
+    s->key = key;
+    ff_mutex_init(&s->lock, NULL);
+    ff_mutex_init(&s->io_lock, NULL);
+    ff_cond_init(&s->cond, NULL);
+    ff_hpack_decoder_init(&s->hpack, HEADER_TABLE_SIZE);
+    av_bprint_init(&s->block, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    s->next_stream_id      = 1;
+    s->peer_max_frame_size = 16384;
+    s->peer_max_streams    = UINT32_MAX;
+    s->peer_initial_window = DEFAULT_WINDOW;
+    s->send_window         = DEFAULT_WINDOW;
+    s->refcount            = 1;
+
+    if (tls && (ret = av_dict_set(options, "alpn", "h2,http/1.1", 0)) < 0)
+        goto fail;
+    s->open_cb = h->interrupt_callback;
+    cb = (AVIOInterruptCB){ forward_interrupt, s };
+    ret = ffurl_open_whitelist(&s->hd, lower_url, AVIO_FLAG_READ_WRITE, &cb,
+                               options, h->protocol_whitelist,
+                               h->protocol_blacklist, h);
+    av_dict_set(options, "alpn", NULL, 0);
+    if (ret < 0)
+        goto fail;
+    s->open_cb = (AVIOInterruptCB){ 0 };
+
+    if (tls) {
+        uint8_t *alpn = NULL;
+
+        av_opt_get(s->hd->priv_data, "alpn_selected", 0, &alpn);
+        if (!alpn || strcmp(alpn, "h2")) {
+            av_log(h, AV_LOG_VERBOSE, "HTTP/2 not supported by the server, "
+                   "using HTTP/1.1\n");
+            av_free(alpn);
+            *direct = s->hd;
+            s->hd   = NULL;
+            session_free(s);
+            return 0;
+        }
+        av_free(alpn);
+    }
+
+    s->fd = ffurl_get_file_handle(s->hd);
+    // the waits are done by the users of the session, with their own
+    // interrupt callback
+    s->hd->flags |= AVIO_FLAG_NONBLOCK;
+
+    if ((ret = session_start(s, h)) < 0)
+        goto fail;
+
+    av_log(h, AV_LOG_DEBUG, "Opened HTTP/2 connection %s\n", lower_url);
+    *ps = s;
+
+    return 0;
+fail:
+    session_free(s);
+    return ret;
+}
+
+/* Check an idle connection for a GOAWAY or a closure by the server. */
+static int session_is_usable(HTTP2Session *s, URLContext *h)
+{
+    int ret;
+
+    ff_mutex_lock(&s->lock);
+    if (!s->goaway && !s->reading) {
+        ret = session_fill(s, h, 1);
+        if (ret >= 0)
+            ret = process_frames(s, h);
+        if (ret == AVERROR_EOF) {
+            // closed by the server while idle, not an error
+            s->err    = ret;
+            s->goaway = 1;
+        } else if (ret < 0 && ret != AVERROR(EAGAIN))
+            session_fail(s, h, ret);
+    }
+    ret = !s->goaway;
+    ff_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static void session_release(HTTP2Session **ps)
+{
+    HTTP2Session *s = *ps, *stale = NULL;
+    int64_t now = av_gettime_relative();
+
+    *ps = NULL;
+    if (!s)
+        return;
+
+    ff_mutex_lock(&sessions_mutex);
+    if (!--s->refcount) {
+        if (s->goaway) {
+            for (HTTP2Session **p = &sessions; *p; p = &(*p)->next) {
+                if (*p == s) {
+                    *p = s->next;
+                    break;
+                }
+            }
+            s->next = NULL;
+            stale   = s;
+        } else
+            s->expiry = now + IDLE_TIMEOUT;
+    }
+    ff_mutex_unlock(&sessions_mutex);
+
+    session_free_list(stale);
+}
+
+/* Move to *stale the idle sessions expired at now. */
+static void remove_idle_locked(HTTP2Session **stale, int64_t now)
+{
+    HTTP2Session **p = &sessions;
+
+    while (*p) {
+        HTTP2Session *s = *p;
+
+        if (!s->refcount && s->expiry <= now) {
+            *p      = s->next;
+            s->next = *stale;
+            *stale  = s;
+        } else
+            p = &s->next;
+    }
+}
+
+static int session_get(URLContext *h)
+{
+    HTTP2Context *c = h->priv_data;
+    AVDictionary *opts = NULL;
+    HTTP2Session *s, *stale = NULL;
+    char *key, *str = NULL;
+    int ret, idle = 0;
+
+    ret = av_dict_get_string(c->lower_opts, &str, '=', ',');
+    if (ret < 0)
+        return ret;
+    key = av_asprintf("%s|%s", c->lower_url, str);
+    av_free(str);
+    if (!key)
+        return AVERROR(ENOMEM);
+
+    while (1) {
+        ff_mutex_lock(&sessions_mutex);
+        remove_idle_locked(&stale, av_gettime_relative());
+        for (s = sessions; s; s = s->next)
+            if (!s->goaway && !strcmp(s->key, key))
+                break;
+        if (s) {
+            idle      = !s->refcount++;
+            s->expiry = 0;
+        }
+        ff_mutex_unlock(&sessions_mutex);
+
+        session_free_list(stale);
+        stale = NULL;
+
+        if (!s)
+            break;
+        // only an idle connection can be checked without blocking
+        if (!idle || session_is_usable(s, h)) {
+            av_free(key);
+            c->session = s;
+            return 0;
+        }
+        session_release(&s);
+    }
+
+    ret = av_dict_copy(&opts, c->lower_opts, 0);
+    if (ret >= 0)
+        ret = session_open(&s, &c->direct, h, c->lower_url, &opts, key);
+    else
+        av_free(key);
+    av_dict_free(&opts);
+    if (ret < 0 || !s)
+        return ret;
+
+    ff_mutex_lock(&sessions_mutex);
+    s->next  = sessions;
+    sessions = s;
+    ff_mutex_unlock(&sessions_mutex);
+
+    c->session = s;
+
+    return 0;
+}
+
+static void stream_free(HTTP2Context *c, URLContext *h)
+{
+    HTTP2Session *s = c->session;
+    HTTP2Stream *st = c->stream;
+
+    if (!st)
+        return;
+    c->stream = NULL;
+
+    ff_mutex_lock(&s->lock);
+    if (!st->closed) {
+        send_rst_stream(s, h, st->id, CANCEL);
+        stream_close(s, st, 0);
+        ff_cond_broadcast(&s->cond);
+    }
+    for (HTTP2Stream **p = &s->streams; *p; p = &(*p)->next) {
+        if (*p == st) {
+            *p = st->next;
+            break;
+        }
+    }
+    ff_mutex_unlock(&s->lock);
+
+    av_fifo_freep2(&st->fifo);
+    av_bprint_finalize(&st->header, NULL);
+    av_free(st);
+}
+
+static int is_hop_by_hop(const char *name)
+{
+    static const char *const names[] = {
+        "connection", "host", "keep-alive", "proxy-connection",
+        "transfer-encoding", "upgrade",
+    };
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(names); i++)
+        if (!av_strcasecmp(name, names[i]))
+            return 1;
+    return 0;
+}
+
+/* Convert the HTTP/1.1 request header to an HPACK header block. */
+static int encode_request(HTTP2Context *c, URLContext *h, AVBPrint *block)
+{
+    char *header, *line, *next, *method, *path, *authority = NULL;
+    AVBPrint fields;
+    int ret = 0;
+
+    header = av_strndup(c->request.str, c->request.len);
+    if (!header)
+        return AVERROR(ENOMEM);
+    av_bprint_init(&fields, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    // request line
+    line   = header;
+    next   = strstr(line, "\r\n");
+    *next  = '\0';
+    method = av_strtok(line, " ", &line);
+    path   = av_strtok(NULL, " ", &line);
+    if (!method || !path || path[0] != '/') {
+        av_log(h, AV_LOG_ERROR, "Unsupported request line for HTTP/2\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    ff_hpack_encode_literal(block, ":method", method);
+    ff_hpack_encode_literal(block, ":scheme", c->scheme);
+    ff_hpack_encode_literal(block, ":path",   path);
+
+    c->body_left = 0;
+    for (line = next + 2; *line && strncmp(line, "\r\n", 2); line = next + 2) {
+        char *name, *value;
+
+        next  = strstr(line, "\r\n");
+        *next = '\0';
+        name  = line;
+        value = strchr(line, ':');
+        if (!value)
+            continue;
+        *value++ = '\0';
+        value   += strspn(value, " \t");
+
+        if (!av_strcasecmp(name, "host"))
+            authority = value;
+        if (!av_strcasecmp(name, "content-length"))
+            c->body_left = strtoll(value, NULL, 10);
+        if (!av_strcasecmp(name, "transfer-encoding")) {
+            av_log(h, AV_LOG_ERROR, "Chunked requests are not supported with HTTP/2\n");
+            ret = AVERROR(ENOSYS);
+            goto end;
+        }
+        if (is_hop_by_hop(name) ||
+            (!av_strcasecmp(name, "te") && av_strcasecmp(value, "trailers")))
+            continue;
+
+        for (char *p = name; *p; p++)
+            *p = av_tolower(*p);
+        ff_hpack_encode_literal(&fields, name, value);
+    }
+    // the pseudo-header fields have to come first
+    if (authority)
+        ff_hpack_encode_literal(block, ":authority", authority);
+    av_bprint_append_data(block, fields.str, fields.len);
+
+    if (!av_bprint_is_complete(block) || !av_bprint_is_complete(&fields))
+        ret = AVERROR(ENOMEM);
+end:
+    av_bprint_finalize(&fields, NULL);
+    av_free(header);
+    return ret;
+}
+
+static int send_request(HTTP2Context *c, URLContext *h)
+{
+    HTTP2Session *s = c->session;
+    HTTP2Stream *st;
+    AVBPrint block;
+    int ret, flags = FLAG_END_HEADERS;
+
+    av_bprint_init(&block, 0, AV_BPRINT_SIZE_UNLIMITED);
+    ret = encode_request(c, h, &block);
+    if (ret < 0)
+        goto end;
+    c->has_body  = c->body_left > 0;
+    c->delivered = 0;
+
+    st = av_mallocz(sizeof(*st));
+    if (!st) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    av_bprint_init(&st->header, 0, AV_BPRINT_SIZE_UNLIMITED);
+    st->fifo = av_fifo_alloc2(4096, 1, AV_FIFO_FLAG_AUTO_GROW);
+    if (!st->fifo) {
+        av_free(st);
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    // the buffered data is bounded by the flow control
+    av_fifo_auto_grow_limit(st->fifo, 4 * STREAM_WINDOW);
+    c->stream = st;
+
+    ff_mutex_lock(&s->lock);
+    while (!s->goaway && s->nb_active >= s->peer_max_streams)
+        if ((ret = session_pump(s, h)) < 0)
+            break;
+    if (ret >= 0 && (s->goaway || s->next_stream_id > MAX_STREAM_ID)) {
+        s->goaway   = 1;
+        st->refused = 1;
+        ret = AVERROR(ECONNRESET);
+    }
+    if (ret < 0) {
+        st->closed = 1;
+        st->err    = ret;
+        ff_mutex_unlock(&s->lock);
+        goto end;
+    }
+
+    st->id              = s->next_stream_id;
+    st->send_window     = s->peer_initial_window;
+    s->next_stream_id  += 2;
+    st->next            = s->streams;
+    s->streams          = st;
+    s->nb_active++;
+
+    if (!c->body_left)
+        flags |= FLAG_END_STREAM;
+    for (int pos = 0; ret >= 0; ) {
+        int size = FFMIN(block.len - pos, FFMIN(s->peer_max_frame_size, MAX_FRAME_SIZE));
+        int type = pos ? FRAME_CONTINUATION : FRAME_HEADERS;
+
+        if (pos + size < block.len) {
+            ret = send_frame(s, h, type, flags & ~FLAG_END_HEADERS, st->id,
+                             block.str + pos, size);
+            // END_STREAM is only set on HEADERS
+            flags &= ~FLAG_END_STREAM;
+            pos   += size;
+        } else {
+            ret = send_frame(s, h, type, flags, st->id, block.str + pos, size);
+            break;
+        }
+    }
+    ff_mutex_unlock(&s->lock);
+
+    av_log(h, AV_LOG_DEBUG, "Sent request on HTTP/2 stream %"PRIu32"\n", st->id);
+end:
+    av_bprint_finalize(&block, NULL);
+    return ret;
+}
+
+static int send_body(HTTP2Context *c, URLContext *h, const uint8_t *buf, int size)
+{
+    HTTP2Session *s = c->session;
+    HTTP2Stream *st = c->stream;
+    int ret = 0;
+
+    if (size > c->body_left)
+        return AVERROR(EINVAL);
+
+    ff_mutex_lock(&s->lock);
+    while (size > 0) {
+        int64_t len = FFMIN3(size, st->send_window, s->send_window);
+
+        if (st->closed) {
+            ret = st->err < 0 ? st->err : AVERROR(EPIPE);
+            break;
+        }
+        if (len <= 0) {
+            if ((ret = session_pump(s, h)) < 0)
+                break;
+            continue;
+        }
+        len = FFMIN(len, FFMIN(s->peer_max_frame_size, MAX_FRAME_SIZE));
+
+        c->body_left -= len;
+        ret = send_frame(s, h, FRAME_DATA, c->body_left ? 0 : FLAG_END_STREAM,
+                         st->id, buf, len);
+        if (ret < 0)
+            break;
+        st->send_window -= len;
+        s->send_window  -= len;
+        buf  += len;
+        size -= len;
+    }
+    ff_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+/* Copy the options of the lower protocols, which also make up the key of the
+ * connection, leaving out the ones meant for other layers. */
+static int copy_lower_options(AVDictionary **dst, const AVDictionary *src,
+                              const char *lower_url)
+{
+    const URLProtocol **protocols = ffurl_get_protocols(NULL, NULL);
+    const AVClass *classes[2] = { NULL };
+    const AVDictionaryEntry *e = NULL;
+    int ret = 0;
+
+    if (!protocols)
+        return AVERROR(ENOMEM);
+    for (int i = 0; protocols[i]; i++) {
+        if (!strcmp(protocols[i]->name, "tcp"))
+            classes[0] = protocols[i]->priv_data_class;
+        else if (av_strstart(lower_url, "tls:", NULL) &&
+                 !strcmp(protocols[i]->name, "tls"))
+            classes[1] = protocols[i]->priv_data_class;
+    }
+    av_free(protocols);
+
+    while (ret >= 0 && (e = av_dict_iterate(src, e))) {
+        int found = !strcmp(e->key, "rw_timeout");
+
+        for (int i = 0; i < FF_ARRAY_ELEMS(classes) && !found; i++)
+            found = classes[i] && av_opt_find(&classes[i], e->key, NULL, 0,
+                                              AV_OPT_SEARCH_FAKE_OBJ);
+        if (found)
+            ret = av_dict_set(dst, e->key, e->value, 0);
+    }
+
+    return ret;
+}
+
+static int http2_open(URLContext *h, const char *uri, int flags,
+                      AVDictionary **options)
+{
+    HTTP2Context *c = h->priv_data;
+    const char *lower_url;
+    int ret;
+
+    av_bprint_init(&c->request, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    if (!av_strstart(uri, "http2:", &lower_url) ||
+        (!av_strstart(lower_url, "tcp:", NULL) && !av_strstart(lower_url, "tls:", NULL))) {
+        av_log(h, AV_LOG_ERROR, "Unsupported url %s\n", uri);
+        return AVERROR(EINVAL);
+    }
+    c->scheme = av_strstart(lower_url, "tls:", NULL) ? "https" : "http";
+
+    c->lower_url = av_strdup(lower_url);
+    if (!c->lower_url)
+        return AVERROR(ENOMEM);
+    // kept for opening another connection if the server shuts this one down
+    if (options && (ret = copy_lower_options(&c->lower_opts, *options,
+                                             c->lower_url)) < 0)
+        return ret;
+    if (options) {
+        // as if they were used by the lower protocol
+        const AVDictionaryEntry *e = NULL;
+        while ((e = av_dict_iterate(c->lower_opts, e)))
+            av_dict_set(options, e->key, NULL, 0);
+    }
+
+    h->is_streamed = 1;
+
+    return session_get(h);
+}
+
+/* Move to another connection, the current one cannot start new streams. */
+static int session_renew(HTTP2Context *c, URLContext *h)
+{
+    stream_free(c, h);
+    session_release(&c->session);
+    return session_get(h);
+}
+
+/* Send the request again on a new connection if it was not processed. */
+static int retry_request(HTTP2Context *c, URLContext *h)
+{
+    int ret;
+
+    av_log(h, AV_LOG_VERBOSE, "Retrying the request on a new HTTP/2 connection\n");
+    c->retried = 1;
+    if ((ret = session_renew(c, h)) < 0)
+        return ret;
+    // the new connection does not use HTTP/2, resend the original request
+    if (c->direct)
+        return ffurl_write(c->direct, c->request.str, c->request.len);
+    return send_request(c, h);
+}
+
+static int http2_write(URLContext *h, const uint8_t *buf, int size)
+{
+    HTTP2Context *c = h->priv_data;
+    const char *end;
+    int header_len, ret;
+
+    if (c->direct)
+        return ffurl_write(c->direct, buf, size);
+
+    if (c->body_left > 0) {
+        ret = send_body(c, h, buf, size);
+        return ret < 0 ? ret : size;
+    }
+
+    // the previous request is complete, this is a new one
+    if (c->request_sent) {
+        stream_free(c, h);
+        av_bprint_clear(&c->request);
+        c->request_sent = 0;
+        c->retried      = 0;
+    }
+
+    av_bprint_append_data(&c->request, buf, size);
+    if (!av_bprint_is_complete(&c->request))
+        return AVERROR(ENOMEM);
+    end = strstr(c->request.str, "\r\n\r\n");
+    if (!end)
+        return size;
+    header_len = end + 4 - c->request.str;
+
+    if (c->session->goaway && (ret = session_renew(c, h)) < 0)
+        return ret;
+    if (c->direct) {
+        ret = ffurl_write(c->direct, c->request.str, c->request.len);
+        return ret < 0 ? ret : size;
+    }
+
+    c->request.str[header_len] = '\0';
+    if ((ret = send_request(c, h)) < 0)
+        return ret;
+    c->request_sent = 1;
+
+    // the body may have been written along with the header
+    if (c->request.len > header_len) {
+        ret = send_body(c, h, buf + size - (c->request.len - header_len),
+                        c->request.len - header_len);
+        if (ret < 0)
+            return ret;
+    }
+    c->request.len = header_len;
+
+    return size;
+}
+
+static int http2_read(URLContext *h, uint8_t *buf, int size)
+{
+    HTTP2Context *c = h->priv_data;
+    HTTP2Session *s;
+    HTTP2Stream *st;
+    int ret;
+
+    if (c->direct)
+        return ffurl_read(c->direct, buf, size);
+
+    while (1) {
+        s   = c->session;
+        st  = c->stream;
+        ret = 0;
+        if (!st)
+            return AVERROR(EINVAL);
+
+        ff_mutex_lock(&s->lock);
+        while (!av_fifo_can_read(st->fifo) && !st->closed)
+            if ((ret = session_pump(s, h)) < 0)
+                break;
+
+        if (av_fifo_can_read(st->fifo)) {
+            ret = FFMIN(size, av_fifo_can_read(st->fifo));
+            av_fifo_read(st->fifo, buf, ret);
+            c->delivered = 1;
+
+            // let the server send more once most of the data is consumed
+            if (!st->closed && st->unacked >= STREAM_WINDOW / 4 &&
+                av_fifo_can_read(st->fifo) < STREAM_WINDOW / 2) {
+                int err = send_window_update(s, h, st->id, st->unacked);
+                if (err < 0)
+                    ret = err;
+                st->unacked = 0;
+            }
+        } else if (st->closed) {
+            if (st->refused && !c->delivered && !c->has_body && !c->retried) {
+                ff_mutex_unlock(&s->lock);
+                if ((ret = retry_request(c, h)) < 0)
+                    return ret;
+                if (c->direct)
+                    return ffurl_read(c->direct, buf, size);
+                continue;
+            }
+            ret = st->err < 0 ? st->err : AVERROR_EOF;
+        }
+        ff_mutex_unlock(&s->lock);
+
+        return ret;
+    }
+}
+
+static int http2_close(URLContext *h)
+{
+    HTTP2Context *c = h->priv_data;
+
+    if (c->session)
+        stream_free(c, h);
+    session_release(&c->session);
+    ffurl_closep(&c->direct);
+    av_bprint_finalize(&c->request, NULL);
+    av_freep(&c->lower_url);
+    av_dict_free(&c->lower_opts);
+
+    return 0;
+}
+
+static int http2_get_file_handle(URLContext *h)
+{
+    HTTP2Context *c = h->priv_data;
+
+    if (c->direct)
+        return ffurl_get_file_handle(c->direct);
+    return c->session ? c->session->fd : -1;
+}
+
+void ff_http2_flush(void)
+{
+    HTTP2Session *stale = NULL;
+
+    ff_mutex_lock(&sessions_mutex);
+    remove_idle_locked(&stale, INT64_MAX);
+    ff_mutex_unlock(&sessions_mutex);
+
+    session_free_list(stale);
+}
+
+static const AVClass http2_context_class = {
+    .class_name = "http2",
+    .item_name  = av_default_item_name,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+const URLProtocol ff_http2_protocol = {
+    .name                = "http2",
+    .url_open2           = http2_open,
+    .url_read            = http2_read,
+    .url_write           = http2_write,
+    .url_close           = http2_close,
+    .url_get_file_handle = http2_get_file_handle,
+    .priv_data_size      = sizeof(HTTP2Context),
+    .priv_data_class     = &http2_context_class,
+    .flags               = URL_PROTOCOL_FLAG_NETWORK,
+    .default_whitelist   = "tcp,tls",
+};
@@ -0,0 +1,40 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_HTTP2_H
+#define AVFORMAT_HTTP2_H
+
+/**
+ * @file
+ * HTTP/2 transport for the HTTP protocol, RFC 9113.
+ *
+ * The http2 protocol is used by the HTTP protocol in place of tcp or tls,
+ * with URLs of the form http2:tcp://host:port (h2c with prior knowledge) or
+ * http2:tls://host:port (h2 negotiated with ALPN). Each context carries the
+ * requests written to it as streams of a connection shared by all the
+ * contexts of the process opened with the same URL and options, and returns
+ * the responses converted to HTTP/1.1, so that the HTTP protocol handles
+ * both versions the same way.
+ */
+
+/**
+ * Close all the idle HTTP/2 connections.
+ */
+void ff_http2_flush(void);
+
+#endif /* AVFORMAT_HTTP2_H */
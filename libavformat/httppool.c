@@ -0,0 +1,243 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "httppool.h"
+#include "network.h"
+#include "os_support.h"
+
+typedef struct PoolConn {
+    URLContext *hd;
+    char       *key;
+    /* interrupt callback of the context using the connection, unset while
+     * the connection is idle */
+    AVIOInterruptCB user_cb;
+    /* time after which an idle connection is closed, 0 while in use */
+    int64_t     expiry;
+    struct PoolConn *next;
+} PoolConn;
+
+static AVMutex pool_mutex = AV_MUTEX_INITIALIZER;
+/* all the connections opened by the pool, most recently released first */
+static PoolConn *pool;
+
+static int forward_interrupt(void *opaque)
+{
+    PoolConn *c = opaque;
+    return ff_check_interrupt(&c->user_cb);
+}
+
+static void conn_free_list(PoolConn *c)
+{
+    while (c) {
+        PoolConn *next = c->next;
+        // the interrupt callback of the connection points to c
+        ffurl_closep(&c->hd);
+        av_free(c->key);
+        av_free(c);
+        c = next;
+    }
+}
+
+static PoolConn *conn_unlink_locked(URLContext *hd)
+{
+    for (PoolConn **pc = &pool; *pc; pc = &(*pc)->next) {
+        PoolConn *c = *pc;
+        if (c->hd == hd) {
+            *pc = c->next;
+            c->next = NULL;
+            return c;
+        }
+    }
+    return NULL;
+}
+
+/* Move to *stale the idle connections expired at now and, if key is set,
+ * the ones with this key beyond the max_idle most recently released. */
+static void remove_idle_locked(PoolConn **stale, int64_t now,
+                               const char *key, int max_idle)
+{
+    PoolConn **pc = &pool;
+    int nb_idle = 0;
+
+    while (*pc) {
+        PoolConn *c = *pc;
+
+        if (c->expiry && (c->expiry <= now ||
+                          (key && !strcmp(c->key, key) && ++nb_idle > max_idle))) {
+            *pc     = c->next;
+            c->next = *stale;
+            *stale  = c;
+        } else
+            pc = &c->next;
+    }
+}
+
+/* An idle connection has nothing to read, unless the server closed it or
+ * sent something unexpected. Either way it cannot be reused. */
+static int conn_is_alive(URLContext *hd)
+{
+    struct pollfd p = { .fd = ffurl_get_file_handle(hd), .events = POLLIN };
+
+    if (p.fd < 0)
+        return 1;
+    return !poll(&p, 1, 0);
+}
+
+int ff_http_pool_open(URLContext **puc, const char *url, int flags,
+                      const AVIOInterruptCB *int_cb, AVDictionary **options,
+                      const char *whitelist, const char *blacklist,
+                      URLContext *parent, int *reused)
+{
+    AVIOInterruptCB cb;
+    PoolConn *c, *stale = NULL;
+    char *opts = NULL, *key;
+    int ret;
+
+    *puc    = NULL;
+    *reused = 0;
+
+    ret = av_dict_get_string(options ? *options : NULL, &opts, '=', ',');
+    if (ret < 0)
+        return ret;
+    key = av_asprintf("%s|%s", url, opts);
+    av_free(opts);
+    if (!key)
+        return AVERROR(ENOMEM);
+
+    while (1) {
+        ff_mutex_lock(&pool_mutex);
+        remove_idle_locked(&stale, av_gettime_relative(), NULL, 0);
+        for (c = pool; c; c = c->next)
+            if (c->expiry && !strcmp(c->key, key))
+                break;
+        if (c) {
+            c->expiry  = 0;
+            c->user_cb = int_cb ? *int_cb : (AVIOInterruptCB){ 0 };
+        }
+        ff_mutex_unlock(&pool_mutex);
+
+        conn_free_list(stale);
+        stale = NULL;
+
+        if (!c)
+            break;
+        if (conn_is_alive(c->hd)) {
+            av_free(key);
+            *puc    = c->hd;
+            *reused = 1;
+            return 0;
+        }
+        ff_http_pool_closep(&c->hd);
+    }
+
+    c = av_mallocz(sizeof(*c));
+    if (!c) {
+        av_free(key);
+        return AVERROR(ENOMEM);
+    }
+    c->key     = key;
+    c->user_cb = int_cb ? *int_cb : (AVIOInterruptCB){ 0 };
+
+    cb = (AVIOInterruptCB){ forward_interrupt, c };
+    ret = ffurl_open_whitelist(&c->hd, url, flags, &cb, options,
+                               whitelist, blacklist, parent);
+    if (ret < 0) {
+        av_free(c->key);
+        av_free(c);
+        return ret;
+    }
+
+    ff_mutex_lock(&pool_mutex);
+    c->next = pool;
+    pool    = c;
+    ff_mutex_unlock(&pool_mutex);
+
+    *puc = c->hd;
+
+    return 0;
+}
+
+void ff_http_pool_release(URLContext **puc, int64_t idle_timeout, int max_idle)
+{
+    URLContext *hd = *puc;
+    PoolConn *c, *stale = NULL;
+    int64_t now = av_gettime_relative();
+
+    *puc = NULL;
+    if (!hd)
+        return;
+    if (idle_timeout <= 0 || max_idle <= 0) {
+        ff_http_pool_closep(&hd);
+        return;
+    }
+
+    ff_mutex_lock(&pool_mutex);
+    c = conn_unlink_locked(hd);
+    if (c) {
+        c->user_cb = (AVIOInterruptCB){ 0 };
+        c->expiry  = now + idle_timeout;
+        c->next    = pool;
+        pool       = c;
+
+        remove_idle_locked(&stale, now, c->key, max_idle);
+    }
+    ff_mutex_unlock(&pool_mutex);
+
+    if (!c)
+        ffurl_closep(&hd);
+    conn_free_list(stale);
+}
+
+int ff_http_pool_closep(URLContext **puc)
+{
+    PoolConn *c;
+    int ret;
+
+    if (!*puc)
+        return 0;
+
+    ff_mutex_lock(&pool_mutex);
+    c = conn_unlink_locked(*puc);
+    ff_mutex_unlock(&pool_mutex);
+
+    ret = ffurl_closep(puc);
+    if (c) {
+        av_free(c->key);
+        av_free(c);
+    }
+
+    return ret;
+}
+
+void ff_http_pool_flush(void)
+{
+    PoolConn *stale = NULL;
+
+    ff_mutex_lock(&pool_mutex);
+    remove_idle_locked(&stale, INT64_MAX, NULL, 0);
+    ff_mutex_unlock(&pool_mutex);
+
+    conn_free_list(stale);
+}
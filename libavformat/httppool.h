@@ -0,0 +1,78 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_HTTPPOOL_H
+#define AVFORMAT_HTTPPOOL_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+
+#include "avio.h"
+#include "url.h"
+
+/**
+ * @file
+ * Process-wide pool of the persistent connections used by the HTTP
+ * protocol. Idle connections are shared between all the HTTP contexts and
+ * threads, keyed by the URL of the lower protocol (scheme, host and port of
+ * the server or proxy) and the options it was opened with (e.g. the TLS
+ * parameters).
+ *
+ * The connections are opened with an interrupt callback owned by the pool,
+ * which forwards to the callback of the context currently using them, so
+ * that a connection does not keep references to the context that opened it.
+ */
+
+/**
+ * Open a connection to url, reusing an idle connection opened with the same
+ * url and options if there is one.
+ *
+ * The arguments are the same as for ffurl_open_whitelist().
+ *
+ * @param reused set to 1 if an idle connection was reused, 0 otherwise
+ */
+int ff_http_pool_open(URLContext **puc, const char *url, int flags,
+                      const AVIOInterruptCB *int_cb, AVDictionary **options,
+                      const char *whitelist, const char *blacklist,
+                      URLContext *parent, int *reused);
+
+/**
+ * Make a connection opened with ff_http_pool_open() available to the other
+ * users of the pool and set *puc to NULL. Connections not opened by the pool
+ * are closed.
+ *
+ * @param idle_timeout time in microseconds after which the connection is
+ *                     closed if it is not reused
+ * @param max_idle     maximum number of idle connections with the same key,
+ *                     the oldest ones are closed first
+ */
+void ff_http_pool_release(URLContext **puc, int64_t idle_timeout, int max_idle);
+
+/**
+ * Close a connection, whether or not it was opened with ff_http_pool_open(),
+ * and set *puc to NULL.
+ */
+int ff_http_pool_closep(URLContext **puc);
+
+/**
+ * Close all the idle connections.
+ */
+void ff_http_pool_flush(void);
+
+#endif /* AVFORMAT_HTTPPOOL_H */
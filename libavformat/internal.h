@@ -185,6 +185,11 @@ typedef struct FFStream {
                                     support seeking natively. */
     int nb_index_entries;
     unsigned int index_entries_allocated_size;
+    /**
+     * Index entries stored instead of index_entries with
+     * AVFMT_FLAG_COMPACT_INDEX, nb_index_entries is still set.
+     */
+    struct FFCompactIndex *compact_index;
 
     int64_t interleaver_chunk_size;
     int64_t interleaver_chunk_duration;
@@ -594,6 +599,15 @@ int ff_rename(const char *url_src, const char *url_dst, void *logctx);
  */
 int ff_alloc_extradata(AVCodecParameters *par, int size);
 
+/**
+ * Like av_get_packet(), but reference the data in place instead of copying
+ * it when s reads from a memory-mapped resource, see ffio_read_mapped().
+ *
+ * The packet data is then read-only. Callers that modify the data in place
+ * must call av_packet_make_writable() first.
+ */
+int ff_get_packet_mapped(AVIOContext *s, AVPacket *pkt, int size);
+
 /**
  * Copies the whilelists from one context to the other
  */
@@ -609,6 +623,12 @@ int ff_copy_whiteblacklists(AVFormatContext *dst, const AVFormatContext *src);
  */
 int ff_format_io_close(AVFormatContext *s, AVIOContext **pb);
 
+/**
+ * Check whether AVFormatContext.io_open is the default callback, which
+ * opens the url with the protocols and the interrupt callback of s.
+ */
+int ff_format_io_open_is_default(const AVFormatContext *s);
+
 /**
  * Utility function to check if the file uses http or https protocol
  *
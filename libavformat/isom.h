@@ -170,6 +170,28 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * Position in the sample tables of a track, used to generate its index
+ * entries incrementally.
+ */
+typedef struct MOVIndexCursor {
+    int64_t offset;       ///< position of the sample
+    int64_t dts;          ///< dts of the sample
+    uint64_t size;        ///< total size of the previous samples
+    unsigned int sample;
+    unsigned int chunk;
+    unsigned int chunk_sample;
+    int chunk_started;
+    unsigned int stsc_index;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    unsigned int distance;
+} MOVIndexCursor;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int refcount;
@@ -214,6 +236,14 @@ typedef struct MOVStreamContext {
     int64_t current_index;
     MOVIndexRange* index_ranges;
     MOVIndexRange* current_index_range;
+    MOVIndexCursor *lazy_index; ///< cursors at the start of each block of samples, if the index is built lazily
+    unsigned int lazy_index_count;
+    unsigned int lazy_index_samples; ///< number of samples in the lazy index
+    unsigned int lazy_index_base;    ///< sample number of the first entry of the loaded block
+    /* index entries of the loaded block, kept out of the generic index which
+     * must hold all the entries of the stream */
+    AVIndexEntry *lazy_entries;
+    int lazy_nb_entries;
     unsigned int bytes_per_frame;
     unsigned int samples_per_frame;
     int dv_audio_container;
@@ -386,6 +416,8 @@ typedef struct MOVContext {
     int64_t idat_offset;
     int interleaved_read;
     AVDictionary* decryption_keys;
+    int lazy_index;
+    int fragment_threads;
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
@@ -1084,10 +1084,25 @@ static int ebml_read_ascii(AVIOContext *pb, int size,
  * 0 is success, < 0 or NEEDS_CHECKING is failure.
  */
 static int ebml_read_binary(AVIOContext *pb, int length,
-                            int64_t pos, EbmlBin *bin)
+                            int64_t pos, EbmlBin *bin, int mapped)
 {
     int ret;
 
+    if (mapped) {
+        AVBufferRef *buf;
+
+        ret = ffio_read_mapped(pb, length, &buf);
+        if (ret >= 0) {
+            av_buffer_unref(&bin->buf);
+            bin->buf  = buf;
+            bin->data = buf->data;
+            bin->size = length;
+            bin->pos  = pos;
+            return 0;
+        } else if (ret != AVERROR(ENOSYS))
+            return ret;
+    }
+
     ret = av_buffer_realloc(&bin->buf, length + AV_INPUT_BUFFER_PADDING_SIZE);
     if (ret < 0)
         return ret;
@@ -1485,7 +1500,10 @@ static int ebml_parse(MatroskaDemuxContext *matroska,
         res = ebml_read_ascii(pb, length, syntax->def.s, data);
         break;
     case EBML_BIN:
-        res = ebml_read_binary(pb, length, pos_alt, data);
+        // block payloads are only read, they can be referenced in place
+        res = ebml_read_binary(pb, length, pos_alt, data,
+                               id == MATROSKA_ID_BLOCK ||
+                               id == MATROSKA_ID_SIMPLEBLOCK);
         break;
     case EBML_LEVEL1:
     case EBML_NEST:
@@ -4333,6 +4351,7 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
     MatroskaTrack *tracks = NULL;
     AVStream *st = s->streams[stream_index];
     FFStream *const sti = ffstream(st);
+    const AVIndexEntry *ie;
     int i, index;
 
     /* Parse the CUES now since we need the index data to seek. */
@@ -4343,11 +4362,12 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
 
     if (!sti->nb_index_entries)
         goto err;
-    timestamp = FFMAX(timestamp, sti->index_entries[0].timestamp);
+    timestamp = FFMAX(timestamp, avformat_index_get_entry(st, 0)->timestamp);
 
     if ((index = av_index_search_timestamp(st, timestamp, flags)) < 0 ||
          index == sti->nb_index_entries - 1) {
-        matroska_reset_status(matroska, 0, sti->index_entries[sti->nb_index_entries - 1].pos);
+        matroska_reset_status(matroska, 0,
+                              avformat_index_get_entry(st, sti->nb_index_entries - 1)->pos);
         while ((index = av_index_search_timestamp(st, timestamp, flags)) < 0 ||
                index == sti->nb_index_entries - 1) {
             matroska_clear_queue(matroska);
@@ -4370,17 +4390,18 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
     }
 
     /* We seek to a level 1 element, so set the appropriate status. */
-    matroska_reset_status(matroska, 0, sti->index_entries[index].pos);
+    ie = avformat_index_get_entry(st, index);
+    matroska_reset_status(matroska, 0, ie->pos);
     if (flags & AVSEEK_FLAG_ANY) {
         sti->skip_to_keyframe = 0;
         matroska->skip_to_timecode = timestamp;
     } else {
         sti->skip_to_keyframe = 1;
-        matroska->skip_to_timecode = sti->index_entries[index].timestamp;
+        matroska->skip_to_timecode = ie->timestamp;
     }
     matroska->skip_to_keyframe = 1;
     matroska->done             = 0;
-    avpriv_update_cur_dts(s, st, sti->index_entries[index].timestamp);
+    avpriv_update_cur_dts(s, st, ie->timestamp);
     return 0;
 err:
     // slightly hackish but allows proper fallback to
@@ -4425,28 +4446,30 @@ typedef struct {
  */
 static CueDesc get_cue_desc(AVFormatContext *s, int64_t ts, int64_t cues_start) {
     MatroskaDemuxContext *matroska = s->priv_data;
-    FFStream *const sti = ffstream(s->streams[0]);
-    AVIndexEntry *const index_entries = sti->index_entries;
-    int nb_index_entries = sti->nb_index_entries;
+    AVStream *const st = s->streams[0];
+    int nb_index_entries = ffstream(st)->nb_index_entries;
+    const AVIndexEntry *ie;
     CueDesc cue_desc;
     int i;
 
     if (ts >= (int64_t)(matroska->duration * matroska->time_scale))
         return (CueDesc) {-1, -1, -1, -1};
     for (i = 1; i < nb_index_entries; i++) {
-        if (index_entries[i - 1].timestamp * matroska->time_scale <= ts &&
-            index_entries[i].timestamp * matroska->time_scale > ts) {
+        if (avformat_index_get_entry(st, i - 1)->timestamp * matroska->time_scale <= ts &&
+            avformat_index_get_entry(st, i)->timestamp * matroska->time_scale > ts) {
             break;
         }
     }
     --i;
-    if (index_entries[i].timestamp > matroska->duration)
+    ie = avformat_index_get_entry(st, i);
+    if (ie->timestamp > matroska->duration)
         return (CueDesc) {-1, -1, -1, -1};
-    cue_desc.start_time_ns = index_entries[i].timestamp * matroska->time_scale;
-    cue_desc.start_offset = index_entries[i].pos - matroska->segment_start;
+    cue_desc.start_time_ns = ie->timestamp * matroska->time_scale;
+    cue_desc.start_offset = ie->pos - matroska->segment_start;
     if (i != nb_index_entries - 1) {
-        cue_desc.end_time_ns = index_entries[i + 1].timestamp * matroska->time_scale;
-        cue_desc.end_offset = index_entries[i + 1].pos - matroska->segment_start;
+        ie = avformat_index_get_entry(st, i + 1);
+        cue_desc.end_time_ns = ie->timestamp * matroska->time_scale;
+        cue_desc.end_offset = ie->pos - matroska->segment_start;
     } else {
         cue_desc.end_time_ns = matroska->duration * matroska->time_scale;
         // FIXME: this needs special handling for files where Cues appear
@@ -4477,7 +4500,7 @@ static int webm_clusters_start_with_keyframe(AVFormatContext *s)
     index = av_index_search_timestamp(st, 0, 0);
     if (index < 0)
         return 0;
-    cluster_pos = sti->index_entries[index].pos;
+    cluster_pos = avformat_index_get_entry(st, index)->pos;
     before_pos = avio_tell(s->pb);
     while (1) {
         uint64_t cluster_id, cluster_length;
@@ -4603,7 +4626,7 @@ static int64_t webm_dash_manifest_compute_bandwidth(AVFormatContext *s, int64_t
 
     for (int i = 0; i < sti->nb_index_entries; i++) {
         int64_t prebuffer_ns = 1000000000;
-        int64_t time_ns = sti->index_entries[i].timestamp * matroska->time_scale;
+        int64_t time_ns = avformat_index_get_entry(st, i)->timestamp * matroska->time_scale;
         double nano_seconds_per_second = 1000000000.0;
         int64_t prebuffered_ns;
         double prebuffer_bytes = 0.0;
@@ -4759,7 +4782,7 @@ static int webm_dash_manifest_cues(AVFormatContext *s, int64_t init_range)
     // for checking subsegment alignment in the muxer.
     av_bprint_init(&bprint, 0, AV_BPRINT_SIZE_UNLIMITED);
     for (int j = 0; j < sti->nb_index_entries; j++)
-        av_bprintf(&bprint, "%" PRId64",", sti->index_entries[j].timestamp);
+        av_bprintf(&bprint, "%" PRId64",", avformat_index_get_entry(st, j)->timestamp);
     if (!av_bprint_is_complete(&bprint)) {
         av_bprint_finalize(&bprint, NULL);
         return AVERROR(ENOMEM);
@@ -4852,7 +4875,7 @@ const FFInputFormat ff_webm_dash_manifest_demuxer = {
     .p.long_name    = NULL_IF_CONFIG_SMALL("WebM DASH Manifest"),
     .p.priv_class   = &webm_dash_class,
     .priv_data_size = sizeof(MatroskaDemuxContext),
-    .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP,
+    .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP | FF_INFMT_FLAG_COMPACT_INDEX,
     .read_header    = webm_dash_manifest_read_header,
     .read_packet    = webm_dash_manifest_read_packet,
     .read_close     = matroska_read_close,
@@ -4865,7 +4888,7 @@ const FFInputFormat ff_matroska_demuxer = {
     .p.extensions   = "mkv,mk3d,mka,mks,webm",
     .p.mime_type    = "audio/webm,audio/x-matroska,video/webm,video/x-matroska",
     .priv_data_size = sizeof(MatroskaDemuxContext),
-    .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP,
+    .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP | FF_INFMT_FLAG_COMPACT_INDEX,
     .read_probe     = matroska_probe,
     .read_header    = matroska_read_header,
     .read_packet    = matroska_read_packet,
@@ -48,6 +48,7 @@
 #include "libavutil/sha.h"
 #include "libavutil/spherical.h"
 #include "libavutil/stereo3d.h"
+#include "libavutil/thread.h"
 #include "libavutil/timecode.h"
 #include "libavutil/uuid.h"
 #include "libavcodec/ac3tab.h"
@@ -4150,6 +4151,9 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
     FFStream *const sti = ffstream(st);
+    // only the first block of a lazy index is available
+    const AVIndexEntry *entries = msc->lazy_index ? msc->lazy_entries : sti->index_entries;
+    int nb_entries = msc->lazy_index ? msc->lazy_nb_entries : sti->nb_index_entries;
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
@@ -4162,14 +4166,14 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
     if (st->codecpar->video_delay <= 0 && msc->ctts_count &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for (int ind = 0; ind < sti->nb_index_entries && ctts_ind < msc->tts_count; ++ind) {
+        for (int ind = 0; ind < nb_entries && ctts_ind < msc->tts_count; ++ind) {
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = sti->index_entries[ind].timestamp + msc->tts_data[ctts_ind].offset;
+            pts_buf[j] = entries[ind].timestamp + msc->tts_data[ctts_ind].offset;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -4700,18 +4704,355 @@ static int mov_merge_tts_data(MOVContext *mov, AVStream *st, int flags)
     return 0;
 }
 
+#define MOV_LAZY_INDEX_BLOCK 1024
+
+/**
+ * Compute the index entry of the sample at the cursor and advance the cursor
+ * to the next sample.
+ *
+ * @return 1 if the sample belongs to the demuxed stream, 0 if it belongs to
+ *         another pseudo stream, AVERROR_EOF after the last chunk or
+ *         AVERROR_INVALIDDATA if the sample tables are invalid
+ */
+static int mov_index_next(MOVContext *mov, AVStream *st, MOVIndexCursor *c,
+                          AVIndexEntry *e)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int rap_group_present = sc->rap_group_count && sc->rap_group;
+    int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+    unsigned int sample_size;
+    int keyframe = 0, ret;
+
+    while (!c->chunk_started || c->chunk_sample >= sc->stsc_data[c->stsc_index].count) {
+        int64_t next_offset;
+
+        if (c->chunk_started) {
+            c->chunk++;
+            c->chunk_started = 0;
+        }
+        if (c->chunk >= sc->chunk_count)
+            return AVERROR_EOF;
+
+        next_offset = c->chunk + 1 < sc->chunk_count ? sc->chunk_offsets[c->chunk + 1] : INT64_MAX;
+        c->offset = sc->chunk_offsets[c->chunk];
+        while (mov_stsc_index_valid(c->stsc_index, sc->stsc_count) &&
+            c->chunk + 1 == sc->stsc_data[c->stsc_index + 1].first)
+            c->stsc_index++;
+
+        if (next_offset > c->offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
+            sc->stsc_data[c->stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - c->offset) {
+            av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
+            sc->stsz_sample_size = sc->sample_size;
+        }
+        if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
+            av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+            sc->stsz_sample_size = sc->sample_size;
+        }
+        c->chunk_started = 1;
+        c->chunk_sample = 0;
+    }
+
+    if (c->sample >= sc->sample_count) {
+        av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (!sc->keyframe_absent && (!sc->keyframe_count || c->sample+key_off == sc->keyframes[c->stss_index])) {
+        keyframe = 1;
+        if (c->stss_index + 1 < sc->keyframe_count)
+            c->stss_index++;
+    } else if (sc->stps_count && c->sample+key_off == sc->stps_data[c->stps_index]) {
+        keyframe = 1;
+        if (c->stps_index + 1 < sc->stps_count)
+            c->stps_index++;
+    }
+    if (rap_group_present && c->rap_group_index < sc->rap_group_count) {
+        if (sc->rap_group[c->rap_group_index].index > 0)
+            keyframe = 1;
+        if (++c->rap_group_sample == sc->rap_group[c->rap_group_index].count) {
+            c->rap_group_sample = 0;
+            c->rap_group_index++;
+        }
+    }
+    if (sc->keyframe_absent
+        && !sc->stps_count
+        && !rap_group_present
+        && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (c->chunk == 0 && c->chunk_sample == 0)))
+         keyframe = 1;
+    if (keyframe)
+        c->distance = 0;
+    sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[c->sample];
+    if (c->offset > INT64_MAX - sample_size) {
+        av_log(mov->fc, AV_LOG_ERROR, "Current offset %"PRId64" or sample size %u is too large\n",
+               c->offset,
+               sample_size);
+        return AVERROR_INVALIDDATA;
+    }
+
+    ret = sc->pseudo_stream_id == -1 ||
+          sc->stsc_data[c->stsc_index].id - 1 == sc->pseudo_stream_id;
+    if (ret) {
+        if (sample_size > 0x3FFFFFFF) {
+            av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
+            return AVERROR_INVALIDDATA;
+        }
+        e->pos = c->offset;
+        e->timestamp = c->dts;
+        e->size = sample_size;
+        e->min_distance = c->distance;
+        e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
+        av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
+                "size %u, distance %u, keyframe %d\n", st->index, c->sample,
+                c->offset, c->dts, sample_size, c->distance, keyframe);
+    }
+
+    c->offset += sample_size;
+    c->size += sample_size;
+
+    c->dts += sc->tts_data[c->stts_index].duration;
+
+    c->distance++;
+    c->chunk_sample++;
+    c->stts_sample++;
+    c->sample++;
+    if (c->stts_index + 1 < sc->tts_count && c->stts_sample == sc->tts_data[c->stts_index].count) {
+        c->stts_sample = 0;
+        c->stts_index++;
+    }
+
+    return ret;
+}
+
+static int mov_lazy_index_supported(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+        st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+        return 0;
+    if (sc->iamf)
+        return 0;
+    /* Fixing the index according to the edit lists needs the whole index. */
+    if (!mov->ignore_editlist && mov->advanced_editlist && sc->elst_count) {
+        av_log(mov->fc, AV_LOG_VERBOSE, "Stream %d has an edit list, not indexed "
+               "lazily unless advanced_editlist is disabled\n", st->index);
+        return 0;
+    }
+    /* Sample numbers must match index entries, so all the samples must
+     * belong to the demuxed stream. */
+    if (sc->pseudo_stream_id != -1) {
+        for (unsigned int i = 0; i < sc->stsc_count; i++)
+            if (sc->stsc_data[i].id - 1 != sc->pseudo_stream_id)
+                return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Fill the lazy index entries of the stream with the block of samples
+ * starting at sample block * MOV_LAZY_INDEX_BLOCK.
+ */
+static int mov_lazy_index_load(MOVContext *mov, AVStream *st, unsigned int block)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVIndexCursor c = sc->lazy_index[block];
+    unsigned int nb = FFMIN(sc->lazy_index_samples - c.sample, MOV_LAZY_INDEX_BLOCK);
+
+    if (!sc->lazy_entries) {
+        sc->lazy_entries = av_malloc_array(MOV_LAZY_INDEX_BLOCK, sizeof(*sc->lazy_entries));
+        if (!sc->lazy_entries)
+            return AVERROR(ENOMEM);
+    }
+
+    sc->lazy_index_base = c.sample;
+    sc->lazy_nb_entries = 0;
+    while (sc->lazy_nb_entries < nb &&
+           mov_index_next(mov, st, &c, &sc->lazy_entries[sc->lazy_nb_entries]) > 0)
+        sc->lazy_nb_entries++;
+
+    return 0;
+}
+
+/**
+ * Walk the sample tables once, storing a cursor every MOV_LAZY_INDEX_BLOCK
+ * samples, and load the first block.
+ */
+static int mov_lazy_index_init(MOVContext *mov, AVStream *st, MOVIndexCursor *c)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int nb = 0;
+    AVIndexEntry e;
+    int ret;
+
+    sc->lazy_index = av_malloc_array(sc->sample_count / MOV_LAZY_INDEX_BLOCK + 1,
+                                     sizeof(*sc->lazy_index));
+    if (!sc->lazy_index)
+        return AVERROR(ENOMEM);
+
+    for (;;) {
+        if (!(nb % MOV_LAZY_INDEX_BLOCK))
+            sc->lazy_index[sc->lazy_index_count++] = *c;
+        ret = mov_index_next(mov, st, c, &e);
+        if (ret < 0)
+            break;
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && nb < 99)
+            ff_rfps_add_frame(mov->fc, st, e.timestamp);
+        nb++;
+    }
+    sc->lazy_index_samples = nb;
+
+    if (nb) {
+        int err = mov_lazy_index_load(mov, st, 0);
+        if (err < 0)
+            return err;
+    }
+
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+/**
+ * Replace the lazy index of the stream by the index of all its samples.
+ */
+static int mov_lazy_index_flush(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVIndexCursor c = sc->lazy_index[0];
+    AVIndexEntry *entries;
+
+    entries = av_realloc_array(sti->index_entries, FFMAX(sc->lazy_index_samples, 1),
+                               sizeof(*sti->index_entries));
+    if (!entries)
+        return AVERROR(ENOMEM);
+    sti->index_entries = entries;
+    sti->index_entries_allocated_size = FFMAX(sc->lazy_index_samples, 1) * sizeof(*entries);
+
+    sti->nb_index_entries = 0;
+    while (sti->nb_index_entries < sc->lazy_index_samples &&
+           mov_index_next(mov, st, &c, &entries[sti->nb_index_entries]) > 0)
+        sti->nb_index_entries++;
+
+    av_freep(&sc->lazy_index);
+    av_freep(&sc->lazy_entries);
+    sc->lazy_index_count = 0;
+    sc->lazy_index_samples = 0;
+    sc->lazy_index_base = 0;
+    sc->lazy_nb_entries = 0;
+
+    return 0;
+}
+
+/**
+ * Get the index entry of a sample, loading the block containing it if the
+ * index is built lazily. The entry is only valid until another block of the
+ * stream is loaded.
+ */
+static AVIndexEntry *mov_get_index_entry(MOVContext *mov, AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+
+    if (sc->lazy_index) {
+        if (sample < 0 || sample >= sc->lazy_index_samples)
+            return NULL;
+        if (sample - sc->lazy_index_base >= sc->lazy_nb_entries &&
+            mov_lazy_index_load(mov, st, sample / MOV_LAZY_INDEX_BLOCK) < 0)
+            return NULL;
+        return &sc->lazy_entries[sample - sc->lazy_index_base];
+    }
+
+    if (sample < 0 || sample >= sti->nb_index_entries)
+        return NULL;
+    return &sti->index_entries[sample];
+}
+
+/**
+ * Get the timestamp of a sample, or AV_NOPTS_VALUE if there is no such
+ * sample. Unlike mov_get_index_entry(), this does not load another block
+ * for the first sample of a block.
+ */
+static int64_t mov_get_index_timestamp(MOVContext *mov, AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    const AVIndexEntry *e;
+
+    if (sc->lazy_index && sample >= 0 && sample < sc->lazy_index_samples &&
+        sample - sc->lazy_index_base >= sc->lazy_nb_entries &&
+        !(sample % MOV_LAZY_INDEX_BLOCK))
+        return sc->lazy_index[sample / MOV_LAZY_INDEX_BLOCK].dts;
+
+    e = mov_get_index_entry(mov, st, sample);
+    return e ? e->timestamp : AV_NOPTS_VALUE;
+}
+
+/**
+ * Get the number of samples of the stream, which are not all in the generic
+ * index if the index is built lazily.
+ */
+static int mov_get_index_count(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    return sc->lazy_index ? sc->lazy_index_samples : ffstream(st)->nb_index_entries;
+}
+
+/**
+ * Same as av_index_search_timestamp(), over all the samples of the stream
+ * when the index is built lazily.
+ */
+static int mov_index_search_timestamp(MOVContext *mov, AVStream *st,
+                                      int64_t timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int nb_blocks, block, lo, hi;
+    int sample;
+
+    if (!sc->lazy_index)
+        return av_index_search_timestamp(st, timestamp, flags);
+    if (!sc->lazy_index_samples)
+        return -1;
+
+    /* last block starting at or before timestamp */
+    nb_blocks = (sc->lazy_index_samples + MOV_LAZY_INDEX_BLOCK - 1) / MOV_LAZY_INDEX_BLOCK;
+    lo = 0;
+    hi = nb_blocks;
+    while (hi - lo > 1) {
+        unsigned int mid = (lo + hi) >> 1;
+        if (sc->lazy_index[mid].dts <= timestamp)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    block = lo;
+
+    for (;;) {
+        if (sc->lazy_index_base != block * MOV_LAZY_INDEX_BLOCK || !sc->lazy_nb_entries) {
+            int ret = mov_lazy_index_load(mov, st, block);
+            if (ret < 0)
+                return ret;
+        }
+        sample = ff_index_search_timestamp(sc->lazy_entries, sc->lazy_nb_entries,
+                                           timestamp, flags);
+        if (sample >= 0)
+            return sc->lazy_index_base + sample;
+        /* no matching keyframe in this block, look in the adjacent one */
+        if (flags & AVSEEK_FLAG_BACKWARD) {
+            if (!block--)
+                return -1;
+        } else if (++block >= nb_blocks)
+            return -1;
+    }
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
     FFStream *const sti = ffstream(st);
     int64_t current_offset;
     int64_t current_dts = 0;
-    unsigned int stts_index = 0;
     unsigned int stsc_index = 0;
-    unsigned int stss_index = 0;
-    unsigned int stps_index = 0;
-    unsigned int i, j;
-    uint64_t stream_size = 0;
+    unsigned int i;
 
     int ret = build_open_gop_key_points(st);
     if (ret < 0)
@@ -4769,125 +5110,47 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
     if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data && sc->stts_data[0].duration == 1)) {
-        unsigned int current_sample = 0;
-        unsigned int stts_sample = 0;
-        unsigned int sample_size;
-        unsigned int distance = 0;
-        unsigned int rap_group_index = 0;
-        unsigned int rap_group_sample = 0;
-        int rap_group_present = sc->rap_group_count && sc->rap_group;
-        int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+        MOVIndexCursor cursor = { 0 };
+        int lazy = mov->lazy_index && mov_lazy_index_supported(mov, st);
 
         current_dts -= sc->dts_shift;
 
         if (!sc->sample_count || sti->nb_index_entries || sc->tts_count)
             return;
-        if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
-            return;
-        if (av_reallocp_array(&sti->index_entries,
-                              sti->nb_index_entries + sc->sample_count,
-                              sizeof(*sti->index_entries)) < 0) {
-            sti->nb_index_entries = 0;
-            return;
+        if (!lazy) {
+            if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
+                return;
+            if (av_reallocp_array(&sti->index_entries,
+                                  sti->nb_index_entries + sc->sample_count,
+                                  sizeof(*sti->index_entries)) < 0) {
+                sti->nb_index_entries = 0;
+                return;
+            }
+            sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
         }
-        sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
 
         ret = mov_merge_tts_data(mov, st, MOV_MERGE_CTTS | MOV_MERGE_STTS);
         if (ret < 0)
             return;
 
-        for (i = 0; i < sc->chunk_count; i++) {
-            int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
-            current_offset = sc->chunk_offsets[i];
-            while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
-                i + 1 == sc->stsc_data[stsc_index + 1].first)
-                stsc_index++;
-
-            if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
-                sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-
-            for (j = 0; j < sc->stsc_data[stsc_index].count; j++) {
-                int keyframe = 0;
-                if (current_sample >= sc->sample_count) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
-                    return;
-                }
-
-                if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+key_off == sc->keyframes[stss_index])) {
-                    keyframe = 1;
-                    if (stss_index + 1 < sc->keyframe_count)
-                        stss_index++;
-                } else if (sc->stps_count && current_sample+key_off == sc->stps_data[stps_index]) {
-                    keyframe = 1;
-                    if (stps_index + 1 < sc->stps_count)
-                        stps_index++;
-                }
-                if (rap_group_present && rap_group_index < sc->rap_group_count) {
-                    if (sc->rap_group[rap_group_index].index > 0)
-                        keyframe = 1;
-                    if (++rap_group_sample == sc->rap_group[rap_group_index].count) {
-                        rap_group_sample = 0;
-                        rap_group_index++;
-                    }
-                }
-                if (sc->keyframe_absent
-                    && !sc->stps_count
-                    && !rap_group_present
-                    && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (i==0 && j==0)))
-                     keyframe = 1;
-                if (keyframe)
-                    distance = 0;
-                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
-                if (current_offset > INT64_MAX - sample_size) {
-                    av_log(mov->fc, AV_LOG_ERROR, "Current offset %"PRId64" or sample size %u is too large\n",
-                           current_offset,
-                           sample_size);
+        cursor.dts = current_dts;
+        if (lazy) {
+            if (mov_lazy_index_init(mov, st, &cursor) < 0)
+                return;
+        } else {
+            while ((ret = mov_index_next(mov, st, &cursor,
+                                         &sti->index_entries[sti->nb_index_entries])) != AVERROR_EOF) {
+                if (ret < 0)
                     return;
-                }
-
-                if (sc->pseudo_stream_id == -1 ||
-                   sc->stsc_data[stsc_index].id - 1 == sc->pseudo_stream_id) {
-                    AVIndexEntry *e;
-                    if (sample_size > 0x3FFFFFFF) {
-                        av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
-                        return;
-                    }
-                    e = &sti->index_entries[sti->nb_index_entries++];
-                    e->pos = current_offset;
-                    e->timestamp = current_dts;
-                    e->size = sample_size;
-                    e->min_distance = distance;
-                    e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
-                    av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
-                            "size %u, distance %u, keyframe %d\n", st->index, current_sample,
-                            current_offset, current_dts, sample_size, distance, keyframe);
-                    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries < 100)
-                        ff_rfps_add_frame(mov->fc, st, current_dts);
-                }
-
-                current_offset += sample_size;
-                stream_size += sample_size;
-
-                current_dts += sc->tts_data[stts_index].duration;
-
-                distance++;
-                stts_sample++;
-                current_sample++;
-                if (stts_index + 1 < sc->tts_count && stts_sample == sc->tts_data[stts_index].count) {
-                    stts_sample = 0;
-                    stts_index++;
-                }
+                if (!ret)
+                    continue;
+                sti->nb_index_entries++;
+                if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries < 100)
+                    ff_rfps_add_frame(mov->fc, st, sti->index_entries[sti->nb_index_entries - 1].timestamp);
             }
         }
         if (st->duration > 0)
-            st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+            st->codecpar->bit_rate = cursor.size*8*sc->time_scale/st->duration;
     } else {
         unsigned chunk_samples, total = 0;
 
@@ -5000,8 +5263,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     }
 
     // Update start time of the stream.
-    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries > 0) {
-        st->start_time = sti->index_entries[0].timestamp + sc->dts_shift;
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && mov_get_index_count(st) > 0) {
+        st->start_time = mov_get_index_timestamp(mov, st, 0) + sc->dts_shift;
         if (sc->tts_data) {
             st->start_time += sc->tts_data[0].offset;
         }
@@ -5326,13 +5589,15 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         if (!stts_constant)
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stps_data);
+    /* Do not need those anymore, unless the index is built lazily. */
+    if (!sc->lazy_index) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->rap_group);
+    }
     av_freep(&sc->elst_data);
-    av_freep(&sc->rap_group);
     av_freep(&sc->sync_group);
     av_freep(&sc->sgpd_sync);
 
@@ -5837,6 +6102,11 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     sc = st->priv_data;
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
+    if (sc->lazy_index) {
+        int ret = mov_lazy_index_flush(c, st);
+        if (ret < 0)
+            return ret;
+    }
 
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
@@ -8537,6 +8807,9 @@ static int cenc_filter(MOVContext *mov, AVStream* st, MOVStreamContext *sc, AVPa
         }
 
         if (mov->decryption_keys || mov->decryption_default_key) {
+            ret = av_packet_make_writable(pkt);
+            if (ret < 0)
+                return ret;
             return cenc_decrypt(mov, sc, encrypted_sample, pkt->data, pkt->size);
         } else {
             size_t size;
@@ -9719,15 +9992,19 @@ static int mov_read_default(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         } else {
             int64_t start_pos = avio_tell(pb);
             int64_t left;
+            int skip_fragments;
             int err = parse(c, pb, a);
             if (err < 0) {
                 c->atom_depth --;
                 return err;
             }
+            /* the following fragments are read while demuxing or in parallel */
+            skip_fragments = !(pb->seekable & AVIO_SEEKABLE_NORMAL) || c->fc->flags & AVFMT_FLAG_IGNIDX ||
+                             c->frag_index.complete ||
+                             (HAVE_THREADS && c->fragment_threads && c->frag_index.nb_items);
             if (c->found_moov && c->found_mdat && a.size <= INT64_MAX - start_pos &&
-                ((!(pb->seekable & AVIO_SEEKABLE_NORMAL) || c->fc->flags & AVFMT_FLAG_IGNIDX || c->frag_index.complete) ||
-                 start_pos + a.size == avio_size(pb))) {
-                if (!(pb->seekable & AVIO_SEEKABLE_NORMAL) || c->fc->flags & AVFMT_FLAG_IGNIDX || c->frag_index.complete)
+                (skip_fragments || start_pos + a.size == avio_size(pb))) {
+                if (skip_fragments)
                     c->next_root_atom = start_pos + a.size;
                 c->atom_depth --;
                 return 0;
@@ -9873,6 +10150,9 @@ static void mov_read_chapters(AVFormatContext *s)
         sti = ffstream(st);
 
         sc = st->priv_data;
+        // the chapters are read from the whole index
+        if (sc->lazy_index && mov_lazy_index_flush(mov, st) < 0)
+            continue;
         cur_pos = avio_tell(sc->pb);
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
@@ -10083,6 +10363,8 @@ static void mov_free_stream_context(AVFormatContext *s, AVStream *st)
     av_freep(&sc->open_key_samples);
     av_freep(&sc->display_matrix);
     av_freep(&sc->index_ranges);
+    av_freep(&sc->lazy_index);
+    av_freep(&sc->lazy_entries);
 
     if (sc->extradata)
         for (int i = 0; i < sc->stsd_count; i++)
@@ -10876,6 +11158,354 @@ static void fix_stream_ids(AVFormatContext *s)
     }
 }
 
+#if HAVE_THREADS
+/* maximum size of the fragment headers read by a job */
+#define MOV_FRAGMENT_MAX_HEADERS (4 << 20)
+
+typedef struct MOVFragmentJob {
+    int64_t offset;   ///< position of the first root atom
+    int64_t end;      ///< position of the next job
+    uint8_t *buf;     ///< root atoms read up to the next mdat
+    int size;
+    int64_t resume;   ///< position to read the file from if parsing fails
+    int ret;
+    int done;
+} MOVFragmentJob;
+
+typedef struct MOVFragmentReader {
+    MOVFragmentJob *jobs;
+    int nb_jobs;
+    int next_job;     ///< first job not taken by a thread
+    int parsed;       ///< number of jobs parsed by the demuxer
+    int abort;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} MOVFragmentReader;
+
+typedef struct MOVFragmentThread {
+    MOVFragmentReader *r;
+    AVIOContext *pb;
+    pthread_t thread;
+    int created;
+} MOVFragmentThread;
+
+/**
+ * Read the root atoms of a fragment, that is the moof and sidx atoms from
+ * the job position to the next mdat atom. Each atom is stored preceded by
+ * its position in the file.
+ */
+static int mov_read_fragment_atoms(AVIOContext *pb, MOVFragmentJob *job)
+{
+    int64_t pos = job->offset;
+
+    if (avio_seek(pb, pos, SEEK_SET) != pos)
+        return AVERROR_INVALIDDATA;
+
+    while (pos < job->end) {
+        uint8_t header[16];
+        int header_size = 8;
+        uint32_t type;
+        uint64_t size;
+        uint8_t *buf;
+        int ret;
+
+        ret = avio_read(pb, header, 8);
+        if (ret == AVERROR_EOF || (ret >= 0 && ret < 8))
+            break;
+        if (ret < 0)
+            return ret;
+        size = AV_RB32(header);
+        type = AV_RL32(header + 4);
+        if (size == 1) {
+            if ((ret = ffio_read_size(pb, header + 8, 8)) < 0)
+                return ret;
+            size = AV_RB64(header + 8);
+            header_size = 16;
+        }
+        if (type == MKTAG('m','d','a','t') || !size)
+            break;
+        if (size < header_size)
+            return AVERROR_INVALIDDATA;
+
+        /* the other root atoms are not needed to build the index */
+        if (type != MKTAG('m','o','o','f') && type != MKTAG('s','i','d','x')) {
+            if (size > INT64_MAX - pos)
+                return AVERROR_INVALIDDATA;
+            pos += size;
+            if (avio_seek(pb, pos, SEEK_SET) != pos)
+                break;
+            continue;
+        }
+        if (size > MOV_FRAGMENT_MAX_HEADERS - 8 - job->size)
+            return AVERROR(ERANGE);
+
+        buf = av_realloc(job->buf, job->size + 8 + size);
+        if (!buf)
+            return AVERROR(ENOMEM);
+        job->buf = buf;
+        AV_WB64(job->buf + job->size, pos);
+        memcpy(job->buf + job->size + 8, header, header_size);
+        ret = ffio_read_size(pb, job->buf + job->size + 8 + header_size,
+                             size - header_size);
+        if (ret < 0)
+            return ret;
+        job->size += 8 + size;
+        pos += size;
+    }
+
+    return 0;
+}
+
+static void *mov_fragment_thread(void *arg)
+{
+    MOVFragmentThread *t = arg;
+    MOVFragmentReader *r = t->r;
+    /* number of jobs the threads may read ahead of the demuxer */
+    int max_ahead = 16;
+
+    pthread_mutex_lock(&r->mutex);
+    for (;;) {
+        MOVFragmentJob *job;
+        int ret;
+
+        while (!r->abort && r->next_job < r->nb_jobs &&
+               r->next_job >= r->parsed + max_ahead)
+            pthread_cond_wait(&r->cond, &r->mutex);
+        if (r->abort || r->next_job >= r->nb_jobs)
+            break;
+        job = &r->jobs[r->next_job++];
+        pthread_mutex_unlock(&r->mutex);
+
+        ret = mov_read_fragment_atoms(t->pb, job);
+
+        pthread_mutex_lock(&r->mutex);
+        job->ret  = ret;
+        job->done = 1;
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->mutex);
+
+    return NULL;
+}
+
+/**
+ * Find the fragments left to read: the fragments of the fragment index if
+ * it is complete, otherwise the root atoms following the atoms read by the
+ * header are walked to find them.
+ */
+static int mov_find_fragments(MOVContext *c, AVIOContext *pb,
+                              MOVFragmentJob **jobs, int *nb_jobs)
+{
+    int64_t file_size = avio_size(pb);
+
+    if (c->frag_index.complete) {
+        for (int i = 0; i < c->frag_index.nb_items; i++) {
+            const MOVFragmentIndexItem *item = &c->frag_index.item[i];
+            MOVFragmentJob *job;
+
+            if (item->headers_read || item->moof_offset <= c->fragment.moof_offset)
+                continue;
+            job = av_dynarray2_add((void **)jobs, nb_jobs, sizeof(**jobs), NULL);
+            if (!job)
+                return AVERROR(ENOMEM);
+            memset(job, 0, sizeof(*job));
+            job->offset = item->moof_offset;
+        }
+    } else {
+        int64_t pos = c->next_root_atom, start = pos;
+
+        /* jobs start after each mdat atom */
+        while (pos > 0 && pos <= file_size - 8) {
+            uint64_t size;
+            uint32_t type;
+
+            if (avio_seek(pb, pos, SEEK_SET) != pos)
+                return AVERROR_INVALIDDATA;
+            size = avio_rb32(pb);
+            type = avio_rl32(pb);
+            if (size == 1)
+                size = avio_rb64(pb);
+            if (avio_feof(pb))
+                break;
+            if (!size)
+                size = file_size - pos;
+            if (size < 8 || size > file_size - pos)
+                break;
+            pos += size;
+            if (type == MKTAG('m','d','a','t') || pos >= file_size) {
+                MOVFragmentJob *job;
+
+                if (type == MKTAG('m','d','a','t') && start == pos - size) {
+                    start = pos;
+                    continue;
+                }
+                job = av_dynarray2_add((void **)jobs, nb_jobs, sizeof(**jobs), NULL);
+                if (!job)
+                    return AVERROR(ENOMEM);
+                memset(job, 0, sizeof(*job));
+                job->offset = start;
+                start = pos;
+            }
+        }
+    }
+
+    for (int i = 0; i < *nb_jobs; i++)
+        (*jobs)[i].end = i + 1 < *nb_jobs ? (*jobs)[i + 1].offset : INT64_MAX;
+
+    return 0;
+}
+
+/**
+ * Parse root atoms read by mov_read_fragment_atoms() as if they were read
+ * from the file. On failure, job->resume is the position following the
+ * atoms parsed, including the failing one which may be partially parsed.
+ */
+static int mov_parse_fragment_atoms(MOVContext *c, MOVFragmentJob *job)
+{
+    int pos = 0;
+
+    while (pos < job->size) {
+        int64_t offset = AV_RB64(job->buf + pos);
+        /* the sizes were checked by mov_read_fragment_atoms() */
+        int size = AV_RB32(job->buf + pos + 8);
+        FFIOContext pb;
+        int ret;
+
+        if (size == 1)
+            size = AV_RB64(job->buf + pos + 16);
+        job->resume = offset + size;
+
+        ffio_init_read_context(&pb, job->buf + pos + 8, size);
+        /* make avio_tell() return positions in the file */
+        pb.pub.pos += offset;
+        c->found_mdat = 0;
+
+        ret = mov_read_default(c, &pb.pub, (MOVAtom){ AV_RL32("root"), size });
+        if (ret < 0)
+            return ret;
+        pos += 8 + size;
+    }
+
+    return 0;
+}
+
+/**
+ * Read the headers of all the fragments of the file with several threads,
+ * so that the index of all the samples is built when opening the file.
+ * The atoms are read in parallel and parsed in order by the demuxer.
+ */
+static int mov_read_fragments(AVFormatContext *s)
+{
+    MOVContext *mov = s->priv_data;
+    MOVFragmentReader r = { 0 };
+    MOVFragmentThread *threads = NULL;
+    int64_t next_root_atom = mov->next_root_atom;
+    int found_mdat = mov->found_mdat;
+    int nb_threads, ret;
+
+    if (!mov->fragment_threads || !(s->pb->seekable & AVIO_SEEKABLE_NORMAL) ||
+        s->flags & AVFMT_FLAG_IGNIDX || !mov->frag_index.nb_items || !s->url || !*s->url)
+        return 0;
+    for (int i = 0; i < s->nb_streams; i++) {
+        MOVStreamContext *sc = s->streams[i]->priv_data;
+        /* the auxiliary information may be stored in the mdat atoms */
+        if (sc->cenc.default_encrypted_sample)
+            return 0;
+    }
+
+    ret = mov_find_fragments(mov, s->pb, &r.jobs, &r.nb_jobs);
+    if (ret < 0 || !r.nb_jobs)
+        goto end;
+
+    nb_threads = FFMIN(mov->fragment_threads, r.nb_jobs);
+    threads = av_calloc(nb_threads, sizeof(*threads));
+    if (!threads) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = pthread_mutex_init(&r.mutex, NULL))) {
+        ret = AVERROR(ret);
+        goto end;
+    }
+    if ((ret = pthread_cond_init(&r.cond, NULL))) {
+        pthread_mutex_destroy(&r.mutex);
+        ret = AVERROR(ret);
+        goto end;
+    }
+
+    av_log(s, AV_LOG_VERBOSE, "reading %d fragments with %d threads\n",
+           r.nb_jobs, nb_threads);
+
+    for (int i = 0; i < nb_threads; i++) {
+        threads[i].r = &r;
+        ret = s->io_open(s, &threads[i].pb, s->url, AVIO_FLAG_READ, NULL);
+        if (ret < 0)
+            break;
+        ret = pthread_create(&threads[i].thread, NULL, mov_fragment_thread, &threads[i]);
+        if (ret) {
+            ret = AVERROR(ret);
+            break;
+        }
+        threads[i].created = 1;
+    }
+
+    /* the threads only stop once all the jobs are taken */
+    while (threads[0].created && r.parsed < r.nb_jobs) {
+        MOVFragmentJob *job = &r.jobs[r.parsed];
+
+        pthread_mutex_lock(&r.mutex);
+        while (!job->done)
+            pthread_cond_wait(&r.cond, &r.mutex);
+        pthread_mutex_unlock(&r.mutex);
+        job->resume = job->offset;
+        if ((ret = job->ret) < 0 ||
+            (ret = mov_parse_fragment_atoms(mov, job)) < 0)
+            break;
+        av_freep(&job->buf);
+
+        pthread_mutex_lock(&r.mutex);
+        r.parsed++;
+        pthread_cond_broadcast(&r.cond);
+        pthread_mutex_unlock(&r.mutex);
+    }
+
+    pthread_mutex_lock(&r.mutex);
+    r.abort = 1;
+    pthread_cond_broadcast(&r.cond);
+    pthread_mutex_unlock(&r.mutex);
+    for (int i = 0; i < nb_threads; i++) {
+        if (threads[i].created)
+            pthread_join(threads[i].thread, NULL);
+        ff_format_io_close(s, &threads[i].pb);
+    }
+    pthread_cond_destroy(&r.cond);
+    pthread_mutex_destroy(&r.mutex);
+
+    if (r.parsed < r.nb_jobs) {
+        av_log(s, AV_LOG_WARNING, "failed to read the fragments at 0x%"PRIx64
+               " in advance: %s\n", r.jobs[r.parsed].offset, av_err2str(ret));
+        /* read the remaining fragments while demuxing, without the atoms
+         * already parsed */
+        if (!mov->frag_index.complete)
+            next_root_atom = r.jobs[r.parsed].resume;
+    } else {
+        /* all the headers are read */
+        next_root_atom = 0;
+    }
+    ret = 0;
+
+end:
+    for (int i = 0; i < r.nb_jobs; i++)
+        av_freep(&r.jobs[i].buf);
+    av_freep(&r.jobs);
+    av_freep(&threads);
+    mov->next_root_atom = next_root_atom;
+    mov->found_mdat = found_mdat;
+
+    return ret == AVERROR(ENOMEM) ? ret : 0;
+}
+#endif
+
 static int mov_read_header(AVFormatContext *s)
 {
     MOVContext *mov = s->priv_data;
@@ -10908,6 +11538,10 @@ static int mov_read_header(AVFormatContext *s)
         av_log(s, AV_LOG_ERROR, "moov atom not found\n");
         return AVERROR_INVALIDDATA;
     }
+#if HAVE_THREADS
+    if ((err = mov_read_fragments(s)) < 0)
+        return err;
+#endif
     av_log(mov->fc, AV_LOG_TRACE, "on_parse_exit_offset=%"PRId64"\n", avio_tell(pb));
 
     if (mov->found_iloc && mov->found_iinf) {
@@ -11128,10 +11762,9 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     int no_interleave = !mov->interleaved_read || !(s->pb->seekable & AVIO_SEEKABLE_NORMAL);
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
-        FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        AVIndexEntry *current_sample = msc->pb ? mov_get_index_entry(mov, avst, msc->current_sample) : NULL;
+        if (current_sample) {
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             uint64_t dtsdiff = best_dts > dts ? best_dts - (uint64_t)dts : ((uint64_t)dts - best_dts);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
@@ -11301,8 +11934,9 @@ static int mov_finalize_packet(AVFormatContext *s, AVStream *st, AVIndexEntry *s
         pkt->pts = av_sat_add64(pkt->dts, av_sat_add64(sc->dts_shift, sc->tts_data[sc->tts_index].offset));
     } else {
         if (pkt->duration == 0) {
-            int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
-                ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
+            int64_t next_dts = mov_get_index_timestamp(s->priv_data, st, sc->current_sample);
+            if (next_dts == AV_NOPTS_VALUE)
+                next_dts = st->duration;
             if (next_dts >= pkt->dts)
                 pkt->duration = next_dts - pkt->dts;
         }
@@ -11466,9 +12100,9 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 #endif
         else if (st->codecpar->codec_id == AV_CODEC_ID_APV && sample->size > 4) {
             const uint32_t au_size = avio_rb32(sc->pb);
-            ret = av_get_packet(sc->pb, pkt, au_size);
+            ret = ff_get_packet_mapped(sc->pb, pkt, au_size);
         } else
-            ret = av_get_packet(sc->pb, pkt, sample->size);
+            ret = ff_get_packet_mapped(sc->pb, pkt, sample->size);
         if (ret < 0) {
             if (should_retry(sc->pb, ret)) {
                 mov_current_sample_dec(sc);
@@ -11510,8 +12144,12 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     if (st->discard == AVDISCARD_ALL)
         goto retry;
 
-    if (mov->aax_mode)
+    if (mov->aax_mode) {
+        ret = av_packet_make_writable(pkt);
+        if (ret < 0)
+            return ret;
         aax_filter(pkt->data, pkt->size, mov);
+    }
 
     ret = cenc_filter(mov, st, sc, pkt, current_index);
     if (ret < 0) {
@@ -11557,10 +12195,9 @@ static int is_open_key_sample(const MOVStreamContext *sc, int sample)
  * Some key sample may be key frames but not IDR frames, so a random access to
  * them may not be allowed.
  */
-static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pts)
+static int can_seek_to_key_sample(MOVContext *mov, AVStream *st, int sample, int64_t requested_pts)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int64_t key_sample_dts, key_sample_pts;
 
     if (st->codecpar->codec_id != AV_CODEC_ID_HEVC)
@@ -11569,7 +12206,7 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     if (sample >= sc->sample_offsets_count)
         return 1;
 
-    key_sample_dts = sti->index_entries[sample].timestamp;
+    key_sample_dts = mov_get_index_timestamp(mov, st, sample);
     key_sample_pts = key_sample_dts + sc->sample_offsets[sample] + sc->dts_shift;
 
     /*
@@ -11585,8 +12222,8 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
 
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
+    MOVContext *mov = s->priv_data;
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int sample, time_sample, ret, requested_sample;
     int64_t next_ts;
     unsigned int i;
@@ -11600,23 +12237,23 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        sample = mov_index_search_timestamp(mov, st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-        if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
+        if (sample < 0 && mov_get_index_count(st) && timestamp < mov_get_index_timestamp(mov, st, 0))
             sample = 0;
         if (sample < 0) /* not sure what to do */
             return AVERROR_INVALIDDATA;
 
-        if (!sample || can_seek_to_key_sample(st, sample, timestamp))
+        if (!sample || can_seek_to_key_sample(mov, st, sample, timestamp))
             break;
 
         next_ts = timestamp - FFMAX(sc->min_sample_duration, 1);
-        requested_sample = av_index_search_timestamp(st, next_ts, flags);
+        requested_sample = mov_index_search_timestamp(mov, st, next_ts, flags);
 
         // If we've reached a different sample trying to find a good pts to
         // seek to, give up searching because we'll end up seeking back to
         // sample 0 on every seek.
-        if (sample != requested_sample && !can_seek_to_key_sample(st, requested_sample, next_ts))
+        if (sample != requested_sample && !can_seek_to_key_sample(mov, st, requested_sample, next_ts))
             break;
 
         timestamp = next_ts;
@@ -11656,12 +12293,11 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     return sample;
 }
 
-static int64_t mov_get_skip_samples(AVStream *st, int sample)
+static int64_t mov_get_skip_samples(MOVContext *mov, AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
-    int64_t first_ts = sti->index_entries[0].timestamp;
-    int64_t ts = sti->index_entries[sample].timestamp;
+    int64_t first_ts = mov_get_index_timestamp(mov, st, 0);
+    int64_t ts = mov_get_index_timestamp(mov, st, sample);
     int64_t off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
@@ -11692,8 +12328,8 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 
     if (mc->seek_individually) {
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = sti->index_entries[sample].timestamp;
-        sti->skip_samples = mov_get_skip_samples(st, sample);
+        int64_t seek_timestamp = mov_get_index_timestamp(mc, st, sample);
+        sti->skip_samples = mov_get_skip_samples(mc, st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
             AVStream *const st  = s->streams[i];
@@ -11706,7 +12342,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
             timestamp = av_rescale_q(seek_timestamp, s->streams[stream_index]->time_base, st->time_base);
             sample = mov_seek_stream(s, st, timestamp, flags);
             if (sample >= 0)
-                sti->skip_samples = mov_get_skip_samples(st, sample);
+                sti->skip_samples = mov_get_skip_samples(mc, st, sample);
         }
     } else {
         for (i = 0; i < s->nb_streams; i++) {
@@ -11781,6 +12417,8 @@ static const AVOption mov_options[] = {
         {.i64 = 0}, 0, 1, FLAGS },
     { "max_stts_delta", "treat offsets above this value as invalid", OFFSET(max_stts_delta), AV_OPT_TYPE_INT, {.i64 = UINT_MAX-48000*10 }, 0, UINT_MAX, .flags = AV_OPT_FLAG_DECODING_PARAM },
     { "interleaved_read", "Interleave packets from multiple tracks at demuxer level", OFFSET(interleaved_read), AV_OPT_TYPE_BOOL, {.i64 = 1 }, 0, 1, .flags = AV_OPT_FLAG_DECODING_PARAM },
+    { "fragment_threads", "Number of threads reading the fragment headers when opening the file", OFFSET(fragment_threads), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, 64, .flags = AV_OPT_FLAG_DECODING_PARAM },
+    { "lazy_index", "Only build the index entries around the read position", OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, .flags = AV_OPT_FLAG_DECODING_PARAM },
 
     { NULL },
 };
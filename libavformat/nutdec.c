@@ -1105,32 +1105,39 @@ static int decode_frame(NUTContext *nut, AVPacket *pkt, int frame_code)
         return 1;
     }
 
-    ret = av_new_packet(pkt, size + nut->header_len[header_idx]);
-    if (ret < 0)
-        return ret;
-    if (nut->header[header_idx])
-        memcpy(pkt->data, nut->header[header_idx], nut->header_len[header_idx]);
-    pkt->pos = avio_tell(bc); // FIXME
-    if (stc->last_flags & FLAG_SM_DATA) {
-        int sm_size;
-        if (read_sm_data(s, bc, pkt, 0, pkt->pos + size) < 0) {
-            ret = AVERROR_INVALIDDATA;
-            goto fail;
-        }
-        if (read_sm_data(s, bc, pkt, 1, pkt->pos + size) < 0) {
-            ret = AVERROR_INVALIDDATA;
-            goto fail;
+    if (!nut->header_len[header_idx] && !(stc->last_flags & FLAG_SM_DATA)) {
+        // nothing to prepend or to parse, the payload can be referenced
+        ret = ff_get_packet_mapped(bc, pkt, size);
+        if (ret < 0)
+            return ret;
+    } else {
+        ret = av_new_packet(pkt, size + nut->header_len[header_idx]);
+        if (ret < 0)
+            return ret;
+        if (nut->header[header_idx])
+            memcpy(pkt->data, nut->header[header_idx], nut->header_len[header_idx]);
+        pkt->pos = avio_tell(bc); // FIXME
+        if (stc->last_flags & FLAG_SM_DATA) {
+            int sm_size;
+            if (read_sm_data(s, bc, pkt, 0, pkt->pos + size) < 0) {
+                ret = AVERROR_INVALIDDATA;
+                goto fail;
+            }
+            if (read_sm_data(s, bc, pkt, 1, pkt->pos + size) < 0) {
+                ret = AVERROR_INVALIDDATA;
+                goto fail;
+            }
+            sm_size = avio_tell(bc) - pkt->pos;
+            size      -= sm_size;
         }
-        sm_size = avio_tell(bc) - pkt->pos;
-        size      -= sm_size;
-    }
 
-    ret = avio_read(bc, pkt->data + nut->header_len[header_idx], size);
-    if (ret != size) {
-        if (ret < 0)
-            goto fail;
+        ret = avio_read(bc, pkt->data + nut->header_len[header_idx], size);
+        if (ret != size) {
+            if (ret < 0)
+                goto fail;
+        }
+        av_shrink_packet(pkt, nut->header_len[header_idx] + ret);
     }
-    av_shrink_packet(pkt, nut->header_len[header_idx] + ret);
 
     pkt->stream_index = stream_id;
     if (stc->last_flags & FLAG_KEY)
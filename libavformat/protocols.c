@@ -40,6 +40,7 @@ extern const URLProtocol ff_ftp_protocol;
 extern const URLProtocol ff_gopher_protocol;
 extern const URLProtocol ff_gophers_protocol;
 extern const URLProtocol ff_http_protocol;
+extern const URLProtocol ff_http2_protocol;
 extern const URLProtocol ff_httpproxy_protocol;
 extern const URLProtocol ff_https_protocol;
 extern const URLProtocol ff_icecast_protocol;
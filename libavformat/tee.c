@@ -39,7 +39,7 @@ typedef enum {
 
 typedef struct {
     AVFormatContext *avf;
-    AVBSFContext **bsfs; ///< bitstream filters per stream
+    AVBSFContext **bsfs; ///< bitstream filters per stream, owned by the chains
 
     SlaveFailurePolicy on_fail;
     int use_fifo;
@@ -51,11 +51,38 @@ typedef struct {
     int header_written;
 } TeeSlave;
 
+typedef struct TeeChainOutput {
+    unsigned slave;
+    int stream_index;   ///< stream index in the slave
+} TeeChainOutput;
+
+/**
+ * A bitstream filter sequence applied to one input stream. Slaves using
+ * the same sequence on the same stream share the chain, so that the
+ * filters run once and the filtered packets are referenced by every slave.
+ *
+ * A failure of the chain is a failure of every slave using it, so only
+ * slaves aborting on failure share chains: the failure of a slave ignoring
+ * failures must not affect the others.
+ */
+typedef struct TeeBSFChain {
+    AVBSFContext *bsf;
+    char *spec;         ///< filter sequence, NULL for pass-through
+    unsigned stream_index;
+    int shared;         ///< other slaves may use the chain
+
+    TeeChainOutput *outputs;
+    unsigned nb_outputs;
+} TeeBSFChain;
+
 typedef struct TeeContext {
     const AVClass *class;
     unsigned nb_slaves;
     unsigned nb_alive;
     TeeSlave *slaves;
+    TeeBSFChain *chains;
+    unsigned nb_chains;
+    AVPacket *pkt;
     int use_fifo;
     AVDictionary *fifo_options;
 } TeeContext;
@@ -129,10 +156,6 @@ static int close_slave(TeeSlave *tee_slave)
     if (tee_slave->header_written)
         ret = av_write_trailer(avf);
 
-    if (tee_slave->bsfs) {
-        for (unsigned i = 0; i < avf->nb_streams; ++i)
-            av_bsf_free(&tee_slave->bsfs[i]);
-    }
     av_freep(&tee_slave->stream_map);
     av_freep(&tee_slave->bsfs);
 
@@ -152,11 +175,83 @@ static void close_slaves(AVFormatContext *avf)
     av_freep(&tee->slaves);
 }
 
+static int get_bsf_chain(AVFormatContext *avf, unsigned stream_index,
+                         const char *spec, int shared, TeeBSFChain **pchain)
+{
+    TeeContext *tee = avf->priv_data;
+    TeeBSFChain *chain;
+    int ret;
+
+    for (unsigned i = 0; shared && i < tee->nb_chains; i++) {
+        chain = &tee->chains[i];
+        if (chain->shared && chain->stream_index == stream_index &&
+            !strcmp(chain->spec ? chain->spec : "", spec ? spec : "")) {
+            *pchain = chain;
+            return 0;
+        }
+    }
+
+    chain = av_realloc_array(tee->chains, tee->nb_chains + 1, sizeof(*tee->chains));
+    if (!chain)
+        return AVERROR(ENOMEM);
+    tee->chains = chain;
+    chain = &tee->chains[tee->nb_chains];
+    memset(chain, 0, sizeof(*chain));
+    chain->stream_index = stream_index;
+    chain->shared       = shared;
+
+    if (spec) {
+        chain->spec = av_strdup(spec);
+        if (!chain->spec)
+            return AVERROR(ENOMEM);
+
+        ret = av_bsf_list_parse_str(spec, &chain->bsf);
+        if (ret < 0) {
+            av_log(avf, AV_LOG_ERROR, "Error parsing bitstream filter sequence "
+                   "'%s' associated to stream %u\n", spec, stream_index);
+            goto fail;
+        }
+    } else {
+        /* Add pass-through bitstream filter */
+        ret = av_bsf_get_null_filter(&chain->bsf);
+        if (ret < 0) {
+            av_log(avf, AV_LOG_ERROR,
+                   "Failed to create pass-through bitstream filter: %s\n",
+                   av_err2str(ret));
+            goto fail;
+        }
+    }
+
+    chain->bsf->time_base_in = avf->streams[stream_index]->time_base;
+    ret = avcodec_parameters_copy(chain->bsf->par_in,
+                                  avf->streams[stream_index]->codecpar);
+    if (ret < 0)
+        goto fail;
+
+    ret = av_bsf_init(chain->bsf);
+    if (ret < 0) {
+        av_log(avf, AV_LOG_ERROR,
+               "Failed to initialize bitstream filter(s): %s\n",
+               av_err2str(ret));
+        goto fail;
+    }
+
+    tee->nb_chains++;
+    *pchain = chain;
+    return 0;
+fail:
+    av_bsf_free(&chain->bsf);
+    av_freep(&chain->spec);
+    return ret;
+}
+
 static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
 {
+    TeeContext *tee = avf->priv_data;
     int ret;
     AVDictionary *options = NULL, *bsf_options = NULL;
     const AVDictionaryEntry *entry;
+    char **bsf_specs = NULL;
     char *filename;
     char *format = NULL, *select = NULL;
     AVFormatContext *avf2 = NULL;
@@ -309,7 +404,8 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
     tee_slave->header_written = 1;
 
     tee_slave->bsfs = av_calloc(avf2->nb_streams, sizeof(*tee_slave->bsfs));
-    if (!tee_slave->bsfs) {
+    bsf_specs       = av_calloc(avf2->nb_streams, sizeof(*bsf_specs));
+    if (!tee_slave->bsfs || !bsf_specs) {
         ret = AVERROR(ENOMEM);
         goto end;
     }
@@ -340,17 +436,15 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
             if (ret > 0) {
                 av_log(avf, AV_LOG_DEBUG, "spec:%s bsfs:%s matches stream %d of slave "
                        "output '%s'\n", spec, entry->value, i, filename);
-                if (tee_slave->bsfs[i]) {
+                if (bsf_specs[i]) {
                     av_log(avf, AV_LOG_WARNING,
                            "Duplicate bsfs specification associated to stream %d of slave "
                            "output '%s', filters will be ignored\n", i, filename);
                     continue;
                 }
-                ret = av_bsf_list_parse_str(entry->value, &tee_slave->bsfs[i]);
-                if (ret < 0) {
-                    av_log(avf, AV_LOG_ERROR,
-                           "Error parsing bitstream filter sequence '%s' associated to "
-                           "stream %d of slave output '%s'\n", entry->value, i, filename);
+                bsf_specs[i] = av_strdup(entry->value);
+                if (!bsf_specs[i]) {
+                    ret = AVERROR(ENOMEM);
                     goto end;
                 }
             }
@@ -361,33 +455,29 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
 
     for (unsigned i = 0; i < avf->nb_streams; i++){
         int target_stream = tee_slave->stream_map[i];
+        TeeChainOutput *outputs;
+        TeeBSFChain *chain;
+
         if (target_stream < 0)
             continue;
 
-        if (!tee_slave->bsfs[target_stream]) {
-            /* Add pass-through bitstream filter */
-            ret = av_bsf_get_null_filter(&tee_slave->bsfs[target_stream]);
-            if (ret < 0) {
-                av_log(avf, AV_LOG_ERROR,
-                       "Failed to create pass-through bitstream filter: %s\n",
-                       av_err2str(ret));
-                goto end;
-            }
-        }
-
-        tee_slave->bsfs[target_stream]->time_base_in = avf->streams[i]->time_base;
-        ret = avcodec_parameters_copy(tee_slave->bsfs[target_stream]->par_in,
-                                      avf->streams[i]->codecpar);
+        ret = get_bsf_chain(avf, i, bsf_specs[target_stream],
+                            tee_slave->on_fail == ON_SLAVE_FAILURE_ABORT, &chain);
         if (ret < 0)
             goto end;
 
-        ret = av_bsf_init(tee_slave->bsfs[target_stream]);
-        if (ret < 0) {
-            av_log(avf, AV_LOG_ERROR,
-            "Failed to initialize bitstream filter(s): %s\n",
-            av_err2str(ret));
+        outputs = av_realloc_array(chain->outputs, chain->nb_outputs + 1,
+                                   sizeof(*chain->outputs));
+        if (!outputs) {
+            ret = AVERROR(ENOMEM);
             goto end;
         }
+        chain->outputs = outputs;
+        chain->outputs[chain->nb_outputs++] = (TeeChainOutput){
+            .slave        = tee_slave - tee->slaves,
+            .stream_index = target_stream,
+        };
+        tee_slave->bsfs[target_stream] = chain->bsf;
     }
 
     if (options) {
@@ -399,6 +489,11 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
     }
 
 end:
+    if (bsf_specs) {
+        for (unsigned i = 0; i < avf2->nb_streams; i++)
+            av_free(bsf_specs[i]);
+        av_free(bsf_specs);
+    }
     av_free(format);
     av_free(select);
     av_dict_free(&options);
@@ -456,6 +551,10 @@ static int tee_write_header(AVFormatContext *avf)
     char **slaves = NULL;
     int ret;
 
+    tee->pkt = av_packet_alloc();
+    if (!tee->pkt)
+        return AVERROR(ENOMEM);
+
     while (*filename) {
         char *slave = av_get_token(&filename, slave_delim);
         if (!slave) {
@@ -530,35 +629,92 @@ static int tee_write_trailer(AVFormatContext *avf)
     return ret_all;
 }
 
-static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
+static int tee_fail_chain(AVFormatContext *avf, TeeBSFChain *chain, int err_n)
 {
     TeeContext *tee = avf->priv_data;
-    AVPacket *const pkt2 = ffformatcontext(avf)->pkt;
     int ret_all = 0, ret;
-    unsigned s;
-    int s2;
 
-    for (unsigned i = 0; i < tee->nb_slaves; i++) {
-        AVFormatContext *avf2 = tee->slaves[i].avf;
-        AVBSFContext *bsfs;
+    for (unsigned i = 0; i < chain->nb_outputs; i++) {
+        if (!tee->slaves[chain->outputs[i].slave].avf)
+            continue;
+        ret = tee_process_slave_failure(avf, chain->outputs[i].slave, err_n);
+        if (!ret_all && ret < 0)
+            ret_all = ret;
+    }
+    return ret_all;
+}
+
+/* Write a filtered packet to every slave using the chain, the last one
+ * taking over the packet itself. */
+static int tee_write_chain_packet(AVFormatContext *avf, TeeBSFChain *chain,
+                                  AVPacket *pkt)
+{
+    TeeContext *tee = avf->priv_data;
+    int ret_all = 0, ret, last = -1;
+
+    for (unsigned i = 0; i < chain->nb_outputs; i++)
+        if (tee->slaves[chain->outputs[i].slave].avf)
+            last = i;
+
+    for (int i = 0; i <= last; i++) {
+        const TeeChainOutput *o = &chain->outputs[i];
+        AVFormatContext *avf2 = tee->slaves[o->slave].avf;
+        AVPacket *out = pkt;
 
         if (!avf2)
             continue;
 
-        /* Flush slave if pkt is NULL*/
-        if (!pkt) {
-            ret = av_interleaved_write_frame(avf2, NULL);
+        ret = 0;
+        if (i < last) {
+            out = tee->pkt;
+            ret = av_packet_ref(out, pkt);
+        }
+        if (ret >= 0) {
+            out->stream_index = o->stream_index;
+            av_packet_rescale_ts(out, chain->bsf->time_base_out,
+                                 avf2->streams[o->stream_index]->time_base);
+            ret = av_interleaved_write_frame(avf2, out);
+        }
+        if (ret < 0) {
+            ret = tee_process_slave_failure(avf, o->slave, ret);
+            if (!ret_all && ret < 0)
+                ret_all = ret;
+        }
+    }
+    av_packet_unref(pkt);
+    return ret_all;
+}
+
+static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
+{
+    TeeContext *tee = avf->priv_data;
+    AVPacket *const pkt2 = ffformatcontext(avf)->pkt;
+    int ret_all = 0, ret;
+
+    /* Flush slaves if pkt is NULL */
+    if (!pkt) {
+        for (unsigned i = 0; i < tee->nb_slaves; i++) {
+            if (!tee->slaves[i].avf)
+                continue;
+            ret = av_interleaved_write_frame(tee->slaves[i].avf, NULL);
             if (ret < 0) {
                 ret = tee_process_slave_failure(avf, i, ret);
                 if (!ret_all && ret < 0)
                     ret_all = ret;
             }
-            continue;
         }
+        return ret_all;
+    }
 
-        s = pkt->stream_index;
-        s2 = tee->slaves[i].stream_map[s];
-        if (s2 < 0)
+    for (unsigned i = 0; i < tee->nb_chains; i++) {
+        TeeBSFChain *chain = &tee->chains[i];
+        int alive = 0;
+
+        if (chain->stream_index != pkt->stream_index)
+            continue;
+        for (unsigned j = 0; j < chain->nb_outputs; j++)
+            alive |= !!tee->slaves[chain->outputs[j].slave].avf;
+        if (!alive)
             continue;
 
         if ((ret = av_packet_ref(pkt2, pkt)) < 0) {
@@ -566,21 +722,16 @@ static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
                 ret_all = ret;
             continue;
         }
-        bsfs = tee->slaves[i].bsfs[s2];
-        pkt2->stream_index = s2;
 
-        ret = av_bsf_send_packet(bsfs, pkt2);
+        ret = av_bsf_send_packet(chain->bsf, pkt2);
         if (ret < 0) {
             av_packet_unref(pkt2);
             av_log(avf, AV_LOG_ERROR, "Error while sending packet to bitstream filter: %s\n",
                    av_err2str(ret));
-            ret = tee_process_slave_failure(avf, i, ret);
-            if (!ret_all && ret < 0)
-                ret_all = ret;
         }
 
-        while(1) {
-            ret = av_bsf_receive_packet(bsfs, pkt2);
+        while (ret >= 0) {
+            ret = av_bsf_receive_packet(chain->bsf, pkt2);
             if (ret == AVERROR(EAGAIN)) {
                 ret = 0;
                 break;
@@ -588,15 +739,14 @@ static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
                 break;
             }
 
-            av_packet_rescale_ts(pkt2, bsfs->time_base_out,
-                                 avf2->streams[s2]->time_base);
-            ret = av_interleaved_write_frame(avf2, pkt2);
-            if (ret < 0)
-                break;
-        };
+            ret = tee_write_chain_packet(avf, chain, pkt2);
+            if (!ret_all && ret < 0)
+                ret_all = ret;
+            ret = 0;
+        }
 
         if (ret < 0) {
-            ret = tee_process_slave_failure(avf, i, ret);
+            ret = tee_fail_chain(avf, chain, ret);
             if (!ret_all && ret < 0)
                 ret_all = ret;
         }
@@ -604,6 +754,20 @@ static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
     return ret_all;
 }
 
+static void tee_deinit(AVFormatContext *avf)
+{
+    TeeContext *tee = avf->priv_data;
+
+    for (unsigned i = 0; i < tee->nb_chains; i++) {
+        av_bsf_free(&tee->chains[i].bsf);
+        av_freep(&tee->chains[i].spec);
+        av_freep(&tee->chains[i].outputs);
+    }
+    av_freep(&tee->chains);
+    tee->nb_chains = 0;
+    av_packet_free(&tee->pkt);
+}
+
 const FFOutputFormat ff_tee_muxer = {
     .p.name            = "tee",
     .p.long_name       = NULL_IF_CONFIG_SMALL("Multiple muxer tee"),
@@ -611,6 +775,7 @@ const FFOutputFormat ff_tee_muxer = {
     .write_header      = tee_write_header,
     .write_trailer     = tee_write_trailer,
     .write_packet      = tee_write_packet,
+    .deinit            = tee_deinit,
     .p.priv_class      = &tee_muxer_class,
     .p.flags           = AVFMT_NOFILE | AVFMT_TS_NEGATIVE,
     .flags_internal    = FF_OFMT_FLAG_ALLOW_FLUSH,
@@ -0,0 +1,130 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavformat/async.c"
+
+#include <stdio.h>
+
+/* Test of the sizing of the read-ahead buffer of the async protocol, with
+ * reads simulated on a fake clock: the buffer must follow the rate at which
+ * the data is read, grow on underruns after it was full, and be reallocated
+ * smaller only when the data stayed below its size for a while and the
+ * buffered data fits. */
+
+#define STEP   100000
+#define KiB    1024
+
+static int64_t now = RATE_WINDOW;
+
+static int init(AsyncContext *c, int read_back)
+{
+    memset(c, 0, sizeof(*c));
+    c->min_buffer_size = 256 * KiB;
+    c->max_buffer_size = 16 * 1024 * KiB;
+    c->buffer_duration = 10000000;
+    c->target_capacity = av_clip(BUFFER_CAPACITY, c->min_buffer_size, c->max_buffer_size);
+    return ring_init(&c->ring, c->target_capacity, read_back);
+}
+
+static void print_state(AsyncContext *c, const char *what)
+{
+    printf("%-20s bitrate %8"PRId64", target %8d, capacity %8d, allocated %8zu\n",
+           what, c->bitrate, c->target_capacity, c->ring.capacity,
+           ring_allocated(&c->ring));
+}
+
+/* read at a steady rate, the background thread applying the target */
+static void read_at_rate(AsyncContext *c, int bytes_per_second, int seconds)
+{
+    char what[32];
+
+    for (int i = 0; i < seconds; i++) {
+        for (int j = 0; j < RATE_WINDOW / STEP; j++) {
+            now += STEP;
+            update_buffer_target(c, now, bytes_per_second / (RATE_WINDOW / STEP), 0);
+            resize_buffer(NULL, c);
+        }
+        snprintf(what, sizeof(what), "%d KiB/s, %ds", bytes_per_second / KiB, i + 1);
+        print_state(c, what);
+    }
+}
+
+static int fill(AsyncContext *c, int size)
+{
+    for (int i = 0; i < size; i++) {
+        uint8_t byte = i * 7;
+        int ret = av_fifo_write(c->ring.fifo, &byte, 1);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static int check(AsyncContext *c, int offset, int size)
+{
+    uint8_t buf[4096];
+    int ok = 1;
+
+    while (size > 0) {
+        int n = FFMIN(size, sizeof(buf));
+        ring_read(&c->ring, buf, n);
+        for (int i = 0; i < n; i++)
+            ok &= buf[i] == (uint8_t)((offset + i) * 7);
+        offset += n;
+        size   -= n;
+    }
+    return ok;
+}
+
+int main(void)
+{
+    AsyncContext c;
+    int ok;
+
+    if (init(&c, 64 * KiB) < 0)
+        return 1;
+    print_state(&c, "initial");
+
+    // high bitrate video, then low bitrate audio
+    read_at_rate(&c, 1024 * KiB, 3);
+    read_at_rate(&c, 16 * KiB, 12);
+
+    // a buffer which was full when the reader ran out of data doubles
+    c.buffer_full = 1;
+    now += STEP;
+    update_buffer_target(&c, now, 0, 1);
+    resize_buffer(NULL, &c);
+    print_state(&c, "underrun when full");
+    ring_destroy(&c.ring);
+
+    // the buffered data must fit before the fifo is reallocated smaller
+    if (init(&c, 0) < 0 || fill(&c, 1024 * KiB) < 0)
+        return 1;
+    c.target_capacity = 256 * KiB;
+    c.shrink          = 1;
+    resize_buffer(NULL, &c);
+    print_state(&c, "1024 KiB buffered");
+    ok = check(&c, 0, 900 * KiB);
+    resize_buffer(NULL, &c);
+    print_state(&c, "124 KiB buffered");
+    ok &= check(&c, 900 * KiB, 124 * KiB);
+    printf("data %s\n", ok ? "preserved" : "corrupted");
+    ring_destroy(&c.ring);
+
+    return 0;
+}
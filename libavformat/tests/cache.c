@@ -0,0 +1,181 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the persistent cache of the cache protocol: data must be served
+ * from the cache directory across opens, by concurrent users of the same
+ * entry, and entries in use must survive the eviction.
+ */
+
+#include "config.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/mem.h"
+
+#include "libavformat/avio.h"
+#include "libavformat/internal.h"
+
+#define FILE_SIZE (200 * 1024)
+
+static char *dir;
+
+static int write_file(const char *name, int seed)
+{
+    static uint8_t buf[FILE_SIZE];
+    char *path = av_asprintf("%s/%s", dir, name);
+    FILE *f = path ? fopen(path, "wb") : NULL;
+    int ret;
+
+    av_free(path);
+    if (!f)
+        return 1;
+    for (int i = 0; i < FILE_SIZE; i++)
+        buf[i] = i * 7 + seed;
+    ret = fwrite(buf, 1, FILE_SIZE, f) != FILE_SIZE;
+    fclose(f);
+    return ret;
+}
+
+static AVIOContext *open_cached(const char *name, int64_t max_size)
+{
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    char *url = av_asprintf("cache:%s/%s", dir, name);
+    char *cache_dir = av_asprintf("%s/cache", dir);
+
+    if (url && cache_dir) {
+        av_dict_set(&opts, "cache_dir", cache_dir, 0);
+        av_dict_set_int(&opts, "cache_max_size", max_size, 0);
+        if (avio_open2(&pb, url, AVIO_FLAG_READ, NULL, &opts) < 0)
+            printf("failed to open %s\n", url);
+        av_dict_free(&opts);
+    }
+    av_free(url);
+    av_free(cache_dir);
+    return pb;
+}
+
+/* Read size bytes at pos, and check they were written with seed. */
+static int check(AVIOContext *pb, int64_t pos, int size, int seed)
+{
+    static uint8_t buf[FILE_SIZE];
+
+    if (!pb || avio_seek(pb, pos, SEEK_SET) != pos ||
+        avio_read(pb, buf, size) != size)
+        return 1;
+    for (int i = 0; i < size; i++)
+        if (buf[i] != (uint8_t)((pos + i) * 7 + seed))
+            return 1;
+    return 0;
+}
+
+/* Count the entries of the cache directory, deleting them if clear is set. */
+static int count_entries(int clear)
+{
+    char *path = av_asprintf("%s/cache", dir);
+    DIR *d = path ? opendir(path) : NULL;
+    struct dirent *e;
+    int n = 0;
+
+    if (!d) {
+        av_free(path);
+        return -1;
+    }
+    while ((e = readdir(d))) {
+        size_t len = strlen(e->d_name);
+        char *entry;
+
+        if (len <= 6 || strcmp(e->d_name + len - 6, ".cache"))
+            continue;
+        n++;
+        if (clear && (entry = av_asprintf("%s/%s", path, e->d_name))) {
+            unlink(entry);
+            av_free(entry);
+        }
+    }
+    closedir(d);
+    av_free(path);
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    AVIOContext *a, *b;
+    char *path;
+    int ret;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+    dir = argv[1];
+
+    path = av_asprintf("%s/cache", dir);
+    if (!path)
+        return 1;
+    ff_mkdir_p(path);
+    av_free(path);
+    if (count_entries(1) < 0)
+        return 1;
+
+    if (write_file("a", 1) || write_file("b", 2))
+        return 1;
+
+    /* filling the entry in two passes from two concurrent users */
+    a = open_cached("a", 0);
+    b = open_cached("a", 0);
+    ret = check(a, 0, 100000, 1) || check(b, 50000, FILE_SIZE - 50000, 1) ||
+          check(a, 100000, FILE_SIZE - 100000, 1);
+    printf("concurrent fill: %s, %d entries\n", ret ? "failed" : "ok", count_entries(0));
+    avio_closep(&a);
+    avio_closep(&b);
+
+    /* a modification keeping the size is not detected for files, so the
+     * original data comes from the cache */
+    if (write_file("a", 3))
+        return 1;
+    a = open_cached("a", 0);
+    ret = check(a, 0, FILE_SIZE, 1);
+    printf("cached read: %s\n", ret ? "failed" : "ok");
+
+    /* the entry of a is in use and must survive the eviction, unless
+     * entries cannot be locked */
+    b = open_cached("b", 1);
+    ret = check(b, 0, FILE_SIZE, 2);
+    avio_closep(&b);
+    ret |= check(a, 0, FILE_SIZE, 1);
+    printf("eviction while in use: %s, entry of a %s\n", ret ? "failed" : "ok",
+           !HAVE_FLOCK || count_entries(0) == 2 ? "kept" : "deleted");
+    avio_closep(&a);
+
+    /* nothing in use anymore, only the entry being closed is kept */
+    b = open_cached("b", 1);
+    ret = check(b, 0, FILE_SIZE, 2);
+    avio_closep(&b);
+    printf("eviction: %s, %d entries\n", ret ? "failed" : "ok", count_entries(0));
+
+    return 0;
+}
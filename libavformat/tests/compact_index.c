@@ -0,0 +1,183 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+
+#include "libavformat/compact_index.h"
+#include "libavformat/demux.h"
+
+typedef struct Index {
+    AVIndexEntry *entries;
+    int nb_entries;
+    unsigned int allocated_size;
+    FFCompactIndex *ci;
+} Index;
+
+static int add(Index *idx, int64_t pos, int64_t timestamp, int size,
+               int distance, int flags)
+{
+    int ret  = ff_add_index_entry(&idx->entries, &idx->nb_entries,
+                                  &idx->allocated_size, pos, timestamp,
+                                  size, distance, flags);
+    int ret2 = ff_compact_index_add(idx->ci, pos, timestamp, size,
+                                    distance, flags);
+
+    if (ret != ret2) {
+        printf("add %"PRId64": %d != %d\n", timestamp, ret2, ret);
+        return 1;
+    }
+    return 0;
+}
+
+static int compare(Index *idx, const char *name)
+{
+    if (idx->ci->nb_entries != idx->nb_entries) {
+        printf("%s: %d entries instead of %d\n", name,
+               idx->ci->nb_entries, idx->nb_entries);
+        return 1;
+    }
+    for (int i = 0; i < idx->nb_entries; i++) {
+        const AVIndexEntry *e = ff_compact_index_get(idx->ci, i);
+        const AVIndexEntry *ref = &idx->entries[i];
+
+        if (e->pos != ref->pos || e->timestamp != ref->timestamp ||
+            e->size != ref->size || e->flags != ref->flags ||
+            e->min_distance != ref->min_distance) {
+            printf("%s: entry %d differs\n", name, i);
+            return 1;
+        }
+    }
+    if (ff_compact_index_get(idx->ci, idx->nb_entries)) {
+        printf("%s: entry out of range\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+static int search(Index *idx, AVLFG *lfg, const char *name)
+{
+    static const int flags[] = {
+        0, AVSEEK_FLAG_BACKWARD, AVSEEK_FLAG_ANY,
+        AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD,
+    };
+    int64_t min = idx->nb_entries ? idx->entries[0].timestamp - 10 : -10;
+    int64_t max = idx->nb_entries ? idx->entries[idx->nb_entries - 1].timestamp + 10 : 10;
+
+    for (int i = 0; i < 2000; i++) {
+        int64_t ts = min + av_lfg_get(lfg) % (max - min + 1);
+
+        for (int j = 0; j < FF_ARRAY_ELEMS(flags); j++) {
+            int ref = ff_index_search_timestamp(idx->entries, idx->nb_entries,
+                                                ts, flags[j]);
+            int ret = ff_compact_index_search(idx->ci, ts, flags[j]);
+
+            if (ret != ref) {
+                printf("%s: search %"PRId64" flags %d: %d != %d\n",
+                       name, ts, flags[j], ret, ref);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void reduce(Index *idx)
+{
+    int i;
+
+    for (i = 0; 2 * i < idx->nb_entries; i++)
+        idx->entries[i] = idx->entries[2 * i];
+    idx->nb_entries = i;
+    ff_compact_index_reduce(idx->ci);
+}
+
+static int test(const char *name, AVLFG *lfg, int nb_entries,
+                int regular, int shuffle)
+{
+    Index idx = { 0 };
+    int64_t pos = 4096, ts = -2048;
+    int ret = 1;
+
+    idx.ci = ff_compact_index_alloc();
+    if (!idx.ci)
+        return 1;
+
+    if (search(&idx, lfg, name))
+        goto end;
+
+    for (int i = 0; i < nb_entries; i++) {
+        int size     = regular ? 1024 : 1 + av_lfg_get(lfg) % 100000;
+        int flags    = regular || av_lfg_get(lfg) % 4 ? AVINDEX_KEYFRAME : 0;
+        int distance = regular ? 0 : av_lfg_get(lfg) % 3 * size;
+
+        if (add(&idx, pos, ts, size, distance, flags))
+            goto end;
+        pos += size + (regular ? 0 : av_lfg_get(lfg) % 3 * 100);
+        ts  += regular ? 1024 : 1 + av_lfg_get(lfg) % 5000;
+    }
+    for (int i = 0; i < shuffle; i++) {
+        int64_t t = av_lfg_get(lfg) % (ts + 4096) - 4096;
+        int64_t p = av_lfg_get(lfg) % pos;
+
+        /* existing timestamps replace the entry */
+        if (i & 1 && idx.nb_entries)
+            t = idx.entries[av_lfg_get(lfg) % idx.nb_entries].timestamp;
+        if (add(&idx, p, t, av_lfg_get(lfg) % 5000, av_lfg_get(lfg) % 10,
+                av_lfg_get(lfg) & AVINDEX_KEYFRAME))
+            goto end;
+    }
+
+    if (compare(&idx, name) || search(&idx, lfg, name))
+        goto end;
+
+    if (regular && ff_compact_index_size(idx.ci) >= nb_entries * 2) {
+        printf("%s: %zu bytes for %d entries\n", name,
+               ff_compact_index_size(idx.ci), nb_entries);
+        goto end;
+    }
+
+    reduce(&idx);
+    if (compare(&idx, name) || search(&idx, lfg, name))
+        goto end;
+
+    ret = 0;
+end:
+    av_free(idx.entries);
+    ff_compact_index_free(&idx.ci);
+    return ret;
+}
+
+int main(void)
+{
+    AVLFG lfg;
+    int ret = 0;
+
+    av_lfg_init(&lfg, 0xCAFE);
+
+    ret |= test("empty",     &lfg, 0,      0, 0);
+    ret |= test("regular",   &lfg, 100000, 1, 0);
+    ret |= test("irregular", &lfg, 20000,  0, 0);
+    ret |= test("inserted",  &lfg, 3000,   0, 3000);
+    ret |= test("unordered", &lfg, 0,      0, 5000);
+
+    return ret;
+}
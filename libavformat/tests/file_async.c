@@ -0,0 +1,135 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the asynchronous I/O of the file protocol: a file written with
+ * write-behind must be read back identically with read-ahead, with and
+ * without direct I/O, and when direct I/O falls back to synchronous reads.
+ */
+
+#include <stdio.h>
+
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+
+#include "libavformat/avio.h"
+
+#define FILE_SIZE (5 * 65536 + 1000)
+#define CHUNK     10007
+
+static uint8_t file_byte(int64_t pos)
+{
+    return pos * 7 + (pos >> 12);
+}
+
+static AVIOContext *open_file(const char *path, int flags, int direct, int follow)
+{
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+
+    av_dict_set_int(&opts, "queue_depth", 4, 0);
+    av_dict_set_int(&opts, "io_block_size", 65536, 0);
+    av_dict_set_int(&opts, "direct", direct, 0);
+    av_dict_set_int(&opts, "follow", follow, 0);
+    // follow retries forever at the end of the file
+    av_dict_set_int(&opts, "rw_timeout", 2000000, 0);
+    if (avio_open2(&pb, path, flags, NULL, &opts) < 0)
+        pb = NULL;
+    av_dict_free(&opts);
+    return pb;
+}
+
+static int write_file(const char *path)
+{
+    AVIOContext *pb = open_file(path, AVIO_FLAG_WRITE, 0, 0);
+    uint8_t buf[CHUNK];
+
+    if (!pb)
+        return 1;
+    for (int pos = 0; pos < FILE_SIZE; pos += CHUNK) {
+        int size = FFMIN(CHUNK, FILE_SIZE - pos);
+
+        for (int i = 0; i < size; i++)
+            buf[i] = file_byte(pos + i);
+        avio_write(pb, buf, size);
+    }
+    return avio_closep(&pb) < 0;
+}
+
+/* Read size bytes at pos, and check they are the ones written. */
+static int check(AVIOContext *pb, int64_t pos, int size)
+{
+    static uint8_t buf[FILE_SIZE];
+
+    if (avio_seek(pb, pos, SEEK_SET) != pos || avio_read(pb, buf, size) != size)
+        return 1;
+    for (int i = 0; i < size; i++)
+        if (buf[i] != file_byte(pos + i))
+            return 1;
+    return 0;
+}
+
+static void test_read(const char *path, const char *name, int direct, int follow)
+{
+    AVIOContext *pb = open_file(path, AVIO_FLAG_READ, direct, follow);
+    int ret = !pb;
+
+    for (int pos = 0; !ret && pos < FILE_SIZE; pos += CHUNK)
+        ret = check(pb, pos, FFMIN(CHUNK, FILE_SIZE - pos));
+    // backward and forward seeks
+    if (!ret)
+        ret = check(pb, 70000, 3000) || check(pb, 5, 65536) ||
+              check(pb, 4 * 65536 - 1, 2) || check(pb, FILE_SIZE - 1, 1);
+    printf("%s: %s\n", name, ret ? "failed" : "ok");
+    avio_closep(&pb);
+}
+
+int main(int argc, char **argv)
+{
+    AVIOContext *pb;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    if (write_file(argv[1])) {
+        printf("writing failed\n");
+        return 1;
+    }
+
+    test_read(argv[1], "async", 0, 0);
+    test_read(argv[1], "async follow", 0, 1);
+
+    // direct I/O is not supported by all filesystems
+    pb = open_file(argv[1], AVIO_FLAG_READ, 1, 0);
+    if (pb) {
+        avio_closep(&pb);
+        test_read(argv[1], "async direct", 1, 0);
+        test_read(argv[1], "async direct follow", 1, 1);
+    } else {
+        printf("async direct: ok\n");
+        printf("async direct follow: ok\n");
+    }
+
+    return 0;
+}
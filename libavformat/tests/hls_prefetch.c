@@ -0,0 +1,185 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the segment prefetching of the HLS demuxer with a custom io_open
+ * callback: the playlist and its segments are served from local files by
+ * the callback under http urls, which must all be opened through it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+
+#include "libavcodec/packet.h"
+
+#include "libavformat/avformat.h"
+#include "libavformat/avio.h"
+
+#define BASE_URL     "http://fate.invalid/"
+#define NB_SEGMENTS  4
+#define NB_PACKETS   5
+#define PACKET_SIZE  16
+
+static const char *prefix;
+
+static int write_segment(int idx)
+{
+    AVFormatContext *oc = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    char path[1024];
+    AVStream *st;
+    int ret;
+
+    snprintf(path, sizeof(path), "%sseg%d.ts", prefix, idx);
+    ret = avformat_alloc_output_context2(&oc, NULL, "mpegts", path);
+    if (ret < 0 || !pkt)
+        goto end;
+    st = avformat_new_stream(oc, NULL);
+    if (!st) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    st->codecpar->codec_type = AVMEDIA_TYPE_DATA;
+    st->codecpar->codec_id   = AV_CODEC_ID_SMPTE_KLV;
+    st->time_base            = (AVRational){ 1, 90000 };
+
+    if ((ret = avio_open(&oc->pb, path, AVIO_FLAG_WRITE)) < 0 ||
+        (ret = avformat_write_header(oc, NULL)) < 0)
+        goto end;
+    for (int i = 0; i < NB_PACKETS && ret >= 0; i++) {
+        int n = idx * NB_PACKETS + i;
+
+        if ((ret = av_new_packet(pkt, PACKET_SIZE)) < 0)
+            break;
+        memset(pkt->data, n, PACKET_SIZE);
+        pkt->pts   =
+        pkt->dts   = n * 18000;
+        pkt->flags = AV_PKT_FLAG_KEY;
+        ret = av_write_frame(oc, pkt);
+        av_packet_unref(pkt);
+    }
+    if (ret >= 0)
+        ret = av_write_trailer(oc);
+
+end:
+    if (oc)
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+static int write_playlist(void)
+{
+    AVIOContext *pb;
+    char path[1024];
+    int ret;
+
+    snprintf(path, sizeof(path), "%sindex.m3u8", prefix);
+    if ((ret = avio_open(&pb, path, AVIO_FLAG_WRITE)) < 0)
+        return ret;
+    avio_printf(pb, "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:1\n"
+                    "#EXT-X-MEDIA-SEQUENCE:0\n");
+    for (int i = 0; i < NB_SEGMENTS; i++)
+        avio_printf(pb, "#EXTINF:1.0,\n" BASE_URL "seg%d.ts\n", i);
+    avio_printf(pb, "#EXT-X-ENDLIST\n");
+    return avio_closep(&pb);
+}
+
+/* serve the http urls from the local files */
+static int io_open(AVFormatContext *s, AVIOContext **pb, const char *url,
+                   int flags, AVDictionary **options)
+{
+    const char *name;
+    char path[1024];
+
+    if (!av_strstart(url, BASE_URL, &name))
+        return AVERROR(ENOENT);
+    printf("open %s\n", name);
+    snprintf(path, sizeof(path), "%s%s", prefix, name);
+    return avio_open2(pb, path, flags, &s->interrupt_callback, NULL);
+}
+
+static void log_callback(void *avcl, int level, const char *fmt, va_list vl)
+{
+    // only report the problems of the prefetching
+    if (level <= AV_LOG_WARNING && av_stristr(fmt, "prefetch")) {
+        vprintf(fmt, vl);
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    AVFormatContext *ic = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket *pkt;
+    int nb_packets = 0, ok = 1, ret;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file prefix>\n", argv[0]);
+        return 1;
+    }
+    prefix = argv[1];
+
+    av_log_set_level(AV_LOG_WARNING);
+    av_log_set_callback(log_callback);
+
+    for (int i = 0; i < NB_SEGMENTS; i++) {
+        if (write_segment(i) < 0) {
+            printf("writing the segments failed\n");
+            return 1;
+        }
+    }
+    if (write_playlist() < 0) {
+        printf("writing the playlist failed\n");
+        return 1;
+    }
+
+    pkt = av_packet_alloc();
+    ic  = avformat_alloc_context();
+    if (!pkt || !ic)
+        return 1;
+    ic->io_open = io_open;
+    av_dict_set_int(&opts, "prefetch_segments", 2, 0);
+    ret = avformat_open_input(&ic, BASE_URL "index.m3u8",
+                              av_find_input_format("hls"), &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        printf("opening failed: %s\n", av_err2str(ret));
+        av_packet_free(&pkt);
+        return 1;
+    }
+
+    while ((ret = av_read_frame(ic, pkt)) >= 0) {
+        ok &= pkt->size == PACKET_SIZE && pkt->data[0] == nb_packets;
+        nb_packets++;
+        av_packet_unref(pkt);
+    }
+    printf("%d packets, %s\n", nb_packets,
+           ret == AVERROR_EOF && ok ? "ok" : "wrong");
+
+    avformat_close_input(&ic);
+    av_packet_free(&pkt);
+    return 0;
+}
@@ -0,0 +1,430 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the segment downloads of the HLS prefetcher: the segments are
+ * served by a local HTTP server honouring byte range requests, downloaded
+ * by the workers in parts of split_size within the max_size budget and
+ * read back in order.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/log.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "libavformat/avformat.h"
+#include "libavformat/hls_prefetch.h"
+#include "libavformat/network.h"
+
+#define NB_PLAYLISTS 2
+#define NB_SEGMENTS  3
+#define SPLIT_SIZE   1000
+#define SEGMENT_SIZE (3 * SPLIT_SIZE + 100)
+#define NB_PARTS     ((SEGMENT_SIZE + SPLIT_SIZE - 1) / SPLIT_SIZE)
+#define NB_WORKERS   3
+#define MAX_SIZE     (2 * SPLIT_SIZE)
+#define MAX_CONNS    64
+
+typedef struct Server {
+    int fd;
+    int port;
+    pthread_t thread;
+    pthread_t conns[MAX_CONNS];
+    int conn_fds[MAX_CONNS];
+    int nb_conns;
+
+    pthread_mutex_t lock;
+    int stop;
+    int nb_requests;
+    /* requests with a closed range of at most SPLIT_SIZE bytes */
+    int nb_split;
+    /* requests for the rest of a segment */
+    int nb_open;
+    int nb_bad;
+    int64_t nb_bytes;
+} Server;
+
+typedef struct Conn {
+    Server *s;
+    int fd;
+} Conn;
+
+static Conn conn_args[MAX_CONNS];
+
+static uint8_t segment_byte(int playlist, int seq_no, int pos)
+{
+    return (pos ^ (pos >> 8) ^ (playlist * 16 + seq_no)) & 0xff;
+}
+
+static int stopped(Server *s)
+{
+    int stop;
+
+    pthread_mutex_lock(&s->lock);
+    stop = s->stop;
+    pthread_mutex_unlock(&s->lock);
+    return stop;
+}
+
+/* wait for fd to become readable, 0 if the server is stopped */
+static int wait_readable(Server *s, int fd)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int ret;
+
+    while (!stopped(s)) {
+        ret = poll(&pfd, 1, 50);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+static int send_all(int fd, const void *data, int size)
+{
+    const uint8_t *buf = data;
+
+    while (size > 0) {
+        int ret = send(fd, buf, size, 0);
+        if (ret <= 0)
+            return -1;
+        buf  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static int serve_request(Server *s, int fd, char *req)
+{
+    uint8_t body[SEGMENT_SIZE];
+    char head[512];
+    const char *range = av_stristr(req, "\r\nRange: bytes=");
+    int keep = !av_stristr(req, "\r\nConnection: close");
+    int playlist, seq_no, len;
+    int64_t start = 0, end = SEGMENT_SIZE - 1;
+
+    if (sscanf(req, "GET /pl%d_seg%d.ts ", &playlist, &seq_no) != 2) {
+        len = snprintf(head, sizeof(head), "HTTP/1.1 404 Not Found\r\n"
+                       "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        send_all(fd, head, len);
+        return -1;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->nb_requests++;
+    if (range) {
+        char *p;
+        start = strtoll(range + 15, &p, 10);
+        if (*p == '-' && p[1] >= '0' && p[1] <= '9') {
+            end = strtoll(p + 1, NULL, 10);
+            s->nb_split += end - start < SPLIT_SIZE;
+        } else {
+            s->nb_open++;
+        }
+    }
+    if (!range || start < 0 || start > end || end >= SEGMENT_SIZE) {
+        s->nb_bad++;
+        start = 0;
+        end   = SEGMENT_SIZE - 1;
+    }
+    s->nb_bytes += end - start + 1;
+    pthread_mutex_unlock(&s->lock);
+
+    for (int i = start; i <= end; i++)
+        body[i - start] = segment_byte(playlist, seq_no, i);
+    len = snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\n"
+                   "Accept-Ranges: bytes\r\n"
+                   "Content-Range: bytes %"PRId64"-%"PRId64"/%d\r\n"
+                   "Content-Length: %"PRId64"\r\n"
+                   "Connection: %s\r\n\r\n",
+                   start, end, SEGMENT_SIZE, end - start + 1,
+                   keep ? "keep-alive" : "close");
+    if (send_all(fd, head, len) < 0 ||
+        send_all(fd, body, end - start + 1) < 0)
+        return -1;
+    return keep ? 0 : -1;
+}
+
+static void *conn_thread(void *arg)
+{
+    Conn *c = arg;
+    char req[4096];
+    int filled = 0;
+
+    while (wait_readable(c->s, c->fd) > 0) {
+        char *end;
+        int ret = recv(c->fd, req + filled, sizeof(req) - 1 - filled, 0);
+
+        if (ret <= 0)
+            break;
+        filled += ret;
+        req[filled] = 0;
+        // only requests without a body are sent
+        while ((end = strstr(req, "\r\n\r\n"))) {
+            end += 4;
+            if (serve_request(c->s, c->fd, req) < 0)
+                goto end;
+            filled -= end - req;
+            memmove(req, end, filled + 1);
+        }
+        if (filled == sizeof(req) - 1)
+            break;
+    }
+end:
+    shutdown(c->fd, SHUT_RDWR);
+    return NULL;
+}
+
+static void *server_thread(void *arg)
+{
+    Server *s = arg;
+
+    while (wait_readable(s, s->fd) > 0) {
+        int fd = accept(s->fd, NULL, NULL);
+        Conn *c;
+
+        if (fd < 0)
+            continue;
+        if (s->nb_conns == MAX_CONNS) {
+            closesocket(fd);
+            continue;
+        }
+        c = &conn_args[s->nb_conns];
+        c->s  = s;
+        c->fd = fd;
+        if (pthread_create(&s->conns[s->nb_conns], NULL, conn_thread, c)) {
+            closesocket(fd);
+            continue;
+        }
+        pthread_mutex_lock(&s->lock);
+        s->conn_fds[s->nb_conns++] = fd;
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+static int server_start(Server *s)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+
+    memset(s, 0, sizeof(*s));
+    s->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->fd < 0)
+        return -1;
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(s->fd, MAX_CONNS) ||
+        getsockname(s->fd, (struct sockaddr *)&addr, &addr_len))
+        goto fail;
+    s->port = ntohs(addr.sin_port);
+
+    if (pthread_mutex_init(&s->lock, NULL))
+        goto fail;
+    if (pthread_create(&s->thread, NULL, server_thread, s)) {
+        pthread_mutex_destroy(&s->lock);
+        goto fail;
+    }
+    return 0;
+fail:
+    closesocket(s->fd);
+    return -1;
+}
+
+static void server_stop(Server *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+    for (int i = 0; i < s->nb_conns; i++) {
+        pthread_join(s->conns[i], NULL);
+        closesocket(s->conn_fds[i]);
+    }
+    closesocket(s->fd);
+    pthread_mutex_destroy(&s->lock);
+}
+
+/* wait until the workers stop making progress */
+static int wait_idle(Server *s)
+{
+    int64_t last = -1;
+    int nb_requests = 0, idle = 0;
+
+    while (idle < 5) {
+        int64_t bytes;
+
+        av_usleep(100000);
+        pthread_mutex_lock(&s->lock);
+        bytes       = s->nb_bytes;
+        nb_requests = s->nb_requests;
+        pthread_mutex_unlock(&s->lock);
+        idle = bytes == last ? idle + 1 : 0;
+        last = bytes;
+    }
+    return nb_requests;
+}
+
+static void segment_url(char *url, int size, Server *s, int playlist, int seq_no)
+{
+    snprintf(url, size, "http://127.0.0.1:%d/pl%d_seg%d.ts", s->port, playlist, seq_no);
+}
+
+static int read_segments(HLSPrefetch *p, Server *s)
+{
+    int ret = 0;
+
+    for (int seq_no = 0; seq_no < NB_SEGMENTS; seq_no++) {
+        for (int pl = 0; pl < NB_PLAYLISTS; pl++) {
+            HLSPrefetchSegment *seg;
+            uint8_t buf[700];
+            char url[256];
+            int pos = 0, ok = 1;
+
+            segment_url(url, sizeof(url), s, pl, seq_no);
+            seg = ff_hls_prefetch_get(p, pl, seq_no, url);
+            if (!seg) {
+                printf("playlist %d segment %d: not queued\n", pl, seq_no);
+                ret = -1;
+                continue;
+            }
+            // smaller reads than the parts, to read across them
+            while ((ret = ff_hls_prefetch_read(p, seg, buf, sizeof(buf))) > 0) {
+                for (int i = 0; i < ret; i++)
+                    ok &= buf[i] == segment_byte(pl, seq_no, pos + i);
+                pos += ret;
+            }
+            printf("playlist %d segment %d: %d bytes, %s\n", pl, seq_no, pos,
+                   ret == AVERROR_EOF && ok && pos == SEGMENT_SIZE ? "ok" : "wrong");
+            ret = ret == AVERROR_EOF ? 0 : ret;
+            ff_hls_prefetch_release(p, &seg);
+        }
+    }
+    return ret;
+}
+
+/* segments of known size, split when queued */
+static int test_budget(Server *s)
+{
+    HLSPrefetch *p;
+    int nb_requests, ret;
+
+    ret = ff_hls_prefetch_alloc(&p, NULL, NB_WORKERS, MAX_SIZE, SPLIT_SIZE, 0,
+                                NULL, NULL, NULL);
+    if (ret < 0)
+        return ret;
+    for (int seq_no = 0; seq_no < NB_SEGMENTS && ret >= 0; seq_no++) {
+        for (int pl = 0; pl < NB_PLAYLISTS && ret >= 0; pl++) {
+            char url[256];
+            segment_url(url, sizeof(url), s, pl, seq_no);
+            ret = ff_hls_prefetch_add(p, pl, seq_no, url, 0, SEGMENT_SIZE, NULL);
+        }
+    }
+    if (ret < 0)
+        goto end;
+
+    /* The first segment of each playlist is downloaded entirely, then the
+     * others only as long as less than MAX_SIZE is buffered, each worker
+     * overshooting by at most a part. */
+    nb_requests = wait_idle(s);
+    printf("budget: %s\n",
+           nb_requests >= NB_PLAYLISTS * NB_PARTS &&
+           nb_requests <= NB_PLAYLISTS * NB_PARTS + MAX_SIZE / SPLIT_SIZE + NB_WORKERS &&
+           nb_requests < NB_PLAYLISTS * NB_SEGMENTS * NB_PARTS ? "ok" : "exceeded");
+
+    ret = read_segments(p, s);
+end:
+    ff_hls_prefetch_free(&p);
+    pthread_mutex_lock(&s->lock);
+    printf("%d requests, %d split, %d open, %d bad, %"PRId64" bytes\n",
+           s->nb_requests, s->nb_split, s->nb_open, s->nb_bad, s->nb_bytes);
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+/* segments of unknown size, split after the first response, downloaded
+ * over persistent connections */
+static int test_split_pending(Server *s)
+{
+    HLSPrefetch *p;
+    int ret;
+
+    ret = ff_hls_prefetch_alloc(&p, NULL, NB_WORKERS, INT64_MAX, SPLIT_SIZE, 1,
+                                NULL, NULL, NULL);
+    if (ret < 0)
+        return ret;
+    for (int seq_no = 0; seq_no < NB_SEGMENTS && ret >= 0; seq_no++) {
+        for (int pl = 0; pl < NB_PLAYLISTS && ret >= 0; pl++) {
+            char url[256];
+            segment_url(url, sizeof(url), s, pl, seq_no);
+            ret = ff_hls_prefetch_add(p, pl, seq_no, url, 0, -1, NULL);
+        }
+    }
+    if (ret >= 0)
+        ret = read_segments(p, s);
+    ff_hls_prefetch_free(&p);
+
+    pthread_mutex_lock(&s->lock);
+    printf("%d requests, %d split, %d open, %d bad, connections %s\n",
+           s->nb_requests, s->nb_split, s->nb_open, s->nb_bad,
+           s->nb_conns < s->nb_requests ? "reused" : "not reused");
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+int main(void)
+{
+    Server s;
+    int ret;
+
+#ifdef SIGPIPE
+    // the server writes to connections closed after the first range
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    av_log_set_level(AV_LOG_ERROR);
+    avformat_network_init();
+
+    if (server_start(&s) < 0) {
+        printf("starting the server failed\n");
+        return 1;
+    }
+    printf("known size, max_size %d, split_size %d\n", MAX_SIZE, SPLIT_SIZE);
+    ret = test_budget(&s);
+    server_stop(&s);
+    if (ret < 0)
+        return 1;
+
+    if (server_start(&s) < 0) {
+        printf("starting the server failed\n");
+        return 1;
+    }
+    printf("unknown size, split_size %d, persistent\n", SPLIT_SIZE);
+    ret = test_split_pending(&s);
+    server_stop(&s);
+
+    avformat_network_deinit();
+    return ret < 0;
+}
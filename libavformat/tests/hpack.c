@@ -0,0 +1,145 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavformat/hpack.c"
+
+#include <stdio.h>
+
+/* RFC 7541 appendix C.4 and C.6: requests and responses with Huffman coding,
+ * each sequence sharing a dynamic table */
+static const char *const requests[] = {
+    "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+    "828684be5886a8eb10649cbf",
+    "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+    NULL
+};
+
+static const char *const responses[] = {
+    "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1b"
+    "ff6e919d29ad171863c78f0b97c8e9ae82ae43d3",
+    "4883640effc1c0bf",
+    "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad"
+    "94e7821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1ab270fb5291f95873160"
+    "65c003ed4ee5b1063d5007",
+    NULL
+};
+
+static int print_header(void *opaque, const char *name, const char *value)
+{
+    printf("  %s: %s\n", name, value);
+    return 0;
+}
+
+static int hex_decode(uint8_t *buf, const char *hex)
+{
+    int n = 0;
+
+    for (; hex[0] && hex[1]; hex += 2) {
+        unsigned byte;
+        sscanf(hex, "%2x", &byte);
+        buf[n++] = byte;
+    }
+
+    return n;
+}
+
+static void test_sequence(const char *const *blocks, size_t table_size)
+{
+    HPACKDecoder d;
+    uint8_t buf[256];
+
+    ff_hpack_decoder_init(&d, table_size);
+    for (int i = 0; blocks[i]; i++) {
+        int size = hex_decode(buf, blocks[i]);
+        int ret;
+
+        printf("block %d:\n", i);
+        ret = ff_hpack_decode(&d, buf, size, print_header, NULL);
+        printf("  ret %d, %d entries, table size %zu\n", ret, d.nb_entries, d.size);
+    }
+    ff_hpack_decoder_uninit(&d);
+}
+
+static void test_encode(void)
+{
+    HPACKDecoder d;
+    AVBPrint bp;
+    char long_value[131];
+    int ret;
+
+    memset(long_value, 'x', sizeof(long_value) - 1);
+    long_value[sizeof(long_value) - 1] = '\0';
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    ff_hpack_encode_literal(&bp, ":method", "GET");
+    ff_hpack_encode_literal(&bp, ":path", "/live/index.m3u8");
+    ff_hpack_encode_literal(&bp, "x-long", long_value);
+
+    ff_hpack_decoder_init(&d, 4096);
+    printf("literals, %u bytes:\n", bp.len);
+    ret = ff_hpack_decode(&d, (const uint8_t *)bp.str, bp.len, print_header, NULL);
+    printf("  ret %d, %d entries\n", ret, d.nb_entries);
+    ff_hpack_decoder_uninit(&d);
+
+    av_bprint_finalize(&bp, NULL);
+}
+
+static void test_invalid(void)
+{
+    /* index out of range, EOS in a Huffman string, padding longer than 7
+     * bits, padding not made of ones, truncated string, integer with too
+     * many continuation bytes, integer too large, table size update after
+     * a header field */
+    static const char *const invalid[] = {
+        "be", "0084ffffffff", "0081ff", "008118", "0005616263",
+        "ffffffffffff0f", "ffffffffff7f", "823fe11f", NULL
+    };
+    HPACKDecoder d;
+    uint8_t buf[16];
+    int size;
+
+    for (int i = 0; invalid[i]; i++) {
+        size = hex_decode(buf, invalid[i]);
+
+        ff_hpack_decoder_init(&d, 4096);
+        printf("invalid %d: %s\n", i,
+               ff_hpack_decode(&d, buf, size, print_header, NULL) ==
+               AVERROR_INVALIDDATA ? "rejected" : "accepted");
+        ff_hpack_decoder_uninit(&d);
+    }
+
+    // table size update at the start of a block
+    size = hex_decode(buf, "3fe11f82");
+    ff_hpack_decoder_init(&d, 4096);
+    printf("table size update: %s\n",
+           ff_hpack_decode(&d, buf, size, print_header, NULL) < 0 ?
+           "rejected" : "accepted");
+    ff_hpack_decoder_uninit(&d);
+}
+
+int main(void)
+{
+    printf("requests\n");
+    test_sequence(requests, 4096);
+    printf("responses\n");
+    test_sequence(responses, 256);
+    test_encode();
+    test_invalid();
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the processing of the frames received by the http2 protocol: the
+ * frames are fed to a session without connection, and the frames it sends
+ * in reply are printed.
+ */
+
+#include "libavformat/http2.c"
+
+#include <stdio.h>
+
+static const char *const frame_names[] = {
+    "DATA", "HEADERS", "PRIORITY", "RST_STREAM", "SETTINGS",
+    "PUSH_PROMISE", "PING", "GOAWAY", "WINDOW_UPDATE", "CONTINUATION",
+};
+
+static int sink_write(URLContext *h, const uint8_t *buf, int size)
+{
+    int type = buf[3];
+
+    printf("  sent %s", type < FF_ARRAY_ELEMS(frame_names) ?
+           frame_names[type] : "unknown");
+    if (type == FRAME_RST_STREAM)
+        printf(" stream %"PRIu32" code %"PRIu32, AV_RB32(buf + 5),
+               AV_RB32(buf + FRAME_HEADER_SIZE));
+    else if (type == FRAME_GOAWAY)
+        printf(" code %"PRIu32, AV_RB32(buf + FRAME_HEADER_SIZE + 4));
+    printf("\n");
+
+    return size;
+}
+
+static const URLProtocol sink_protocol = {
+    .name      = "sink",
+    .url_write = sink_write,
+};
+
+static HTTP2Session *session_new(void)
+{
+    HTTP2Session *s = av_mallocz(sizeof(*s));
+
+    if (!s)
+        return NULL;
+    s->hd = av_mallocz(sizeof(*s->hd));
+    if (!s->hd) {
+        av_free(s);
+        return NULL;
+    }
+    s->hd->prot  = &sink_protocol;
+    s->hd->flags = AVIO_FLAG_WRITE;
+
+    ff_mutex_init(&s->lock, NULL);
+    ff_mutex_init(&s->io_lock, NULL);
+    ff_cond_init(&s->cond, NULL);
+    ff_hpack_decoder_init(&s->hpack, HEADER_TABLE_SIZE);
+    av_bprint_init(&s->block, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    s->next_stream_id      = 1;
+    s->peer_max_frame_size = 16384;
+    s->peer_max_streams    = UINT32_MAX;
+    s->peer_initial_window = DEFAULT_WINDOW;
+    s->send_window         = DEFAULT_WINDOW;
+    s->refcount            = 1;
+
+    return s;
+}
+
+static HTTP2Stream *stream_new(HTTP2Session *s)
+{
+    HTTP2Stream *st = av_mallocz(sizeof(*st));
+
+    if (!st)
+        return NULL;
+    av_bprint_init(&st->header, 0, AV_BPRINT_SIZE_UNLIMITED);
+    st->fifo = av_fifo_alloc2(4096, 1, AV_FIFO_FLAG_AUTO_GROW);
+    if (!st->fifo) {
+        av_free(st);
+        return NULL;
+    }
+
+    st->id             = s->next_stream_id;
+    st->send_window    = s->peer_initial_window;
+    s->next_stream_id += 2;
+    st->next           = s->streams;
+    s->streams         = st;
+    s->nb_active++;
+
+    return st;
+}
+
+static void print_stream(HTTP2Stream *st)
+{
+    char buf[256];
+    size_t size = FFMIN(av_fifo_can_read(st->fifo), sizeof(buf) - 1);
+
+    av_fifo_read(st->fifo, buf, size);
+    buf[size] = 0;
+    printf("  stream %"PRIu32": %s, error %d, %zu bytes of response\n",
+           st->id, st->closed ? "closed" : "open", st->err < 0, size);
+    for (char *line = buf, *end; (end = strstr(line, "\r\n")); line = end + 2) {
+        *end = 0;
+        if (*line)
+            printf("    %s\n", line);
+    }
+}
+
+static void print_result(HTTP2Session *s, int ret)
+{
+    printf("  result: %s, connection %s\n", ret < 0 ? "error" : "ok",
+           s->err ? "failed" : "usable");
+}
+
+static void session_done(HTTP2Session *s)
+{
+    // no GOAWAY for the test
+    s->err = AVERROR_EOF;
+    session_free(s);
+}
+
+static int test_headers(void)
+{
+    HTTP2Session *s = session_new();
+    HTTP2Stream *st = s ? stream_new(s) : NULL;
+    AVBPrint block;
+    int ret;
+
+    if (!st)
+        return 1;
+    printf("headers:\n");
+    av_bprint_init(&block, 0, AV_BPRINT_SIZE_UNLIMITED);
+    ff_hpack_encode_literal(&block, ":status", "200");
+    ff_hpack_encode_literal(&block, "content-length", "3");
+    ret = process_frame(s, NULL, FRAME_HEADERS, FLAG_END_HEADERS, st->id,
+                        (const uint8_t *)block.str, block.len);
+    if (ret >= 0)
+        ret = process_frame(s, NULL, FRAME_DATA, FLAG_END_STREAM, st->id,
+                            (const uint8_t *)"abc", 3);
+    print_result(s, ret);
+    print_stream(st);
+    av_bprint_finalize(&block, NULL);
+    session_done(s);
+
+    return 0;
+}
+
+static int test_continuation_flood(void)
+{
+    static const uint8_t field[16384] = { 0 };
+    HTTP2Session *s = session_new();
+    HTTP2Stream *st = s ? stream_new(s) : NULL;
+    int ret, frames = 0;
+
+    if (!st)
+        return 1;
+    printf("continuation flood:\n");
+    ret = process_frame(s, NULL, FRAME_HEADERS, 0, st->id, field, sizeof(field));
+    while (ret >= 0 && frames < 1000) {
+        ret = process_frame(s, NULL, FRAME_CONTINUATION, 0, st->id,
+                            field, sizeof(field));
+        frames += ret >= 0;
+    }
+    printf("  %d CONTINUATION frames accepted\n", frames);
+    print_result(s, ret);
+    print_stream(st);
+    session_done(s);
+
+    return 0;
+}
+
+static int test_header_list_size(void)
+{
+    HTTP2Session *s = session_new();
+    HTTP2Stream *st1 = s ? stream_new(s) : NULL;
+    HTTP2Stream *st2 = st1 ? stream_new(s) : NULL;
+    AVBPrint block;
+    int ret;
+
+    if (!st2)
+        return 1;
+    printf("header list size:\n");
+    av_bprint_init(&block, 0, AV_BPRINT_SIZE_UNLIMITED);
+    // a 4000 bytes field added to the dynamic table, then referenced
+    ff_hpack_encode_literal(&block, ":status", "200");
+    av_bprint_chars(&block, 0x40, 1);
+    av_bprint_chars(&block, 1, 1);
+    av_bprint_chars(&block, 'x', 1);
+    av_bprint_chars(&block, 0x7f, 1);
+    av_bprint_chars(&block, 0x80 | ((4000 - 127) & 0x7f), 1);
+    av_bprint_chars(&block, (4000 - 127) >> 7, 1);
+    av_bprint_chars(&block, 'y', 4000);
+    av_bprint_chars(&block, 0x80 | 62, 20);
+    ret = process_frame(s, NULL, FRAME_HEADERS, FLAG_END_HEADERS, st1->id,
+                        (const uint8_t *)block.str, block.len);
+    print_result(s, ret);
+    print_stream(st1);
+
+    // the dynamic table is still in sync for the next streams
+    av_bprint_clear(&block);
+    ff_hpack_encode_literal(&block, ":status", "204");
+    av_bprint_chars(&block, 0x80 | 62, 1);
+    ret = process_frame(s, NULL, FRAME_HEADERS, FLAG_END_HEADERS | FLAG_END_STREAM,
+                        st2->id, (const uint8_t *)block.str, block.len);
+    print_result(s, ret);
+    printf("  stream %"PRIu32": %zu bytes of header\n", st2->id,
+           av_fifo_can_read(st2->fifo));
+    av_bprint_finalize(&block, NULL);
+    session_done(s);
+
+    return 0;
+}
+
+static int window_update(HTTP2Session *s, uint32_t id, uint32_t increment)
+{
+    uint8_t payload[4];
+
+    AV_WB32(payload, increment);
+    return process_frame(s, NULL, FRAME_WINDOW_UPDATE, 0, id, payload, 4);
+}
+
+static int test_window_update(void)
+{
+    static const struct {
+        const char *name;
+        int stream;
+        uint32_t increment;
+    } tests[] = {
+        { "stream increment",            1, 1000        },
+        { "zero stream increment",       1, 0           },
+        { "stream window overflow",      1, MAX_WINDOW  },
+        { "connection increment",        0, 1000        },
+        { "zero connection increment",   0, 0           },
+        { "connection window overflow",  0, MAX_WINDOW  },
+    };
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(tests); i++) {
+        HTTP2Session *s = session_new();
+        HTTP2Stream *st = s ? stream_new(s) : NULL;
+        int ret;
+
+        if (!st)
+            return 1;
+        printf("%s:\n", tests[i].name);
+        ret = window_update(s, tests[i].stream ? st->id : 0, tests[i].increment);
+        print_result(s, ret);
+        printf("  windows: connection %"PRId64", stream %"PRId64" %s\n",
+               s->send_window, st->send_window, st->closed ? "closed" : "open");
+        session_done(s);
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    int ret = 0;
+
+    av_log_set_level(AV_LOG_QUIET);
+
+    ret |= test_headers();
+    ret |= test_continuation_flood();
+    ret |= test_header_list_size();
+    ret |= test_window_update();
+
+    return ret;
+}
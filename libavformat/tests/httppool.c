@@ -0,0 +1,330 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the pool of HTTP connections: files are downloaded from a local
+ * HTTP server keeping the connections alive, which counts the connections
+ * the pool opens for reuse, pool_idle_timeout and pool_max_idle.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "libavformat/avformat.h"
+#include "libavformat/httppool.h"
+#include "libavformat/network.h"
+
+#define BODY      "0123456789abcdef"
+#define MAX_CONNS 16
+#define NB_FILES  3
+
+typedef struct Server {
+    int fd;
+    int port;
+    pthread_t thread;
+    pthread_t conns[MAX_CONNS];
+    int conn_fds[MAX_CONNS];
+
+    pthread_mutex_t lock;
+    int stop;
+    int nb_conns;
+    int nb_requests;
+} Server;
+
+typedef struct Conn {
+    Server *s;
+    int fd;
+} Conn;
+
+static Conn conn_args[MAX_CONNS];
+
+static int stopped(Server *s)
+{
+    int stop;
+
+    pthread_mutex_lock(&s->lock);
+    stop = s->stop;
+    pthread_mutex_unlock(&s->lock);
+    return stop;
+}
+
+/* wait for fd to become readable, 0 if the server is stopped */
+static int wait_readable(Server *s, int fd)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int ret;
+
+    while (!stopped(s)) {
+        ret = poll(&pfd, 1, 50);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+static int send_all(int fd, const char *buf, int size)
+{
+    while (size > 0) {
+        int ret = send(fd, buf, size, 0);
+        if (ret <= 0)
+            return -1;
+        buf  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static void *conn_thread(void *arg)
+{
+    Conn *c = arg;
+    char req[4096], resp[256];
+    int filled = 0, len;
+
+    len = snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\n"
+                   "Content-Length: %d\r\nConnection: keep-alive\r\n\r\n"
+                   BODY, (int)strlen(BODY));
+
+    while (wait_readable(c->s, c->fd) > 0) {
+        char *end;
+        int ret = recv(c->fd, req + filled, sizeof(req) - 1 - filled, 0);
+
+        if (ret <= 0)
+            break;
+        filled += ret;
+        req[filled] = 0;
+        // only requests without a body are sent
+        while ((end = strstr(req, "\r\n\r\n"))) {
+            pthread_mutex_lock(&c->s->lock);
+            c->s->nb_requests++;
+            pthread_mutex_unlock(&c->s->lock);
+            if (send_all(c->fd, resp, len) < 0)
+                goto end;
+            end += 4;
+            filled -= end - req;
+            memmove(req, end, filled + 1);
+        }
+        if (filled == sizeof(req) - 1)
+            break;
+    }
+end:
+    shutdown(c->fd, SHUT_RDWR);
+    return NULL;
+}
+
+static void *server_thread(void *arg)
+{
+    Server *s = arg;
+
+    while (wait_readable(s, s->fd) > 0) {
+        int fd = accept(s->fd, NULL, NULL);
+        Conn *c;
+
+        if (fd < 0)
+            continue;
+        pthread_mutex_lock(&s->lock);
+        if (s->nb_conns == MAX_CONNS) {
+            pthread_mutex_unlock(&s->lock);
+            closesocket(fd);
+            continue;
+        }
+        c = &conn_args[s->nb_conns];
+        c->s  = s;
+        c->fd = fd;
+        if (pthread_create(&s->conns[s->nb_conns], NULL, conn_thread, c))
+            closesocket(fd);
+        else
+            s->conn_fds[s->nb_conns++] = fd;
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+static int server_start(Server *s)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+
+    memset(s, 0, sizeof(*s));
+    s->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->fd < 0)
+        return -1;
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(s->fd, MAX_CONNS) ||
+        getsockname(s->fd, (struct sockaddr *)&addr, &addr_len))
+        goto fail;
+    s->port = ntohs(addr.sin_port);
+
+    if (pthread_mutex_init(&s->lock, NULL))
+        goto fail;
+    if (pthread_create(&s->thread, NULL, server_thread, s)) {
+        pthread_mutex_destroy(&s->lock);
+        goto fail;
+    }
+    return 0;
+fail:
+    closesocket(s->fd);
+    return -1;
+}
+
+static void server_stop(Server *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+    for (int i = 0; i < s->nb_conns; i++) {
+        pthread_join(s->conns[i], NULL);
+        closesocket(s->conn_fds[i]);
+    }
+    closesocket(s->fd);
+    pthread_mutex_destroy(&s->lock);
+}
+
+static void print_counts(Server *s, const char *step)
+{
+    pthread_mutex_lock(&s->lock);
+    printf("%s: %d requests, %d connections\n", step, s->nb_requests, s->nb_conns);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int open_file(AVIOContext **pb, Server *s, int idx, const char *idle_timeout,
+                     const char *max_idle)
+{
+    AVDictionary *opts = NULL;
+    char url[256];
+    int ret;
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/file%d", s->port, idx);
+    if ((ret = av_dict_set(&opts, "connection_pool", "1", 0)) < 0 ||
+        (ret = av_dict_set(&opts, "pool_idle_timeout", idle_timeout, 0)) < 0 ||
+        (ret = av_dict_set(&opts, "pool_max_idle", max_idle, 0)) < 0)
+        goto end;
+    ret = avio_open2(pb, url, AVIO_FLAG_READ, NULL, &opts);
+end:
+    av_dict_free(&opts);
+    if (ret < 0)
+        printf("opening %s failed: %s\n", url, av_err2str(ret));
+    return ret;
+}
+
+/* read the whole response, which releases the connection on close */
+static int read_file(AVIOContext **pb)
+{
+    char buf[64];
+    int ret = avio_read(*pb, buf, sizeof(buf));
+
+    if (ret != strlen(BODY) || memcmp(buf, BODY, ret) ||
+        avio_read(*pb, buf, sizeof(buf)) != AVERROR_EOF) {
+        printf("wrong response\n");
+        ret = AVERROR_INVALIDDATA;
+    }
+    avio_closep(pb);
+    return FFMIN(ret, 0);
+}
+
+/* download the files one after another, the connection must be reused */
+static int test_reuse(void)
+{
+    Server s;
+    int ret = 0;
+
+    if (server_start(&s) < 0)
+        return AVERROR(EIO);
+    for (int i = 0; i < NB_FILES && ret >= 0; i++) {
+        AVIOContext *pb;
+        if ((ret = open_file(&pb, &s, i, "30", "4")) >= 0)
+            ret = read_file(&pb);
+    }
+    print_counts(&s, "sequential downloads");
+    server_stop(&s);
+    return ret;
+}
+
+/* an idle connection is not reused after pool_idle_timeout */
+static int test_idle_timeout(void)
+{
+    AVIOContext *pb;
+    Server s;
+    int ret;
+
+    if (server_start(&s) < 0)
+        return AVERROR(EIO);
+    if ((ret = open_file(&pb, &s, 0, "1", "4")) < 0 ||
+        (ret = read_file(&pb)) < 0)
+        goto end;
+    av_usleep(1500000);
+    if ((ret = open_file(&pb, &s, 1, "1", "4")) < 0 ||
+        (ret = read_file(&pb)) < 0)
+        goto end;
+    print_counts(&s, "download after the idle timeout");
+end:
+    server_stop(&s);
+    return ret;
+}
+
+/* only pool_max_idle of the connections released together are kept */
+static int test_max_idle(void)
+{
+    AVIOContext *pbs[NB_FILES] = { NULL };
+    Server s;
+    int ret = 0;
+
+    if (server_start(&s) < 0)
+        return AVERROR(EIO);
+    for (int round = 0; round < 2 && ret >= 0; round++) {
+        for (int i = 0; i < NB_FILES && ret >= 0; i++)
+            ret = open_file(&pbs[i], &s, i, "30", "2");
+        for (int i = 0; i < NB_FILES; i++) {
+            if (pbs[i] && ret >= 0)
+                ret = read_file(&pbs[i]);
+            avio_closep(&pbs[i]);
+        }
+        print_counts(&s, round ? "concurrent downloads with 2 idle connections" :
+                                 "concurrent downloads");
+    }
+    server_stop(&s);
+    return ret;
+}
+
+int main(void)
+{
+    int ret;
+
+    av_log_set_level(AV_LOG_ERROR);
+    avformat_network_init();
+
+    if ((ret = test_reuse()) >= 0 &&
+        (ret = test_idle_timeout()) >= 0)
+        ret = test_max_idle();
+    if (ret < 0)
+        printf("test failed: %s\n", av_err2str(ret));
+
+    // the connections are owned by the stopped servers
+    ff_http_pool_flush();
+    avformat_network_deinit();
+    return ret < 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the packets read with the mmap option of the file protocol: they
+ * must hold the data of the file and be followed by zeroed padding, also at
+ * the end of the file.
+ */
+
+#include <stdio.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/mem.h"
+
+#include "libavcodec/defs.h"
+#include "libavcodec/packet.h"
+
+#include "libavformat/avio.h"
+#include "libavformat/internal.h"
+
+#define FILE_SIZE (3 * 65536 + 1000)
+
+static uint8_t file_byte(int64_t pos)
+{
+    // no zero, so that padding read from the file is detected
+    return pos % 255 + 1;
+}
+
+static int write_file(const char *path)
+{
+    uint8_t *buf = av_malloc(FILE_SIZE);
+    FILE *f = fopen(path, "wb");
+    int ret = 1;
+
+    if (buf && f) {
+        for (int i = 0; i < FILE_SIZE; i++)
+            buf[i] = file_byte(i);
+        ret = fwrite(buf, 1, FILE_SIZE, f) != FILE_SIZE;
+    }
+    if (f)
+        fclose(f);
+    av_free(buf);
+    return ret;
+}
+
+static void read_packet(AVIOContext *pb, AVPacket *pkt, int64_t pos, int size)
+{
+    int data_ok = 1, padding_ok = 1, ret;
+
+    if (avio_seek(pb, pos, SEEK_SET) != pos ||
+        (ret = ff_get_packet_mapped(pb, pkt, size)) != size) {
+        printf("packet at %"PRId64": read failed\n", pos);
+        return;
+    }
+    for (int i = 0; i < size; i++)
+        data_ok &= pkt->data[i] == file_byte(pos + i);
+    for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; i++)
+        padding_ok &= !pkt->data[size + i];
+
+    printf("packet at %"PRId64", size %d: data %s, padding %s, next read at %"PRId64"\n",
+           pos, size, data_ok ? "ok" : "wrong", padding_ok ? "zeroed" : "not zeroed",
+           avio_tell(pb));
+    av_packet_unref(pkt);
+}
+
+int main(int argc, char **argv)
+{
+    AVDictionary *opts = NULL;
+    AVIOContext *pb = NULL;
+    AVPacket *pkt;
+    char *url;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+    if (write_file(argv[1]))
+        return 1;
+
+    url = av_asprintf("file:%s", argv[1]);
+    pkt = av_packet_alloc();
+    if (!url || !pkt)
+        return 1;
+    av_dict_set(&opts, "mmap", "1", 0);
+    if (avio_open2(&pb, url, AVIO_FLAG_READ, NULL, &opts) < 0) {
+        printf("failed to open %s\n", url);
+        return 1;
+    }
+
+    read_packet(pb, pkt, 0,                 40000);
+    read_packet(pb, pkt, 40000,             70001);
+    read_packet(pb, pkt, 123,               65536);
+    // copied, smaller than the I/O buffer
+    read_packet(pb, pkt, 70000,             100);
+    read_packet(pb, pkt, FILE_SIZE - 40000, 40000);
+
+    avio_closep(&pb);
+    av_packet_free(&pkt);
+    av_dict_free(&opts);
+    av_free(url);
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the fragment_threads option of the mov demuxer: the index of all
+ * the fragments must be built when opening the file, and seeking and
+ * demuxing must give the same packets as without it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/dict.h"
+#include "libavutil/mathematics.h"
+
+#include "libavcodec/packet.h"
+
+#include "libavformat/avformat.h"
+
+#define NB_FRAMES 500
+#define FRAME_SIZE 12
+
+static int write_file(const char *path)
+{
+    AVFormatContext *oc = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    uint8_t data[FRAME_SIZE];
+    AVStream *st;
+    int ret;
+
+    if (!pkt)
+        return AVERROR(ENOMEM);
+    ret = avformat_alloc_output_context2(&oc, NULL, "mov", path);
+    if (ret < 0)
+        goto end;
+    st = avformat_new_stream(oc, NULL);
+    if (!st) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    st->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    st->codecpar->codec_id   = AV_CODEC_ID_RAWVIDEO;
+    st->codecpar->format     = AV_PIX_FMT_RGB24;
+    st->codecpar->width      = 2;
+    st->codecpar->height     = 2;
+    st->time_base            = (AVRational){ 1, 25 };
+
+    if ((ret = avio_open(&oc->pb, path, AVIO_FLAG_WRITE)) < 0)
+        goto end;
+    av_dict_set(&opts, "movflags", "empty_moov+default_base_moof+global_sidx", 0);
+    av_dict_set(&opts, "frag_duration", "1000000", 0);
+    ret = avformat_write_header(oc, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < NB_FRAMES && ret >= 0; i++) {
+        memset(data, i, sizeof(data));
+        pkt->data         = data;
+        pkt->size         = sizeof(data);
+        pkt->pts          =
+        pkt->dts          = av_rescale_q(i, (AVRational){ 1, 25 }, st->time_base);
+        pkt->flags        = AV_PKT_FLAG_KEY;
+        pkt->stream_index = 0;
+        ret = av_write_frame(oc, pkt);
+    }
+    if (ret >= 0)
+        ret = av_write_trailer(oc);
+
+end:
+    if (oc)
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+static void test(const char *path, int threads)
+{
+    AVFormatContext *ic = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    int64_t first_dts = AV_NOPTS_VALUE;
+    int nb_packets = 0, ok = 1, ret;
+
+    av_dict_set_int(&opts, "fragment_threads", threads, 0);
+    ret = avformat_open_input(&ic, path, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0 || !pkt) {
+        printf("threads %d: open failed\n", threads);
+        av_packet_free(&pkt);
+        return;
+    }
+
+    printf("threads %d: %d index entries after opening\n", threads,
+           avformat_index_get_entries_count(ic->streams[0]));
+
+    ret = avformat_seek_file(ic, -1, INT64_MIN, 10 * AV_TIME_BASE, INT64_MAX, 0);
+    while (ret >= 0 && (ret = av_read_frame(ic, pkt)) >= 0) {
+        int frame = pkt->data[0];
+
+        if (first_dts == AV_NOPTS_VALUE)
+            first_dts = pkt->dts;
+        // the frame numbers stored in the data wrap at 256
+        ok &= pkt->size == FRAME_SIZE &&
+              frame == (uint8_t)(nb_packets + 250);
+        nb_packets++;
+        av_packet_unref(pkt);
+    }
+    printf("threads %d: %d packets after seeking to dts %"PRId64", %s\n",
+           threads, nb_packets, first_dts,
+           ret == AVERROR_EOF && ok ? "ok" : "wrong");
+
+    avformat_close_input(&ic);
+    av_packet_free(&pkt);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    if (write_file(argv[1]) < 0) {
+        printf("writing failed\n");
+        return 1;
+    }
+
+    test(argv[1], 0);
+    test(argv[1], 2);
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Test of the failures of the bitstream filters of the tee muxer: a packet
+ * the filters fail on must only fail the outputs using them, according to
+ * the onfail option of each of them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+
+#include "libavcodec/packet.h"
+
+#include "libavformat/avformat.h"
+
+#define NB_OUTPUTS 3
+#define NB_PACKETS 10
+#define BAD_PACKET 4
+
+/* avcC with a single SPS and PPS, and 4 bytes NAL unit lengths */
+static const uint8_t extradata[] = {
+    0x01, 0x64, 0x00, 0x1e, 0xff, 0xe1,
+    0x00, 0x04, 0x67, 0x64, 0x00, 0x1e,
+    0x01,
+    0x00, 0x04, 0x68, 0xee, 0x3c, 0x80,
+};
+
+static const uint8_t good_packet[] = { 0x00, 0x00, 0x00, 0x05, 0x65, 0x88, 0x84, 0x00, 0x10 };
+/* the NAL unit length exceeds the packet size */
+static const uint8_t bad_packet[]  = { 0x00, 0x00, 0x00, 0xff, 0x65, 0x88, 0x84, 0x00, 0x10 };
+
+static int count_packets(const char *path)
+{
+    char line[256];
+    int nb_packets = 0;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f))
+        nb_packets += line[0] != '#';
+    fclose(f);
+    return nb_packets;
+}
+
+static void test(const char *name, const char *prefix, const char *options[NB_OUTPUTS])
+{
+    AVFormatContext *oc = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    char url[4096] = "";
+    AVStream *st;
+    int ret, i;
+
+    for (i = 0; i < NB_OUTPUTS; i++)
+        av_strlcatf(url, sizeof(url), "%s[f=framecrc%s]%s.%d", i ? "|" : "",
+                    options[i], prefix, i);
+
+    ret = avformat_alloc_output_context2(&oc, NULL, "tee", url);
+    if (ret < 0 || !pkt)
+        goto end;
+    st = avformat_new_stream(oc, NULL);
+    if (!st) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    st->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    st->codecpar->codec_id   = AV_CODEC_ID_H264;
+    st->codecpar->width      = 16;
+    st->codecpar->height     = 16;
+    st->time_base            = (AVRational){ 1, 25 };
+    st->codecpar->extradata  = av_mallocz(sizeof(extradata) + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!st->codecpar->extradata) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    memcpy(st->codecpar->extradata, extradata, sizeof(extradata));
+    st->codecpar->extradata_size = sizeof(extradata);
+
+    ret = avformat_write_header(oc, NULL);
+    if (ret < 0)
+        goto end;
+
+    for (i = 0; i < NB_PACKETS; i++) {
+        ret = av_new_packet(pkt, sizeof(good_packet));
+        if (ret < 0)
+            break;
+        memcpy(pkt->data, i == BAD_PACKET ? bad_packet : good_packet, pkt->size);
+        pkt->pts   =
+        pkt->dts   = i;
+        pkt->flags = AV_PKT_FLAG_KEY;
+        ret = av_write_frame(oc, pkt);
+        av_packet_unref(pkt);
+        if (ret < 0) {
+            printf("%s: packet %d: %s\n", name, i, av_err2str(ret));
+            break;
+        }
+    }
+    printf("%s: trailer: %s\n", name, av_err2str(av_write_trailer(oc)));
+
+    for (i = 0; i < NB_OUTPUTS; i++) {
+        char path[1024];
+
+        snprintf(path, sizeof(path), "%s.%d", prefix, i);
+        printf("%s: output %d: %d packets\n", name, i, count_packets(path));
+    }
+    ret = 0;
+
+end:
+    if (ret < 0)
+        printf("%s: failed: %s\n", name, av_err2str(ret));
+    avformat_free_context(oc);
+    av_packet_free(&pkt);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *ignore_failures[NB_OUTPUTS] = {
+        ":onfail=ignore:bsfs/v=h264_mp4toannexb",
+        ":onfail=ignore:bsfs/v=h264_mp4toannexb",
+        ":onfail=ignore",
+    };
+    static const char *abort_on_failure[NB_OUTPUTS] = {
+        ":onfail=ignore:bsfs/v=h264_mp4toannexb",
+        ":bsfs/v=h264_mp4toannexb",
+        ":onfail=ignore",
+    };
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <output prefix>\n", argv[0]);
+        return 1;
+    }
+
+    av_log_set_level(AV_LOG_QUIET);
+
+    test("ignore", argv[1], ignore_failures);
+    test("abort",  argv[1], abort_on_failure);
+
+    return 0;
+}
@@ -110,6 +110,35 @@ int ff_tls_open_underlying(TLSShared *c, URLContext *parent, const char *uri, AV
     return ret;
 }
 
+int ff_tls_alpn_wire_format(const char *list, uint8_t **buf, int *size)
+{
+    // each comma is replaced by the length of the next name
+    size_t len = strlen(list) + 1;
+    uint8_t *p;
+
+    *buf = NULL;
+    if (len > INT_MAX)
+        return AVERROR(EINVAL);
+    *buf = p = av_malloc(len);
+    if (!p)
+        return AVERROR(ENOMEM);
+
+    while (*list) {
+        size_t n = strcspn(list, ",");
+        if (!n || n > 255) {
+            av_freep(buf);
+            return AVERROR(EINVAL);
+        }
+        *p++ = n;
+        memcpy(p, list, n);
+        p    += n;
+        list += n + (list[n] == ',');
+    }
+    *size = p - *buf;
+
+    return 0;
+}
+
 /**
  * Read all data from the given URL url and store it in the given buffer bp.
  */
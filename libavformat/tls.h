@@ -64,6 +64,11 @@ typedef struct TLSShared {
      * Note that pion requires a smaller value, for example, 1200.
      */
     int mtu;
+
+    /* comma-separated list of the protocols offered with ALPN by a client,
+     * and the one selected by the server */
+    char *alpn;
+    char *alpn_selected;
 } TLSShared;
 
 #define TLS_OPTFL (AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM)
@@ -93,12 +98,23 @@ typedef struct TLSShared {
     {"mtu", "Maximum Transmission Unit", offsetof(pstruct, options_field . mtu), AV_OPT_TYPE_INT,  { .i64 = 0 }, 0, INT_MAX, .flags = TLS_OPTFL}, \
     {"cert_pem",   "Certificate PEM string",              offsetof(pstruct, options_field . cert_buf),  AV_OPT_TYPE_STRING, .flags = TLS_OPTFL }, \
     {"key_pem",    "Private key PEM string",              offsetof(pstruct, options_field . key_buf),   AV_OPT_TYPE_STRING, .flags = TLS_OPTFL }, \
+    {"alpn",       "Comma-separated list of protocols to offer with ALPN", offsetof(pstruct, options_field . alpn), AV_OPT_TYPE_STRING, .flags = TLS_OPTFL }, \
+    {"alpn_selected", "Protocol selected by the server with ALPN", offsetof(pstruct, options_field . alpn_selected), AV_OPT_TYPE_STRING, .flags = AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY }, \
     FF_TLS_CLIENT_OPTIONS(pstruct, options_field)
 
 int ff_tls_open_underlying(TLSShared *c, URLContext *parent, const char *uri, AVDictionary **options);
 
 int ff_url_read_all(const char *url, AVBPrint *bp);
 
+/**
+ * Convert a comma-separated list of ALPN protocol names to the wire format
+ * of RFC 7301, each name preceded by its length.
+ *
+ * @param buf  set to the allocated list, to be freed with av_free()
+ * @param size set to the size of the list
+ */
+int ff_tls_alpn_wire_format(const char *list, uint8_t **buf, int *size);
+
 int ff_tls_set_external_socket(URLContext *h, URLContext *sock);
 
 int ff_dtls_export_materials(URLContext *h, char *dtls_srtp_materials, size_t materials_sz);
@@ -30,7 +30,9 @@
 #include "os_support.h"
 #include "url.h"
 #include "tls.h"
+#include "libavutil/avstring.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/thread.h"
 #include "libavutil/random_seed.h"
@@ -626,12 +628,42 @@ static int tls_open(URLContext *h, const char *uri, int flags, AVDictionary **op
         }
     }
 
+    if (!s->listen && s->alpn) {
+        gnutls_datum_t protos[16];
+        uint8_t *wire;
+        int wire_len, nb_protos = 0;
+
+        if ((ret = ff_tls_alpn_wire_format(s->alpn, &wire, &wire_len)) < 0) {
+            av_log(h, AV_LOG_ERROR, "Invalid ALPN protocol list '%s'\n", s->alpn);
+            goto fail;
+        }
+        for (int i = 0; i < wire_len && nb_protos < FF_ARRAY_ELEMS(protos); i += wire[i] + 1)
+            protos[nb_protos++] = (gnutls_datum_t){ .data = wire + i + 1, .size = wire[i] };
+        // the names are copied
+        ret = gnutls_alpn_set_protocols(c->session, protos, nb_protos, 0);
+        av_free(wire);
+        if (ret < 0) {
+            av_log(h, AV_LOG_ERROR, "Unable to set ALPN protocols: %s\n", gnutls_strerror(ret));
+            ret = AVERROR(EINVAL);
+            goto fail;
+        }
+    }
+
     if (!s->external_sock) {
         ret = tls_handshake(h);
         if (ret < 0)
             goto fail;
     }
     c->need_shutdown = 1;
+    if (!s->listen && s->alpn) {
+        gnutls_datum_t proto;
+
+        if (!gnutls_alpn_get_selected_protocol(c->session, &proto) &&
+            !(s->alpn_selected = av_strndup((const char *)proto.data, proto.size))) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
     if (s->verify) {
         unsigned int status, cert_list_size;
         gnutls_x509_crt_t cert;
@@ -20,6 +20,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/avstring.h"
 #include "libavutil/mem.h"
 #include "network.h"
 #include "os_support.h"
@@ -881,6 +882,23 @@ static int tls_open(URLContext *h, const char *uri, int flags, AVDictionary **op
             goto fail;
         }
     }
+    if (!s->listen && s->alpn) {
+        uint8_t *protos;
+        int protos_len;
+
+        if ((ret = ff_tls_alpn_wire_format(s->alpn, &protos, &protos_len)) < 0) {
+            av_log(h, AV_LOG_ERROR, "Invalid ALPN protocol list '%s'\n", s->alpn);
+            goto fail;
+        }
+        // unlike most of the API, returns 0 on success
+        ret = SSL_set_alpn_protos(c->ssl, protos, protos_len);
+        av_free(protos);
+        if (ret) {
+            av_log(h, AV_LOG_ERROR, "Failed to set ALPN protocols: %s\n", openssl_get_error(c));
+            ret = AVERROR_EXTERNAL;
+            goto fail;
+        }
+    }
     ret = s->listen ? SSL_accept(c->ssl) : SSL_connect(c->ssl);
     if (ret == 0) {
         av_log(h, AV_LOG_ERROR, "Unable to negotiate TLS/SSL session\n");
@@ -890,6 +908,16 @@ static int tls_open(URLContext *h, const char *uri, int flags, AVDictionary **op
         ret = print_ssl_error(h, ret);
         goto fail;
     }
+    if (!s->listen && s->alpn) {
+        const unsigned char *proto;
+        unsigned int len;
+
+        SSL_get0_alpn_selected(c->ssl, &proto, &len);
+        if (len && !(s->alpn_selected = av_strndup((const char *)proto, len))) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
 
     return 0;
 fail:
@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -83,6 +84,13 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    /**
+     * Map size bytes of the resource at pos in memory, read-only and
+     * followed by AV_INPUT_BUFFER_PADDING_SIZE zeroed bytes, see
+     * ffio_read_mapped().
+     */
+    int (*url_get_mapping)(URLContext *h, int64_t pos, int size,
+                           AVBufferRef **buf);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
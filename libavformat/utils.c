@@ -23,6 +23,7 @@
 #include <time.h>
 
 #include "config.h"
+#include "config_components.h"
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
@@ -39,6 +40,8 @@
 
 #include "avformat.h"
 #include "avio_internal.h"
+#include "http2.h"
+#include "httppool.h"
 #include "internal.h"
 #if CONFIG_NETWORK
 #include "network.h"
@@ -111,6 +114,27 @@ FF_ENABLE_DEPRECATION_WARNINGS
     return append_packet_chunked(s, pkt, size);
 }
 
+int ff_get_packet_mapped(AVIOContext *s, AVPacket *pkt, int size)
+{
+    AVBufferRef *buf;
+    int64_t pos = avio_tell(s);
+    int ret;
+
+    ret = ffio_read_mapped(s, size, &buf);
+    if (ret == AVERROR(ENOSYS))
+        return av_get_packet(s, pkt, size);
+    if (ret < 0)
+        return ret;
+
+    av_packet_unref(pkt);
+    pkt->buf  = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+    pkt->pos  = pos;
+
+    return size;
+}
+
 int av_append_packet(AVIOContext *s, AVPacket *pkt, int size)
 {
     if (!pkt->size)
@@ -573,6 +597,12 @@ int avformat_network_init(void)
 int avformat_network_deinit(void)
 {
 #if CONFIG_NETWORK
+#if CONFIG_HTTPPOOL
+    ff_http_pool_flush();
+#endif
+#if CONFIG_HTTP2_PROTOCOL
+    ff_http2_flush();
+#endif
     ff_network_close();
     ff_tls_deinit();
 #endif
@@ -846,6 +846,7 @@ const FFInputFormat ff_wav_demuxer = {
     .p.codec_tag    = ff_wav_codec_tags_list,
     .p.priv_class   = &wav_demuxer_class,
     .priv_data_size = sizeof(WAVDemuxContext),
+    .flags_internal = FF_INFMT_FLAG_COMPACT_INDEX,
     .read_probe     = wav_probe,
     .read_header    = wav_read_header,
     .read_packet    = wav_read_packet,
@@ -1015,7 +1016,7 @@ const FFInputFormat ff_w64_demuxer = {
     .p.codec_tag    = ff_wav_codec_tags_list,
     .p.priv_class   = &w64_demuxer_class,
     .priv_data_size = sizeof(WAVDemuxContext),
-    .flags_internal = FF_INFMT_FLAG_ID3V2_AUTO,
+    .flags_internal = FF_INFMT_FLAG_ID3V2_AUTO | FF_INFMT_FLAG_COMPACT_INDEX,
     .read_probe     = w64_probe,
     .read_header    = w64_read_header,
     .read_packet    = wav_read_packet,
@@ -275,6 +275,7 @@ AVBufferPool *av_buffer_pool_init2(size_t size, void *opaque,
     pool->alloc     = av_buffer_alloc; // fallback
     pool->pool_free = pool_free;
 
+    atomic_init(&pool->pool, 0);
     atomic_init(&pool->refcount, 1);
 
     return pool;
@@ -294,19 +295,76 @@ AVBufferPool *av_buffer_pool_init(size_t size, AVBufferRef* (*alloc)(size_t size
     pool->size     = size;
     pool->alloc    = alloc ? alloc : av_buffer_alloc;
 
+    atomic_init(&pool->pool, 0);
     atomic_init(&pool->refcount, 1);
 
     return pool;
 }
 
+static BufferPoolEntry *buffer_pool_entry(AVBufferPool *pool, uintptr_t idx)
+{
+    int chunk = av_log2(idx + 1);
+
+    return &pool->chunks[chunk][idx + 1 - ((uintptr_t)1 << chunk)];
+}
+
+/**
+ * Build a new head of the free list from the previous one, with the tag
+ * incremented and the given first entry index plus one.
+ */
+static uintptr_t buffer_pool_new_head(uintptr_t old, uintptr_t idx1)
+{
+    return ((old & ~BUFFER_POOL_INDEX_MASK) + BUFFER_POOL_INDEX_MASK + 1) | idx1;
+}
+
+static void buffer_pool_push(AVBufferPool *pool, BufferPoolEntry *buf)
+{
+    uintptr_t old = atomic_load_explicit(&pool->pool, memory_order_relaxed);
+
+    do {
+        atomic_store_explicit(&buf->next, old & BUFFER_POOL_INDEX_MASK,
+                              memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->pool, &old,
+                                                    buffer_pool_new_head(old, buf->index + 1),
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+/**
+ * Take one entry off the free list, or return NULL if it is empty.
+ */
+static BufferPoolEntry *buffer_pool_pop(AVBufferPool *pool)
+{
+    uintptr_t old = atomic_load_explicit(&pool->pool, memory_order_acquire);
+    BufferPoolEntry *buf;
+    uintptr_t next;
+
+    do {
+        if (!(old & BUFFER_POOL_INDEX_MASK))
+            return NULL;
+        buf  = buffer_pool_entry(pool, (old & BUFFER_POOL_INDEX_MASK) - 1);
+        /* if buf was popped meanwhile, this may be stale, but then the tag
+         * changed and the compare-and-swap fails */
+        next = atomic_load_explicit(&buf->next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->pool, &old,
+                                                    buffer_pool_new_head(old, next),
+                                                    memory_order_acquire,
+                                                    memory_order_acquire));
+
+    return buf;
+}
+
+/**
+ * Free the data of all the entries on the free list. The entries themselves
+ * stay allocated until the pool is freed.
+ */
 static void buffer_pool_flush(AVBufferPool *pool)
 {
-    while (pool->pool) {
-        BufferPoolEntry *buf = pool->pool;
-        pool->pool = buf->next;
+    BufferPoolEntry *buf;
 
+    while ((buf = buffer_pool_pop(pool))) {
         buf->free(buf->opaque, buf->data);
-        av_freep(&buf);
+        buf->data = NULL;
     }
 }
 
@@ -322,6 +380,8 @@ static void buffer_pool_free(AVBufferPool *pool)
     if (pool->pool_free)
         pool->pool_free(pool->opaque);
 
+    for (int i = 0; i < FF_ARRAY_ELEMS(pool->chunks); i++)
+        av_freep(&pool->chunks[i]);
     av_freep(&pool);
 }
 
@@ -334,9 +394,7 @@ void av_buffer_pool_uninit(AVBufferPool **ppool)
     pool   = *ppool;
     *ppool = NULL;
 
-    ff_mutex_lock(&pool->mutex);
     buffer_pool_flush(pool);
-    ff_mutex_unlock(&pool->mutex);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
@@ -347,10 +405,7 @@ static void pool_release_buffer(void *opaque, uint8_t *data)
     BufferPoolEntry *buf = opaque;
     AVBufferPool *pool = buf->pool;
 
-    ff_mutex_lock(&pool->mutex);
-    buf->next = pool->pool;
-    pool->pool = buf;
-    ff_mutex_unlock(&pool->mutex);
+    buffer_pool_push(pool, buf);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
@@ -362,20 +417,26 @@ static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
 {
     BufferPoolEntry *buf;
     AVBufferRef     *ret;
+    int chunk;
 
     av_assert0(pool->alloc || pool->alloc2);
 
+    if (pool->nb_entries >= BUFFER_POOL_INDEX_MASK)
+        return NULL;
+    chunk = av_log2(pool->nb_entries + 1);
+    if (!pool->chunks[chunk]) {
+        pool->chunks[chunk] = av_calloc((size_t)1 << chunk, sizeof(*pool->chunks[chunk]));
+        if (!pool->chunks[chunk])
+            return NULL;
+    }
+
     ret = pool->alloc2 ? pool->alloc2(pool->opaque, pool->size) :
                          pool->alloc(pool->size);
     if (!ret)
         return NULL;
 
-    buf = av_mallocz(sizeof(*buf));
-    if (!buf) {
-        av_buffer_unref(&ret);
-        return NULL;
-    }
-
+    buf = buffer_pool_entry(pool, pool->nb_entries);
+    buf->index  = pool->nb_entries++;
     buf->data   = ret->buffer->data;
     buf->opaque = ret->buffer->opaque;
     buf->free   = ret->buffer->free;
@@ -392,21 +453,20 @@ AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
     AVBufferRef *ret;
     BufferPoolEntry *buf;
 
-    ff_mutex_lock(&pool->mutex);
-    buf = pool->pool;
+    buf = buffer_pool_pop(pool);
     if (buf) {
         memset(&buf->buffer, 0, sizeof(buf->buffer));
         ret = buffer_create(&buf->buffer, buf->data, pool->size,
                             pool_release_buffer, buf, 0);
-        if (ret) {
-            pool->pool = buf->next;
-            buf->next = NULL;
+        if (ret)
             buf->buffer.flags_internal |= BUFFER_FLAG_NO_FREE;
-        }
+        else
+            buffer_pool_push(pool, buf);
     } else {
+        ff_mutex_lock(&pool->mutex);
         ret = pool_alloc_buffer(pool);
+        ff_mutex_unlock(&pool->mutex);
     }
-    ff_mutex_unlock(&pool->mutex);
 
     if (ret)
         atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
@@ -223,7 +223,7 @@ int av_buffer_replace(AVBufferRef **dst, const AVBufferRef *src);
  * @ingroup lavu_data
  *
  * @{
- * AVBufferPool is an API for a lock-free thread-safe pool of AVBuffers.
+ * AVBufferPool is an API for a thread-safe pool of AVBuffers.
  *
  * Frequently allocating and freeing large buffers may be slow. AVBufferPool is
  * meant to solve this in cases when the caller needs a set of buffers of the
@@ -242,9 +242,11 @@ int av_buffer_replace(AVBufferRef **dst, const AVBufferRef *src);
  * buffers, av_buffer_pool_uninit() must be called to mark the pool as freeable.
  * Once all the buffers are released, it will automatically be freed.
  *
- * Allocating and releasing buffers with this API is thread-safe as long as
- * either the default alloc callback is used, or the user-supplied one is
- * thread-safe.
+ * Allocating and releasing buffers with this API is thread-safe. Releasing
+ * a buffer to the pool and getting a buffer the pool already holds never
+ * block. Calls to the alloc callback are serialized, so it is never called
+ * concurrently for the same pool; it must still be thread-safe if it shares
+ * state with other pools.
  */
 
 /**
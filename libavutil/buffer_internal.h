@@ -65,6 +65,13 @@ struct AVBuffer {
     int flags_internal;
 };
 
+/**
+ * Number of bits of the head of the free list of a pool holding the index
+ * of the entry, the remaining bits hold a tag changed on every update.
+ */
+#define BUFFER_POOL_INDEX_BITS (sizeof(uintptr_t) * 4)
+#define BUFFER_POOL_INDEX_MASK (((uintptr_t)1 << BUFFER_POOL_INDEX_BITS) - 1)
+
 typedef struct BufferPoolEntry {
     uint8_t *data;
 
@@ -76,7 +83,12 @@ typedef struct BufferPoolEntry {
     void (*free)(void *opaque, uint8_t *data);
 
     AVBufferPool *pool;
-    struct BufferPoolEntry *next;
+    uintptr_t index;
+
+    /*
+     * Index plus one of the next free entry, 0 for the last one.
+     */
+    atomic_uintptr_t next;
 
     /*
      * An AVBuffer structure to (re)use as AVBuffer for subsequent uses
@@ -86,8 +98,30 @@ typedef struct BufferPoolEntry {
 } BufferPoolEntry;
 
 struct AVBufferPool {
+    /*
+     * Serializes the alloc callbacks, which may keep state of their own
+     * (e.g. the number of surfaces of a fixed size hardware frame pool),
+     * and the growth of the entries array.
+     */
     AVMutex mutex;
-    BufferPoolEntry *pool;
+
+    /*
+     * Head of the list of free entries, managed as a lock-free stack.
+     * The low BUFFER_POOL_INDEX_BITS bits hold the index plus one of the
+     * first entry, 0 if the list is empty, the other ones a tag incremented
+     * on every push and pop, so that a pop racing with other pops and pushes
+     * of the same entry fails its compare-and-swap instead of linking an
+     * entry in use back into the list (the ABA problem).
+     */
+    atomic_uintptr_t pool;
+
+    /*
+     * The entries, by index. Chunk i holds the 2^i entries starting at
+     * index 2^i - 1. Chunks are only added, with the mutex held, and are
+     * freed with the pool, so entries can always be accessed by index.
+     */
+    BufferPoolEntry *chunks[BUFFER_POOL_INDEX_BITS];
+    size_t nb_entries;
 
     /*
      * This is used to track when the pool is to be freed.
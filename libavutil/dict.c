@@ -19,21 +19,207 @@
  */
 
 #include <inttypes.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "avassert.h"
 #include "avstring.h"
 #include "dict.h"
+#include "dict_internal.h"
 #include "error.h"
+#include "macros.h"
 #include "mem.h"
 #include "bprint.h"
 
+/**
+ * Minimum number of entries for which lookups use a hash table.
+ */
+#define DICT_HASH_MIN_COUNT 8
+
+typedef struct DictHashSlot {
+    unsigned hash;
+    int index;      ///< index in AVDictionary.elems plus one, 0 for an empty slot
+} DictHashSlot;
+
 struct AVDictionary {
     int count;
     AVDictionaryEntry *elems;
+
+    /*
+     * Number of owners of this dictionary. ff_dict_ref() into an empty
+     * dictionary only takes a new reference, and a dictionary shared by
+     * several owners is immutable: av_dict_set() first replaces the caller's
+     * reference by a private copy. It may only be modified in place while
+     * refcount is 1.
+     */
+    atomic_uint refcount;
+
+    /*
+     * Set when entries were added in a way that may have produced keys that
+     * compare equal case-insensitively (AV_DICT_MULTIKEY, AV_DICT_MATCH_CASE,
+     * AV_DICT_IGNORE_SUFFIX). Copying such a dictionary entry by entry may
+     * merge entries, so it cannot be shared by ff_dict_ref().
+     */
+    int may_have_dups;
+
+    /*
+     * Open addressing hash table with linear probing mapping the
+     * case-insensitive hash of a key to its index in elems. It is only
+     * maintained once the dictionary holds DICT_HASH_MIN_COUNT entries;
+     * smaller dictionaries are searched linearly. hash_size is 0 or
+     * a power of two at least twice as large as count.
+     */
+    DictHashSlot *hash;
+    unsigned hash_size;
 };
 
+static unsigned dict_hash(const char *key)
+{
+    unsigned h = 2166136261U;
+
+    for (; *key; key++)
+        h = (h ^ av_toupper(*key)) * 16777619U;
+    return h;
+}
+
+static void dict_hash_insert(AVDictionary *m, int idx)
+{
+    unsigned mask = m->hash_size - 1;
+    unsigned h = dict_hash(m->elems[idx].key);
+    unsigned i = h & mask;
+
+    while (m->hash[i].index)
+        i = (i + 1) & mask;
+    m->hash[i].hash  = h;
+    m->hash[i].index = idx + 1;
+}
+
+static unsigned dict_hash_find_slot(const AVDictionary *m, int idx)
+{
+    unsigned mask = m->hash_size - 1;
+    unsigned i = dict_hash(m->elems[idx].key) & mask;
+
+    while (m->hash[i].index != idx + 1)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void dict_hash_rebuild(AVDictionary *m)
+{
+    unsigned size = FFMAX(m->hash_size, 2 * DICT_HASH_MIN_COUNT);
+
+    while (size < 2U * m->count)
+        size *= 2;
+
+    av_freep(&m->hash);
+    m->hash_size = 0;
+    m->hash = av_calloc(size, sizeof(*m->hash));
+    /* on allocation failure, searches fall back to a linear scan */
+    if (!m->hash)
+        return;
+    m->hash_size = size;
+    for (int i = 0; i < m->count; i++)
+        dict_hash_insert(m, i);
+}
+
+/**
+ * Index the entry that was just appended at the end of elems. Once built,
+ * the hash is kept up to date even if deletions shrink the dictionary
+ * below DICT_HASH_MIN_COUNT, since lookups use it whenever it exists.
+ */
+static void dict_hash_add_last(AVDictionary *m)
+{
+    if (!m->hash && m->count < DICT_HASH_MIN_COUNT)
+        return;
+    if (!m->hash || 2U * m->count > m->hash_size)
+        dict_hash_rebuild(m);
+    else
+        dict_hash_insert(m, m->count - 1);
+}
+
+/**
+ * Unindex the entry at idx, which is about to be overwritten by the last
+ * entry of elems, and let the slot of the last entry point to idx instead.
+ */
+static void dict_hash_remove(AVDictionary *m, int idx)
+{
+    unsigned mask = m->hash_size - 1;
+    unsigned i, j;
+    int last = m->count - 1;
+
+    if (!m->hash)
+        return;
+
+    i = dict_hash_find_slot(m, idx);
+    /* backward shift deletion: move back every following entry of the
+     * cluster whose home slot is not cyclically within (i, j] */
+    for (j = (i + 1) & mask; m->hash[j].index; j = (j + 1) & mask) {
+        unsigned home = m->hash[j].hash & mask;
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        m->hash[i] = m->hash[j];
+        i = j;
+    }
+    m->hash[i].index = 0;
+
+    if (idx != last)
+        m->hash[dict_hash_find_slot(m, last)].index = idx + 1;
+}
+
+static void dict_free_entries(AVDictionary *m)
+{
+    while (m->count--) {
+        av_freep(&m->elems[m->count].key);
+        av_freep(&m->elems[m->count].value);
+    }
+    av_freep(&m->elems);
+    av_freep(&m->hash);
+    m->hash_size = 0;
+}
+
+/**
+ * Make sure *pm is not shared with any other owner, replacing it with
+ * a private copy if needed.
+ */
+static int dict_make_writable(AVDictionary **pm)
+{
+    AVDictionary *m = *pm, *copy;
+
+    if (atomic_load_explicit(&m->refcount, memory_order_acquire) == 1)
+        return 0;
+
+    copy = av_mallocz(sizeof(*copy));
+    if (!copy)
+        return AVERROR(ENOMEM);
+    atomic_init(&copy->refcount, 1);
+    copy->may_have_dups = m->may_have_dups;
+
+    copy->elems = av_malloc_array(m->count, sizeof(*copy->elems));
+    if (!copy->elems)
+        goto fail;
+    for (; copy->count < m->count; copy->count++) {
+        AVDictionaryEntry *e = &copy->elems[copy->count];
+        e->key   = av_strdup(m->elems[copy->count].key);
+        e->value = av_strdup(m->elems[copy->count].value);
+        if (!e->key || !e->value) {
+            av_freep(&e->key);
+            av_freep(&e->value);
+            goto fail;
+        }
+    }
+    if (copy->count >= DICT_HASH_MIN_COUNT)
+        dict_hash_rebuild(copy);
+
+    av_dict_free(pm);
+    *pm = copy;
+    return 0;
+fail:
+    dict_free_entries(copy);
+    av_free(copy);
+    return AVERROR(ENOMEM);
+}
+
 int av_dict_count(const AVDictionary *m)
 {
     return m ? m->count : 0;
@@ -57,28 +243,52 @@ const AVDictionaryEntry *av_dict_iterate(const AVDictionary *m,
     return &m->elems[i];
 }
 
+static int dict_key_match(const char *s, const char *key, int flags)
+{
+    unsigned int j;
+
+    if (flags & AV_DICT_MATCH_CASE)
+        for (j = 0; s[j] == key[j] && key[j]; j++)
+            ;
+    else
+        for (j = 0; av_toupper(s[j]) == av_toupper(key[j]) && key[j]; j++)
+            ;
+    if (key[j])
+        return 0;
+    if (s[j] && !(flags & AV_DICT_IGNORE_SUFFIX))
+        return 0;
+    return 1;
+}
+
 AVDictionaryEntry *av_dict_get(const AVDictionary *m, const char *key,
                                const AVDictionaryEntry *prev, int flags)
 {
     const AVDictionaryEntry *entry = prev;
-    unsigned int j;
 
     if (!key)
         return NULL;
 
+    if (m && m->hash && !(flags & AV_DICT_IGNORE_SUFFIX)) {
+        unsigned mask = m->hash_size - 1;
+        unsigned h = dict_hash(key);
+        int start = prev ? prev - m->elems + 1 : 0;
+        int best  = m->count;
+
+        /* Equal keys share a cluster but are not ordered within it, so
+         * look for the first matching entry after prev in the whole one. */
+        for (unsigned i = h & mask; m->hash[i].index; i = (i + 1) & mask) {
+            int idx = m->hash[i].index - 1;
+            if (m->hash[i].hash != h || idx < start || idx >= best)
+                continue;
+            if (dict_key_match(m->elems[idx].key, key, flags))
+                best = idx;
+        }
+        return best < m->count ? &m->elems[best] : NULL;
+    }
+
     while ((entry = av_dict_iterate(m, entry))) {
-        const char *s = entry->key;
-        if (flags & AV_DICT_MATCH_CASE)
-            for (j = 0; s[j] == key[j] && key[j]; j++)
-                ;
-        else
-            for (j = 0; av_toupper(s[j]) == av_toupper(key[j]) && key[j]; j++)
-                ;
-        if (key[j])
-            continue;
-        if (s[j] && !(flags & AV_DICT_IGNORE_SUFFIX))
-            continue;
-        return (AVDictionaryEntry *)entry;
+        if (dict_key_match(entry->key, key, flags))
+            return (AVDictionaryEntry *)entry;
     }
     return NULL;
 }
@@ -118,17 +328,29 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value,
             }
         }
     }
-    if (!m)
+    if (tag && (flags & AV_DICT_DONT_OVERWRITE)) {
+        av_free(copy_key);
+        av_free(copy_value);
+        return 0;
+    }
+    if (m && (tag || copy_value)) {
+        ptrdiff_t idx = tag ? tag - m->elems : 0;
+        if ((err = dict_make_writable(pm)) < 0)
+            goto err_out;
+        m = *pm;
+        if (tag)
+            tag = &m->elems[idx];
+    }
+    if (!m) {
         m = *pm = av_mallocz(sizeof(*m));
-    if (!m)
-        goto enomem;
+        if (!m)
+            goto enomem;
+        atomic_init(&m->refcount, 1);
+    }
+    if (flags & (AV_DICT_MULTIKEY | AV_DICT_MATCH_CASE | AV_DICT_IGNORE_SUFFIX))
+        m->may_have_dups = 1;
 
     if (tag) {
-        if (flags & AV_DICT_DONT_OVERWRITE) {
-            av_free(copy_key);
-            av_free(copy_value);
-            return 0;
-        }
         if (copy_value && flags & AV_DICT_APPEND) {
             size_t oldlen = strlen(tag->value);
             size_t new_part_len = strlen(copy_value);
@@ -141,6 +363,7 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value,
             copy_value = newval;
         } else
             av_free(tag->value);
+        dict_hash_remove(m, tag - m->elems);
         av_free(tag->key);
         *tag = m->elems[--m->count];
     } else if (copy_value) {
@@ -154,6 +377,7 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value,
         m->elems[m->count].key = copy_key;
         m->elems[m->count].value = copy_value;
         m->count++;
+        dict_hash_add_last(m);
     } else {
         err = 0;
         goto end;
@@ -167,7 +391,7 @@ err_out:
     av_free(copy_value);
 end:
     if (m && !m->count) {
-        av_freep(&m->elems);
+        dict_free_entries(m);
         av_freep(pm);
     }
     av_free(copy_key);
@@ -234,14 +458,24 @@ void av_dict_free(AVDictionary **pm)
 {
     AVDictionary *m = *pm;
 
-    if (m) {
-        while (m->count--) {
-            av_freep(&m->elems[m->count].key);
-            av_freep(&m->elems[m->count].value);
-        }
-        av_freep(&m->elems);
+    if (m && atomic_fetch_sub_explicit(&m->refcount, 1, memory_order_acq_rel) == 1) {
+        dict_free_entries(m);
+        av_free(m);
     }
-    av_freep(pm);
+    *pm = NULL;
+}
+
+int ff_dict_ref(AVDictionary **dst, AVDictionary *src)
+{
+    /* copying into an empty dictionary amounts to sharing src, unless the
+     * copy would merge some of its entries */
+    if (!*dst && src && !src->may_have_dups) {
+        atomic_fetch_add_explicit(&src->refcount, 1, memory_order_relaxed);
+        *dst = src;
+        return 0;
+    }
+
+    return av_dict_copy(dst, src, 0);
 }
 
 int av_dict_copy(AVDictionary **dst, const AVDictionary *src, int flags)
@@ -0,0 +1,36 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_DICT_INTERNAL_H
+#define AVUTIL_DICT_INTERNAL_H
+
+#include "dict.h"
+
+/**
+ * Copy the entries of src into *dst, like av_dict_copy() without flags.
+ * If *dst is empty, it becomes a new reference to src instead, sharing its
+ * entries until either of them is modified.
+ *
+ * Unlike av_dict_copy(), src is modified, so the caller must own src or
+ * a reference to it.
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_dict_ref(AVDictionary **dst, AVDictionary *src);
+
+#endif /* AVUTIL_DICT_INTERNAL_H */
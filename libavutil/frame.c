@@ -20,6 +20,7 @@
 #include "avassert.h"
 #include "buffer.h"
 #include "dict.h"
+#include "dict_internal.h"
 #include "frame.h"
 #include "imgutils.h"
 #include "mem.h"
@@ -243,7 +244,7 @@ static int frame_copy_props(AVFrame *dst, const AVFrame *src, int force_copy)
     dst->chroma_location        = src->chroma_location;
     dst->alpha_mode             = src->alpha_mode;
 
-    av_dict_copy(&dst->metadata, src->metadata, 0);
+    ff_dict_ref(&dst->metadata, src->metadata);
 
     for (int i = 0; i < src->nb_side_data; i++) {
         const AVFrameSideData *sd_src = src->side_data[i];
@@ -268,7 +269,7 @@ static int frame_copy_props(AVFrame *dst, const AVFrame *src, int force_copy)
                 return AVERROR(ENOMEM);
             }
         }
-        av_dict_copy(&sd_dst->metadata, sd_src->metadata, 0);
+        ff_dict_ref(&sd_dst->metadata, sd_src->metadata);
     }
 
     av_refstruct_replace(&dst->private_ref, src->private_ref);
@@ -20,6 +20,7 @@
 #include "buffer.h"
 #include "common.h"
 #include "dict.h"
+#include "dict_internal.h"
 #include "frame.h"
 #include "mem.h"
 #include "side_data.h"
@@ -266,7 +267,7 @@ int av_frame_side_data_clone(AVFrameSideData ***sd, int *nb_sd,
         if (!(flags & AV_FRAME_SIDE_DATA_FLAG_REPLACE))
             return AVERROR(EEXIST);
 
-        ret = av_dict_copy(&dict, src->metadata, 0);
+        ret = ff_dict_ref(&dict, src->metadata);
         if (ret < 0)
             return ret;
 
@@ -294,7 +295,7 @@ int av_frame_side_data_clone(AVFrameSideData ***sd, int *nb_sd,
         return AVERROR(ENOMEM);
     }
 
-    ret = av_dict_copy(&sd_dst->metadata, src->metadata, 0);
+    ret = ff_dict_ref(&sd_dst->metadata, src->metadata);
     if (ret < 0) {
         remove_side_data_by_entry(sd, nb_sd, sd_dst);
         return ret;
@@ -0,0 +1,161 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Stress test and benchmark for AVBufferPool: several threads concurrently
+ * get buffers from and return buffers to the same pool, checking that no
+ * buffer is ever handed out twice and that the alloc callback is never run
+ * concurrently. Run with -b to print timings.
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/macros.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define MAX_THREADS 64
+#define MAX_HELD    8
+#define BUF_SIZE    64
+
+typedef struct ThreadArg {
+    AVBufferPool *pool;
+    int           id;
+    int           iterations;
+    int           errors;
+} ThreadArg;
+
+static atomic_int nb_allocs;
+static atomic_int nb_pool_free;
+static atomic_int in_alloc;
+static atomic_int nb_concurrent_allocs;
+
+static AVBufferRef *counting_alloc(void *opaque, size_t size)
+{
+    AVBufferRef *ret;
+
+    if (atomic_fetch_add(&in_alloc, 1))
+        atomic_fetch_add(&nb_concurrent_allocs, 1);
+    atomic_fetch_add(&nb_allocs, 1);
+    ret = av_buffer_alloc(size);
+    atomic_fetch_sub(&in_alloc, 1);
+
+    return ret;
+}
+
+static void counting_pool_free(void *opaque)
+{
+    atomic_fetch_add(&nb_pool_free, 1);
+}
+
+static void *worker(void *opaque)
+{
+    ThreadArg *arg = opaque;
+    AVBufferRef *held[MAX_HELD] = { NULL };
+    uint8_t tags[MAX_HELD];
+
+    for (int i = 0; i < arg->iterations; i++) {
+        int slot = i % MAX_HELD;
+        int tag  = (arg->id * 131 + i) & 0xFF;
+
+        if (held[slot]) {
+            for (int j = 0; j < BUF_SIZE; j++)
+                if (held[slot]->data[j] != tags[slot])
+                    arg->errors++;
+            av_buffer_unref(&held[slot]);
+        }
+
+        held[slot] = av_buffer_pool_get(arg->pool);
+        if (!held[slot]) {
+            arg->errors++;
+            continue;
+        }
+        tags[slot] = tag;
+        memset(held[slot]->data, tag, BUF_SIZE);
+    }
+
+    for (int i = 0; i < MAX_HELD; i++)
+        av_buffer_unref(&held[i]);
+
+    return NULL;
+}
+
+static int run(int nb_threads, int iterations, int bench)
+{
+    pthread_t threads[MAX_THREADS];
+    ThreadArg args[MAX_THREADS];
+    AVBufferPool *pool;
+    int64_t start, elapsed;
+    int errors = 0, allocs, ret;
+
+    atomic_store(&nb_allocs, 0);
+    atomic_store(&nb_pool_free, 0);
+    atomic_store(&nb_concurrent_allocs, 0);
+
+    pool = av_buffer_pool_init2(BUF_SIZE, NULL, counting_alloc, counting_pool_free);
+    if (!pool)
+        return 1;
+
+    start = av_gettime_relative();
+    for (int i = 0; i < nb_threads; i++) {
+        args[i] = (ThreadArg){ .pool = pool, .id = i, .iterations = iterations };
+        if ((ret = pthread_create(&threads[i], NULL, worker, &args[i]))) {
+            fprintf(stderr, "pthread_create failed: %s.\n", strerror(ret));
+            return 1;
+        }
+    }
+    for (int i = 0; i < nb_threads; i++) {
+        pthread_join(threads[i], NULL);
+        errors += args[i].errors;
+    }
+    elapsed = av_gettime_relative() - start;
+
+    allocs = atomic_load(&nb_allocs);
+    errors += atomic_load(&nb_concurrent_allocs);
+    /* the pool must only grow when all of its buffers are in use */
+    if (allocs > nb_threads * MAX_HELD)
+        errors++;
+    av_buffer_pool_uninit(&pool);
+
+    printf("threads %d: errors %d, pool freed %d\n", nb_threads, errors,
+           atomic_load(&nb_pool_free));
+    if (bench)
+        printf("  %d gets in %"PRId64" us (%.1f ns/get), %d allocations\n",
+               nb_threads * iterations, elapsed,
+               elapsed * 1000.0 / (nb_threads * iterations), allocs);
+
+    return errors || atomic_load(&nb_pool_free) != 1;
+}
+
+int main(int argc, char **argv)
+{
+    static const int thread_counts[] = { 1, 2, 4, 8, 16 };
+    int bench = argc > 1 && !strcmp(argv[1], "-b");
+    int iterations = bench ? 1000000 : 20000;
+    int ret = 0;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(thread_counts); i++)
+        ret |= run(thread_counts[i], iterations, bench);
+
+    return ret;
+}
@@ -166,5 +166,97 @@ int main(void)
     printf("%s\n", e->value);
     av_dict_free(&dict);
 
+    printf("\nTesting ff_dict_ref() and copy-on-write\n");
+    {
+        AVDictionary *copy = NULL, *copy2 = NULL;
+
+        av_dict_set(&dict, "a", "a", 0);
+        av_dict_set(&dict, "b", "b", 0);
+        ff_dict_ref(&copy, dict);
+        ff_dict_ref(&copy2, copy);
+        av_dict_set(&copy, "a", "changed", 0);
+        av_dict_set(&copy, "c", "c", 0);
+        av_dict_set(&copy2, "b", NULL, 0);
+        print_dict(dict);
+        print_dict(copy);
+        print_dict(copy2);
+        av_dict_free(&dict);
+        av_dict_free(&copy);
+        print_dict(copy2);
+        av_dict_free(&copy2);
+
+        av_dict_set(&dict, "a", "1", AV_DICT_MULTIKEY);
+        av_dict_set(&dict, "a", "2", AV_DICT_MULTIKEY);
+        av_dict_set(&dict, "A", "3", AV_DICT_MULTIKEY);
+        ff_dict_ref(&copy, dict);
+        av_dict_copy(&copy2, dict, AV_DICT_MULTIKEY);
+        print_dict(copy);
+        print_dict(copy2);
+        av_dict_free(&dict);
+        av_dict_free(&copy);
+        av_dict_free(&copy2);
+    }
+
+    printf("\nTesting hashed lookups\n");
+    {
+        char key[16], val[16];
+        int mismatches = 0;
+
+        for (int i = 0; i < 200; i++) {
+            snprintf(key, sizeof(key), "key%d", i);
+            snprintf(val, sizeof(val), "%d", i);
+            av_dict_set(&dict, key, val, 0);
+        }
+        for (int i = 0; i < 200; i += 3) {
+            snprintf(key, sizeof(key), "KEY%d", i);
+            av_dict_set(&dict, key, NULL, 0);
+        }
+        for (int i = 0; i < 200; i += 5) {
+            snprintf(key, sizeof(key), "Key%d", i);
+            av_dict_set(&dict, key, "new", 0);
+        }
+        av_dict_set(&dict, "dup", "1", AV_DICT_MULTIKEY);
+        av_dict_set(&dict, "DUP", "2", AV_DICT_MULTIKEY);
+        av_dict_set(&dict, "dup", "3", AV_DICT_MULTIKEY);
+
+        for (int i = 0; i < 210; i++) {
+            const AVDictionaryEntry *linear = NULL;
+            snprintf(key, sizeof(key), "kEy%d", i);
+            while ((linear = av_dict_iterate(dict, linear)))
+                if (!av_strcasecmp(linear->key, key))
+                    break;
+            if (linear != av_dict_get(dict, key, NULL, 0))
+                mismatches++;
+        }
+        printf("%d entries, %d mismatches\n", av_dict_count(dict), mismatches);
+
+        e = NULL;
+        while ((e = av_dict_get(dict, "dup", e, 0)))
+            printf("%s %s\n", e->key, e->value);
+        e = NULL;
+        while ((e = av_dict_get(dict, "dup", e, AV_DICT_MATCH_CASE)))
+            printf("%s %s\n", e->key, e->value);
+        av_dict_free(&dict);
+
+        /* shrink a hashed dictionary below the hashing threshold */
+        for (int i = 0; i < 8; i++) {
+            snprintf(key, sizeof(key), "k%d", i);
+            av_dict_set(&dict, key, "x", 0);
+        }
+        av_dict_set(&dict, "k0", NULL, 0);
+        av_dict_set(&dict, "k1", NULL, 0);
+        av_dict_set(&dict, "new", "1", 0);
+        e = av_dict_get(dict, "new", NULL, 0);
+        printf("%s %s\n", e ? e->key : "(null)", e ? e->value : "(null)");
+        av_dict_set(&dict, "new", "2", 0);
+        av_dict_set(&dict, "k1", "y", 0);
+        e = av_dict_get(dict, "new", NULL, 0);
+        printf("%s %s\n", e ? e->key : "(null)", e ? e->value : "(null)");
+        e = av_dict_get(dict, "k1", NULL, 0);
+        printf("%s %s\n", e ? e->key : "(null)", e ? e->value : "(null)");
+        printf("%d entries\n", av_dict_count(dict));
+        av_dict_free(&dict);
+    }
+
     return 0;
 }
@@ -0,0 +1,173 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Test of the thread pool of the ffmpeg CLI: batches of various sizes and
+ * priorities are executed from one thread, then from several threads
+ * sharing the pool at the same time, and every job of every batch must run
+ * exactly once and have its return code stored.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/error.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "fftools/thread_pool.h"
+
+#define NB_SUBMITTERS 4
+#define NB_BATCHES    50
+
+static const int job_counts[] = { 0, 1, 2, 5, 64, 1000 };
+static const int priorities[] = { -1, 0, 3 };
+
+typedef struct Batch {
+    atomic_int *runs;
+    int        *ret;
+    int         nb_jobs;
+    atomic_int  wrong_nb_jobs;
+} Batch;
+
+typedef struct Submitter {
+    pthread_t   tid;
+    ThreadPool *tp;
+    int         priority;
+    int         ret;
+} Submitter;
+
+static int job(void *priv, int jobnr, int nb_jobs)
+{
+    Batch *b = priv;
+
+    if (nb_jobs != b->nb_jobs)
+        atomic_fetch_add(&b->wrong_nb_jobs, 1);
+    atomic_fetch_add(&b->runs[jobnr], 1);
+    return jobnr ^ 0x55;
+}
+
+/* execute a batch and check that each job ran once */
+static int run_batch(ThreadPool *tp, int nb_jobs, int priority, int with_ret)
+{
+    Batch b = { .nb_jobs = nb_jobs };
+    int ret = 0;
+
+    b.runs = av_calloc(FFMAX(nb_jobs, 1), sizeof(*b.runs));
+    b.ret  = av_calloc(FFMAX(nb_jobs, 1), sizeof(*b.ret));
+    if (!b.runs || !b.ret) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int i = 0; i < nb_jobs; i++) {
+        atomic_init(&b.runs[i], 0);
+        b.ret[i] = -1;
+    }
+    atomic_init(&b.wrong_nb_jobs, 0);
+
+    tp_execute(tp, job, &b, with_ret ? b.ret : NULL, nb_jobs, priority);
+
+    for (int i = 0; i < nb_jobs; i++) {
+        int runs = atomic_load(&b.runs[i]);
+        if (runs != 1 || (with_ret && b.ret[i] != (i ^ 0x55))) {
+            fprintf(stderr, "batch of %d jobs, priority %d: job %d ran %d times, "
+                    "returned %d\n", nb_jobs, priority, i, runs, b.ret[i]);
+            ret = AVERROR_BUG;
+            break;
+        }
+    }
+    if (atomic_load(&b.wrong_nb_jobs)) {
+        fprintf(stderr, "batch of %d jobs: wrong job count passed\n", nb_jobs);
+        ret = AVERROR_BUG;
+    }
+
+end:
+    av_free(b.runs);
+    av_free(b.ret);
+    return ret;
+}
+
+static void *submitter_thread(void *arg)
+{
+    Submitter *s = arg;
+
+    for (int i = 0; !s->ret && i < NB_BATCHES; i++)
+        s->ret = run_batch(s->tp, (i * 37 + s->priority * 11) % 200 + 1,
+                           s->priority, i & 1);
+    return NULL;
+}
+
+static int test_pool(int nb_threads)
+{
+    Submitter submitters[NB_SUBMITTERS] = { 0 };
+    ThreadPool *tp = tp_alloc(nb_threads);
+    int nb_started = 0, ret = 0;
+
+    if (!tp)
+        return AVERROR(ENOMEM);
+    printf("%d thread(s), %d executing a batch\n", nb_threads, tp_nb_threads(tp));
+
+    for (int i = 0; !ret && i < FF_ARRAY_ELEMS(job_counts); i++) {
+        for (int j = 0; !ret && j < FF_ARRAY_ELEMS(priorities); j++) {
+            ret = run_batch(tp, job_counts[i], priorities[j], j & 1);
+            if (!ret)
+                printf("%4d jobs, priority %2d: each job ran once\n",
+                       job_counts[i], priorities[j]);
+        }
+    }
+
+    // batches of different priorities submitted concurrently
+    while (!ret && nb_started < NB_SUBMITTERS) {
+        Submitter *s = &submitters[nb_started];
+
+        s->tp       = tp;
+        s->priority = nb_started;
+        ret = pthread_create(&s->tid, NULL, submitter_thread, s);
+        if (ret)
+            ret = AVERROR(ret);
+        else
+            nb_started++;
+    }
+    for (int i = 0; i < nb_started; i++) {
+        pthread_join(submitters[i].tid, NULL);
+        if (!ret)
+            ret = submitters[i].ret;
+    }
+    if (!ret)
+        printf("%d submitters of %d batches: each job ran once\n",
+               NB_SUBMITTERS, NB_BATCHES);
+
+    tp_free(&tp);
+    return ret;
+}
+
+int main(void)
+{
+    static const int nb_threads[] = { 1, 2, 5 };
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(nb_threads); i++) {
+        int ret = test_pool(nb_threads[i]);
+        if (ret < 0) {
+            fprintf(stderr, "Error: %s\n", av_err2str(ret));
+            return 1;
+        }
+    }
+    return 0;
+}
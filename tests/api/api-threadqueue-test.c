@@ -0,0 +1,232 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * Stress test of the thread queue of the ffmpeg CLI: several senders push
+ * items for their own stream into a small queue while another thread chokes
+ * and unchokes it, and the receiver must get every item of every stream in
+ * order, followed by a single EOF. The receiver finishes one of the streams
+ * early, whose sender must then get EOF.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "libavcodec/packet.h"
+
+#include "fftools/thread_queue.h"
+
+#define NB_CHOKES 100
+
+typedef struct SenderData {
+    pthread_t tid;
+    ThreadQueue *tq;
+    enum ThreadQueueType type;
+    unsigned int stream_idx;
+    int nb_items;
+    int ret;
+} SenderData;
+
+typedef struct ChokerData {
+    pthread_t tid;
+    ThreadQueue *tq;
+} ChokerData;
+
+static void *item_alloc(enum ThreadQueueType type)
+{
+    return type == THREAD_QUEUE_FRAMES ? (void*)av_frame_alloc() :
+                                         (void*)av_packet_alloc();
+}
+
+static void item_free(enum ThreadQueueType type, void **item)
+{
+    if (type == THREAD_QUEUE_FRAMES)
+        av_frame_free((AVFrame**)item);
+    else
+        av_packet_free((AVPacket**)item);
+}
+
+static int64_t *item_pts(enum ThreadQueueType type, void *item)
+{
+    return type == THREAD_QUEUE_FRAMES ? &((AVFrame*)item)->pts :
+                                         &((AVPacket*)item)->pts;
+}
+
+static void *sender_thread(void *arg)
+{
+    SenderData *sd = arg;
+    void *item = item_alloc(sd->type);
+
+    sd->ret = item ? 0 : AVERROR(ENOMEM);
+    for (int i = 0; !sd->ret && i < sd->nb_items; i++) {
+        *item_pts(sd->type, item) = i;
+        sd->ret = tq_send(sd->tq, sd->stream_idx, item);
+    }
+    tq_send_finish(sd->tq, sd->stream_idx);
+
+    item_free(sd->type, &item);
+    return NULL;
+}
+
+static void *choker_thread(void *arg)
+{
+    ChokerData *cd = arg;
+
+    for (int i = 0; i < NB_CHOKES; i++) {
+        tq_choke(cd->tq, 1);
+        av_usleep(rand() % 100);
+        tq_choke(cd->tq, 0);
+        av_usleep(rand() % 500);
+    }
+    return NULL;
+}
+
+static int run(enum ThreadQueueType type, int queue_size, int nb_senders,
+               int nb_items)
+{
+    const char *name = type == THREAD_QUEUE_FRAMES ? "frames" : "packets";
+    SenderData *senders = av_calloc(nb_senders, sizeof(*senders));
+    int *received       = av_calloc(nb_senders, sizeof(*received));
+    int *eofs           = av_calloc(nb_senders, sizeof(*eofs));
+    ThreadQueue *tq     = tq_alloc(nb_senders, queue_size, type);
+    void *item          = item_alloc(type);
+    ChokerData choker   = { .tq = tq };
+    int nb_started = 0, choker_started = 0, ret = AVERROR(ENOMEM);
+
+    if (!senders || !received || !eofs || !tq || !item)
+        goto end;
+
+    for (; nb_started < nb_senders; nb_started++) {
+        SenderData *sd = &senders[nb_started];
+
+        sd->tq         = tq;
+        sd->type       = type;
+        sd->stream_idx = nb_started;
+        sd->nb_items   = nb_items;
+        ret = pthread_create(&sd->tid, NULL, sender_thread, sd);
+        if (ret) {
+            ret = AVERROR(ret);
+            goto end;
+        }
+    }
+    ret = pthread_create(&choker.tid, NULL, choker_thread, &choker);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto end;
+    }
+    choker_started = 1;
+
+    while (1) {
+        int stream_idx;
+
+        ret = tq_receive(tq, &stream_idx, item);
+        if (ret == AVERROR_EOF && stream_idx < 0) {
+            ret = 0;
+            break;
+        }
+        if (stream_idx < 0 || stream_idx >= nb_senders) {
+            fprintf(stderr, "%s: invalid stream %d (%s)\n", name, stream_idx,
+                    av_err2str(ret));
+            ret = AVERROR_BUG;
+            break;
+        }
+        if (ret == AVERROR_EOF) {
+            eofs[stream_idx]++;
+            continue;
+        }
+        if (ret < 0)
+            break;
+
+        if (eofs[stream_idx] ||
+            (stream_idx == 0 && received[0] == nb_items / 2) ||
+            *item_pts(type, item) != received[stream_idx]) {
+            fprintf(stderr, "%s: stream %d: got item %"PRId64" after %d items%s\n",
+                    name, stream_idx, *item_pts(type, item), received[stream_idx],
+                    eofs[stream_idx] ? " and EOF" : "");
+            ret = AVERROR_BUG;
+            break;
+        }
+        received[stream_idx]++;
+        item_free(type, &item);
+        item = item_alloc(type);
+        if (!item) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+
+        // the remaining items of the first stream must be dropped
+        if (stream_idx == 0 && received[0] == nb_items / 2)
+            tq_receive_finish(tq, 0);
+    }
+
+end:
+    // let blocked senders terminate on errors
+    for (int i = 0; tq && ret < 0 && i < nb_senders; i++)
+        tq_receive_finish(tq, i);
+    for (int i = 0; i < nb_started; i++)
+        pthread_join(senders[i].tid, NULL);
+    if (choker_started)
+        pthread_join(choker.tid, NULL);
+
+    if (ret >= 0) {
+        for (int i = 0; i < nb_senders; i++)
+            printf("%s: stream %d: %d items received, %d EOF, sender: %s\n",
+                   name, i, received[i], eofs[i],
+                   senders[i].ret == AVERROR_EOF ? "EOF" : av_err2str(senders[i].ret));
+    }
+
+    item_free(type, &item);
+    tq_free(&tq);
+    av_freep(&eofs);
+    av_freep(&received);
+    av_freep(&senders);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int queue_size, nb_senders, nb_items, ret;
+
+    if (argc != 4) {
+        fprintf(stderr, "%s <queue_size> <nb_senders> <nb_items>\n", argv[0]);
+        return 1;
+    }
+    queue_size = atoi(argv[1]);
+    nb_senders = atoi(argv[2]);
+    nb_items   = atoi(argv[3]);
+    // the first stream must be finished while its sender is still sending
+    if (queue_size <= 0 || nb_senders <= 0 || nb_items / 2 <= queue_size) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    ret = run(THREAD_QUEUE_PACKETS, queue_size, nb_senders, nb_items);
+    if (ret >= 0)
+        ret = run(THREAD_QUEUE_FRAMES, queue_size, nb_senders, nb_items);
+    if (ret < 0) {
+        fprintf(stderr, "Error: %s\n", av_err2str(ret));
+        return 1;
+    }
+    return 0;
+}
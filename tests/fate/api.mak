@@ -28,6 +28,14 @@ fate-api-threadmessage: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
 fate-api-threadmessage: CMD = run $(APITESTSDIR)/api-threadmessage-test$(EXESUF) 3 10 30 50 2 20 40
 fate-api-threadmessage: CMP = null
 
+FATE_API-$(CONFIG_FFMPEG) += fate-api-threadpool
+fate-api-threadpool: $(APITESTSDIR)/api-threadpool-test$(EXESUF)
+fate-api-threadpool: CMD = run $(APITESTSDIR)/api-threadpool-test$(EXESUF)
+
+FATE_API-$(CONFIG_FFMPEG) += fate-api-threadqueue
+fate-api-threadqueue: $(APITESTSDIR)/api-threadqueue-test$(EXESUF)
+fate-api-threadqueue: CMD = run $(APITESTSDIR)/api-threadqueue-test$(EXESUF) 4 4 20000
+
 FATE_API_SAMPLES-$(CONFIG_AVFORMAT) += $(FATE_API_SAMPLES_LIBAVFORMAT-yes)
 
 ifdef SAMPLES
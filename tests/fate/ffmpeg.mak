@@ -16,6 +16,11 @@ fate-ffmpeg-filter_colorkey: CMD = framecrc -auto_conversion_filters -idct simpl
 FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+# parallel chunk encoding with B-frames, the dts must stay monotonic across
+# chunks, including across timestamp gaps
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC SETPTS SCALE, MPEG4_ENCODER) += fate-ffmpeg-enc_chunks
+fate-ffmpeg-enc_chunks: CMD = framecrc -auto_conversion_filters -lavfi "testsrc=d=2:r=10:s=64x48,setpts=N+20*trunc(N/6)" -fps_mode passthrough -c:v mpeg4 -bf 2 -q:v 10 -dct fastint -idct simple -threads 1 -enc_chunks 3 -enc_chunk_frames 5 -fflags +bitexact
+
 FATE_FFMPEG-$(call ENCDEC2, MPEG4, RAWVIDEO, AVI, RAWVIDEO_DEMUXER FRAMECRC_MUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth1.yuv
 fate-force_key_frames: CMD = enc_dec \
@@ -511,6 +511,14 @@ FATE_FILTER_VSYNTH-$(call FILTERDEMDEC, SCALE, RAWVIDEO, RAWVIDEO) += fate-filte
 fate-filter-scalechroma: tests/data/vsynth1.yuv
 fate-filter-scalechroma: CMD = framecrc -flags bitexact -s 352x288 -pix_fmt yuv444p -i $(TARGET_PATH)/tests/data/vsynth1.yuv -pix_fmt yuv420p -sws_flags +bitexact -vf scale=out_chroma_loc=bottomleft
 
+FATE_FILTER-$(CONFIG_SCALE_FILTER) += fate-filter-scale-update-size
+fate-filter-scale-update-size: libavfilter/tests/video_size$(EXESUF)
+fate-filter-scale-update-size: CMD = run libavfilter/tests/video_size$(EXESUF)
+
+FATE_FILTER-$(CONFIG_HFLIP_FILTER) += fate-filter-stats
+fate-filter-stats: libavfilter/tests/filter_stats$(EXESUF)
+fate-filter-stats: CMD = run libavfilter/tests/filter_stats$(EXESUF)
+
 FATE_FILTER_VSYNTH_VIDEO_FILTER-$(CONFIG_VFLIP_FILTER) += fate-filter-vflip
 fate-filter-vflip: CMD = video_filter "vflip"
 
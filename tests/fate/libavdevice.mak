@@ -1,3 +1,7 @@
+FATE_LIBAVDEVICE-$(call ALLYES, FRAMEBUS_INDEV FRAMEBUS_OUTDEV) += fate-framebus
+fate-framebus: libavdevice/tests/framebus$(EXESUF)
+fate-framebus: CMD = run libavdevice/tests/framebus
+
 FATE_LIBAVDEVICE-$(CONFIG_JACK_INDEV) += fate-timefilter
 fate-timefilter: libavdevice/tests/timefilter$(EXESUF)
 fate-timefilter: CMD = run libavdevice/tests/timefilter
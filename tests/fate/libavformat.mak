@@ -2,6 +2,23 @@
 #fate-async: libavformat/tests/async$(EXESUF)
 #fate-async: CMD = run libavformat/tests/async
 
+FATE_LIBAVFORMAT-$(CONFIG_ASYNC_PROTOCOL) += fate-async-buffer
+fate-async-buffer: libavformat/tests/async_buffer$(EXESUF)
+fate-async-buffer: CMD = run libavformat/tests/async_buffer$(EXESUF)
+
+FATE_LIBAVFORMAT-$(call ALLYES, CACHE_PROTOCOL FILE_PROTOCOL) += fate-cache
+fate-cache: libavformat/tests/cache$(EXESUF)
+fate-cache: CMD = run libavformat/tests/cache$(EXESUF) $(TARGET_PATH)/tests/data/fate/cache.dir
+
+FATE_LIBAVFORMAT-$(call ALLYES, FILE_PROTOCOL FILE_ASYNC) += fate-file-async
+fate-file-async: libavformat/tests/file_async$(EXESUF)
+fate-file-async: CMD = run libavformat/tests/file_async$(EXESUF) $(TARGET_PATH)/tests/data/fate/file-async.bin
+
+FATE_MOV_FRAGMENTS-$(call ALLYES, MOV_MUXER MOV_DEMUXER FILE_PROTOCOL) += fate-mov-fragment-threads
+FATE_LIBAVFORMAT-$(HAVE_THREADS) += $(FATE_MOV_FRAGMENTS-yes)
+fate-mov-fragment-threads: libavformat/tests/mov_fragments$(EXESUF)
+fate-mov-fragment-threads: CMD = run libavformat/tests/mov_fragments$(EXESUF) $(TARGET_PATH)/tests/data/fate/mov-fragment-threads.mov
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy$(EXESUF)
@@ -10,10 +27,38 @@ FATE_LIBAVFORMAT-$(CONFIG_FFRTMPCRYPT_PROTOCOL) += fate-rtmpdh
 fate-rtmpdh: libavformat/tests/rtmpdh$(EXESUF)
 fate-rtmpdh: CMD = run libavformat/tests/rtmpdh$(EXESUF)
 
+FATE_LIBAVFORMAT-$(call ALLYES, HLS_PREFETCH MPEGTS_MUXER MPEGTS_DEMUXER FILE_PROTOCOL) += fate-hls-prefetch
+fate-hls-prefetch: libavformat/tests/hls_prefetch$(EXESUF)
+fate-hls-prefetch: CMD = run libavformat/tests/hls_prefetch$(EXESUF) $(TARGET_PATH)/tests/data/fate/hls-prefetch-
+
+FATE_LIBAVFORMAT-$(call ALLYES, HLS_PREFETCH HTTP_PROTOCOL) += fate-hls-prefetch-http
+fate-hls-prefetch-http: libavformat/tests/hls_prefetch_http$(EXESUF)
+fate-hls-prefetch-http: CMD = run libavformat/tests/hls_prefetch_http$(EXESUF)
+
+FATE_LIBAVFORMAT-$(CONFIG_HTTP2_PROTOCOL) += fate-hpack
+fate-hpack: libavformat/tests/hpack$(EXESUF)
+fate-hpack: CMD = run libavformat/tests/hpack$(EXESUF)
+
+FATE_LIBAVFORMAT-$(CONFIG_HTTP2_PROTOCOL) += fate-http2
+fate-http2: libavformat/tests/http2$(EXESUF)
+fate-http2: CMD = run libavformat/tests/http2$(EXESUF)
+
+FATE_LIBAVFORMAT-$(CONFIG_HTTP_PROTOCOL) += fate-httppool
+fate-httppool: libavformat/tests/httppool$(EXESUF)
+fate-httppool: CMD = run libavformat/tests/httppool$(EXESUF)
+
+FATE_LIBAVFORMAT-$(CONFIG_FILE_PROTOCOL) += fate-mapped
+fate-mapped: libavformat/tests/mapped$(EXESUF)
+fate-mapped: CMD = run libavformat/tests/mapped$(EXESUF) $(TARGET_PATH)/tests/data/fate/mapped.bin
+
 FATE_LIBAVFORMAT-$(CONFIG_SRTP) += fate-srtp
 fate-srtp: libavformat/tests/srtp$(EXESUF)
 fate-srtp: CMD = run libavformat/tests/srtp$(EXESUF)
 
+FATE_LIBAVFORMAT-$(call ALLYES, TEE_MUXER FRAMECRC_MUXER H264_MP4TOANNEXB_BSF FILE_PROTOCOL) += fate-tee
+fate-tee: libavformat/tests/tee$(EXESUF)
+fate-tee: CMD = run libavformat/tests/tee$(EXESUF) $(TARGET_PATH)/tests/data/fate/tee
+
 FATE_LIBAVFORMAT-yes += fate-url
 fate-url: libavformat/tests/url$(EXESUF)
 fate-url: CMD = run libavformat/tests/url$(EXESUF)
@@ -26,6 +71,11 @@ FATE_LIBAVFORMAT-$(CONFIG_IMF_DEMUXER) += fate-imf
 fate-imf: libavformat/tests/imf$(EXESUF)
 fate-imf: CMD = run libavformat/tests/imf$(EXESUF)
 
+FATE_LIBAVFORMAT += fate-compact_index
+fate-compact_index: libavformat/tests/compact_index$(EXESUF)
+fate-compact_index: CMD = run libavformat/tests/compact_index$(EXESUF)
+fate-compact_index: CMP = null
+
 FATE_LIBAVFORMAT += fate-seek_utils
 fate-seek_utils: libavformat/tests/seek_utils$(EXESUF)
 fate-seek_utils: CMD = run libavformat/tests/seek_utils$(EXESUF)
@@ -88,6 +88,10 @@ FATE_MATROSKA-$(call TRANSCODE, PCM_S24BE PCM_S24LE, MATROSKA, WAV_DEMUXER) \
                 += fate-matroska-move-cues-to-front
 fate-matroska-move-cues-to-front: CMD = transcode wav $(TARGET_SAMPLES)/audio-reference/divertimenti_2ch_96kHz_s24.wav matroska "-map 0 -map 0 -c:a:0 pcm_s24be -c:a:1 copy -cluster_time_limit 5 -cues_to_front yes -metadata_header_padding 7840 -write_crc32 0" "-map 0 -c copy -t 0.1"
 
+# Seeking with the index of the Cues stored in compact form.
+FATE_MATROSKA_FFMPEG-$(call TRANSCODE, PCM_S16LE, MATROSKA, LAVFI_INDEV SINE_FILTER) += fate-matroska-compact-index
+fate-matroska-compact-index: CMD = transcode "lavfi -graph sine=d=20" "foo" matroska "-c:a pcm_s16le -cluster_time_limit 100" "-c copy -t 1" "" "" "-fflags +compactindex -ss 10"
+
 # This test covers the case in which a displaymatrix is not a rotation
 # and is therefore ignored by the muxer, i.e. the ffprobe output of
 # side data should be empty.
@@ -282,7 +286,8 @@ fate-matroska-side-data-pref-packet: CMD = run ffprobe$(PROGSSUF)$(EXESUF) $(TAR
 FATE_MATROSKA_FFPROBE-$(call ALLYES, MATROSKA_DEMUXER HEVC_DECODER) += fate-matroska-side-data-pref-codec fate-matroska-side-data-pref-packet
 
 FATE_SAMPLES_AVCONV += $(FATE_MATROSKA-yes)
+FATE_FFMPEG += $(FATE_MATROSKA_FFMPEG-yes)
 FATE_SAMPLES_FFPROBE += $(FATE_MATROSKA_FFPROBE-yes)
 FATE_SAMPLES_FFMPEG_FFPROBE += $(FATE_MATROSKA_FFMPEG_FFPROBE-yes)
 
-fate-matroska: $(FATE_MATROSKA-yes) $(FATE_MATROSKA_FFPROBE-yes) $(FATE_MATROSKA_FFMPEG_FFPROBE-yes)
+fate-matroska: $(FATE_MATROSKA-yes) $(FATE_MATROSKA_FFMPEG-yes) $(FATE_MATROSKA_FFPROBE-yes) $(FATE_MATROSKA_FFMPEG_FFPROBE-yes)
@@ -285,6 +285,9 @@ fate-mov-vfr: CMD = md5 -filter_complex testsrc=size=2x2:duration=1,setpts=N*N:s
 fate-mov-vfr: CMP = oneline
 fate-mov-vfr: REF = 1558b4a9398d8635783c93f84eb5a60d
 
+FATE_MOV_FFMPEG-$(call TRANSCODE, RAWVIDEO, MOV, LAVFI_INDEV TESTSRC_FILTER) += fate-mov-lazy-index
+fate-mov-lazy-index: CMD = transcode "lavfi -graph testsrc=size=2x2:r=25:d=100" "foo" mov "-c:v rawvideo -use_editlist 0" "-c copy -t 1" "" "" "-lazy_index 1 -ss 60"
+
 FATE_MOV_FFMPEG_FFPROBE-$(call TRANSCODE, FLAC, MP4 MOV, WAV_DEMUXER PCM_S16LE_DECODER) += fate-mov-mp4-iamf-stereo
 fate-mov-mp4-iamf-stereo: tests/data/asynth-44100-2.wav tests/data/streamgroups/audio_element-stereo tests/data/streamgroups/mix_presentation-stereo
 fate-mov-mp4-iamf-stereo: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
@@ -0,0 +1,130 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Measure the time needed to open an input and find its stream parameters,
+ * with and without decoding frames (fflags nodecode). The first iteration of
+ * each mode is reported separately, since it includes the one-time
+ * initialization of the components it uses, e.g. the static tables of the
+ * decoders. Run with -n to set the number of iterations.
+ */
+
+#include "config.h"
+#if HAVE_UNISTD_H
+#include <unistd.h>             /* getopt */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavformat/avformat.h"
+#include "libavutil/dict.h"
+#include "libavutil/time.h"
+
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+static void usage(int ret)
+{
+    fprintf(ret ? stderr : stdout,
+            "Usage: probe_bench [-n iterations] file ...\n");
+    exit(ret);
+}
+
+static int open_input(const char *filename, const char *fflags, int64_t *elapsed)
+{
+    AVFormatContext *avf = NULL;
+    AVDictionary *opts = NULL;
+    int64_t start = av_gettime_relative();
+    int ret;
+
+    av_dict_set(&opts, "fflags", fflags, 0);
+
+    ret = avformat_open_input(&avf, filename, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    ret = avformat_find_stream_info(avf, NULL);
+    avformat_close_input(&avf);
+
+    *elapsed = av_gettime_relative() - start;
+
+    return ret < 0 ? ret : 0;
+}
+
+static int bench(const char *filename, const char *fflags, int iterations)
+{
+    int64_t first = 0, total = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        int64_t elapsed;
+        int ret = open_input(filename, fflags, &elapsed);
+        if (ret < 0) {
+            fprintf(stderr, "%s: %s\n", filename, av_err2str(ret));
+            return ret;
+        }
+
+        if (!i)
+            first = elapsed;
+        else
+            total += elapsed;
+    }
+
+    printf("%s: fflags %-10s first %8.3f ms", filename, fflags, first / 1000.0);
+    if (iterations > 1)
+        printf(", mean of %d %8.3f ms", iterations - 1,
+               total / 1000.0 / (iterations - 1));
+    printf("\n");
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int opt, iterations = 10, ret = 0;
+
+    while ((opt = getopt(argc, argv, "hn:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            if (iterations <= 0)
+                usage(1);
+            break;
+        case 'h':
+            usage(0);
+        default:
+            usage(1);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (!argc)
+        usage(1);
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    /* nodecode first, so that its first iteration does not benefit from the
+     * decoders initialized by the default mode */
+    for (int i = 0; i < argc; i++)
+        ret |= bench(argv[i], "+nodecode", iterations) < 0;
+    for (int i = 0; i < argc; i++)
+        ret |= bench(argv[i], "-nodecode", iterations) < 0;
+
+    return ret;
+}